@@ -0,0 +1,92 @@
+#include "Bench.h"
+
+#include "ui/EmojiAtlas.h"
+
+#include <FL/Fl_RGB_Image.H>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+constexpr int kSizes[] = {22, 48}; // Inline and jumbo emoji
+constexpr int kEvictingInserts = 100;
+
+std::vector<std::string> makeKeys(size_t count, int size) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("unicode:" + std::to_string(i) + "#" + std::to_string(size));
+    }
+    return keys;
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Drawing needs a display, so this covers the bookkeeping around it: filling a sheet, looking emoji up,
+// inserting into a full sheet (each insert evicts the least recently used cell) and pruning
+const bool atlasBench = Bench::add("atlas/emoji", [] {
+    for (int size : kSizes) {
+        std::mt19937 rng(static_cast<uint32_t>(size));
+        std::vector<unsigned char> pixels(static_cast<size_t>(size) * size * 4);
+        for (auto &byte : pixels) {
+            byte = static_cast<unsigned char>(rng());
+        }
+        const Fl_RGB_Image image(pixels.data(), size, size, 4);
+
+        const int columns = EmojiAtlas::PAGE_SIZE / size;
+        const size_t capacity = static_cast<size_t>(columns) * columns * EmojiAtlas::MAX_PAGES_PER_SIZE;
+        // Twice the capacity, so cycling through them always inserts a key that was evicted
+        const auto keys = makeKeys(capacity * 2, size);
+        const std::string suffix = " " + std::to_string(size) + "px";
+
+        Bench::measure("atlas/emoji fill" + suffix + " x" + std::to_string(capacity), 5, [&] {
+            EmojiAtlas::clear();
+            for (size_t i = 0; i < capacity; ++i) {
+                EmojiAtlas::insert(keys[i], size, &image);
+            }
+        }, pixels.size() * capacity);
+
+        Bench::measure("atlas/emoji lookup" + suffix + " x" + std::to_string(capacity), 20, [&] {
+            for (size_t i = 0; i < capacity; ++i) {
+                Bench::keep(EmojiAtlas::contains(keys[i]) ? &keys[i] : nullptr);
+            }
+        });
+
+        size_t next = capacity;
+        Bench::measure("atlas/emoji evict" + suffix + " x" + std::to_string(kEvictingInserts), 5, [&] {
+            for (int i = 0; i < kEvictingInserts; ++i) {
+                EmojiAtlas::insert(keys[next], size, &image);
+                next = (next + 1) % keys.size();
+            }
+        }, pixels.size() * kEvictingInserts);
+
+        // A channel switch keeping half of what was shown
+        EmojiAtlas::clear();
+        std::unordered_set<std::string> keep;
+        for (size_t i = 0; i < capacity; ++i) {
+            EmojiAtlas::insert(keys[i], size, &image);
+            if (i < capacity / 2) {
+                keep.insert(keys[i]);
+            }
+        }
+        const EmojiAtlas::Stats full = EmojiAtlas::getStats();
+        const auto start = std::chrono::steady_clock::now();
+        EmojiAtlas::prune(keep, "unicode:");
+        const double pruneMs = millisecondsSince(start);
+        const EmojiAtlas::Stats pruned = EmojiAtlas::getStats();
+        std::printf("%-40s %12.2f us  %zu -> %zu pages, %zu -> %zu KiB\n", ("atlas/emoji prune half" + suffix).c_str(),
+                    pruneMs * 1000.0, full.pages, pruned.pages, full.bytes / 1024, pruned.bytes / 1024);
+        EmojiAtlas::clear();
+    }
+    return true;
+});
+
+} // namespace
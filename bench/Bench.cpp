@@ -0,0 +1,191 @@
+#include "Bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace Bench {
+
+namespace {
+
+constexpr int kRuns = 5;
+
+std::vector<Case> &registry() {
+    static std::vector<Case> all;
+    return all;
+}
+
+bool matches(const std::string &name, const std::vector<std::string> &prefixes) {
+    if (prefixes.empty()) {
+        return true;
+    }
+    return std::any_of(prefixes.begin(), prefixes.end(),
+                       [&](const std::string &prefix) { return name.compare(0, prefix.size(), prefix) == 0; });
+}
+
+// LSB-first bit writer for the LZW stream, split into the 255-byte sub-blocks GIF wants
+class CodeWriter {
+  public:
+    explicit CodeWriter(std::string &out) : out_(out) {}
+
+    void write(unsigned code, int bits) {
+        buffer_ |= code << used_;
+        used_ += bits;
+        while (used_ >= 8) {
+            push(static_cast<char>(buffer_ & 0xFF));
+            buffer_ >>= 8;
+            used_ -= 8;
+        }
+    }
+
+    void finish() {
+        if (used_ > 0) {
+            push(static_cast<char>(buffer_ & 0xFF));
+        }
+        flushBlock();
+        out_.push_back('\0');
+    }
+
+  private:
+    void push(char byte) {
+        block_.push_back(byte);
+        if (block_.size() == 255) {
+            flushBlock();
+        }
+    }
+
+    void flushBlock() {
+        if (!block_.empty()) {
+            out_.push_back(static_cast<char>(block_.size()));
+            out_.append(block_);
+            block_.clear();
+        }
+    }
+
+    std::string &out_;
+    std::string block_;
+    unsigned buffer_ = 0;
+    int used_ = 0;
+};
+
+void put16(std::string &out, int value) {
+    out.push_back(static_cast<char>(value & 0xFF));
+    out.push_back(static_cast<char>((value >> 8) & 0xFF));
+}
+
+} // namespace
+
+bool add(std::string name, std::function<bool()> run, bool isCheck) {
+    registry().push_back({std::move(name), std::move(run), isCheck});
+    return true;
+}
+
+const std::vector<Case> &cases() { return registry(); }
+
+void measure(const std::string &label, int iterations, const std::function<void()> &fn, size_t bytes) {
+    fn(); // Warm caches and lazily built tables
+    double best = 0.0;
+    for (int run = 0; run < kRuns; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            fn();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = run == 0 ? seconds : std::min(best, seconds);
+    }
+
+    double perCallUs = best / iterations * 1e6;
+    if (bytes > 0) {
+        std::printf("%-40s %12.2f us  %10.1f MB/s\n", label.c_str(), perCallUs,
+                    static_cast<double>(bytes) * iterations / best / 1e6);
+    } else {
+        std::printf("%-40s %12.2f us\n", label.c_str(), perCallUs);
+    }
+    std::fflush(stdout);
+}
+
+void keep(const void *value) {
+    static std::atomic<const void *> sink;
+    sink.store(value, std::memory_order_relaxed);
+}
+
+std::string makeGif(int width, int height, int frames) {
+    constexpr unsigned kClearCode = 256;
+    constexpr unsigned kEndCode = 257;
+    // Each literal after a clear adds a table entry; clearing this often keeps every code 9 bits wide
+    constexpr int kLiteralsPerClear = 250;
+
+    std::string out = "GIF89a";
+    put16(out, width);
+    put16(out, height);
+    out.push_back(static_cast<char>(0xF7)); // 256-entry global colour table
+    out.push_back('\0');
+    out.push_back('\0');
+    for (int i = 0; i < 256; ++i) {
+        out.push_back(static_cast<char>(i));
+        out.push_back(static_cast<char>(255 - i));
+        out.push_back(static_cast<char>((i * 7) & 0xFF));
+    }
+    out.append("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 19);
+
+    for (int frame = 0; frame < frames; ++frame) {
+        out.append("\x21\xF9\x04\x04", 4);
+        put16(out, 4); // 40 ms
+        out.append("\x00\x00", 2);
+
+        out.push_back(',');
+        put16(out, 0);
+        put16(out, 0);
+        put16(out, width);
+        put16(out, height);
+        out.push_back('\0');
+        out.push_back('\x08');
+
+        CodeWriter writer(out);
+        writer.write(kClearCode, 9);
+        int literals = 0;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                if (literals == kLiteralsPerClear) {
+                    writer.write(kClearCode, 9);
+                    literals = 0;
+                }
+                writer.write(static_cast<unsigned>((x + y + frame * 8) & 0xFF), 9);
+                literals++;
+            }
+        }
+        writer.write(kEndCode, 9);
+        writer.finish();
+    }
+
+    out.push_back(';');
+    return out;
+}
+
+} // namespace Bench
+
+int main(int argc, char **argv) {
+    bool checks = false;
+    std::vector<std::string> prefixes;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--check") == 0) {
+            checks = true;
+        } else {
+            prefixes.emplace_back(argv[i]);
+        }
+    }
+
+    int failures = 0;
+    for (const auto &benchCase : Bench::cases()) {
+        if (benchCase.isCheck != checks || !Bench::matches(benchCase.name, prefixes)) {
+            continue;
+        }
+        if (!benchCase.run()) {
+            std::printf("FAILED: %s\n", benchCase.name.c_str());
+            failures++;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Registry and timer for DiscoveBench. Benchmark and check cases register themselves from namespace-scope
+ * initialisers and are picked by name prefix on the command line:
+ *
+ *   DiscoveBench                 run every benchmark
+ *   DiscoveBench text gif        run benchmarks whose name starts with "text" or "gif"
+ *   DiscoveBench --check         run every check (what ctest runs)
+ */
+namespace Bench {
+
+struct Case {
+    std::string name;
+    std::function<bool()> run; // false when a check fails
+    bool isCheck = false;
+};
+
+/**
+ * @brief Register a case
+ * @return true, so a registration can initialise a namespace-scope constant
+ */
+bool add(std::string name, std::function<bool()> run, bool isCheck = false);
+
+const std::vector<Case> &cases();
+
+/**
+ * @brief Time fn and print the best time per call over several runs
+ * @param iterations Calls of fn per run
+ * @param bytes Bytes processed per call, to also print throughput; 0 for none
+ */
+void measure(const std::string &label, int iterations, const std::function<void()> &fn, size_t bytes = 0);
+
+/**
+ * @brief Keep the optimiser from discarding a result
+ */
+void keep(const void *value);
+
+/**
+ * @brief Animated GIF of frames frames, each a shifted colour gradient
+ * @note Encoded with 9-bit literal codes only, so it is large for its size but decodes with any GIF reader
+ */
+std::string makeGif(int width, int height, int frames);
+
+} // namespace Bench
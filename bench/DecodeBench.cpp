@@ -0,0 +1,112 @@
+#include "Bench.h"
+
+#include "ui/GifAnimation.h"
+
+#include <FL/Fl_GIF_Image.H>
+#include <FL/Fl_RGB_Image.H>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace {
+
+// What Images::imageFromData does with a GIF download
+std::unique_ptr<Fl_RGB_Image> decodeFromMemory(const std::string &data) {
+    Fl_GIF_Image gif(nullptr, reinterpret_cast<const unsigned char *>(data.data()), data.size());
+    return std::make_unique<Fl_RGB_Image>(&gif, FL_BLACK);
+}
+
+// The temp file round trip that decoding used to take
+std::unique_ptr<Fl_RGB_Image> decodeThroughTempFile(const std::string &data, const std::string &path) {
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+    Fl_GIF_Image gif(path.c_str());
+    auto image = std::make_unique<Fl_RGB_Image>(&gif, FL_BLACK);
+    std::remove(path.c_str());
+    return image;
+}
+
+const bool registered = Bench::add("decode/gif", [] {
+    const std::string path = (std::filesystem::temp_directory_path() / "discove_bench.gif").string();
+    for (int size : {64, 256}) {
+        const std::string data = Bench::makeGif(size, size, 1);
+        const std::string suffix = " " + std::to_string(size) + "x" + std::to_string(size);
+        Bench::measure("decode/gif memory" + suffix, 200, [&] { Bench::keep(decodeFromMemory(data).get()); },
+                       data.size());
+        Bench::measure("decode/gif temp file" + suffix, 200,
+                       [&] { Bench::keep(decodeThroughTempFile(data, path).get()); }, data.size());
+    }
+    return true;
+});
+
+struct AnimationCase {
+    const char *name;
+    int size;
+    int frames;
+};
+
+// An animated emoji as drawn in chat, an avatar, and a profile banner far over the default memory budget
+constexpr AnimationCase kAnimations[] = {{"emoji", 48, 60}, {"avatar", 256, 30}, {"banner", 512, 200}};
+
+// Polls the way the UI thread would, since frames are decoded on WorkerPool threads
+bool waitFor(const std::function<bool()> &done) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!done() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    return done();
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Opening is all the UI thread pays for an animation. Resident bytes are decoded frames plus the compressed
+// data a stream keeps; the loader before streaming kept every frame, which is where "all frames" ends up.
+const bool animationRegistered = Bench::add("decode/animation", [] {
+    bool complete = true;
+    for (const auto &animationCase : kAnimations) {
+        const std::string data = Bench::makeGif(animationCase.size, animationCase.size, animationCase.frames);
+        const auto *bytes = reinterpret_cast<const unsigned char *>(data.data());
+        const std::string suffix = std::string(" ") + animationCase.name + " " + std::to_string(animationCase.size) +
+                                   "px x" + std::to_string(animationCase.frames);
+        const size_t frameBytes = static_cast<size_t>(animationCase.size) * animationCase.size * 4;
+        const size_t frames = static_cast<size_t>(animationCase.frames);
+        const size_t allFrames = frameBytes * frames;
+
+        Bench::measure("decode/animation open" + suffix, animationCase.frames > 100 ? 5 : 50,
+                       [&] { Bench::keep(std::make_unique<GifAnimation>(bytes, data.size()).get()); }, data.size());
+
+        // Default budget: the window fills, then playing every frame decodes each one once on the workers
+        GifAnimation streamed(bytes, data.size());
+        const size_t window = std::clamp<size_t>(GifAnimation::DEFAULT_MEMORY_BUDGET / frameBytes,
+                                                 std::min<size_t>(2, frames), frames);
+        complete &= waitFor([&] { return streamed.memoryUsage() == window * frameBytes; });
+        const size_t streamedResident = streamed.memoryUsage() + data.size();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < frames; ++i) {
+            streamed.setFrame(i);
+            complete &= waitFor([&] { return streamed.isFrameResident(i); });
+        }
+        std::printf("%-40s %12.2f ms  %10zu KiB resident\n", ("decode/animation stream" + suffix).c_str(),
+                    millisecondsSince(start), streamedResident / 1024);
+
+        GifAnimation decoded(bytes, data.size());
+        start = std::chrono::steady_clock::now();
+        decoded.setMemoryBudget(allFrames);
+        complete &= waitFor([&] { return decoded.memoryUsage() == allFrames; });
+        std::printf("%-40s %12.2f ms  %10zu KiB resident\n", ("decode/animation all frames" + suffix).c_str(),
+                    millisecondsSince(start), decoded.memoryUsage() / 1024);
+    }
+    return complete;
+});
+
+} // namespace
@@ -0,0 +1,868 @@
+#include "LegacyTokenizer.h"
+
+#include "ui/EmojiManager.h"
+#include "ui/Theme.h"
+#include "utils/Fonts.h"
+#include "utils/TextMetrics.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+
+// Copied verbatim from MessageWidget.cpp before link parsing moved to a single pass per line; only shapeMessage's
+// non-system branch is kept. Do not fix bugs here: this is the reference the current tokenizer is checked against.
+
+namespace Legacy {
+
+namespace {
+
+constexpr int kEmojiSize = 22;
+constexpr int kEmojiOnlySize = 48;
+constexpr int kEmojiRequestSize = 48;
+constexpr int kContentFontSize = 16;
+constexpr int kEditedFontSize = 12;
+
+size_t utf8CharLength(unsigned char lead) {
+    if (lead < 0x80) {
+        return 1;
+    }
+    if ((lead >> 5) == 0x6) {
+        return 2;
+    }
+    if ((lead >> 4) == 0xE) {
+        return 3;
+    }
+    if ((lead >> 3) == 0x1E) {
+        return 4;
+    }
+    return 1;
+}
+
+std::string buildEmojiCacheKey(const std::string &url, int size) { return url + "#" + std::to_string(size); }
+
+// Appends tokens to a ShapedContent, copying their text into its arena and interning URLs and cache keys
+struct TokenSink {
+    explicit TokenSink(MessageWidget::ShapedContent &target) : content(target) {}
+
+    MessageWidget::InlineItem &append(MessageWidget::InlineItem item, std::string_view text = {}) {
+        item.textOffset = static_cast<uint32_t>(content.text.size());
+        item.textLength = static_cast<uint32_t>(text.size());
+        content.text.append(text);
+        content.tokens.push_back(item);
+        return content.tokens.back();
+    }
+
+    uint32_t intern(std::string_view value) {
+        if (value.empty()) {
+            return 0;
+        }
+        auto [it, inserted] = ids.try_emplace(std::string(value), 0);
+        if (inserted) {
+            content.strings.push_back(it->first);
+            it->second = static_cast<uint32_t>(content.strings.size());
+        }
+        return it->second;
+    }
+
+    MessageWidget::ShapedContent &content;
+    std::unordered_map<std::string, uint32_t> ids;
+};
+
+void tokenizeStyledText(TokenSink &sink, std::string_view text, Fl_Font font, int size, Fl_Color color,
+                        std::string_view linkUrl = {}, bool underline = false, bool strikethrough = false) {
+    const auto &tokens = sink.content.tokens;
+    const size_t firstToken = tokens.size();
+    const uint32_t linkId = sink.intern(linkUrl);
+
+    MessageWidget::InlineItem style;
+    style.font = font;
+    style.size = size;
+    style.color = color;
+    style.underline = underline;
+    style.strikethrough = strikethrough;
+
+    MessageWidget::InlineItem textStyle = style;
+    textStyle.kind = MessageWidget::InlineItem::Kind::Text;
+    textStyle.linkUrl = linkId;
+    textStyle.isLink = linkId != 0;
+
+    size_t wordStart = 0;
+    auto flushWord = [&](size_t end) {
+        if (end > wordStart) {
+            sink.append(textStyle, text.substr(wordStart, end - wordStart));
+        }
+        wordStart = end + 1;
+    };
+
+    for (size_t i = 0; i < text.size(); ++i) {
+        char ch = text[i];
+        if (ch == '\n') {
+            flushWord(i);
+            MessageWidget::InlineItem lineBreak = style;
+            lineBreak.kind = MessageWidget::InlineItem::Kind::LineBreak;
+            sink.append(lineBreak);
+        } else if (ch == ' ' || ch == '\t' || ch == '\r') {
+            flushWord(i);
+            if (tokens.size() == firstToken || tokens.back().kind == MessageWidget::InlineItem::Kind::LineBreak ||
+                sink.content.textOf(tokens.back()) != " ") {
+                sink.append(textStyle, " ");
+            }
+        }
+    }
+
+    flushWord(text.size());
+}
+
+void tokenizeLiteralText(TokenSink &sink, std::string_view text, Fl_Font font, int size, Fl_Color color,
+                         bool preserveWhitespace, bool isCodeBlock) {
+    MessageWidget::InlineItem style;
+    style.kind = MessageWidget::InlineItem::Kind::Text;
+    style.font = font;
+    style.size = size;
+    style.color = color;
+    style.preserveWhitespace = preserveWhitespace;
+    style.isCodeBlock = isCodeBlock;
+
+    // Carriage returns are dropped, so a run is gathered before it is copied into the arena
+    std::string current;
+    bool currentWhitespace = false;
+
+    auto flushCurrent = [&]() {
+        if (current.empty()) {
+            return;
+        }
+        sink.append(style, current);
+        current.clear();
+    };
+
+    for (char ch : text) {
+        if (ch == '\r') {
+            continue;
+        }
+        if (ch == '\n') {
+            flushCurrent();
+            MessageWidget::InlineItem lineBreak = style;
+            lineBreak.kind = MessageWidget::InlineItem::Kind::LineBreak;
+            sink.append(lineBreak);
+            currentWhitespace = false;
+        } else {
+            if (preserveWhitespace) {
+                bool isWs = (ch == ' ' || ch == '\t');
+                if (!current.empty() && isWs != currentWhitespace) {
+                    flushCurrent();
+                }
+                currentWhitespace = isWs;
+            }
+            current.push_back(ch);
+        }
+    }
+
+    flushCurrent();
+}
+
+struct LinkRun {
+    std::string text;
+    std::string linkUrl;
+    Fl_Color color = ThemeColors::TEXT_NORMAL;
+};
+
+struct MarkdownRun {
+    std::string text;
+    bool bold = false;
+    bool italic = false;
+    bool underline = false;
+    bool strikethrough = false;
+    std::string linkUrl;
+    Fl_Color color = ThemeColors::TEXT_NORMAL;
+};
+
+bool isHttpUrl(const std::string &url) { return url.rfind("https://", 0) == 0 || url.rfind("http://", 0) == 0; }
+
+bool isUrlStartAt(const std::string &text, size_t pos) {
+    return text.compare(pos, 8, "https://") == 0 || text.compare(pos, 7, "http://") == 0;
+}
+
+bool isTrailingPunct(char ch) {
+    switch (ch) {
+    case '.':
+    case ',':
+    case '!':
+    case '?':
+    case ':':
+    case ';':
+    case ')':
+    case ']':
+    case '}':
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool isAllDigits(const std::string &text) {
+    return !text.empty() &&
+           std::all_of(text.begin(), text.end(), [](unsigned char ch) { return std::isdigit(ch) != 0; });
+}
+
+std::string buildEmojiUrl(const std::string &id, bool animated) {
+    std::ostringstream out;
+    out << "https://cdn.discordapp.com/emojis/" << id << (animated ? ".gif" : ".webp") << "?size=" << kEmojiRequestSize;
+    return out.str();
+}
+
+bool tryParseTimestamp(const std::string &text, size_t pos, size_t &outLength, std::string &outFormatted) {
+    if (pos >= text.size() || text[pos] != '<') {
+        return false;
+    }
+
+    size_t start = pos + 1;
+    if (start >= text.size() || text[start] != 't') {
+        return false;
+    }
+    start++;
+    if (start >= text.size() || text[start] != ':') {
+        return false;
+    }
+    start++;
+
+    size_t colonOrEnd = start;
+    while (colonOrEnd < text.size() && text[colonOrEnd] != ':' && text[colonOrEnd] != '>') {
+        colonOrEnd++;
+    }
+
+    if (colonOrEnd >= text.size()) {
+        return false;
+    }
+
+    std::string timestampStr = text.substr(start, colonOrEnd - start);
+    if (!isAllDigits(timestampStr)) {
+        return false;
+    }
+
+    char style = 'f';
+    size_t closePos = colonOrEnd;
+    if (text[colonOrEnd] == ':') {
+        size_t stylePos = colonOrEnd + 1;
+        if (stylePos < text.size() && text[stylePos] != '>') {
+            style = text[stylePos];
+            closePos = stylePos + 1;
+        }
+    }
+
+    if (closePos >= text.size() || text[closePos] != '>') {
+        return false;
+    }
+
+    try {
+        int64_t timestamp = std::stoll(timestampStr);
+        auto timePoint = std::chrono::system_clock::from_time_t(static_cast<time_t>(timestamp));
+        auto timeT = std::chrono::system_clock::to_time_t(timePoint);
+        std::tm tm;
+        localtime_s(&tm, &timeT);
+
+        auto now = std::chrono::system_clock::now();
+        auto nowT = std::chrono::system_clock::to_time_t(now);
+        std::tm nowTm;
+        localtime_s(&nowTm, &nowT);
+
+        std::ostringstream oss;
+        switch (style) {
+        case 't':
+            oss << std::put_time(&tm, "%H:%M");
+            break;
+        case 'T':
+            oss << std::put_time(&tm, "%H:%M:%S");
+            break;
+        case 'd':
+            oss << std::put_time(&tm, "%d/%m/%Y");
+            break;
+        case 'D':
+            oss << std::put_time(&tm, "%d %B %Y");
+            break;
+        case 'f':
+            oss << std::put_time(&tm, "%d %B %Y %H:%M");
+            break;
+        case 'F':
+            oss << std::put_time(&tm, "%A, %d %B %Y %H:%M");
+            break;
+        case 'R': {
+            auto diff = std::chrono::duration_cast<std::chrono::seconds>(now - timePoint).count();
+            if (diff < 0) {
+                diff = -diff;
+                if (diff < 60)
+                    oss << "in " << diff << " second" << (diff == 1 ? "" : "s");
+                else if (diff < 3600)
+                    oss << "in " << (diff / 60) << " minute" << ((diff / 60) == 1 ? "" : "s");
+                else if (diff < 86400)
+                    oss << "in " << (diff / 3600) << " hour" << ((diff / 3600) == 1 ? "" : "s");
+                else if (diff < 2592000)
+                    oss << "in " << (diff / 86400) << " day" << ((diff / 86400) == 1 ? "" : "s");
+                else if (diff < 31536000)
+                    oss << "in " << (diff / 2592000) << " month" << ((diff / 2592000) == 1 ? "" : "s");
+                else
+                    oss << "in " << (diff / 31536000) << " year" << ((diff / 31536000) == 1 ? "" : "s");
+            } else {
+                if (diff < 60)
+                    oss << diff << " second" << (diff == 1 ? "" : "s") << " ago";
+                else if (diff < 3600)
+                    oss << (diff / 60) << " minute" << ((diff / 60) == 1 ? "" : "s") << " ago";
+                else if (diff < 86400)
+                    oss << (diff / 3600) << " hour" << ((diff / 3600) == 1 ? "" : "s") << " ago";
+                else if (diff < 2592000)
+                    oss << (diff / 86400) << " day" << ((diff / 86400) == 1 ? "" : "s") << " ago";
+                else if (diff < 31536000)
+                    oss << (diff / 2592000) << " month" << ((diff / 2592000) == 1 ? "" : "s") << " ago";
+                else
+                    oss << (diff / 31536000) << " year" << ((diff / 31536000) == 1 ? "" : "s") << " ago";
+            }
+            break;
+        }
+        default:
+            oss << std::put_time(&tm, "%d %B %Y %H:%M");
+            break;
+        }
+
+        outFormatted = oss.str();
+        outLength = closePos - pos + 1;
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+bool tryParseMention(const std::string &text, size_t pos, size_t &outLength, std::string &outId, char &outType) {
+    if (pos >= text.size() || text[pos] != '<') {
+        return false;
+    }
+
+    size_t start = pos + 1;
+    if (start >= text.size()) {
+        return false;
+    }
+
+    char type = text[start];
+    if (type == '@') {
+        start++;
+        if (start < text.size() && (text[start] == '!' || text[start] == '&')) {
+            outType = text[start];
+            start++;
+        } else {
+            outType = '@';
+        }
+    } else if (type == '#') {
+        outType = '#';
+        start++;
+    } else {
+        return false;
+    }
+
+    size_t idEnd = text.find('>', start);
+    if (idEnd == std::string::npos) {
+        return false;
+    }
+
+    std::string id = text.substr(start, idEnd - start);
+    if (!isAllDigits(id)) {
+        return false;
+    }
+
+    outId = id;
+    outLength = idEnd - pos + 1;
+    return true;
+}
+
+bool tryParseEmoji(const std::string &text, size_t pos, size_t &outLength, std::string &outUrl) {
+    if (pos >= text.size() || text[pos] != '<') {
+        return false;
+    }
+
+    bool animated = false;
+    size_t start = pos + 1;
+    if (start < text.size() && text[start] == 'a') {
+        animated = true;
+        start++;
+    }
+    if (start >= text.size() || text[start] != ':') {
+        return false;
+    }
+
+    size_t nameStart = start + 1;
+    size_t nameEnd = text.find(':', nameStart);
+    if (nameEnd == std::string::npos) {
+        return false;
+    }
+
+    size_t idStart = nameEnd + 1;
+    size_t idEnd = text.find('>', idStart);
+    if (idEnd == std::string::npos) {
+        return false;
+    }
+
+    std::string id = text.substr(idStart, idEnd - idStart);
+    if (!isAllDigits(id)) {
+        return false;
+    }
+
+    outUrl = buildEmojiUrl(id, animated);
+    outLength = idEnd - pos + 1;
+    return true;
+}
+
+std::vector<LinkRun> parseLinkRuns(const std::string &text, Fl_Color baseColor, Fl_Color linkColor) {
+    std::vector<LinkRun> runs;
+    size_t i = 0;
+    size_t last = 0;
+
+    auto flushNormal = [&](size_t start, size_t end) {
+        if (end > start) {
+            runs.push_back({text.substr(start, end - start), "", baseColor});
+        }
+    };
+
+    while (i < text.size()) {
+        if (text[i] == '[') {
+            size_t close = text.find(']', i + 1);
+            if (close != std::string::npos && close + 1 < text.size() && text[close + 1] == '(') {
+                size_t urlStart = close + 2;
+                size_t urlEnd = text.find(')', urlStart);
+                if (urlEnd != std::string::npos) {
+                    std::string label = text.substr(i + 1, close - i - 1);
+                    std::string url = text.substr(urlStart, urlEnd - urlStart);
+
+                    if (!url.empty() && url.front() == '<' && url.back() == '>') {
+                        url = url.substr(1, url.size() - 2);
+                    }
+
+                    if (isHttpUrl(url)) {
+                        flushNormal(last, i);
+                        runs.push_back({label, url, linkColor});
+                        i = urlEnd + 1;
+                        last = i;
+                        continue;
+                    }
+                }
+            }
+        }
+
+        if (isUrlStartAt(text, i)) {
+            flushNormal(last, i);
+            size_t end = i;
+            while (end < text.size() && !std::isspace(static_cast<unsigned char>(text[end]))) {
+                end++;
+            }
+
+            std::string url = text.substr(i, end - i);
+            std::string suffix;
+            while (!url.empty() && isTrailingPunct(url.back())) {
+                suffix.insert(suffix.begin(), url.back());
+                url.pop_back();
+            }
+
+            if (!url.empty()) {
+                runs.push_back({url, url, linkColor});
+            }
+            if (!suffix.empty()) {
+                runs.push_back({suffix, "", baseColor});
+            }
+
+            i = end;
+            last = i;
+            continue;
+        }
+
+        i++;
+    }
+
+    flushNormal(last, text.size());
+    return runs;
+}
+
+bool hasClosingMarker(const std::vector<LinkRun> &runs, size_t runIndex, size_t start, const std::string &marker) {
+    for (size_t i = runIndex; i < runs.size(); ++i) {
+        const std::string &text = runs[i].text;
+        size_t offset = (i == runIndex) ? start : 0;
+        if (text.find(marker, offset) != std::string::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<MarkdownRun> parseMarkdownRuns(const std::vector<LinkRun> &runs) {
+    std::vector<MarkdownRun> output;
+    bool bold = false;
+    bool italic = false;
+    bool underline = false;
+    bool strikethrough = false;
+
+    for (size_t runIndex = 0; runIndex < runs.size(); ++runIndex) {
+        const auto &run = runs[runIndex];
+        std::string current;
+        auto flushCurrent = [&]() {
+            if (!current.empty()) {
+                MarkdownRun out;
+                out.text = current;
+                out.bold = bold;
+                out.italic = italic;
+                out.underline = underline;
+                out.strikethrough = strikethrough;
+                out.linkUrl = run.linkUrl;
+                out.color = run.color;
+                output.push_back(std::move(out));
+                current.clear();
+            }
+        };
+
+        bool skipMarkdown = !run.linkUrl.empty() && run.text == run.linkUrl && isHttpUrl(run.text);
+        if (skipMarkdown) {
+            current = run.text;
+            flushCurrent();
+            continue;
+        }
+
+        size_t i = 0;
+        while (i < run.text.size()) {
+            if (run.text.compare(i, 3, "***") == 0) {
+                bool canToggle =
+                    (bold && italic) || (!bold && !italic && hasClosingMarker(runs, runIndex, i + 3, "***"));
+                if (canToggle) {
+                    flushCurrent();
+                    bold = !bold;
+                    italic = !italic;
+                    i += 3;
+                    continue;
+                }
+            }
+            if (run.text.compare(i, 2, "**") == 0) {
+                bool canToggle = bold || hasClosingMarker(runs, runIndex, i + 2, "**");
+                if (canToggle) {
+                    flushCurrent();
+                    bold = !bold;
+                    i += 2;
+                    continue;
+                }
+            }
+            if (run.text.compare(i, 2, "__") == 0) {
+                bool canToggle = underline || hasClosingMarker(runs, runIndex, i + 2, "__");
+                if (canToggle) {
+                    flushCurrent();
+                    underline = !underline;
+                    i += 2;
+                    continue;
+                }
+            }
+            if (run.text.compare(i, 2, "~~") == 0) {
+                bool canToggle = strikethrough || hasClosingMarker(runs, runIndex, i + 2, "~~");
+                if (canToggle) {
+                    flushCurrent();
+                    strikethrough = !strikethrough;
+                    i += 2;
+                    continue;
+                }
+            }
+            if (run.text[i] == '*') {
+                bool canToggle = italic || hasClosingMarker(runs, runIndex, i + 1, "*");
+                if (canToggle) {
+                    flushCurrent();
+                    italic = !italic;
+                    i += 1;
+                    continue;
+                }
+            }
+            if (run.text[i] == '_') {
+                bool canToggle = italic || hasClosingMarker(runs, runIndex, i + 1, "_");
+                if (canToggle) {
+                    flushCurrent();
+                    italic = !italic;
+                    i += 1;
+                    continue;
+                }
+            }
+
+            current.push_back(run.text[i]);
+            i += 1;
+        }
+
+        flushCurrent();
+    }
+
+    return output;
+}
+
+Fl_Font resolveMarkdownFont(Fl_Font baseFont, bool bold, bool italic) {
+    if (bold && italic) {
+        return FontLoader::Fonts::INTER_BOLD_ITALIC;
+    }
+    if (bold) {
+        return FontLoader::Fonts::INTER_BOLD;
+    }
+    if (italic) {
+        return FontLoader::Fonts::INTER_REGULAR_ITALIC;
+    }
+    return baseFont;
+}
+
+void tokenizeEmojiText(TokenSink &sink, const std::string &text, Fl_Font font, int size, Fl_Color color,
+                       const std::string &linkUrl, bool underline, bool strikethrough, const Message *msg) {
+    size_t textStart = 0;
+    size_t i = 0;
+
+    auto flushText = [&]() {
+        if (i > textStart) {
+            tokenizeStyledText(sink, std::string_view(text).substr(textStart, i - textStart), font, size, color,
+                               linkUrl, underline, strikethrough);
+        }
+    };
+
+    while (i < text.size()) {
+        size_t length = 0;
+
+        if (text.compare(i, 9, "@everyone") == 0) {
+            flushText();
+            tokenizeStyledText(sink, "@everyone", FontLoader::Fonts::INTER_SEMIBOLD, size, ThemeColors::TEXT_LINK);
+            i += 9;
+            textStart = i;
+            continue;
+        }
+
+        if (text.compare(i, 5, "@here") == 0) {
+            flushText();
+            tokenizeStyledText(sink, "@here", FontLoader::Fonts::INTER_SEMIBOLD, size, ThemeColors::TEXT_LINK);
+            i += 5;
+            textStart = i;
+            continue;
+        }
+
+        std::string timestampText;
+        if (tryParseTimestamp(text, i, length, timestampText)) {
+            flushText();
+            tokenizeStyledText(sink, timestampText, font, size, ThemeColors::TEXT_LINK, {}, true, false);
+            i += length;
+            textStart = i;
+            continue;
+        }
+
+        std::string mentionId;
+        char mentionType;
+        if (tryParseMention(text, i, length, mentionId, mentionType)) {
+            flushText();
+            std::string mentionText;
+            if (mentionType == '#') {
+                mentionText = "#unknown-channel";
+            } else if (mentionType == '&') {
+                mentionText = "@Unknown Role";
+            } else {
+                mentionText = "@Unknown User";
+                if (msg) {
+                    for (size_t j = 0; j < msg->mentionIds.size(); ++j) {
+                        if (msg->mentionIds[j] == mentionId) {
+                            if (j < msg->mentionDisplayNames.size() && !msg->mentionDisplayNames[j].empty()) {
+                                mentionText = "@" + msg->mentionDisplayNames[j];
+                            }
+                            break;
+                        }
+                    }
+                }
+            }
+            tokenizeStyledText(sink, mentionText, FontLoader::Fonts::INTER_SEMIBOLD, size, ThemeColors::TEXT_LINK);
+            i += length;
+            textStart = i;
+            continue;
+        }
+
+        std::string emojiUrl;
+        if (tryParseEmoji(text, i, length, emojiUrl)) {
+            flushText();
+            MessageWidget::InlineItem item;
+            item.kind = MessageWidget::InlineItem::Kind::Emoji;
+            item.emojiUrl = sink.intern(emojiUrl);
+            item.emojiSize = kEmojiSize;
+            item.width = kEmojiSize;
+            item.emojiCacheKey = sink.intern(buildEmojiCacheKey(emojiUrl, kEmojiSize));
+            sink.append(item);
+            i += length;
+            textStart = i;
+            continue;
+        }
+
+        std::string unicodeEmoji;
+        if (EmojiManager::tryMatch(text, i, length, unicodeEmoji)) {
+            flushText();
+            MessageWidget::InlineItem item;
+            item.kind = MessageWidget::InlineItem::Kind::Emoji;
+            item.emojiSize = kEmojiSize;
+            item.width = kEmojiSize;
+            item.emojiCacheKey = sink.intern(EmojiManager::makeCacheKey(unicodeEmoji, kEmojiSize));
+            sink.append(item, unicodeEmoji);
+            i += length;
+            textStart = i;
+            continue;
+        }
+
+        size_t charLen = utf8CharLength(static_cast<unsigned char>(text[i]));
+        if (i + charLen > text.size()) {
+            charLen = text.size() - i;
+        }
+        i += charLen;
+    }
+
+    flushText();
+}
+
+void tokenizeTextWithMessage(TokenSink &sink, const std::string &text, Fl_Font font, int size, Fl_Color color,
+                             const Message *msg) {
+
+    auto appendMarkdownSegment = [&](const std::string &segment) {
+        size_t lineStart = 0;
+        while (lineStart <= segment.size()) {
+            size_t lineEnd = segment.find('\n', lineStart);
+            bool hasNewline = (lineEnd != std::string::npos);
+            std::string line = hasNewline ? segment.substr(lineStart, lineEnd - lineStart) : segment.substr(lineStart);
+
+            int lineSize = size;
+            Fl_Font lineBaseFont = font;
+
+            if (line.rfind("### ", 0) == 0) {
+                line = line.substr(4);
+                lineSize = size + 2;
+                lineBaseFont = FontLoader::Fonts::INTER_BOLD;
+            } else if (line.rfind("## ", 0) == 0) {
+                line = line.substr(3);
+                lineSize = size + 4;
+                lineBaseFont = FontLoader::Fonts::INTER_BOLD;
+            } else if (line.rfind("# ", 0) == 0) {
+                line = line.substr(2);
+                lineSize = size + 6;
+                lineBaseFont = FontLoader::Fonts::INTER_BOLD;
+            }
+
+            auto runs = parseLinkRuns(line, color, ThemeColors::TEXT_LINK);
+            auto mdRuns = parseMarkdownRuns(runs);
+            for (const auto &mdRun : mdRuns) {
+                Fl_Font runFont = resolveMarkdownFont(lineBaseFont, mdRun.bold, mdRun.italic);
+                tokenizeEmojiText(sink, mdRun.text, runFont, lineSize, mdRun.color, mdRun.linkUrl, mdRun.underline,
+                                  mdRun.strikethrough, msg);
+            }
+
+            if (hasNewline) {
+                MessageWidget::InlineItem br;
+                br.kind = MessageWidget::InlineItem::Kind::LineBreak;
+                br.font = font;
+                br.size = size;
+                br.color = color;
+                sink.append(br);
+                lineStart = lineEnd + 1;
+            } else {
+                break;
+            }
+        }
+    };
+
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t fence = text.find("```", pos);
+        if (fence == std::string::npos) {
+            appendMarkdownSegment(text.substr(pos));
+            break;
+        }
+
+        if (fence > pos) {
+            appendMarkdownSegment(text.substr(pos, fence - pos));
+        }
+
+        size_t langStart = fence + 3;
+        size_t firstNewline = text.find('\n', langStart);
+        if (firstNewline == std::string::npos) {
+            appendMarkdownSegment(text.substr(fence));
+            break;
+        }
+
+        size_t codeStart = firstNewline + 1;
+        size_t close = text.find("```", codeStart);
+        if (close == std::string::npos) {
+            appendMarkdownSegment(text.substr(fence));
+            break;
+        }
+
+        tokenizeLiteralText(sink, std::string_view(text).substr(codeStart, close - codeStart), FL_COURIER_BOLD,
+                            std::max(10, size - 1), ThemeColors::TEXT_NORMAL, true, true);
+
+        pos = close + 3;
+    }
+}
+
+} // namespace
+
+std::shared_ptr<const MessageWidget::ShapedContent> shapeMessage(const Message &msg) {
+    using InlineItem = MessageWidget::InlineItem;
+
+    auto shaped = std::make_shared<MessageWidget::ShapedContent>();
+    TokenSink sink(*shaped);
+    auto &tokens = shaped->tokens;
+    tokenizeTextWithMessage(sink, msg.content, FontLoader::Fonts::INTER_REGULAR, kContentFontSize,
+                            ThemeColors::TEXT_NORMAL, &msg);
+    bool emojiOnly = true;
+    int maxEmojiSize = 0;
+    for (const auto &token : tokens) {
+        if (token.kind == InlineItem::Kind::Emoji) {
+            maxEmojiSize = std::max(maxEmojiSize, token.emojiSize > 0 ? token.emojiSize : kEmojiSize);
+            continue;
+        }
+        if (token.kind == InlineItem::Kind::LineBreak) {
+            continue;
+        }
+        if (token.kind == InlineItem::Kind::Text &&
+            shaped->textOf(token).find_first_not_of(" \t\r\n") == std::string_view::npos) {
+            continue;
+        }
+        emojiOnly = false;
+        break;
+    }
+
+    if (emojiOnly && maxEmojiSize > 0) {
+        for (auto &token : tokens) {
+            if (token.kind == InlineItem::Kind::Emoji) {
+                token.emojiSize = kEmojiOnlySize;
+                token.width = kEmojiOnlySize;
+                if (token.emojiUrl != 0) {
+                    token.emojiCacheKey =
+                        sink.intern(buildEmojiCacheKey(shaped->stringOf(token.emojiUrl), kEmojiOnlySize));
+                } else if (token.textLength > 0) {
+                    token.emojiCacheKey =
+                        sink.intern(EmojiManager::makeCacheKey(std::string(shaped->textOf(token)), kEmojiOnlySize));
+                }
+            }
+        }
+        maxEmojiSize = kEmojiOnlySize;
+    }
+
+    shaped->hasContent = msg.content.find_first_not_of(" \t\r\n") != std::string::npos;
+    if (shaped->hasContent && msg.wasEdited()) {
+        tokenizeStyledText(sink, " (edited)", FontLoader::Fonts::INTER_REGULAR, kEditedFontSize,
+                           ThemeColors::TEXT_MUTED);
+    }
+
+    int maxTextSize = kContentFontSize;
+    for (const auto &token : tokens) {
+        if (token.kind == InlineItem::Kind::Text && token.size > maxTextSize) {
+            maxTextSize = token.size;
+        }
+    }
+    shaped->maxTextSize = maxTextSize;
+    shaped->maxEmojiSize = maxEmojiSize;
+
+    for (auto &token : shaped->tokens) {
+        if (token.kind == InlineItem::Kind::Text && token.textLength > 0) {
+            token.width = TextMetrics::width(shaped->textOf(token), token.font, token.size);
+        }
+    }
+
+    return shaped;
+}
+
+} // namespace Legacy
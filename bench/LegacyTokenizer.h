@@ -0,0 +1,16 @@
+#pragma once
+
+#include "models/Message.h"
+#include "ui/components/MessageWidget.h"
+
+#include <memory>
+
+namespace Legacy {
+
+/**
+ * @brief MessageWidget::shapeMessage as it was before the single-pass line tokenizer, for non-system messages
+ * @note Reference for the "tokenizer" check; generation, username and time are left unset
+ */
+std::shared_ptr<const MessageWidget::ShapedContent> shapeMessage(const Message &msg);
+
+} // namespace Legacy
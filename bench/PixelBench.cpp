@@ -0,0 +1,288 @@
+#include "Bench.h"
+
+#include "utils/PixelKernels.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int kFrameSize = 256;
+constexpr int kEmojiSize = 48;
+constexpr int kEmojiCount = 200;
+constexpr int kTransparentIndex = 255;
+constexpr int kAvatarSize = 32;
+constexpr int kAvatarCount = 1000;
+// Row lengths from 1 up to this cover every vector width with each possible remainder
+constexpr int kMaxCheckedRow = 70;
+constexpr int kMaxCheckedMask = 67;
+
+std::vector<uint8_t> randomBytes(size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> bytes(count);
+    for (auto &byte : bytes) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    return bytes;
+}
+
+// The GIF compositing loop expandPalette replaced: bounds and transparency checked per pixel
+void compositeLoop(const uint8_t *indices, const uint8_t (*colors)[3], int colorCount, uint8_t *canvas) {
+    for (int y = 0; y < kFrameSize; y++) {
+        for (int x = 0; x < kFrameSize; x++) {
+            const uint8_t index = indices[static_cast<size_t>(y) * kFrameSize + x];
+            if (index == kTransparentIndex || index >= colorCount) {
+                continue;
+            }
+            uint8_t *pixel = canvas + (static_cast<size_t>(y) * kFrameSize + x) * 4;
+            pixel[0] = colors[index][0];
+            pixel[1] = colors[index][1];
+            pixel[2] = colors[index][2];
+            pixel[3] = 255;
+        }
+    }
+}
+
+// The emoji tinting loop tint replaced
+void tintLoop(const uint8_t *src, int depth, int width, int height, uint8_t red, uint8_t green, uint8_t blue,
+              uint8_t *dst) {
+    for (int y = 0; y < height; ++y) {
+        const uint8_t *srcRow = src + static_cast<size_t>(y) * width * depth;
+        uint8_t *dstRow = dst + static_cast<size_t>(y) * width * depth;
+        for (int x = 0; x < width; ++x) {
+            const int idx = x * depth;
+            const uint8_t srcA = depth == 4 ? srcRow[idx + 3] : 255;
+            const bool hasInk = depth == 4 ? srcA > 0 : (srcRow[idx] || srcRow[idx + 1] || srcRow[idx + 2]);
+            dstRow[idx + 0] = hasInk ? red : srcRow[idx + 0];
+            dstRow[idx + 1] = hasInk ? green : srcRow[idx + 1];
+            dstRow[idx + 2] = hasInk ? blue : srcRow[idx + 2];
+            if (depth == 4) {
+                dstRow[idx + 3] = srcA;
+            }
+        }
+    }
+}
+
+// The avatar masking loop before coverage masks: a hard-edged circle test per pixel into a scratch buffer
+void circleLoop(const uint8_t *src, int diameter, uint8_t *dst) {
+    std::vector<uint8_t> buffer(static_cast<size_t>(diameter) * diameter * 4);
+    const int radius = diameter / 2;
+    for (int y = 0; y < diameter; y++) {
+        for (int x = 0; x < diameter; x++) {
+            const size_t idx = (static_cast<size_t>(y) * diameter + x) * 4;
+            const int dx = x - radius;
+            const int dy = y - radius;
+            buffer[idx + 0] = src[idx + 0];
+            buffer[idx + 1] = src[idx + 1];
+            buffer[idx + 2] = src[idx + 2];
+            buffer[idx + 3] = dx * dx + dy * dy <= radius * radius ? src[idx + 3] : 0;
+        }
+    }
+    std::memcpy(dst, buffer.data(), buffer.size());
+}
+
+// Scalar definitions of what the kernels compute, written per pixel with no shared code
+std::vector<uint8_t> referenceToRgba(const uint8_t *src, int depth, size_t count) {
+    std::vector<uint8_t> rgba(count * 4);
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t *in = src + i * depth;
+        uint8_t *out = rgba.data() + i * 4;
+        const bool gray = depth < 3;
+        out[0] = in[0];
+        out[1] = gray ? in[0] : in[1];
+        out[2] = gray ? in[0] : in[2];
+        out[3] = depth == 2 ? in[1] : depth == 4 ? in[3] : 255;
+    }
+    return rgba;
+}
+
+std::vector<uint8_t> referenceMask(const uint8_t *src, int depth, const PixelKernels::CoverageMask &mask) {
+    std::vector<uint8_t> rgba(static_cast<size_t>(mask.width) * mask.height * 4);
+    for (int y = 0; y < mask.height; y++) {
+        const size_t rowStart = static_cast<size_t>(y) * mask.width;
+        const auto row = referenceToRgba(src + rowStart * depth, depth, mask.width);
+        for (int x = 0; x < mask.width; x++) {
+            const unsigned weight = mask.coverage[rowStart + x];
+            const uint8_t *in = row.data() + static_cast<size_t>(x) * 4;
+            uint8_t *out = rgba.data() + (rowStart + x) * 4;
+            if (weight == 0) {
+                continue;
+            }
+            out[0] = in[0];
+            out[1] = in[1];
+            out[2] = in[2];
+            out[3] = static_cast<uint8_t>((in[3] * weight + 127) / 255);
+        }
+    }
+    return rgba;
+}
+
+int reportMismatch(const char *kernel, const std::string &what, const std::vector<uint8_t> &expected,
+                   const std::vector<uint8_t> &actual) {
+    if (expected == actual) {
+        return 0;
+    }
+    size_t at = 0;
+    while (expected[at] == actual[at]) {
+        at++;
+    }
+    std::printf("pixels/reference: %s %s differs at byte %zu: expected %u, got %u\n", kernel, what.c_str(), at,
+                expected[at], actual[at]);
+    return 1;
+}
+
+// The vector paths against scalar definitions, for every row length up to a few vectors
+const bool referenceCheck = Bench::add(
+    "pixels/reference",
+    [] {
+        int failures = 0;
+        int compared = 0;
+
+        auto paletteBytes = randomBytes(256 * 4, 5);
+        uint32_t palette[256];
+        std::memcpy(palette, paletteBytes.data(), sizeof(palette));
+        for (int i = 0; i < 256; i++) {
+            // Every fourth entry is left transparent, the others opaque
+            palette[i] = i % 4 == 0 ? 0 : palette[i] | 0xFF000000u;
+        }
+
+        for (int count = 1; count <= kMaxCheckedRow; count++) {
+            const std::string what = std::to_string(count) + " px";
+            const auto indices = randomBytes(count, 6 + count);
+            const auto canvas = randomBytes(static_cast<size_t>(count) * 4, 7 + count);
+            auto expected = canvas;
+            for (int i = 0; i < count; i++) {
+                if (palette[indices[i]] != 0) {
+                    std::memcpy(expected.data() + static_cast<size_t>(i) * 4, &palette[indices[i]], 4);
+                }
+            }
+            auto actual = canvas;
+            PixelKernels::expandPalette(indices.data(), count, palette, actual.data());
+            failures += reportMismatch("expandPalette", what, expected, actual);
+
+            for (int depth = 1; depth <= 4; depth++) {
+                const auto src = randomBytes(static_cast<size_t>(count) * depth, 8 + count);
+                std::vector<uint8_t> rgba(static_cast<size_t>(count) * 4);
+                PixelKernels::toRgba(src.data(), depth, count, rgba.data());
+                failures += reportMismatch("toRgba", what + " depth " + std::to_string(depth),
+                                           referenceToRgba(src.data(), depth, count), rgba);
+            }
+
+            for (int depth : {3, 4}) {
+                auto src = randomBytes(static_cast<size_t>(count) * depth, 9 + count);
+                // Blank pixels, which tint leaves as they are, in runs that straddle vector boundaries
+                for (int i = 0; i < count; i += 1 + i % 5) {
+                    src[static_cast<size_t>(i) * depth + depth - 1] = 0;
+                    if (depth == 3) {
+                        src[static_cast<size_t>(i) * 3] = src[static_cast<size_t>(i) * 3 + 1] = 0;
+                    }
+                }
+                std::vector<uint8_t> expected(src.size());
+                std::vector<uint8_t> actual(src.size());
+                tintLoop(src.data(), depth, count, 1, 0x94, 0x9b, 0xa4, expected.data());
+                PixelKernels::tint(src.data(), depth, count, 0x94, 0x9b, 0xa4, actual.data());
+                failures += reportMismatch("tint", what + " depth " + std::to_string(depth), expected, actual);
+            }
+            compared++;
+        }
+
+        for (int size = 1; size <= kMaxCheckedMask; size++) {
+            const auto circle = PixelKernels::circleMask(size);
+            const auto rounded = PixelKernels::roundedRectMask(size + 7, size, size / 3);
+            for (const auto *mask : {&circle, &rounded}) {
+                const std::string what = std::to_string(mask->width) + "x" + std::to_string(mask->height);
+                for (int depth = 1; depth <= 4; depth++) {
+                    const size_t pixels = static_cast<size_t>(mask->width) * mask->height;
+                    const auto src = randomBytes(pixels * depth, 10 + size);
+                    std::vector<uint8_t> actual(pixels * 4);
+                    PixelKernels::applyMask(src.data(), depth, static_cast<size_t>(mask->width) * depth, *mask,
+                                            actual.data());
+                    failures += reportMismatch("applyMask", what + " depth " + std::to_string(depth),
+                                               referenceMask(src.data(), depth, *mask), actual);
+                }
+            }
+            compared++;
+        }
+
+        std::printf("pixels/reference: %d row lengths and mask sizes, %d mismatches\n", compared, failures);
+        return failures == 0;
+    },
+    true);
+
+const bool kernelsBench = Bench::add("pixels/kernels", [] {
+    const size_t framePixels = static_cast<size_t>(kFrameSize) * kFrameSize;
+    const auto indices = randomBytes(framePixels, 1);
+    const auto colorBytes = randomBytes(256 * 3, 2);
+    const auto *colors = reinterpret_cast<const uint8_t(*)[3]>(colorBytes.data());
+    uint32_t palette[256] = {};
+    for (int i = 0; i < 256; i++) {
+        if (i != kTransparentIndex) {
+            const uint8_t rgba[4] = {colors[i][0], colors[i][1], colors[i][2], 255};
+            std::memcpy(&palette[i], rgba, 4);
+        }
+    }
+    std::vector<uint8_t> canvas(framePixels * 4);
+
+    Bench::measure("pixels/composite loop 256x256", 200, [&] {
+        compositeLoop(indices.data(), colors, 256, canvas.data());
+        Bench::keep(canvas.data());
+    }, framePixels * 4);
+    Bench::measure("pixels/composite expandPalette 256x256", 200, [&] {
+        for (int y = 0; y < kFrameSize; y++) {
+            const size_t offset = static_cast<size_t>(y) * kFrameSize;
+            PixelKernels::expandPalette(indices.data() + offset, kFrameSize, palette, canvas.data() + offset * 4);
+        }
+        Bench::keep(canvas.data());
+    }, framePixels * 4);
+
+    const size_t emojiBytes = static_cast<size_t>(kEmojiSize) * kEmojiSize * 4;
+    const auto emoji = randomBytes(emojiBytes, 3);
+    std::vector<uint8_t> tinted(emojiBytes);
+    Bench::measure("pixels/tint loop 48px x200", 20, [&] {
+        for (int i = 0; i < kEmojiCount; ++i) {
+            tintLoop(emoji.data(), 4, kEmojiSize, kEmojiSize, 0x94, 0x9b, 0xa4, tinted.data());
+        }
+        Bench::keep(tinted.data());
+    }, emojiBytes * kEmojiCount);
+    Bench::measure("pixels/tint kernel 48px x200", 20, [&] {
+        for (int i = 0; i < kEmojiCount; ++i) {
+            for (int y = 0; y < kEmojiSize; ++y) {
+                const size_t offset = static_cast<size_t>(y) * kEmojiSize * 4;
+                PixelKernels::tint(emoji.data() + offset, 4, kEmojiSize, 0x94, 0x9b, 0xa4, tinted.data() + offset);
+            }
+        }
+        Bench::keep(tinted.data());
+    }, emojiBytes * kEmojiCount);
+    return true;
+});
+
+const bool maskBench = Bench::add("pixels/mask", [] {
+    const size_t avatarBytes = static_cast<size_t>(kAvatarSize) * kAvatarSize * 4;
+    const auto avatar = randomBytes(avatarBytes, 4);
+    std::vector<uint8_t> masked(avatarBytes);
+
+    Bench::measure("pixels/mask circleMask 32px", 1000,
+                   [] { Bench::keep(PixelKernels::circleMask(kAvatarSize).coverage.data()); });
+    Bench::measure("pixels/mask loop 32px x1000", 5, [&] {
+        for (int i = 0; i < kAvatarCount; ++i) {
+            circleLoop(avatar.data(), kAvatarSize, masked.data());
+        }
+        Bench::keep(masked.data());
+    }, avatarBytes * kAvatarCount);
+
+    // Images keeps one coverage mask per shape and size, so only applyMask runs per avatar
+    const PixelKernels::CoverageMask mask = PixelKernels::circleMask(kAvatarSize);
+    Bench::measure("pixels/mask applyMask 32px x1000", 5, [&] {
+        for (int i = 0; i < kAvatarCount; ++i) {
+            PixelKernels::applyMask(avatar.data(), 4, kAvatarSize * 4, mask, masked.data());
+        }
+        Bench::keep(masked.data());
+    }, avatarBytes * kAvatarCount);
+    return true;
+});
+
+} // namespace
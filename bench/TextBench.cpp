@@ -0,0 +1,383 @@
+#include "Bench.h"
+#include "LegacyTokenizer.h"
+
+#include "ui/EmojiManager.h"
+#include "ui/components/MessageWidget.h"
+#include "utils/TextMetrics.h"
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int kRandomCases = 200000;
+constexpr int kMaxPieces = 24;
+constexpr int kInvalidateEvery = 4096; // keeps the worker miss queue from growing without bound
+constexpr int kMaxReported = 5;
+
+// Pieces random messages are assembled from: markdown markers, mention and emoji syntax, URLs and brackets
+const std::vector<std::string> kPieces = {
+    "a", "b", " ", "*", "_", "~", "<", "@", ">", ":", "1", "#", "h", "ttp://", "https://x", "[", "]", "(", ")",
+    "\n", "t:", "\xF0\x9F\x98\x80", "`", "everyone", "here", "\t", ".", "a:",
+};
+
+// Messages that exercise each rule at least once, plus the shapes that used to be slow
+const std::vector<std::string> kHandWritten = {
+    "hello world",
+    "a  b   c",
+    "**bold** and *it* _u_ __under__ ~~strike~~ ***bi***",
+    "**unclosed",
+    "see https://example.com/a_b_c. and _this_",
+    "[label **x**](https://x.y/z_q) after_",
+    "[https://a.b](https://a.b) ok",
+    "<@123> hi <@!99> <#5> <@&7> @everyone @here",
+    "<:pepe_hands:123> and <:x_y:45> _",
+    "<a:dance:99>**",
+    "<t:1700000000:R> <t:1700000000> <t:17x>",
+    "\xF0\x9F\x98\x80\xF0\x9F\x98\x80 *\xEF\xB8\x8F\xE2\x83\xA3 \xE2\x9D\xA4\xEF\xB8\x8F \xE2\x9D\xA4",
+    "\xF0\x9F\x98\x80 <:only:1>",
+    "# Heading **b**\n## sub\n### s3 _i_",
+    "line1\nline2\n\nline3",
+    "```cpp\nint a = 1;\n  b\n```after **x**",
+    "```\nunterminated",
+    "*a **b** c*",
+    "_a_b_c_",
+    "http://x.y/*a* *b*",
+    "[x](<https://q.w>)",
+    "[x](ftp://no)",
+    "<@12_3> _",
+    "~~a~ ~~",
+    "***a** b*",
+    "**a*b**c*",
+    "text (https://x.y/a).",
+    "\xC3*x*",
+    "ab\tcd\r\nef",
+    "@every one",
+    "<@123",
+    "[](https://e.mp)x",
+    "[a](b) [c](https://d) [e]",
+    "((([[[)))]]]",
+};
+
+Message makeMessage(std::string content) {
+    Message msg;
+    msg.id = "1";
+    msg.authorId = "2";
+    msg.content = std::move(content);
+    msg.timestamp = std::chrono::system_clock::now();
+    msg.mentionIds = {"123"};
+    msg.mentionDisplayNames = {"bob"};
+    return msg;
+}
+
+std::string describe(const MessageWidget::ShapedContent &shaped) {
+    std::string out;
+    char fields[160];
+    std::snprintf(fields, sizeof(fields), "content=%d maxText=%d maxEmoji=%d\n", shaped.hasContent,
+                  shaped.maxTextSize, shaped.maxEmojiSize);
+    out += fields;
+    for (const auto &token : shaped.tokens) {
+        std::snprintf(fields, sizeof(fields),
+                      "[kind=%d font=%d size=%d color=%08x link=%d u=%d s=%d pre=%d code=%d emoji=%d w=%d '",
+                      static_cast<int>(token.kind), token.font, token.size, token.color, token.isLink,
+                      token.underline, token.strikethrough, token.preserveWhitespace, token.isCodeBlock,
+                      token.emojiSize, token.width);
+        out += fields;
+        out += shaped.textOf(token);
+        out += "' url=" + shaped.stringOf(token.linkUrl) + " emojiUrl=" + shaped.stringOf(token.emojiUrl) +
+               " key=" + shaped.stringOf(token.emojiCacheKey) + "]\n";
+    }
+    return out;
+}
+
+// A synthetic channel: ordinary chat with the markup real messages carry
+std::vector<Message> makeChatLog(int count) {
+    const std::vector<std::string> lines = {
+        "Hey **check** this https://example.com/path_x and <@123> \xF0\x9F\x98\x80 _nice_ stuff",
+        "did anyone look at [the doc](https://example.com/doc) yet? ~~no~~ yes",
+        "```cpp\nint main() {\n    return 0;\n}\n```",
+        "# Release notes\n- fixed the *thing*\n- broke __another__ thing",
+        "lol",
+        "<:pepe_hands:123456> <t:1700000000:R>",
+    };
+    std::vector<Message> log;
+    log.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        log.push_back(makeMessage(lines[i % lines.size()]));
+    }
+    return log;
+}
+
+// An item as it was before items became spans: it owned its strings, and each wrapped line owned its items
+struct LegacyItem {
+    MessageWidget::InlineItem::Kind kind = MessageWidget::InlineItem::Kind::Text;
+    std::string text;
+    int width = 0;
+    Fl_Font font = 0;
+    int size = 0;
+    Fl_Color color = 0;
+    std::string linkUrl;
+    bool isLink = false;
+    bool underline = false;
+    bool strikethrough = false;
+    bool preserveWhitespace = false;
+    bool isCodeBlock = false;
+    std::string emojiUrl;
+    std::string emojiCacheKey;
+    int emojiSize = 0;
+};
+
+struct LegacyLine {
+    std::vector<LegacyItem> items;
+    int width = 0;
+    bool isCodeBlock = false;
+};
+
+// Heap blocks held by item storage, counted the way Layout::memoryBytes counts them
+struct Footprint {
+    size_t bytes = 0;
+    size_t allocations = 0;
+
+    void block(size_t size) {
+        if (size > 0) {
+            bytes += size;
+            allocations++;
+        }
+    }
+    void string(const std::string &value) {
+        const auto *object = reinterpret_cast<const char *>(&value);
+        if (value.data() < object || value.data() >= object + sizeof(value)) {
+            block(value.capacity() + 1);
+        }
+    }
+};
+
+LegacyItem legacyItem(const MessageWidget::ShapedContent &content, const MessageWidget::InlineItem &item) {
+    LegacyItem legacy;
+    legacy.kind = item.kind;
+    legacy.text = std::string(content.textOf(item));
+    legacy.width = item.width;
+    legacy.font = item.font;
+    legacy.size = item.size;
+    legacy.color = item.color;
+    legacy.linkUrl = content.stringOf(item.linkUrl);
+    legacy.isLink = item.isLink;
+    legacy.underline = item.underline;
+    legacy.strikethrough = item.strikethrough;
+    legacy.preserveWhitespace = item.preserveWhitespace;
+    legacy.isCodeBlock = item.isCodeBlock;
+    legacy.emojiUrl = content.stringOf(item.emojiUrl);
+    legacy.emojiCacheKey = content.stringOf(item.emojiCacheKey);
+    legacy.emojiSize = item.emojiSize;
+    return legacy;
+}
+
+void addLegacyItems(const std::vector<LegacyItem> &items, Footprint &footprint) {
+    footprint.block(items.capacity() * sizeof(LegacyItem));
+    for (const auto &item : items) {
+        footprint.string(item.text);
+        footprint.string(item.linkUrl);
+        footprint.string(item.emojiUrl);
+        footprint.string(item.emojiCacheKey);
+    }
+}
+
+// Items, lines and shaped tokens of a layout as they are stored now
+Footprint flatItems(const MessageWidget::Layout &layout) {
+    const auto &shaped = *layout.shaped;
+    Footprint footprint;
+    footprint.block(layout.items.capacity() * sizeof(MessageWidget::InlineItem));
+    footprint.block(layout.lines.capacity() * sizeof(MessageWidget::LayoutLine));
+    footprint.block(shaped.tokens.capacity() * sizeof(MessageWidget::InlineItem));
+    footprint.string(shaped.text);
+    footprint.block(shaped.strings.capacity() * sizeof(std::string));
+    for (const auto &value : shaped.strings) {
+        footprint.string(value);
+    }
+    return footprint;
+}
+
+// The same items, lines and shaped tokens in the legacy representation
+Footprint legacyItems(const MessageWidget::Layout &layout) {
+    const auto &shaped = *layout.shaped;
+    std::vector<LegacyLine> lines(layout.lines.size());
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const auto &line = layout.lines[i];
+        lines[i].items.reserve(line.itemCount);
+        for (uint32_t j = 0; j < line.itemCount; ++j) {
+            lines[i].items.push_back(legacyItem(shaped, layout.items[line.firstItem + j]));
+        }
+    }
+    std::vector<LegacyItem> tokens;
+    tokens.reserve(shaped.tokens.size());
+    for (const auto &token : shaped.tokens) {
+        tokens.push_back(legacyItem(shaped, token));
+    }
+
+    Footprint footprint;
+    footprint.block(lines.capacity() * sizeof(LegacyLine));
+    for (const auto &line : lines) {
+        addLegacyItems(line.items, footprint);
+    }
+    addLegacyItems(tokens, footprint);
+    return footprint;
+}
+
+size_t contentBytes(const std::vector<Message> &log) {
+    size_t bytes = 0;
+    for (const auto &msg : log) {
+        bytes += msg.content.size();
+    }
+    return bytes;
+}
+
+const bool tokenizerCheck = Bench::add(
+    "text/tokenizer",
+    [] {
+        EmojiManager::initializeFromDefaultLocations();
+        TextMetrics::WorkerScope scope;
+
+        std::vector<std::string> cases = kHandWritten;
+        std::mt19937 rng(42);
+        for (int i = 0; i < kRandomCases; ++i) {
+            std::string text;
+            const int pieces = static_cast<int>(rng() % kMaxPieces);
+            for (int j = 0; j < pieces; ++j) {
+                text += kPieces[rng() % kPieces.size()];
+            }
+            cases.push_back(std::move(text));
+        }
+
+        int failures = 0;
+        for (size_t i = 0; i < cases.size(); ++i) {
+            if (i % kInvalidateEvery == 0) {
+                TextMetrics::invalidate();
+            }
+            Message msg = makeMessage(cases[i]);
+            if (i % 7 == 0) {
+                msg.editedTimestamp = msg.timestamp;
+            }
+            const std::string expected = describe(*Legacy::shapeMessage(msg));
+            const std::string actual = describe(*MessageWidget::shapeMessage(msg));
+            if (expected != actual && failures++ < kMaxReported) {
+                std::printf("text/tokenizer: mismatch for \"%s\"\nexpected:\n%sactual:\n%s\n", cases[i].c_str(),
+                            expected.c_str(), actual.c_str());
+            }
+        }
+        TextMetrics::invalidate();
+        std::printf("text/tokenizer: %zu messages, %d mismatches\n", cases.size(), failures);
+        return failures == 0;
+    },
+    true);
+
+const bool shapeBench = Bench::add("text/shape", [] {
+    EmojiManager::initializeFromDefaultLocations();
+    TextMetrics::WorkerScope scope;
+    const auto log = makeChatLog(2000);
+    const size_t bytes = contentBytes(log);
+
+    Bench::measure("text/shape legacy", 5, [&] {
+        for (const auto &msg : log) {
+            Bench::keep(Legacy::shapeMessage(msg).get());
+        }
+    }, bytes);
+    Bench::measure("text/shape current", 5, [&] {
+        for (const auto &msg : log) {
+            Bench::keep(MessageWidget::shapeMessage(msg).get());
+        }
+    }, bytes);
+
+    // One long line of unclosed link syntax: every '[' used to rescan the rest of the line
+    for (const std::string unit : {"[a](", "["}) {
+        std::string line;
+        for (int i = 0; i < 40000; ++i) {
+            line += unit;
+        }
+        const Message msg = makeMessage(line);
+        Bench::measure("text/shape legacy \"" + unit + "\" x40000", 1,
+                       [&] { Bench::keep(Legacy::shapeMessage(msg).get()); }, line.size());
+        Bench::measure("text/shape current \"" + unit + "\" x40000", 1,
+                       [&] { Bench::keep(MessageWidget::shapeMessage(msg).get()); }, line.size());
+    }
+    TextMetrics::invalidate();
+    return true;
+});
+
+const bool layoutBench = Bench::add("text/layout", [] {
+    EmojiManager::initializeFromDefaultLocations();
+    TextMetrics::WorkerScope scope;
+    const auto log = makeChatLog(2000);
+    std::vector<std::shared_ptr<const MessageWidget::ShapedContent>> shaped;
+    shaped.reserve(log.size());
+    for (const auto &msg : log) {
+        shaped.push_back(MessageWidget::shapeMessage(msg));
+    }
+
+    // A window resize: shaped content is reused and only wrapping is redone
+    for (int width : {360, 1200}) {
+        Bench::measure("text/layout rewrap at " + std::to_string(width) + "px", 5, [&] {
+            for (size_t i = 0; i < log.size(); ++i) {
+                auto layout = MessageWidget::buildLayout(log[i], shaped[i], width, false, false, nullptr);
+                Bench::keep(&layout);
+            }
+        });
+    }
+
+    // What the layout cache holds per message, and what the same layouts took with owned strings per item
+    for (int width : {360, 1200}) {
+        size_t total = 0;
+        Footprint flat;
+        Footprint legacy;
+        for (size_t i = 0; i < log.size(); ++i) {
+            const auto layout = MessageWidget::buildLayout(log[i], shaped[i], width, false, false, nullptr);
+            total += layout.memoryBytes();
+            const Footprint layoutFlat = flatItems(layout);
+            const Footprint layoutLegacy = legacyItems(layout);
+            flat.bytes += layoutFlat.bytes;
+            flat.allocations += layoutFlat.allocations;
+            legacy.bytes += layoutLegacy.bytes;
+            legacy.allocations += layoutLegacy.allocations;
+        }
+        const double messages = static_cast<double>(log.size());
+        const size_t legacyTotal = total - flat.bytes + legacy.bytes;
+        const std::string at = " at " + std::to_string(width) + "px";
+        std::printf("%-40s %9.0f B/message %8zu KiB total %6.1f item allocations/message\n",
+                    ("text/layout memory flat" + at).c_str(), total / messages, total / 1024,
+                    flat.allocations / messages);
+        std::printf("%-40s %9.0f B/message %8zu KiB total %6.1f item allocations/message\n",
+                    ("text/layout memory legacy" + at).c_str(), legacyTotal / messages, legacyTotal / 1024,
+                    legacy.allocations / messages);
+    }
+    TextMetrics::invalidate();
+    return true;
+});
+
+const bool emojiBench = Bench::add("text/emoji", [] {
+    EmojiManager::initializeFromDefaultLocations();
+    const auto log = makeChatLog(2000);
+    size_t positions = 0;
+    for (const auto &msg : log) {
+        positions += msg.content.size();
+    }
+
+    // The tokenizer asks at every byte of a message that may contain an emoji
+    std::string emoji;
+    Bench::measure("text/emoji tryMatch x" + std::to_string(positions), 5, [&] {
+        for (const auto &msg : log) {
+            for (size_t pos = 0; pos < msg.content.size(); ++pos) {
+                size_t length = 0;
+                Bench::keep(EmojiManager::tryMatch(msg.content, pos, length, emoji) ? &emoji : nullptr);
+            }
+        }
+    }, positions);
+    Bench::measure("text/emoji mayContainEmoji x" + std::to_string(log.size()), 5, [&] {
+        for (const auto &msg : log) {
+            Bench::keep(EmojiManager::mayContainEmoji(msg.content) ? &msg : nullptr);
+        }
+    }, positions);
+    return true;
+});
+
+} // namespace
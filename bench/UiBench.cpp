@@ -0,0 +1,207 @@
+#include "Bench.h"
+
+#include "models/GuildFolder.h"
+#include "models/GuildInfo.h"
+#include "models/Message.h"
+#include "state/Store.h"
+#include "ui/Theme.h"
+#include "ui/components/GuildBar.h"
+#include "ui/components/TextChannelView.h"
+#include "utils/Fonts.h"
+
+#include <FL/Fl.H>
+#include <FL/Fl_Double_Window.H>
+#include <FL/Fl_Image_Surface.H>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int kGuilds = 60;
+constexpr int kFolders = 4;
+constexpr int kGuildsPerFolder = 5;
+constexpr int kBarWidth = 72;
+constexpr int kBarHeight = 900;
+
+constexpr int kChannelMessages = 1000;
+constexpr int kMessagesPerAuthor = 4;
+constexpr int kScrollSteps = 150; // About five screens at 32 px a wheel step
+constexpr int kViewWidth = 800;
+constexpr int kViewHeight = 900;
+
+bool hasDisplay(const char *name) {
+#if !defined(_WIN32) && !defined(__APPLE__)
+    if (!std::getenv("DISPLAY") && !std::getenv("WAYLAND_DISPLAY")) {
+        std::printf("%-40s skipped, no display\n", name);
+        return false;
+    }
+#endif
+    return true;
+}
+
+// Guilds without icons, so every tile is an initial, a few of them grouped into folders as most accounts have
+void populateGuilds() {
+    Store::get().update([](AppState &state) {
+        state.guilds.clear();
+        state.guildFolders.clear();
+        for (int i = 0; i < kGuilds; ++i) {
+            GuildInfo guild;
+            guild.id = std::to_string(100000 + i);
+            guild.name = std::string(1, static_cast<char>('A' + i % 26)) + " guild " + std::to_string(i);
+            state.guilds.push_back(guild);
+        }
+        for (int f = 0; f < kFolders; ++f) {
+            GuildFolder folder;
+            folder.id = f + 1;
+            folder.name = "Folder " + std::to_string(f);
+            if (f % 2 == 0) {
+                folder.color = 0x5865F2;
+            }
+            for (int g = 0; g < kGuildsPerFolder; ++g) {
+                folder.guildIds.push_back(state.guilds[static_cast<size_t>(f * kGuildsPerFolder + g)].id);
+            }
+            state.guildFolders.push_back(folder);
+        }
+    });
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Draws the guild bar offscreen: the first draw renders every icon and folder tile, later ones reuse them
+const bool guildBarBench = Bench::add("ui/guildbar", [] {
+    if (!hasDisplay("ui/guildbar")) {
+        return true;
+    }
+    populateGuilds();
+    {
+        GuildBar bar(0, 0, kBarWidth, kBarHeight);
+        Fl_Image_Surface surface(kBarWidth, kBarHeight);
+        Fl_Surface_Device::push_current(&surface);
+
+        const auto start = std::chrono::steady_clock::now();
+        bar.damage(FL_DAMAGE_ALL);
+        bar.draw();
+        std::printf("%-40s %12.2f ms\n", "ui/guildbar first draw", millisecondsSince(start));
+
+        Bench::measure("ui/guildbar redraw", 50, [&] {
+            bar.damage(FL_DAMAGE_ALL);
+            bar.draw();
+        });
+        Fl_Surface_Device::pop_current();
+    }
+    Store::get().update([](AppState &state) {
+        state.guilds.clear();
+        state.guildFolders.clear();
+    });
+    return true;
+});
+
+// Runs of messages from the same author, as a busy channel has them. Authors have no id and so no avatar to
+// load, which leaves every message drawable in its final form once its layout arrives.
+std::vector<Message> makeChannelMessages() {
+    static const char *const kLines[] = {
+        "sounds good",
+        "did anyone get the build working on the new toolchain? mine fails at link time with a missing symbol",
+        "**done**, pushed to the branch",
+        "I think the problem is the cache key: it ignores the width, so a resize reuses the old wrap and the "
+        "lines overflow the view until something else invalidates it",
+        "lol",
+        "`git bisect` says it started two commits ago",
+    };
+    const auto start = std::chrono::system_clock::now() - std::chrono::minutes(kChannelMessages);
+    std::vector<Message> messages;
+    messages.reserve(kChannelMessages);
+    for (int i = 0; i < kChannelMessages; ++i) {
+        Message msg;
+        msg.id = std::to_string(200000 + i);
+        msg.authorUsername = "user" + std::to_string(i / kMessagesPerAuthor % 7);
+        msg.content = kLines[(i * 5 + i / 3) % std::size(kLines)];
+        msg.timestamp = start + std::chrono::minutes(i);
+        messages.push_back(std::move(msg));
+    }
+    return messages;
+}
+
+struct FrameTimes {
+    double meanMs = 0.0;
+    double p95Ms = 0.0;
+    double worstMs = 0.0;
+};
+
+// Scrolls by one wheel step per frame and times each frame's handling and flush
+FrameTimes scrollFrames(TextChannelView &view, int direction) {
+    std::vector<double> frames;
+    frames.reserve(kScrollSteps);
+    Fl::e_x = view.x() + view.w() / 2;
+    Fl::e_y = view.y() + view.h() / 2;
+    Fl::e_dx = 0;
+    Fl::e_dy = direction;
+    for (int i = 0; i < kScrollSteps; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        view.handle(FL_MOUSEWHEEL);
+        Fl::flush();
+        frames.push_back(millisecondsSince(start));
+        // Lets finished layouts arrive between frames, as the event loop would
+        Fl::check();
+    }
+    std::sort(frames.begin(), frames.end());
+    FrameTimes times;
+    for (double frame : frames) {
+        times.meanMs += frame / frames.size();
+    }
+    times.p95Ms = frames[frames.size() * 95 / 100];
+    times.worstMs = frames.back();
+    return times;
+}
+
+void printFrames(const char *label, const FrameTimes &times) {
+    std::printf("%-40s %12.2f ms mean  %.2f ms p95  %.2f ms worst\n", label, times.meanMs, times.p95Ms,
+                times.worstMs);
+}
+
+// Scrolls a 1000-message channel in a real window. The first pass up builds layouts and message tiles as
+// messages come into view; after scrolling back down, the second pass up covers the same messages from tiles.
+const bool scrollBench = Bench::add("ui/scroll", [] {
+    if (!hasDisplay("ui/scroll")) {
+        return true;
+    }
+    static const bool initialised = [] {
+        Fl::lock();
+        init_theme();
+        return FontLoader::loadFonts();
+    }();
+    Bench::keep(&initialised);
+
+    // An empty channel id loads from the store without asking the API for messages
+    Store::get().update([](AppState &state) { state.channelMessages[""] = makeChannelMessages(); });
+    {
+        Fl_Double_Window window(kViewWidth, kViewHeight, "DiscoveBench");
+        TextChannelView view(0, 0, kViewWidth, kViewHeight);
+        window.end();
+        window.show();
+        view.setChannel("", "bench");
+
+        // Lays out the newest messages before the first scroll
+        const auto settle = std::chrono::steady_clock::now();
+        while (millisecondsSince(settle) < 1000.0) {
+            Fl::wait(0.01);
+        }
+
+        printFrames("ui/scroll 1000 messages, first pass", scrollFrames(view, -1));
+        scrollFrames(view, 1);
+        printFrames("ui/scroll 1000 messages, from tiles", scrollFrames(view, -1));
+        window.hide();
+    }
+    Store::get().update([](AppState &state) { state.channelMessages.erase(""); });
+    return true;
+});
+
+} // namespace
@@ -0,0 +1,173 @@
+#!/usr/bin/env python3
+"""Compile assets/emojis/mappings.json into the binary emoji index read by EmojiManager.
+
+This is the only writer of the format: the index is embedded as a C++ header, or written as a raw
+emoji_index.bin that EmojiManager::initialize() reads. Bump VERSION together with kIndexVersion in
+EmojiManager.cpp whenever the layout changes. All integers are little-endian:
+
+    IndexHeader     magic, version, recordCount, nodeCount, edgeCount, stringBytes, flags, reserved
+    uint32[256]     root edges (child node per first byte, 0 = none)
+    EmojiRecord[]   emoji, name and sheet URL as (offset, length) into the string pool,
+                    bgPosX, bgPosY, bgSizeW, bgSizeH, tileW, tileH, acceptsSkinTone
+    TrieNode[]      firstEdge, edgeCount, record (-1 = none)
+    uint32[]        edge targets
+    uint8[]         edge bytes (sorted per node)
+    char[]          string pool
+"""
+import json
+import re
+import struct
+import sys
+
+MAGIC = 0x4A4D4544  # "DEMJ"
+VERSION = 1
+FLAG_HAS_ASCII_ONLY_EMOJI = 1
+BASE_YELLOW_ATLAS_HASHES = {"9d6f7bad0b4786fd", "668ed2f8f314c3b7"}
+
+
+def parse_px_pair(value):
+    match = re.match(r' *([-+]?\d+)[^ ]* +([-+]?\d+)', value or '')
+    if not match:
+        return 0, 0
+    return int(match.group(1)), int(match.group(2))
+
+
+def asset_hash(url):
+    match = re.search(r'assets/([0-9a-fA-F]+)\.png', url or '')
+    return match.group(1).lower() if match else ''
+
+
+class StringPool:
+    def __init__(self):
+        self.data = bytearray()
+        self.offsets = {}
+
+    def add(self, text):
+        encoded = text.encode('utf-8')
+        if encoded not in self.offsets:
+            self.offsets[encoded] = len(self.data)
+            self.data += encoded
+        return self.offsets[encoded], len(encoded)
+
+
+def load_records(path):
+    with open(path, 'r', encoding='utf-8') as f:
+        data = json.load(f)
+
+    records = []
+    seen = set()
+    for item in data.get('items', []):
+        if not isinstance(item, dict):
+            continue
+        emoji = item.get('surrogates')
+        if not isinstance(emoji, str) or not emoji or emoji in seen:
+            continue
+        seen.add(emoji)
+
+        sheet_url = item.get('sheetUrl') if isinstance(item.get('sheetUrl'), str) else ''
+        pos_x, pos_y = parse_px_pair(item.get('bgPos') if isinstance(item.get('bgPos'), str) else '')
+        size_w, size_h = parse_px_pair(item.get('bgSize') if isinstance(item.get('bgSize'), str) else '')
+        tile_w = item.get('w') if isinstance(item.get('w'), (int, float)) else 0
+        tile_h = item.get('h') if isinstance(item.get('h'), (int, float)) else 0
+        records.append({
+            'emoji': emoji,
+            'name': item.get('name') if isinstance(item.get('name'), str) else '',
+            'sheetUrl': sheet_url,
+            'ints': (pos_x, pos_y, size_w, size_h, int(tile_w), int(tile_h)),
+            'skinTone': asset_hash(sheet_url) in BASE_YELLOW_ATLAS_HASHES,
+        })
+    return records
+
+
+def build_index(records):
+    children = [{}]
+    node_records = [-1]
+    for index, record in enumerate(records):
+        node = 0
+        for byte in record['emoji'].encode('utf-8'):
+            if byte not in children[node]:
+                children[node][byte] = len(children)
+                children.append({})
+                node_records.append(-1)
+            node = children[node][byte]
+        node_records[node] = index
+
+    nodes = []
+    edge_bytes = bytearray()
+    edge_targets = []
+    for node, edges in enumerate(children):
+        nodes.append((len(edge_bytes), len(edges), node_records[node]))
+        for byte in sorted(edges):
+            edge_bytes.append(byte)
+            edge_targets.append(edges[byte])
+
+    root_edges = [0] * 256
+    for byte, target in children[0].items():
+        root_edges[byte] = target
+
+    pool = StringPool()
+    packed_records = bytearray()
+    has_ascii_only = False
+    for record in records:
+        emoji = pool.add(record['emoji'])
+        name = pool.add(record['name'])
+        sheet = pool.add(record['sheetUrl'])
+        packed_records += struct.pack('<6I6iI', *emoji, *name, *sheet, *record['ints'], 1 if record['skinTone'] else 0)
+        has_ascii_only |= all(ord(ch) < 0x80 for ch in record['emoji'])
+
+    blob = bytearray()
+    blob += struct.pack('<8I', MAGIC, VERSION, len(records), len(nodes), len(edge_bytes), len(pool.data),
+                        FLAG_HAS_ASCII_ONLY_EMOJI if has_ascii_only else 0, 0)
+    blob += struct.pack('<256I', *root_edges)
+    blob += packed_records
+    for first_edge, edge_count, record in nodes:
+        blob += struct.pack('<IIi', first_edge, edge_count, record)
+    blob += struct.pack(f'<{len(edge_targets)}I', *edge_targets)
+    blob += edge_bytes
+    blob += pool.data
+    return blob
+
+
+def write_binary(blob, output_file):
+    with open(output_file, 'wb') as f:
+        f.write(blob)
+
+
+def write_header(blob, output_file, variable_name):
+    lines = []
+    lines.append("#pragma once\n")
+    lines.append("#include <cstddef>\n")
+    lines.append("namespace EmbeddedEmojis {\n")
+    lines.append(f"alignas(8) static const unsigned char {variable_name}[] = {{")
+
+    for i in range(0, len(blob), 16):
+        chunk = blob[i:i+16]
+        hex_values = ', '.join(f'0x{b:02x}' for b in chunk)
+        lines.append(f"    {hex_values},")
+
+    lines.append("};")
+    lines.append(f"\nstatic const size_t {variable_name}_size = {len(blob)};")
+    lines.append("\n}")
+
+    with open(output_file, 'w', encoding='utf-8') as f:
+        f.write('\n'.join(lines))
+
+
+if __name__ == '__main__':
+    if len(sys.argv) not in (3, 4) or (len(sys.argv) == 3) != sys.argv[2].endswith('.bin'):
+        print("Usage: generate_emoji_index.py <mappings.json> <output_header> <variable_name>")
+        print("       generate_emoji_index.py <mappings.json> <emoji_index.bin>")
+        sys.exit(1)
+
+    try:
+        records = load_records(sys.argv[1])
+        blob = build_index(records)
+        if len(sys.argv) == 3:
+            write_binary(blob, sys.argv[2])
+        else:
+            write_header(blob, sys.argv[2], sys.argv[3])
+        print(f"Generated {sys.argv[2]} ({len(records)} emojis, {len(blob)} bytes)")
+        sys.exit(0)
+    except Exception as e:
+        print(f"Error: {e}", file=sys.stderr)
+        sys.exit(1)
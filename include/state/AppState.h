@@ -76,7 +76,8 @@ struct AppState {
     std::vector<GuildFolder> guildFolders;
     std::vector<uint64_t> guildPositions;
     std::vector<GuildInfo> guilds;
-    std::vector<std::shared_ptr<DMChannel>> privateChannels;
+    std::vector<std::shared_ptr<DMChannel>> privateChannels; // Newest activity first; replaced, never mutated in place
+    uint64_t privateChannelsRevision = 0;
     std::unordered_map<std::string, std::vector<std::shared_ptr<GuildChannel>>> guildChannels;
     std::unordered_map<std::string, GuildMember> guildMembers;
     std::unordered_map<std::string, std::vector<Role>> guildRoles;
@@ -20,6 +20,16 @@ class Store {
     static Store &get();
 
     AppState snapshot() const;
+
+    /**
+     * @brief Run reader on the current state under the store lock instead of copying it
+     * @note reader must not call back into the Store
+     */
+    template <class Reader> decltype(auto) read(Reader &&reader) const {
+        std::scoped_lock lock(m_mutex);
+        return reader(static_cast<const AppState &>(m_state));
+    }
+
     void update(const std::function<void(AppState &)> &mutator);
 
     ListenerId subscribe(Listener cb);
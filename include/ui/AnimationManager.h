@@ -3,15 +3,28 @@
 #include <FL/Fl.H>
 
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <mutex>
+#include <queue>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 class AnimationManager {
   public:
     using AnimationId = uint64_t;
-    using AnimationCallback = std::function<bool()>; 
+    using AnimationCallback = std::function<bool()>;
+
+    /**
+     * Called when the animation is due.
+     * @param elapsed Seconds on the animation clock since the previous call, or since registration
+     * @return Seconds until the next call, or STOP to unregister
+     */
+    using ScheduledCallback = std::function<double(double elapsed)>;
+
+    static constexpr double STOP = -1.0;
 
     static AnimationManager &get();
 
@@ -21,12 +34,42 @@ class AnimationManager {
      */
     AnimationId registerAnimation(AnimationCallback callback);
 
+    /**
+     * Register a callback that decides when it runs next, e.g. at the next GIF frame deadline.
+     * Callbacks are never run more often than the frame rate, and everything due in the same frame runs in one
+     * wake-up so the resulting damage is flushed in one repaint.
+     * @param callback Function called when due
+     * @param delay Seconds until the first call
+     * @return Animation ID for later unregistration
+     */
+    AnimationId registerScheduledAnimation(ScheduledCallback callback, double delay = 0.0);
+
     /**
      * Unregister an animation callback.
      * @param id The animation ID returned from registerAnimation
      */
     void unregisterAnimation(AnimationId id);
 
+    /**
+     * Stop calling an animation without unregistering it, e.g. while its widget is scrolled out of view.
+     * When resumed it is called on the next frame, and the suspended time is not part of its elapsed time.
+     * @param id The animation ID returned from registerAnimation
+     * @param suspended true to suspend, false to resume
+     */
+    void setSuspended(AnimationId id, bool suspended);
+
+    /**
+     * Get the number of registered animations that are being called.
+     * @return Animations not suspended
+     */
+    size_t activeCount() const;
+
+    /**
+     * Get the number of registered animations that are suspended.
+     * @return Animations suspended with setSuspended
+     */
+    size_t suspendedCount() const;
+
     /**
      * Set the target frame rate for all animations.
      * @param fps Frames per second (must be > 0)
@@ -45,6 +88,12 @@ class AnimationManager {
      */
     double getFrameTime() const { return 1.0 / static_cast<double>(m_fps.load()); }
 
+    /**
+     * Get the shared animation clock.
+     * @return Seconds of unpaused time; constant while the callbacks of one wake-up run
+     */
+    double getClock() const;
+
     /**
      * Pause all animations globally.
      */
@@ -62,20 +111,40 @@ class AnimationManager {
     bool isPaused() const { return m_paused.load(); }
 
   private:
+    using Clock = std::chrono::steady_clock;
+    using Deadline = std::pair<double, AnimationId>; // Clock time the animation is due, and its id
+
+    struct Entry {
+        ScheduledCallback callback;
+        double due = 0.0;
+        double lastRun = 0.0; // Clock time of the previous call, or of registration
+        bool suspended = false;
+    };
+
     AnimationManager();
     AnimationManager(const AnimationManager &) = delete;
     AnimationManager &operator=(const AnimationManager &) = delete;
 
-    void startTimer();
+    double clockNow() const;
+    void scheduleWakeLocked();
     void stopTimer();
     void tick();
     static void timerCallback(void *data);
 
   private:
-    std::mutex m_mutex;
-    std::unordered_map<AnimationId, AnimationCallback> m_animations;
+    mutable std::mutex m_mutex;
+    std::unordered_map<AnimationId, Entry> m_animations;
+    // Min-heap of deadlines; entries whose due time no longer matches the animation are stale and skipped
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> m_deadlines;
     std::atomic<AnimationId> m_nextId{0};
     std::atomic<int> m_fps{60};
     std::atomic<bool> m_timerRunning{false};
     std::atomic<bool> m_paused{false};
+
+    double m_wakeAt = 0.0;       // Clock time the pending timeout fires
+    double m_clockBase = 0.0;    // Clock value at m_clockResumed
+    Clock::time_point m_clockResumed = Clock::now();
+    double m_tickClock = 0.0;    // Clock value of the wake-up in progress
+    bool m_inTick = false;
+    size_t m_suspendedCount = 0;
 };
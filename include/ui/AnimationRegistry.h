@@ -0,0 +1,125 @@
+#pragma once
+
+#include <FL/Fl_Image.H>
+#include <FL/Fl_RGB_Image.H>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class GifAnimation;
+
+/**
+ * One decoded animation shared by every widget showing the same URL. Playback follows the AnimationManager
+ * clock, so all holders see the same frame and the frame advances once per tick however many holders sync.
+ * Must be used on the UI thread.
+ */
+class SharedAnimation {
+  public:
+    SharedAnimation(std::string url, std::unique_ptr<GifAnimation> animation);
+    ~SharedAnimation();
+
+    SharedAnimation(const SharedAnimation &) = delete;
+    SharedAnimation &operator=(const SharedAnimation &) = delete;
+
+    const std::string &url() const { return url_; }
+    GifAnimation &animation() { return *animation_; }
+    bool isAnimated() const;
+    size_t currentFrameIndex() const;
+
+    Fl_RGB_Image *currentFrame();
+
+    /**
+     * @brief Current frame scaled to width x height; scaled copies are produced off the UI thread and kept per
+     *        size by the animation
+     * @return nullptr until the first frame at this size is ready
+     */
+    Fl_Image *scaledFrame(int width, int height);
+
+    /**
+     * @brief Current frame masked to a circle of the given diameter, built once per frame and diameter
+     * @note Masked frames follow the animation's decode window: a frame it has evicted is dropped at every
+     *       diameter, and only the last few diameters are kept
+     */
+    Fl_RGB_Image *circularFrame(int diameter);
+
+    /**
+     * @brief Count a viewer that wants the animation to play; the first one starts it from the first frame
+     */
+    void play();
+
+    /**
+     * @brief Drop a viewer added by play(); when none are left playback stops on the first frame
+     * @note A viewer that called suspend() calls resume() first
+     */
+    void stop();
+
+    bool isPlaying() const { return players_ > 0; }
+
+    /**
+     * @brief Mark a viewer added by play() as off screen; once every viewer is, playback holds and the decoded
+     *        frames other than the current one are released
+     */
+    void suspend();
+
+    /**
+     * @brief Undo suspend() for one viewer, catching up from the frame playback held on
+     */
+    void resume();
+
+    bool isSuspended() const { return players_ > 0 && suspended_ >= players_; }
+
+    /**
+     * @brief Catch up with the shared clock
+     * @return true if the frame changed on the current tick, for every holder that asks during that tick
+     */
+    bool sync();
+
+    /**
+     * @brief Seconds until the frame after the current one is due
+     */
+    double timeUntilNextFrame() const;
+
+  private:
+    void dropEvictedCircularFrames();
+
+    std::string url_;
+    std::unique_ptr<GifAnimation> animation_;
+    std::unordered_map<int, std::vector<std::unique_ptr<Fl_RGB_Image>>> circularFrames_; // By diameter, per frame
+    int players_ = 0;
+    int suspended_ = 0; // Viewers among players_ that are off screen
+    double syncedClock_ = 0.0;
+    double changedClock_ = -1.0;
+};
+
+/**
+ * Reference-counted registry of animations by URL: every widget asking for the same GIF or WebP gets the same
+ * SharedAnimation, decoded once, and it is released when the last holder drops its handle.
+ * All functions must be called on the UI thread.
+ */
+namespace AnimationRegistry {
+
+using Handle = std::shared_ptr<SharedAnimation>;
+using LoadCallback = std::function<void(Handle)>;
+
+/**
+ * @brief Animation for url if some widget still holds it
+ */
+Handle find(const std::string &url);
+
+/**
+ * @brief Get the shared animation for url, downloading and decoding it if nobody holds it
+ * @param callback Invoked on the UI thread with the animation, or nullptr if it could not be loaded; runs
+ *                 immediately when the animation is already live. Concurrent requests for a URL share one load.
+ * @note The downloaded still image is evicted from the image memory cache once the animation is decoded
+ */
+void load(const std::string &url, LoadCallback callback);
+
+/**
+ * @brief Number of animations currently held by at least one widget
+ */
+size_t liveCount();
+
+} // namespace AnimationRegistry
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <FL/Fl_RGB_Image.H>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+/**
+ * Shared sheets of pre-scaled emoji, one per display size. Each sheet is a set of RGBA pages cut into
+ * size x size cells; emoji are copied into a free cell once and drawn by rectangle from the page, so a
+ * busy channel holds a handful of page bitmaps instead of one small image per emoji and size.
+ * All functions must be called on the UI thread.
+ */
+namespace EmojiAtlas {
+
+constexpr int PAGE_SIZE = 512;
+constexpr int MAX_PAGES_PER_SIZE = 4;
+
+struct Stats {
+    size_t sheets{0};
+    size_t pages{0};
+    size_t cellsUsed{0};
+    size_t cellsCapacity{0};
+    size_t bytes{0};
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t evictions{0};
+};
+
+/**
+ * @brief Copy an emoji bitmap into the sheet for its size
+ * @param key Key the emoji is drawn by; an existing entry is overwritten in place
+ * @param size Cell size in pixels; the image must be exactly size x size
+ * @param image Bitmap of any depth (stored as RGBA); the atlas does not keep it
+ * @return false if the image has the wrong size or no pixel data
+ * @note When the sheet is full the least recently drawn emoji of that size is evicted
+ */
+bool insert(const std::string &key, int size, const Fl_RGB_Image *image);
+
+bool contains(const std::string &key);
+
+/**
+ * @brief Draw a resident emoji with its top-left corner at x, y
+ * @return false if key is not in the atlas
+ */
+bool draw(const std::string &key, int x, int y);
+
+/**
+ * @brief Free the cells of every entry whose key starts with keyPrefix and is not in keepKeys
+ * @note Trailing pages left empty are released
+ */
+void prune(const std::unordered_set<std::string> &keepKeys, std::string_view keyPrefix = {});
+
+void clear();
+
+Stats getStats();
+
+} // namespace EmojiAtlas
@@ -1,18 +1,34 @@
 #pragma once
 
-#include <FL/Fl_Image.H>
-
 #include <string>
+#include <string_view>
 #include <unordered_set>
 
 namespace EmojiManager {
 bool initialize(const std::string &rootDir);
 void initializeFromDefaultLocations();
 bool isAvailable();
-bool tryMatch(const std::string &text, size_t pos, size_t &outLength, std::string &outEmoji);
+
+/**
+ * @brief Match the longest emoji starting at pos, including a trailing skin tone modifier
+ * @note Lock-free once the dataset is loaded; safe to call from layout workers
+ */
+bool tryMatch(std::string_view text, size_t pos, size_t &outLength, std::string &outEmoji);
+
+/**
+ * @brief Cheap pre-check: false means tryMatch cannot succeed anywhere in text
+ */
+bool mayContainEmoji(std::string_view text);
+
 bool hasEmoji(const std::string &emoji);
 std::string makeCacheKey(const std::string &emoji, int size);
-Fl_Image *loadEmoji(const std::string &emoji, int size);
+
+/**
+ * @brief Draw an emoji from the shared emoji atlas, cutting it from its sprite sheet on first use
+ * @return false if the emoji is unknown or its sheet is still downloading (a redraw follows the download)
+ */
+bool drawEmoji(const std::string &emoji, int size, int x, int y);
+
 void pruneCache(const std::unordered_set<std::string> &keepKeys);
 void clearCache();
 } // namespace EmojiManager
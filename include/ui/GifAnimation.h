@@ -1,21 +1,40 @@
 #pragma once
 
+#include "utils/Images.h"
+
 #include <FL/Fl_Image.H>
 #include <FL/Fl_RGB_Image.H>
 #include <atomic>
+#include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+/**
+ * Animated GIF or WebP player. The compressed file stays in memory and frames are composited on demand by a
+ * sequential decoder that only runs on WorkerPool threads: they decode ahead of the playhead into a window of
+ * frames sized by the memory budget, and the UI thread never decodes or waits for a frame. Animations whose
+ * frames all fit in the budget end up fully decoded after the first loop. Scaled frames are resampled on the
+ * same workers, so drawing at a new size never blocks on a resize either.
+ * All member functions must be called on the UI thread.
+ */
 class GifAnimation {
   public:
     enum class ScalingStrategy { None, Lazy, Eager };
 
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = 16 * 1024 * 1024;
+
     static void setGlobalPaused(bool paused);
     static bool isGlobalPaused();
 
+    /**
+     * @brief Budget for decoded frames applied to animations created afterwards
+     */
+    static void setDefaultMemoryBudget(size_t bytes);
+
     explicit GifAnimation(const std::string &filepath, ScalingStrategy strategy = ScalingStrategy::Lazy);
+    GifAnimation(const unsigned char *data, size_t size, ScalingStrategy strategy = ScalingStrategy::Lazy);
     ~GifAnimation();
 
     GifAnimation(const GifAnimation &) = delete;
@@ -24,8 +43,34 @@ class GifAnimation {
     GifAnimation &operator=(GifAnimation &&) noexcept = default;
 
     Fl_RGB_Image *currentFrame() const;
-    Fl_Image *getScaledFrame(int width, int height);
-    Fl_RGB_Image *getFrame(size_t index) const;
+
+    /**
+     * @brief Current frame resampled to width x height with area averaging, produced by a background worker
+     * @return The scaled frame; while it is being produced, the last frame shown at this size, or nullptr if
+     *         there is none yet so the caller keeps drawing its still image
+     * @note Lazy scaling prepares the current and next frame, Eager every decoded frame; None returns the
+     *       unscaled current frame
+     */
+    Fl_RGB_Image *getScaledFrame(int width, int height, Images::ScaleMode mode = Images::ScaleMode::Fill);
+
+    /**
+     * @brief Called on the UI thread when frames scaled in the background are ready, or a frame that
+     *        currentFrame() or getFrame() did not have yet has been decoded, e.g. to redraw a widget whose
+     *        animation is not playing
+     */
+    void setFrameReadyCallback(std::function<void()> callback);
+
+    /**
+     * @brief Composited frame at index; if it is not resident its decode is scheduled and the last frame
+     *        that was ready is returned instead, or nullptr if there is none yet
+     * @note The pointer is valid until the next call on this animation; copy what needs to outlive it
+     */
+    Fl_RGB_Image *getFrame(size_t index);
+
+    /**
+     * @brief Whether frame index is decoded and held in the playback window
+     */
+    bool isFrameResident(size_t index) const { return residentFrame(index) != nullptr; }
 
     int baseWidth() const { return width_; }
     int baseHeight() const { return height_; }
@@ -35,54 +80,103 @@ class GifAnimation {
     void previousFrame();
     void setFrame(size_t index);
     size_t getCurrentFrameIndex() const { return currentFrameIndex_; }
-    size_t frameCount() const { return frames_.size(); }
+    size_t frameCount() const { return delays_.size(); }
 
+    /**
+     * @brief Move the playhead by deltaSeconds of playback
+     * @return true if the current frame changed, or was decoded since the last call
+     * @note Playback holds on the current frame while the next one is still being decoded
+     */
     bool advance(double deltaSeconds);
     void reset();
 
-    bool isValid() const { return !frames_.empty(); }
-    bool isAnimated() const { return frames_.size() > 1; }
+    /**
+     * @brief Hold playback and drop every decoded frame but the current one, e.g. while off screen
+     * @note Frames are decoded again from the compressed data after resume()
+     */
+    void suspend();
+    void resume();
+    bool isSuspended() const { return suspended_; }
+
+    /**
+     * @brief Seconds of playback left before advance() moves to the next frame
+     */
+    double timeUntilNextFrame() const;
+
+    /**
+     * @brief The data opened and its frames were listed; currentFrame() is null until a worker has decoded
+     *        the first one
+     */
+    bool isValid() const { return stream_ != nullptr; }
+    bool isAnimated() const { return delays_.size() > 1; }
     const std::string &getLastError() const { return lastError_; }
 
     void setScalingStrategy(ScalingStrategy strategy);
     void clearScaledCache();
 
+    /**
+     * @brief Cap the bytes of decoded full-size frames kept for this animation (at least two frames are kept)
+     */
+    void setMemoryBudget(size_t bytes);
+
+    /**
+     * @brief Bytes of decoded full-size frames currently resident
+     */
+    size_t memoryUsage() const;
+
   private:
-    struct Frame {
-        std::unique_ptr<Fl_RGB_Image> image;
-        int delay = 100;
-    };
+    struct Stream;
 
     struct ScaledFrameKey {
         int width;
         int height;
+        Images::ScaleMode mode;
 
-        bool operator==(const ScaledFrameKey &other) const { return width == other.width && height == other.height; }
+        bool operator==(const ScaledFrameKey &other) const {
+            return width == other.width && height == other.height && mode == other.mode;
+        }
     };
 
     struct ScaledFrameKeyHash {
         std::size_t operator()(const ScaledFrameKey &key) const {
-            return std::hash<int>()(key.width) ^ (std::hash<int>()(key.height) << 1);
+            return std::hash<int>()(key.width) ^ (std::hash<int>()(key.height) << 1) ^
+                   (std::hash<int>()(static_cast<int>(key.mode)) << 2);
         }
     };
 
-    bool loadGif(const std::string &filepath);
-    Fl_Image *getOrCreateScaledFrame(size_t frameIndex, int width, int height);
-    void preScaleAllFrames(int width, int height);
+    struct ScaledFrames {
+        std::vector<std::unique_ptr<Fl_RGB_Image>> frames; // By frame, null until a worker has scaled it
+        std::vector<bool> pending;                          // By frame, queued on a worker
+        Fl_RGB_Image *shown = nullptr;                      // Last one handed out, held while the next is scaled
+    };
 
-    std::vector<Frame> frames_;
+    bool loadGif(const std::string &filepath);
+    bool loadFromMemory(std::vector<unsigned char> data);
+    Fl_RGB_Image *residentFrame(size_t index) const;
+    Fl_RGB_Image *ensureFrame(size_t index);
+    void moveTo(size_t index);
+    void applyCapacity();
+    Fl_RGB_Image *getOrCreateScaledFrame(size_t frameIndex, const ScaledFrameKey &key);
+    void requestScaledFrames(const ScaledFrameKey &key, ScaledFrames &cache, size_t fromIndex);
+    void collectScaledFrames();
+
+    std::shared_ptr<Stream> stream_;
+    std::vector<int> delays_;
     size_t currentFrameIndex_ = 0;
     int width_ = 0;
     int height_ = 0;
+    size_t memoryBudget_ = DEFAULT_MEMORY_BUDGET;
+    mutable std::vector<std::unique_ptr<Fl_RGB_Image>> views_; // Images over resident pixels, by frame
+    std::unique_ptr<Fl_RGB_Image> scratchFrame_; // Result of getFrame for a frame outside the playback window
+    size_t scratchIndex_ = 0;
+    bool currentReady_ = false; // currentFrame() was resident when advance() last looked
 
     ScalingStrategy scalingStrategy_ = ScalingStrategy::Lazy;
-    std::unordered_map<ScaledFrameKey, std::vector<std::unique_ptr<Fl_Image>>, ScaledFrameKeyHash> scaledCache_;
+    std::unordered_map<ScaledFrameKey, ScaledFrames, ScaledFrameKeyHash> scaledCache_;
     std::string lastError_;
 
-    int lastScaledWidth_ = 0;
-    int lastScaledHeight_ = 0;
-    std::vector<std::unique_ptr<Fl_Image>> *lastScaledCache_ = nullptr;
-
     double timeAccumulatorSeconds_ = 0.0;
+    bool suspended_ = false;
     static std::atomic<bool> s_globalPaused;
+    static std::atomic<size_t> s_defaultMemoryBudget;
 };
@@ -11,10 +11,9 @@
 
 #include "state/Store.h"
 #include "ui/AnimationManager.h"
-#include "ui/GifAnimation.h"
+#include "ui/AnimationRegistry.h"
 
 class Fl_RGB_Image;
-class GifAnimation;
 
 class DMSidebar : public Fl_Group {
   public:
@@ -34,15 +33,15 @@ class DMSidebar : public Fl_Group {
 
   private:
     struct AnimatedAvatarState {
-        std::unique_ptr<GifAnimation> animation;
-        std::vector<std::unique_ptr<Fl_RGB_Image>> frames;
+        AnimationRegistry::Handle animation;
         AnimationManager::AnimationId animationId = 0;
-        double frameTimeAccumulated = 0.0;
         bool running = false;
     };
 
     struct DMItem {
         std::string id;
+        std::shared_ptr<const DMChannel> channel;
+        bool resolved = false; // Name and avatars filled in from channel; done after the row first comes into view
         std::string displayName;
         std::string recipientId;
         std::string avatarUrl;
@@ -51,22 +50,26 @@ class DMSidebar : public Fl_Group {
         std::string secondaryAvatarUrl;
         std::string secondaryAnimatedAvatarUrl;
         std::string secondaryAvatarLabel;
-        std::string status = "offline";
         bool showStatus = false;
-        int yPos = 0;
     };
 
-    void loadDMsFromState();
-    void updateStatuses(const std::unordered_map<std::string, std::string> &statuses);
-
-    std::vector<DMItem> m_dms;
+    bool syncFromState(const AppState &state);
+    bool syncDMs(const std::vector<std::shared_ptr<DMChannel>> &channels);
+    void scheduleResolve(int firstIndex, int lastIndex);
+    static void resolveTimerCallback(void *data);
+    bool resolveDMs(int firstIndex, int lastIndex);
+    void resolveDM(DMItem &item, const std::unordered_map<std::string, User> &knownUsers,
+                   std::unordered_map<std::string, User> &discoveredUsers);
+
+    std::vector<DMItem> m_dms; // In AppState::privateChannels order
+    uint64_t m_channelsRevision = 0;
+    uint64_t m_usersRevision = 0;
+    std::unordered_map<std::string, std::string> m_statuses;
     std::string m_selectedDMId;
     int m_hoveredDMIndex = -1;
     int m_scrollOffset = 0;
     std::function<void(const std::string &)> m_onDMSelected;
     Store::ListenerId m_storeListenerId = 0;
-    Store::ListenerId m_statusListenerId = 0;
-    Store::ListenerId m_userListenerId = 0;
     std::shared_ptr<bool> m_isAlive;
 
     std::unordered_map<std::string, std::unique_ptr<Fl_RGB_Image>> m_avatarCache;
@@ -75,6 +78,13 @@ class DMSidebar : public Fl_Group {
     std::unordered_set<std::string> m_avatarGifPending;
     std::string m_hoveredAvatarKey;
 
+    // Rows drawn last, resolved from a timer so neither SQLite nor Store::update runs inside draw()
+    int m_resolveFirst = 0;
+    int m_resolveLast = -1;
+    bool m_resolveScheduled = false;
+    // Channel id -> lastMessageId when its stored messages were last searched for unknown recipients
+    std::unordered_map<std::string, std::string> m_searchedChannels;
+
     std::deque<std::string> m_userResolveQueue;
     std::unordered_set<std::string> m_userResolveQueuedUserIds;
     int m_userResolveInFlight = 0;
@@ -95,7 +105,7 @@ class DMSidebar : public Fl_Group {
     Fl_RGB_Image *getAnimatedAvatarFrame(const std::string &gifUrl, int size);
     void ensureAnimatedAvatar(const std::string &gifUrl, int size);
     void setHoveredAvatarKey(const std::string &key);
-    bool updateAvatarAnimation(const std::string &key);
+    double updateAvatarAnimation(const std::string &key);
     void startAvatarAnimation(const std::string &key);
     void stopAvatarAnimation(const std::string &key);
 
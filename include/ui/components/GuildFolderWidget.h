@@ -1,6 +1,8 @@
 #pragma once
 
 #include <FL/Fl_Group.H>
+#include <FL/Fl_RGB_Image.H>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -64,4 +66,6 @@ class GuildFolderWidget : public Fl_Group {
     AnimationManager::AnimationId animationId_{0};
     float indicatorHeight_{0.0f};
     AnimationManager::AnimationId indicatorAnimationId_{0};
+    std::unique_ptr<Fl_RGB_Image> background_; // Rounded folder tile at its settled size
+    Fl_Color backgroundColor_{0};
 };
@@ -1,13 +1,14 @@
 #pragma once
 
 #include <FL/Fl_Box.H>
+#include <FL/Fl_RGB_Image.H>
+#include <FL/fl_draw.H>
 #include <functional>
 #include <memory>
 #include <string>
 
 #include "ui/AnimationManager.h"
-
-class GifAnimation;
+#include "ui/AnimationRegistry.h"
 
 class GuildIcon : public Fl_Box {
   public:
@@ -21,26 +22,30 @@ class GuildIcon : public Fl_Box {
 
     const std::string &guildId() const { return guildId_; }
 
+    /**
+     * @brief Whether this icon was created for the given guild icon, name and size, so a rebuilt guild bar can
+     *        keep it (and its rendered cache) instead of creating a new one
+     */
+    bool shows(const std::string &iconHash, const std::string &guildName, int size) const;
+
     void setSelected(bool selected);
     bool isSelected() const { return isSelected_; }
     void setIndicatorsEnabled(bool enabled);
 
-    void setCornerRadius(int radius) {
-        cornerRadius_ = radius;
-        redraw();
-    }
+    void setCornerRadius(int radius);
+    void setMaskColor(Fl_Color color);
 
-    void setMaskColor(Fl_Color color) {
-        maskColor_ = color;
-        redraw();
-    }
+    void setFallbackFontSize(int size);
 
-    void setFallbackFontSize(int size) { fallbackFontSize_ = size; }
+    void resize(int x, int y, int w, int h) override;
 
   private:
     void draw() override;
     int handle(int event) override;
-    bool updateAnimation();
+    void drawBody(int X, int Y, Fl_Image *image);
+    Fl_RGB_Image *cachedBody();
+    void invalidateCache();
+    double updateAnimation();
     void startAnimation();
     void stopAnimation();
     bool ensureGifLoaded();
@@ -49,7 +54,8 @@ class GuildIcon : public Fl_Box {
     float indicatorTargetHeight() const;
 
     Fl_Image *image_{nullptr};
-    std::unique_ptr<GifAnimation> gifAnimation_;
+    std::string imageKey_;
+    AnimationRegistry::Handle gifAnimation_;
     std::string fallbackLabel_;
     int fallbackFontSize_{20};
     std::string guildId_;
@@ -66,5 +72,6 @@ class GuildIcon : public Fl_Box {
     AnimationManager::AnimationId indicatorAnimationId_{0};
     AnimationManager::AnimationId animationId_{0};
     double frameTimeAccumulated_{0.0};
+    std::unique_ptr<Fl_RGB_Image> cache_; // Still icon or initial with transparent corners; reset on image/size/radius
     std::function<void(const std::string &)> onClickCallback_;
 };
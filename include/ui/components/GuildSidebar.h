@@ -114,6 +114,7 @@ class GuildSidebar : public Fl_Group {
     };
 
     void loadChannelsFromStore();
+    void releaseBannerImage();
 
     std::string m_guildId;
     std::string m_guildName;
@@ -121,6 +122,7 @@ class GuildSidebar : public Fl_Group {
     std::string m_bannerUrl;
     std::string m_bannerHash;
     Fl_RGB_Image *m_bannerImage = nullptr;
+    std::string m_pinnedBannerUrl;
     std::unique_ptr<GifAnimation> m_bannerGif;
     AnimationManager::AnimationId m_bannerAnimationId = 0;
     bool m_isAnimatedBanner = false;
@@ -156,7 +158,8 @@ class GuildSidebar : public Fl_Group {
     int calculateContentHeight() const;
     void loadBannerImage();
     bool ensureBannerGifLoaded();
-    bool updateBannerAnimation();
+    double updateBannerAnimation(double elapsed);
     void startBannerAnimation();
     void stopBannerAnimation();
+    void setBannerAnimationSuspended(bool suspended);
 };
@@ -1,7 +1,12 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_set>
 #include <vector>
 
@@ -11,32 +16,64 @@
 
 class MessageWidget {
   public:
+    /**
+     * @brief One laid-out token
+     * @note Plain value: the text is a span of the owning ShapedContent::text and URLs and cache keys are
+     *       ids into ShapedContent::strings (0 means none), so copying and wrapping items never allocates
+     */
     struct InlineItem {
-        enum class Kind { Text, LineBreak, Emoji };
+        enum class Kind : uint8_t { Text, LineBreak, Emoji };
 
         Kind kind = Kind::Text;
-        std::string text;
-        int width = 0;
-        Fl_Font font = 0;
-        int size = 0;
-        Fl_Color color = 0;
-        std::string linkUrl;
         bool isLink = false;
         bool underline = false;
         bool strikethrough = false;
         bool preserveWhitespace = false;
         bool isCodeBlock = false;
-        std::string emojiUrl;
-        std::string emojiCacheKey;
+        uint32_t textOffset = 0;
+        uint32_t textLength = 0;
+        uint32_t linkUrl = 0;
+        uint32_t emojiUrl = 0;
+        uint32_t emojiCacheKey = 0;
+        int width = 0;
+        Fl_Font font = 0;
+        int size = 0;
+        Fl_Color color = 0;
         int emojiSize = 0;
     };
 
+    /**
+     * @brief A wrapped line: itemCount items of Layout::items starting at firstItem
+     */
     struct LayoutLine {
-        std::vector<InlineItem> items;
+        uint32_t firstItem = 0;
+        uint32_t itemCount = 0;
         int width = 0;
         bool isCodeBlock = false;
     };
 
+    /**
+     * @brief Width-independent stage of a layout: parsed, emoji-matched and measured tokens
+     * @note Shared between layouts of the same message so a resize only re-wraps
+     */
+    struct ShapedContent {
+        std::string text;                 // Arena holding the text of every token back to back
+        std::vector<std::string> strings; // Interned URLs and cache keys; id N is strings[N - 1]
+        std::vector<InlineItem> tokens;
+        std::string username;
+        std::string time;
+        std::string systemIconName;
+        Fl_Color systemIconColor = 0;
+        int maxTextSize = 0;
+        int maxEmojiSize = 0;
+        bool hasContent = false;
+        uint64_t generation = 0; // shapingGeneration() when shaped
+
+        std::string_view textOf(const InlineItem &item) const;
+        const std::string &stringOf(uint32_t id) const;
+        size_t memoryBytes() const;
+    };
+
     struct ReplyPreview {
         std::string author;
         std::string content;
@@ -123,21 +160,93 @@ class MessageWidget {
         std::string time;
         std::string systemIconName;
         Fl_Color systemIconColor = 0;
+        std::vector<InlineItem> items;
         std::vector<LayoutLine> lines;
-        std::vector<InlineItem> replyItems;
         std::vector<StickerLayout> stickers;
         std::vector<AttachmentLayout> attachments;
         std::vector<ReactionLayout> reactions;
+        std::shared_ptr<const ShapedContent> shaped;
+        std::shared_ptr<const ShapedContent> reply;
+
+        /**
+         * @brief Approximate heap and inline bytes held by this layout, including its shaped content
+         */
+        size_t memoryBytes() const;
     };
 
+    struct LayoutRequest {
+        Message message;
+        std::shared_ptr<const ShapedContent> shaped;
+        std::optional<ReplyPreview> replyPreview;
+        int viewWidth = 0;
+        bool grouped = false;
+        bool compactBottom = false;
+    };
+
+    using LayoutCallback = std::function<void(std::shared_ptr<const Layout>)>;
+    using DamageHandler = std::function<void(int x, int y, int w, int h)>;
+
+    static std::shared_ptr<const ShapedContent> shapeMessage(const Message &msg);
+
+    /**
+     * @brief Current local day and TextMetrics epoch; shaped content from another generation is stale
+     * @note The day is part of it because the "Today"/"Yesterday" timestamps are baked into the shaped content
+     */
+    static uint64_t shapingGeneration();
     static Layout buildLayout(const Message &msg, int viewWidth, bool isGrouped, bool compactBottom,
                               const ReplyPreview *replyPreview);
-    static void draw(const Message &msg, const Layout &layout, int originX, int originY, bool avatarHovered);
+
+    /**
+     * @brief Wrap and position previously shaped content for a view width
+     */
+    static Layout buildLayout(const Message &msg, std::shared_ptr<const ShapedContent> shaped, int viewWidth,
+                              bool isGrouped, bool compactBottom, const ReplyPreview *replyPreview);
+
+    /**
+     * @brief Build a layout on the layout worker pool
+     * @param request Self-contained copy of everything the layout depends on
+     * @param callback Invoked on the UI thread with the finished layout, or nullptr if building failed
+     * @note Font metrics come from TextMetrics; glyphs the workers have not seen are measured on the UI
+     *       thread and the layout is rebuilt before the callback runs
+     */
+    static void buildLayoutAsync(LayoutRequest request, LayoutCallback callback);
+
+    /**
+     * @brief Draw a laid-out message with its top-left corner at originX, originY
+     * @return true when the output is final for this layout: no image was still loading and nothing animated
+     *         or hover-dependent was drawn, so the pixels may be cached and reused
+     */
+    static bool draw(const Message &msg, const Layout &layout, int originX, int originY, bool avatarHovered);
     static std::string getAvatarCacheKey(const Message &msg, int size);
     static std::string getAnimatedAvatarKey(const Message &msg, int size);
     static std::string getAttachmentDownloadKey(const Message &msg, size_t attachmentIndex);
     static void setHoveredAvatarKey(const std::string &key);
     static void setHoveredAttachmentDownloadKey(const std::string &key);
+
+    /**
+     * @brief Send the rectangles of animated avatars, emoji and stickers to handler when their frame changes
+     * @param owner Identifies the caller; only the same owner can clear the handler again
+     * @note Draws report each animation's window rectangle; without a handler a new frame redraws every window
+     */
+    static void setDamageHandler(const void *owner, DamageHandler handler);
+    static void clearDamageHandler(const void *owner);
+
+    /**
+     * @brief Forget the reported animation rectangles, before a full repaint reports them again
+     */
+    static void clearAnimatedRects();
+
+    /**
+     * @brief Offset added to reported rectangles, for draws into an offscreen that is copied to x, y
+     */
+    static void setAnimatedRectOrigin(int x, int y);
+
+    /**
+     * @brief Suspend running animations whose reported rectangles all lie outside the viewport, resume the rest
+     * @note An empty viewport suspends every animation, e.g. while the message list is hidden
+     */
+    static void setAnimationViewport(int x, int y, int w, int h);
+
     static void pruneAvatarCache(const std::unordered_set<std::string> &keepKeys);
     static void pruneAnimatedAvatarCache(const std::unordered_set<std::string> &keepKeys);
     static void pruneAnimatedEmojiCache(const std::unordered_set<std::string> &keepKeys);
@@ -147,8 +256,7 @@ class MessageWidget {
     static void pruneEmojiCache(const std::unordered_set<std::string> &keepKeys);
 
   private:
-    static std::vector<InlineItem> tokenizeText(const std::string &text, Fl_Font font, int size, Fl_Color color);
-    static std::vector<LayoutLine> wrapText(const std::string &text, int maxWidth);
-    static std::vector<LayoutLine> wrapTokens(const std::vector<InlineItem> &tokens, int maxWidth, int codeBlockMaxWidth);
-    static std::vector<InlineItem> splitLongToken(const InlineItem &token, int maxWidth);
+    static std::vector<LayoutLine> wrapTokens(const ShapedContent &content, int maxWidth, int codeBlockMaxWidth,
+                                              std::vector<InlineItem> &items);
+    static std::vector<InlineItem> splitLongToken(const ShapedContent &content, const InlineItem &token, int maxWidth);
 };
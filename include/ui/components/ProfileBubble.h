@@ -8,8 +8,7 @@
 #include <vector>
 
 #include "ui/AnimationManager.h"
-
-class GifAnimation;
+#include "ui/AnimationRegistry.h"
 
 class ProfileBubble : public Fl_Widget {
   public:
@@ -75,19 +74,16 @@ class ProfileBubble : public Fl_Widget {
     int m_hoveredButton = -1;
     bool m_hoveredButtonChevron = false;
 
-    Fl_RGB_Image *m_avatarImage = nullptr;
     Fl_RGB_Image *m_circularAvatar = nullptr;
     Fl_RGB_Image *m_customStatusEmoji = nullptr;
 
-    std::unique_ptr<GifAnimation> m_avatarGif;
-    std::vector<std::unique_ptr<Fl_RGB_Image>> m_circularFrames;
-    double m_avatarFrameTimeAccumulated = 0.0;
+    AnimationRegistry::Handle m_avatarGif;
     AnimationManager::AnimationId m_avatarAnimationId = 0;
+    bool m_avatarSuspended = false; // Hidden, so playback is suspended
 
-    std::unique_ptr<GifAnimation> m_emojiGif;
-    std::vector<std::unique_ptr<Fl_RGB_Image>> m_emojiFrames;
-    double m_emojiFrameTimeAccumulated = 0.0;
+    AnimationRegistry::Handle m_emojiGif;
     AnimationManager::AnimationId m_emojiAnimationId = 0;
+    bool m_emojiSuspended = false;
 
     std::function<void()> m_onSettingsClicked;
     std::function<void()> m_onMicrophoneClicked;
@@ -118,6 +114,6 @@ class ProfileBubble : public Fl_Widget {
     bool isChevronHovered(int btnX, int btnY, bool isToggle, int mx, int my) const;
     void loadAvatar();
     void loadCustomStatusEmoji();
-    bool updateAvatarAnimation();
-    bool updateEmojiAnimation();
+    double updateAvatarAnimation();
+    double updateEmojiAnimation();
 };
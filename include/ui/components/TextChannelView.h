@@ -3,6 +3,8 @@
 #include <FL/Fl_Group.H>
 #include <FL/Fl_Input.H>
 #include <FL/Fl_Scroll.H>
+#include <FL/fl_draw.H>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
@@ -81,7 +83,45 @@ class TextChannelView : public Fl_Group {
     };
 
     struct LayoutCacheEntry {
-        MessageWidget::Layout layout;
+        std::shared_ptr<const MessageWidget::Layout> layout;
+        int width = 0;
+        bool grouped = false;
+        bool compactBottom = false;
+    };
+
+    /**
+     * @brief Offscreen copy of a drawn message, blitted while scrolling instead of redrawing it
+     */
+    struct MessageTile {
+        Fl_Offscreen offscreen = 0;
+        int offscreenW = 0;
+        int offscreenH = 0;
+        std::shared_ptr<const MessageWidget::Layout> layout; // Layout the tile was last drawn from
+        int width = 0;
+        bool valid = false;   // The offscreen holds final pixels for layout at width
+        bool dynamic = false; // The last draw was not final, so the message is drawn directly until it is
+        uint64_t lastUsedFrame = 0;
+    };
+
+    /**
+     * @brief A message drawn by the last full repaint, redrawn in place when an animation in it damages the view
+     */
+    struct DrawnMessage {
+        const Message *msg = nullptr; // Points into m_messages or m_pendingMessages, cleared when they change
+        std::shared_ptr<const MessageWidget::Layout> layout;
+        int y = 0;
+        bool avatarHovered = false;
+    };
+
+    struct DamageRect {
+        int x = 0;
+        int y = 0;
+        int w = 0;
+        int h = 0;
+    };
+
+    struct PendingLayout {
+        uint64_t ticket = 0;
         int width = 0;
         bool grouped = false;
         bool compactBottom = false;
@@ -89,6 +129,15 @@ class TextChannelView : public Fl_Group {
 
     int estimateMessageHeight(const Message &msg, bool isGrouped) const;
     int estimatedLineCount(const Message &msg) const;
+    void requestLayout(const Message &msg, const MessageWidget::ReplyPreview *replyPreview, bool grouped,
+                       bool compactBottom);
+    void drawMessageTile(const Message &msg, const std::shared_ptr<const MessageWidget::Layout> &layout, int messageY,
+                         bool avatarHovered);
+    void pruneMessageTiles();
+    void clearMessageTiles();
+    void flushStaleMessageTiles();
+    void damageMessageRect(int rx, int ry, int rw, int rh);
+    bool drawDamagedMessages();
 
     std::string m_channelId;
     std::string m_channelName;
@@ -120,6 +169,19 @@ class TextChannelView : public Fl_Group {
 
     std::unordered_map<std::string, LayoutCacheEntry> m_layoutCache;
     std::unordered_map<std::string, int> m_heightEstimateCache;
+    std::unordered_map<std::string, PendingLayout> m_pendingLayouts;
+    std::unordered_map<std::string, MessageTile> m_messageTiles;
+    size_t m_messageTileBytes = 0;
+    uint64_t m_tileFrame = 0;
+    // What every tile was rendered under; a change to any of them flushes all tiles
+    float m_tileScale = 0.0f;
+    uint64_t m_tileMetricsEpoch = 0;
+    Fl_Color m_tileBackground = 0;
+    Fl_Color m_tileForeground = 0;
+    std::vector<DrawnMessage> m_drawnMessages;
+    std::vector<DamageRect> m_damageRects;
+    uint64_t m_nextLayoutTicket = 0;
+    std::shared_ptr<bool> m_isAlive;
 
     std::vector<int> m_itemYPositions;
     std::vector<int> m_separatorYPositions;
@@ -135,4 +197,7 @@ class TextChannelView : public Fl_Group {
     static constexpr int MESSAGE_INPUT_HEIGHT = 74;
     static constexpr int MESSAGE_SPACING = 4;
     static constexpr int MESSAGE_GROUP_SPACING = 18;
+    static constexpr size_t MAX_TILE_BYTES = 64 * 1024 * 1024;
+    static constexpr int MAX_TILE_HEIGHT = 2048;
+    static constexpr size_t MAX_DAMAGE_RECTS = 256;
 };
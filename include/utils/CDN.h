@@ -36,10 +36,10 @@ inline int normalizeSize(int size) {
 /**
  * @brief Get the file extension for an image hash
  * @param hash The image hash
- * @param preferWebp Whether to prefer .webp over .png for static images
+ * @param preferWebp Whether to prefer .webp over .png for static images (default true, WebP is much smaller)
  * @return ".gif" for animated images, ".png" or ".webp" for static
  */
-std::string getImageExtension(const std::string &hash, bool preferWebp = false);
+std::string getImageExtension(const std::string &hash, bool preferWebp = true);
 
 /**
  * @brief Construct user avatar URL
@@ -80,11 +80,11 @@ std::string getUserBannerUrl(const std::string &userId, const std::string &banne
  * @param guildId Guild's snowflake ID
  * @param iconHash Guild's icon hash
  * @param size Desired size (default 256)
- * @param preferWebp Whether to prefer .webp over .png for static images (default false)
+ * @param preferWebp Whether to prefer .webp over .png for static images (default true)
  * @return CDN URL for guild icon
  */
 std::string getGuildIconUrl(const std::string &guildId, const std::string &iconHash, int size = 256,
-                            bool preferWebp = false);
+                            bool preferWebp = true);
 
 /**
  * @brief Construct guild splash URL
@@ -130,7 +130,7 @@ std::string getMemberAvatarUrl(const std::string &guildId, const std::string &us
  * @param emojiId Emoji's snowflake ID
  * @param animated Whether the emoji is animated
  * @param size Desired size (default 128)
- * @return CDN URL for custom emoji
+ * @return CDN URL for custom emoji (.gif when animated, .webp otherwise)
  */
 std::string getEmojiUrl(const std::string &emojiId, bool animated, int size = 128);
 
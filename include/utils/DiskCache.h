@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace DiskCache {
+
+constexpr uint64_t DEFAULT_MAX_BYTES = 512ull * 1024 * 1024;
+
+struct Entry {
+    std::string key;
+    std::string format;
+    uint64_t size{0};
+    int64_t lastAccess{0};
+    int64_t expiresAt{0};
+    uint64_t useOrder{0}; // Larger is more recently used; not persisted, lastAccess is too coarse to evict by
+    std::string etag;
+
+    bool isExpired(int64_t now) const { return expiresAt > 0 && now >= expiresAt; }
+};
+
+struct Stats {
+    size_t entries{0};
+    uint64_t bytes{0};
+    uint64_t maxBytes{0};
+    uint64_t evictions{0};
+};
+
+/**
+ * @brief Stable, platform independent cache key for a URL (128-bit FNV-1a, hex encoded)
+ */
+std::string keyFor(const std::string &url);
+
+std::string directory();
+
+/**
+ * @brief Look up index metadata without touching the filesystem
+ */
+std::optional<Entry> lookup(const std::string &url);
+
+/**
+ * @brief Read a cached blob and mark it as recently used
+ * @return Blob contents, or nullopt when missing or unreadable (the stale index entry is dropped)
+ */
+std::optional<std::string> read(const std::string &url);
+
+/**
+ * @brief Write a blob and its validation metadata, evicting least recently used blobs beyond the size cap
+ * @note The blob is written to a temporary file and renamed into place; it is never evicted by its own store
+ * @param maxAgeSeconds Freshness lifetime from Cache-Control, or 0 when the response had none
+ */
+void store(const std::string &url, const std::string &data, const std::string &format, const std::string &etag,
+           int64_t maxAgeSeconds);
+
+/**
+ * @brief Extend the lifetime of an entry after a 304 revalidation
+ */
+void refresh(const std::string &url, int64_t maxAgeSeconds);
+
+void remove(const std::string &url);
+
+void setMaxBytes(uint64_t maxBytes);
+
+/**
+ * @brief Persist the index if it changed since the last flush
+ */
+void flush();
+
+/**
+ * @brief Persist the index and mark the cache closed cleanly, so the next start trusts the index instead of
+ *        checking it against every file in the directory
+ * @note A later store() marks the cache open again
+ */
+void shutdown();
+
+void clear();
+
+Stats getStats();
+
+} // namespace DiskCache
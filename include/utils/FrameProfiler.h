@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * UI thread frame profiler. Scopes time draw, event, store-notify and animation work; the busy time of the
+ * top-level scopes between two flushed frames is that frame's time. Recording is off until enabled, either
+ * with setEnabled() or by setting DISCOVE_FRAME_PROFILER in the environment, and scopes on other threads are
+ * ignored.
+ */
+namespace FrameProfiler {
+
+static constexpr double SLOW_FRAME_MS = 16.0;
+
+// Upper bounds in milliseconds of the frame time histogram buckets; the last bucket has no upper bound
+static constexpr std::array<double, 6> HISTOGRAM_BOUNDS_MS = {4.0, 8.0, 16.0, 33.0, 50.0, 100.0};
+static constexpr size_t HISTOGRAM_BUCKETS = HISTOGRAM_BOUNDS_MS.size() + 1;
+
+struct Stats {
+    uint64_t frames = 0;     // Since the profiler was enabled
+    uint64_t slowFrames = 0; // Frames over SLOW_FRAME_MS since the profiler was enabled
+    double p50Ms = 0.0;      // Percentiles and maximum over the recent frames
+    double p95Ms = 0.0;
+    double p99Ms = 0.0;
+    double maxMs = 0.0;
+    std::array<uint64_t, HISTOGRAM_BUCKETS> histogram{}; // Recent frames by HISTOGRAM_BOUNDS_MS bucket
+};
+
+/**
+ * @brief Time the enclosing block under name, which must outlive the profiler (a string literal)
+ */
+class Scope {
+  public:
+    explicit Scope(const char *name);
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    const char *name_;
+    double startUs_ = 0.0;
+    bool active_ = false;
+};
+
+/**
+ * @brief Start or stop recording; stats and the trace are cleared when recording starts
+ * @note Call on the UI thread: the thread that enables the profiler is the one it records
+ */
+void setEnabled(bool enabled);
+bool isEnabled();
+
+/**
+ * @brief Enable recording if DISCOVE_FRAME_PROFILER is set
+ */
+void initFromEnvironment();
+
+/**
+ * @brief Close the current frame; called once a window has been flushed
+ */
+void endFrame();
+
+Stats stats();
+
+/**
+ * @brief One line summary of the recent frame times, e.g. for an overlay
+ */
+std::string summary();
+
+/**
+ * @brief Log the frame time histogram and the scopes that took the most time
+ */
+void logReport();
+
+/**
+ * @brief Write the recorded scopes and frames as a Chrome trace-event JSON file (chrome://tracing, Perfetto)
+ * @return false if the file could not be written
+ */
+bool writeTrace(const std::string &path);
+
+} // namespace FrameProfiler
@@ -2,32 +2,130 @@
 
 #include <FL/Fl_Image.H>
 #include <FL/Fl_RGB_Image.H>
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
 
 namespace Images {
 
 using ImageCallback = std::function<void(Fl_RGB_Image *)>;
+using OwnedImageCallback = std::function<void(std::unique_ptr<Fl_RGB_Image>)>;
+// Derives a new image from a scaled download (e.g. makeCircular); runs on the download worker
+using ImagePrepare = std::function<Fl_RGB_Image *(Fl_RGB_Image *)>;
 
+enum class ScaleMode {
+    Fill,  // Stretch to exactly width x height
+    Cover, // Preserve aspect ratio, centre-crop the overflow
+};
+
+constexpr size_t DEFAULT_MEMORY_BUDGET_BYTES = 256 * 1024 * 1024;
+
+struct CacheStats {
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t evictions{0};
+    size_t entries{0};
+    size_t pinned{0};
+    size_t bytes{0};
+    size_t budgetBytes{0};
+};
+
+struct DownloadStats {
+    uint64_t requests{0};
+    uint64_t bytes{0};
+};
+
+/**
+ * @brief Load an image into the memory cache
+ * @param callback Called on the UI thread with the image (owned by the cache), or nullptr on failure
+ * @note The image is only guaranteed to stay resident until the callback returns; pin it to keep the pointer
+ */
 void loadImageAsync(const std::string &url, ImageCallback callback);
 
+/**
+ * @brief Load an image resampled to its display size on the download worker
+ * @param url Image URL
+ * @param width Target width in pixels
+ * @param height Target height in pixels
+ * @param callback Called on the UI thread with the scaled image (owned by the cache), or nullptr on failure
+ * @param mode How the source aspect ratio is mapped onto the target size
+ * @note Only the scaled bitmap is kept in memory, under scaledCacheKey(url, width, height, mode); as with
+ *       loadImageAsync it has to be pinned to be held past the callback
+ */
+void loadScaledImageAsync(const std::string &url, int width, int height, ImageCallback callback,
+                          ScaleMode mode = ScaleMode::Fill);
+
+/**
+ * @brief Load an image resampled (and optionally post-processed) on the download worker, for a caller that keeps
+ *        its own copy
+ * @param callback Called on the UI thread with an image the caller now owns, or nullptr on failure
+ * @param prepare Optional step run on the scaled image before it is handed over; its result replaces it
+ * @note Nothing is added to the memory cache. Requests for the same URL at any size share one download and decode.
+ */
+void takeScaledImageAsync(const std::string &url, int width, int height, OwnedImageCallback callback,
+                          ScaleMode mode = ScaleMode::Fill, ImagePrepare prepare = nullptr);
+
+/**
+ * @brief Memory cache key of a scaled image; accepted by getCachedImage, pinImage, unpinImage and evictFromMemory
+ */
+std::string scaledCacheKey(const std::string &url, int width, int height, ScaleMode mode = ScaleMode::Fill);
+
 Fl_RGB_Image *getCachedImage(const std::string &url);
 
+/**
+ * @brief Drop a decoded image from the memory cache
+ * @note Pinned images are kept until they are unpinned
+ */
 void evictFromMemory(const std::string &url);
 
-std::string getCacheFilePath(const std::string &url, const std::string &extension);
+/**
+ * @brief Keep an image resident while a widget holds its pointer (e.g. while it is on screen)
+ * @note Pins are reference counted; every pinImage must be matched by an unpinImage
+ */
+void pinImage(const std::string &url);
+
+void unpinImage(const std::string &url);
+
+/**
+ * @brief Set the byte budget for decoded bitmaps; least recently used unpinned images are evicted beyond it
+ * @param bytes Budget in bytes of decoded pixel data (defaults to DEFAULT_MEMORY_BUDGET_BYTES)
+ */
+void setMemoryBudget(size_t bytes);
+
+CacheStats getCacheStats();
+
+/**
+ * @brief Contents of the disk-cached download of url, if it was stored in the given format ("gif", "png", ...)
+ * @note Read through the disk cache index rather than by path, since the blob can be evicted at any time
+ */
+std::optional<std::string> readCachedFile(const std::string &url, const std::string &format);
 
 void clearCache();
 
 void shutdownDownloadWorker();
 
+/**
+ * @brief Network bytes fetched per detected image format since startup
+ * @return Map of format ("png", "gif", "jpeg", "webp", "unknown") to request count and byte total
+ */
+std::unordered_map<std::string, DownloadStats> getDownloadStats();
+
+/**
+ * @brief Resample an image with area averaging (linear interpolation when enlarging)
+ * @return New image with the source depth, or nullptr on failure
+ * @note Safe to call off the UI thread; caller is responsible for deleting the returned image
+ */
+Fl_RGB_Image *scaleImage(const Fl_RGB_Image *source, int width, int height, ScaleMode mode = ScaleMode::Fill);
+
 /**
  * @brief Create a circular image from the source image
  * @param source Source image to mask
  * @param diameter Diameter of the circle (will be scaled to fit)
  * @return New circular image, or nullptr on failure
+ * @note Edges are anti-aliased with a coverage mask that is computed once per diameter
  * @note Caller is responsible for deleting the returned image
  */
 Fl_RGB_Image *makeCircular(Fl_RGB_Image *source, int diameter);
@@ -39,6 +137,7 @@ Fl_RGB_Image *makeCircular(Fl_RGB_Image *source, int diameter);
  * @param height Target height
  * @param radius Corner radius in pixels
  * @return New rounded image, or nullptr on failure
+ * @note Edges are anti-aliased with a coverage mask that is computed once per size and radius
  * @note Caller is responsible for deleting the returned image
  */
 Fl_RGB_Image *makeRoundedRect(Fl_RGB_Image *source, int width, int height, int radius);
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Row kernels for the pixel loops of GIF compositing, avatar masking and emoji tinting. Each one has an SSE2
+ * (x86-64) or NEON (ARM64) path and a scalar fallback; builds configured with DISCOVE_AVX2 add AVX2 and SSSE3
+ * paths. Buffers may be unaligned; source and destination must not overlap. RGBA buffers are 4 bytes per pixel
+ * in R, G, B, A order.
+ */
+namespace PixelKernels {
+
+/**
+ * @brief Columns [begin, end) of a row that lie inside a mask shape
+ */
+struct Span {
+    int begin = 0;
+    int end = 0;
+};
+
+/**
+ * @brief Anti-aliased shape: the fraction of each pixel inside it, and per row the columns it touches at all
+ *        and the columns it covers fully
+ */
+struct CoverageMask {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> coverage; // width * height, 255 where the pixel is fully inside
+    std::vector<Span> covered;     // By row, columns with any coverage
+    std::vector<Span> opaque;      // By row, columns with full coverage; always within covered
+};
+
+/**
+ * @brief Circle inscribed in a diameter x diameter square
+ */
+CoverageMask circleMask(int diameter);
+
+/**
+ * @brief Width x height rectangle with corners rounded by radius
+ */
+CoverageMask roundedRectMask(int width, int height, int radius);
+
+/**
+ * @brief Write the palette color of each index into a row of RGBA pixels
+ * @param palette 256 entries, each an opaque RGBA color or 0 to leave the destination pixel as it is (the
+ *                transparent index and indices past the color map)
+ */
+void expandPalette(const uint8_t *indices, size_t count, const uint32_t *palette, uint8_t *dst);
+
+/**
+ * @brief Convert a row of 1 to 4 channel pixels (gray, gray + alpha, RGB, RGBA) to RGBA; sources without an
+ *        alpha channel become opaque
+ */
+void toRgba(const uint8_t *src, int depth, size_t count, uint8_t *dst);
+
+/**
+ * @brief Multiply the alpha of a row of RGBA pixels by coverage, where 255 leaves it unchanged
+ */
+void scaleAlpha(uint8_t *rgba, const uint8_t *coverage, size_t count);
+
+/**
+ * @brief Copy an image of the mask's size into a tightly packed RGBA buffer with alpha multiplied by coverage
+ */
+void applyMask(const uint8_t *src, int depth, size_t srcLineSize, const CoverageMask &mask, uint8_t *dst);
+
+/**
+ * @brief Paint every inked pixel of an RGB or RGBA row in a flat color, keeping alpha
+ * @note Inked pixels are the ones with non-zero alpha, or any non-black pixel for RGB sources
+ */
+void tint(const uint8_t *src, int depth, size_t count, uint8_t red, uint8_t green, uint8_t blue, uint8_t *dst);
+
+} // namespace PixelKernels
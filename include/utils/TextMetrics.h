@@ -0,0 +1,84 @@
+#pragma once
+
+#include <FL/Enumerations.H>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace TextMetrics {
+
+/**
+ * @brief Width of UTF-8 text, summed from cached per-codepoint advances
+ * @note Text with tabs, control characters or non-ASCII is measured whole with fl_width() instead, cached per
+ *       string
+ * @param text UTF-8 text (invalid bytes are measured as U+FFFD)
+ * @param font FLTK font id
+ * @param size Font size in pixels
+ * @return Width in pixels, without kerning
+ * @note On the UI thread a cache miss measures the glyph and may change the current fl_font();
+ *       inside a WorkerScope it returns an estimate and marks the scope as incomplete instead
+ */
+double advance(std::string_view text, Fl_Font font, int size);
+
+/**
+ * @brief Integer width of UTF-8 text, truncated the same way as static_cast<int>(fl_width(...))
+ */
+int width(std::string_view text, Fl_Font font, int size);
+
+/**
+ * @brief Length in bytes of the longest prefix whose width does not exceed maxWidth
+ * @param fittedWidth Receives the width of the returned prefix when not null
+ * @return Byte count on a UTF-8 boundary, possibly 0
+ */
+size_t fitPrefix(std::string_view text, double maxWidth, Fl_Font font, int size, double *fittedWidth = nullptr);
+
+/**
+ * @brief Length in bytes of the first UTF-8 sequence of text (1 for invalid lead bytes, 0 when empty)
+ */
+size_t codepointLength(std::string_view text);
+
+/**
+ * @brief Cached fl_height() for a font
+ */
+int height(Fl_Font font, int size);
+
+/**
+ * @brief Cached fl_descent() for a font
+ */
+int descent(Fl_Font font, int size);
+
+/**
+ * @brief Marks the current thread as a worker for its lifetime: measurements never call into FLTK
+ *
+ * Glyphs or fonts that have not been measured yet are estimated and queued; the owner should call
+ * resolvePending() on the UI thread and redo the work when missed() is true.
+ */
+class WorkerScope {
+  public:
+    WorkerScope();
+    ~WorkerScope();
+
+    WorkerScope(const WorkerScope &) = delete;
+    WorkerScope &operator=(const WorkerScope &) = delete;
+
+    bool missed() const;
+};
+
+/**
+ * @brief Measure glyphs and fonts requested by workers since the last call
+ * @note Must be called on the UI thread
+ */
+void resolvePending();
+
+/**
+ * @brief Drop every cached measurement, e.g. after the display scale or the loaded fonts changed
+ * @note Must be called on the UI thread; bumps epoch() so results derived from old measurements can be redone
+ */
+void invalidate();
+
+/**
+ * @brief Generation of the cached measurements; changes whenever invalidate() drops them
+ */
+uint64_t epoch();
+
+} // namespace TextMetrics
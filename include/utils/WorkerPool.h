@@ -0,0 +1,24 @@
+#pragma once
+
+#include <functional>
+
+/**
+ * Small pool of background threads shared by CPU-bound UI work (message layout, animation decoding). Threads
+ * are started on demand and are owned by the pool, so they can be stopped and joined before the process
+ * starts tearing down the state their jobs touch.
+ */
+namespace WorkerPool {
+
+/**
+ * @brief Run job on a pool thread
+ * @note Jobs posted after shutdown() are dropped
+ */
+void post(std::function<void()> job);
+
+/**
+ * @brief Drop queued jobs, wait for running ones to finish and join every thread
+ * @note Call on the UI thread once the event loop has returned; jobs must not wait on the UI thread
+ */
+void shutdown();
+
+} // namespace WorkerPool
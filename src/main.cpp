@@ -14,12 +14,15 @@
 #include <FL/Fl_Button.H>
 #include <FL/Fl_Double_Window.H>
 #include <FL/Fl_Image.H>
+#include <FL/fl_draw.H>
 
 #ifdef _WIN32
 #include <FL/x.H>
 #include <windows.h>
 #endif
 
+#include <ctime>
+#include <filesystem>
 #include <string>
 
 #include "data/Database.h"
@@ -38,10 +41,14 @@
 #include "ui/EmojiManager.h"
 #include "ui/GifAnimation.h"
 #include "ui/Theme.h"
+#include "utils/DiskCache.h"
 #include "utils/Fonts.h"
+#include "utils/FrameProfiler.h"
 #include "utils/Logger.h"
 #include "utils/Secrets.h"
+#include "utils/TextMetrics.h"
 #include "utils/Uuid.h"
+#include "utils/WorkerPool.h"
 
 const int INITIAL_WINDOW_WIDTH = 1280;
 const int INITIAL_WINDOW_HEIGHT = 720;
@@ -105,12 +112,100 @@ class AppWindow : public Fl_Double_Window {
     using Fl_Double_Window::Fl_Double_Window;
 
     int handle(int event) override {
+        FrameProfiler::Scope profile("AppWindow::handle");
         if (event == FL_ACTIVATE || event == FL_DEACTIVATE || event == FL_SHOW || event == FL_HIDE || event == FL_FOCUS ||
             event == FL_UNFOCUS) {
             syncAnimationPauseState();
         }
+        // F12 toggles the frame time overlay, Shift+F12 writes a trace of the frames recorded so far
+        if (event == FL_SHORTCUT && Fl::event_key() == FL_F + 12) {
+            if (Fl::event_state(FL_SHIFT)) {
+                dumpFrameTrace();
+            } else {
+                toggleProfilerOverlay();
+            }
+            return 1;
+        }
         return Fl_Double_Window::handle(event);
     }
+
+    void flush() override {
+        {
+            FrameProfiler::Scope profile("AppWindow::flush");
+            Fl_Double_Window::flush();
+        }
+        FrameProfiler::endFrame();
+    }
+
+  protected:
+    void draw() override {
+        Fl_Double_Window::draw();
+        if (m_profilerOverlay) {
+            drawProfilerOverlay();
+        }
+    }
+
+  private:
+    static constexpr int OVERLAY_WIDTH = 560;
+    static constexpr int OVERLAY_HEIGHT = 24;
+    static constexpr double OVERLAY_REFRESH_SECONDS = 0.5;
+
+    void toggleProfilerOverlay() {
+        m_profilerOverlay = !m_profilerOverlay;
+        if (m_profilerOverlay) {
+            FrameProfiler::setEnabled(true);
+            Fl::add_timeout(OVERLAY_REFRESH_SECONDS, refreshProfilerOverlay, this);
+        } else {
+            Fl::remove_timeout(refreshProfilerOverlay, this);
+        }
+        damageProfilerOverlay();
+    }
+
+    // Only the overlay corner is repainted, so refreshing it barely shows up in the numbers it reports.
+    // FL_DAMAGE_EXPOSE would just copy the stale back buffer; USER1 redraws the region into it first.
+    void damageProfilerOverlay() {
+        damage(FL_DAMAGE_USER1, w() - OVERLAY_WIDTH, h() - OVERLAY_HEIGHT, OVERLAY_WIDTH, OVERLAY_HEIGHT);
+    }
+
+    static void refreshProfilerOverlay(void *data) {
+        auto *window = static_cast<AppWindow *>(data);
+        window->damageProfilerOverlay();
+        Fl::repeat_timeout(OVERLAY_REFRESH_SECONDS, refreshProfilerOverlay, data);
+    }
+
+    void drawProfilerOverlay() {
+        const std::string text = FrameProfiler::summary();
+        const int boxX = w() - OVERLAY_WIDTH;
+        const int boxY = h() - OVERLAY_HEIGHT;
+
+        fl_push_clip(boxX, boxY, OVERLAY_WIDTH, OVERLAY_HEIGHT);
+        fl_color(ThemeColors::BG_TERTIARY);
+        fl_rectf(boxX, boxY, OVERLAY_WIDTH, OVERLAY_HEIGHT);
+        fl_color(FrameProfiler::stats().p95Ms > FrameProfiler::SLOW_FRAME_MS ? ThemeColors::STATUS_DANGER
+                                                                             : ThemeColors::TEXT_NORMAL);
+        fl_font(FontLoader::Fonts::INTER_REGULAR, 12);
+        fl_draw(text.c_str(), boxX, boxY, OVERLAY_WIDTH - 8, OVERLAY_HEIGHT, FL_ALIGN_RIGHT);
+        fl_pop_clip();
+    }
+
+    void dumpFrameTrace() {
+        if (!FrameProfiler::isEnabled()) {
+            FrameProfiler::setEnabled(true);
+            Logger::info("FrameProfiler: Recording started; press Shift+F12 again to write the trace");
+            return;
+        }
+
+        std::error_code error;
+        std::filesystem::path directory = std::filesystem::temp_directory_path(error);
+        if (error) {
+            directory = std::filesystem::current_path();
+        }
+        const std::string name = "discove-frames-" + std::to_string(std::time(nullptr)) + ".json";
+        FrameProfiler::logReport();
+        FrameProfiler::writeTrace((directory / name).string());
+    }
+
+    bool m_profilerOverlay = false;
 };
 
 int main(int argc, char **argv) {
@@ -125,11 +220,15 @@ int main(int argc, char **argv) {
             event == FL_UNFOCUS) {
             syncAnimationPauseState();
         }
+        if (event == FL_SCREEN_CONFIGURATION_CHANGED || event == FL_ZOOM_EVENT) {
+            TextMetrics::invalidate();
+        }
         return 0;
     });
 
     Logger::setLevel(Logger::Level::INFO);
     Logger::info("Application started");
+    FrameProfiler::initFromEnvironment();
 
     if (!Data::Database::get().initialize()) {
         Logger::error("Failed to initialize database");
@@ -280,5 +379,11 @@ int main(int argc, char **argv) {
     window->show(argc, argv);
     syncAnimationPauseState();
 
-    return Fl::run();
+    int exitCode = Fl::run();
+    WorkerPool::shutdown();
+    if (FrameProfiler::isEnabled()) {
+        FrameProfiler::logReport();
+    }
+    DiskCache::shutdown();
+    return exitCode;
 }
@@ -13,6 +13,7 @@
 #include "utils/Logger.h"
 #include "utils/Protobuf.h"
 
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
 #include <filesystem>
@@ -55,19 +56,32 @@ uint64_t lastMessageSortKey(const std::shared_ptr<DMChannel> &channel) {
     return parseSnowflake(*channel->lastMessageId);
 }
 
+bool privateChannelPrecedes(const std::shared_ptr<DMChannel> &a, const std::shared_ptr<DMChannel> &b) {
+    uint64_t ka = lastMessageSortKey(a);
+    uint64_t kb = lastMessageSortKey(b);
+    if (ka != kb) {
+        return ka > kb;
+    }
+    if (!a || !b) {
+        return static_cast<bool>(a) > static_cast<bool>(b);
+    }
+    return a->id > b->id;
+}
+
 void sortPrivateChannelsByLastMessage(std::vector<std::shared_ptr<DMChannel>> &channels) {
-    std::stable_sort(channels.begin(), channels.end(),
-                     [](const std::shared_ptr<DMChannel> &a, const std::shared_ptr<DMChannel> &b) {
-                         uint64_t ka = lastMessageSortKey(a);
-                         uint64_t kb = lastMessageSortKey(b);
-                         if (ka != kb) {
-                             return ka > kb;
-                         }
-                         if (!a || !b) {
-                             return static_cast<bool>(a) > static_cast<bool>(b);
-                         }
-                         return a->id > b->id;
-                     });
+    std::stable_sort(channels.begin(), channels.end(), privateChannelPrecedes);
+}
+
+// Move channels[index] to its place when every other channel is already in order, e.g. after it got a new message
+void repositionPrivateChannel(std::vector<std::shared_ptr<DMChannel>> &channels, size_t index) {
+    auto it = channels.begin() + static_cast<std::ptrdiff_t>(index);
+    auto before = std::upper_bound(channels.begin(), it, *it, privateChannelPrecedes);
+    if (before != it) {
+        std::rotate(before, it, it + 1);
+        return;
+    }
+    auto after = std::lower_bound(it + 1, channels.end(), *it, privateChannelPrecedes);
+    std::rotate(it, it + 1, after);
 }
 
 bool upsertUser(std::unordered_map<std::string, User> &users, const User &user) {
@@ -621,7 +635,7 @@ void Gateway::handleReady(const Json &data) {
                         }
 
                         if (!cs.emojiId.empty()) {
-                            std::string ext = cs.emojiAnimated ? "gif" : "png";
+                            std::string ext = cs.emojiAnimated ? "gif" : "webp";
                             cs.emojiUrl = "https://cdn.discordapp.com/emojis/" + cs.emojiId + "." + ext;
                             Logger::info("Custom status emoji URL: " + cs.emojiUrl);
                         }
@@ -868,6 +882,7 @@ void Gateway::handleReady(const Json &data) {
         size_t dmCount = privateChannels.size();
         Store::get().update([privateChannels = std::move(privateChannels), users = std::move(users)](AppState &appState) mutable {
             appState.privateChannels = std::move(privateChannels);
+            appState.privateChannelsRevision++;
 
             bool changed = false;
             for (auto &entry : users) {
@@ -1030,18 +1045,18 @@ void Gateway::handleMessageCreate(const Json &data) {
                 }
             }
 
-            bool dmChannelUpdated = false;
-            for (auto &dm : state.privateChannels) {
+            for (size_t i = 0; i < state.privateChannels.size(); ++i) {
+                auto &dm = state.privateChannels[i];
                 if (dm && dm->id == message.channelId) {
-                    dm->lastMessageId = message.id;
-                    dmChannelUpdated = true;
+                    // Listeners may still be reading the old channel, so swap in an updated copy
+                    auto updated = std::make_shared<DMChannel>(*dm);
+                    updated->lastMessageId = message.id;
+                    dm = std::move(updated);
+                    repositionPrivateChannel(state.privateChannels, i);
+                    state.privateChannelsRevision++;
                     break;
                 }
             }
-
-            if (dmChannelUpdated) {
-                sortPrivateChannelsByLastMessage(state.privateChannels);
-            }
         });
 
         Logger::debug("Stored message " + message.id + " in channel " + message.channelId);
@@ -1587,20 +1602,17 @@ void Gateway::handleChannelUpdate(const Json &data) {
 
             std::shared_ptr<DMChannel> updated(static_cast<DMChannel *>(channel.release()));
             Store::get().update([updated](AppState &state) {
-                bool replaced = false;
-                for (auto &existing : state.privateChannels) {
-                    if (existing && existing->id == updated->id) {
-                        existing = updated;
-                        replaced = true;
-                        break;
-                    }
-                }
-
-                if (!replaced) {
-                    state.privateChannels.push_back(updated);
+                auto existing = std::find_if(state.privateChannels.begin(), state.privateChannels.end(),
+                                             [&](const auto &dm) { return dm && dm->id == updated->id; });
+                if (existing != state.privateChannels.end()) {
+                    *existing = updated;
+                } else {
+                    existing = state.privateChannels.insert(existing, updated);
                 }
 
-                sortPrivateChannelsByLastMessage(state.privateChannels);
+                repositionPrivateChannel(state.privateChannels,
+                                         static_cast<size_t>(existing - state.privateChannels.begin()));
+                state.privateChannelsRevision++;
 
                 bool changed = false;
                 for (const auto &recipient : updated->recipients) {
@@ -58,16 +58,17 @@ class GifBox : public Fl_Widget {
 
         m_running = true;
         m_animation.reset();
-        m_animationId = AnimationManager::get().registerAnimation([this]() {
-            if (!m_running) {
-                return false;
-            }
-            bool advanced = m_animation.advance(AnimationManager::get().getFrameTime());
-            if (advanced) {
-                redraw();
-            }
-            return m_running;
-        });
+        m_animationId = AnimationManager::get().registerScheduledAnimation(
+            [this](double elapsed) {
+                if (!m_running) {
+                    return AnimationManager::STOP;
+                }
+                if (m_animation.advance(elapsed)) {
+                    redraw();
+                }
+                return m_animation.timeUntilNextFrame();
+            },
+            m_animation.timeUntilNextFrame());
     }
 
     void stop() {
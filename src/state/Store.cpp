@@ -1,5 +1,7 @@
 #include "state/Store.h"
 
+#include "utils/FrameProfiler.h"
+
 Store &Store::get() {
     static Store instance;
     return instance;
@@ -35,6 +37,7 @@ void Store::notifyAsync() {
 }
 
 void Store::notifyNow() {
+    FrameProfiler::Scope profile("Store::notifyNow");
     AppState stateCopy;
     std::unordered_map<ListenerId, Listener> listenersCopy;
     {
@@ -43,6 +46,7 @@ void Store::notifyNow() {
         listenersCopy = m_listeners;
     }
     for (auto &[id, cb] : listenersCopy) {
+        FrameProfiler::Scope listenerProfile("Store listener");
         cb(stateCopy);
     }
 }
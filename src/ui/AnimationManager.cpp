@@ -1,8 +1,10 @@
 #include "ui/AnimationManager.h"
 
+#include "utils/FrameProfiler.h"
 #include "utils/Logger.h"
 
 #include <algorithm>
+#include <tuple>
 
 AnimationManager &AnimationManager::get() {
     static AnimationManager instance;
@@ -12,18 +14,27 @@ AnimationManager &AnimationManager::get() {
 AnimationManager::AnimationManager() { m_fps.store(60); }
 
 AnimationManager::AnimationId AnimationManager::registerAnimation(AnimationCallback callback) {
+    return registerScheduledAnimation(
+        [this, callback = std::move(callback)](double) { return callback() ? getFrameTime() : STOP; },
+        getFrameTime());
+}
+
+AnimationManager::AnimationId AnimationManager::registerScheduledAnimation(ScheduledCallback callback,
+                                                                           double delay) {
     std::scoped_lock lock(m_mutex);
 
     const auto id = ++m_nextId;
-    m_animations.emplace(id, std::move(callback));
+    const double due = clockNow() + std::max(delay, 0.0);
+    m_animations.emplace(id, Entry{std::move(callback), due, clockNow()});
+    m_deadlines.emplace(due, id);
 
     Logger::debug("AnimationManager: Registered animation #" + std::to_string(id) + " (total: " +
                   std::to_string(m_animations.size()) + ")");
 
     if (m_animations.size() == 1 && !m_timerRunning.load()) {
-        Logger::info("AnimationManager: Starting timer at " + std::to_string(m_fps.load()) + " FPS");
-        startTimer();
+        Logger::info("AnimationManager: Starting scheduler (max " + std::to_string(m_fps.load()) + " FPS)");
     }
+    scheduleWakeLocked();
 
     return id;
 }
@@ -33,36 +44,126 @@ void AnimationManager::unregisterAnimation(AnimationId id) {
 
     auto it = m_animations.find(id);
     if (it != m_animations.end()) {
+        if (it->second.suspended) {
+            m_suspendedCount--;
+        }
         m_animations.erase(it);
         Logger::debug("AnimationManager: Unregistered animation #" + std::to_string(id) + " (remaining: " +
                       std::to_string(m_animations.size()) + ")");
     }
 
     if (m_animations.empty() && m_timerRunning.load()) {
-        Logger::info("AnimationManager: Stopping timer (no animations remaining)");
+        Logger::info("AnimationManager: Stopping scheduler (no animations remaining)");
         stopTimer();
     }
 }
 
+void AnimationManager::setSuspended(AnimationId id, bool suspended) {
+    std::scoped_lock lock(m_mutex);
+
+    auto it = m_animations.find(id);
+    if (it == m_animations.end() || it->second.suspended == suspended) {
+        return;
+    }
+
+    Entry &entry = it->second;
+    entry.suspended = suspended;
+    if (suspended) {
+        // Its heap entry goes stale and is skipped
+        entry.due = -1.0;
+        m_suspendedCount++;
+    } else {
+        const double now = clockNow();
+        entry.due = now + getFrameTime();
+        entry.lastRun = now;
+        m_deadlines.emplace(entry.due, id);
+        m_suspendedCount--;
+    }
+
+    Logger::debug("AnimationManager: " + std::string(suspended ? "Suspended" : "Resumed") + " animation #" +
+                  std::to_string(id) + " (active: " + std::to_string(m_animations.size() - m_suspendedCount) +
+                  ", suspended: " + std::to_string(m_suspendedCount) + ")");
+
+    scheduleWakeLocked();
+}
+
+size_t AnimationManager::activeCount() const {
+    std::scoped_lock lock(m_mutex);
+    return m_animations.size() - m_suspendedCount;
+}
+
+size_t AnimationManager::suspendedCount() const {
+    std::scoped_lock lock(m_mutex);
+    return m_suspendedCount;
+}
+
 void AnimationManager::setFrameRate(int fps) {
     if (fps <= 0)
         return;
 
     m_fps.store(fps);
-    if (m_timerRunning.load()) {
+}
+
+double AnimationManager::getClock() const { return m_inTick ? m_tickClock : clockNow(); }
+
+double AnimationManager::clockNow() const {
+    if (m_paused.load()) {
+        return m_clockBase;
     }
+    return m_clockBase + std::chrono::duration<double>(Clock::now() - m_clockResumed).count();
 }
 
-void AnimationManager::pauseAll() { m_paused.store(true); }
+void AnimationManager::pauseAll() {
+    std::scoped_lock lock(m_mutex);
+    if (m_paused.load()) {
+        return;
+    }
+    m_clockBase = clockNow();
+    m_paused.store(true);
+    stopTimer();
+}
 
-void AnimationManager::resumeAll() { m_paused.store(false); }
+void AnimationManager::resumeAll() {
+    std::scoped_lock lock(m_mutex);
+    if (!m_paused.load()) {
+        return;
+    }
+    m_clockResumed = Clock::now();
+    m_paused.store(false);
+    scheduleWakeLocked();
+}
+
+void AnimationManager::scheduleWakeLocked() {
+    while (!m_deadlines.empty()) {
+        const auto &[due, id] = m_deadlines.top();
+        auto it = m_animations.find(id);
+        if (it != m_animations.end() && it->second.due == due) {
+            break;
+        }
+        m_deadlines.pop();
+    }
 
-void AnimationManager::startTimer() {
-    if (m_timerRunning.exchange(true)) {
+    if (m_deadlines.empty() || m_paused.load()) {
+        stopTimer();
         return;
     }
 
-    Fl::add_timeout(getFrameTime(), timerCallback, this);
+    // tick() arms the timer once every due callback has run
+    if (m_inTick) {
+        return;
+    }
+
+    const double due = m_deadlines.top().first;
+    if (m_timerRunning.load() && m_wakeAt <= due) {
+        return;
+    }
+
+    const double now = clockNow();
+    const double delay = std::max(0.0, due - now);
+    Fl::remove_timeout(timerCallback, this);
+    Fl::add_timeout(delay, timerCallback, this);
+    m_timerRunning.store(true);
+    m_wakeAt = now + delay;
 }
 
 void AnimationManager::stopTimer() {
@@ -74,47 +175,92 @@ void AnimationManager::stopTimer() {
 }
 
 void AnimationManager::tick() {
+    FrameProfiler::Scope profile("AnimationManager::tick");
+    m_timerRunning.store(false);
     if (m_paused.load()) {
-        Fl::repeat_timeout(getFrameTime(), timerCallback, this);
         return;
     }
 
-    std::unordered_map<AnimationId, AnimationCallback> animationsCopy;
+    const double now = clockNow();
+    const double frameTime = getFrameTime();
+
+    // Everything due within half a frame runs now, so animations a few milliseconds apart share one repaint
+    std::vector<std::tuple<AnimationId, ScheduledCallback, double>> due;
     {
         std::scoped_lock lock(m_mutex);
-        animationsCopy = m_animations;
+        const double batchUntil = now + frameTime / 2.0;
+        while (!m_deadlines.empty() && m_deadlines.top().first <= batchUntil) {
+            const auto [deadline, id] = m_deadlines.top();
+            m_deadlines.pop();
+
+            auto it = m_animations.find(id);
+            if (it == m_animations.end() || it->second.due != deadline) {
+                continue;
+            }
+            const double elapsed = now - it->second.lastRun;
+            it->second.lastRun = now;
+            due.emplace_back(id, it->second.callback, elapsed);
+        }
     }
 
-    std::vector<AnimationId> toRemove;
-    for (auto &[id, callback] : animationsCopy) {
-        try {
-            bool shouldContinue = callback();
-            if (!shouldContinue) {
-                toRemove.push_back(id);
+    std::vector<std::pair<AnimationId, double>> delays;
+    delays.reserve(due.size());
+
+    m_tickClock = now;
+    m_inTick = true;
+    for (auto &[id, callback, elapsed] : due) {
+        {
+            // An earlier callback may have unregistered this one, e.g. by destroying its widget
+            std::scoped_lock lock(m_mutex);
+            if (m_animations.find(id) == m_animations.end()) {
+                continue;
             }
+        }
+
+        double delay = STOP;
+        try {
+            FrameProfiler::Scope callbackProfile("Animation callback");
+            delay = callback(elapsed);
         } catch (...) {
-            toRemove.push_back(id);
+            delay = STOP;
         }
+        delays.emplace_back(id, delay);
     }
+    m_inTick = false;
 
-    if (!toRemove.empty()) {
-        std::scoped_lock lock(m_mutex);
-        for (auto id : toRemove) {
-            m_animations.erase(id);
-            Logger::debug("AnimationManager: Auto-removed animation #" + std::to_string(id) +
-                          " (returned false)");
+    std::scoped_lock lock(m_mutex);
+    size_t removed = 0;
+    for (const auto &[id, delay] : delays) {
+        auto it = m_animations.find(id);
+        if (it == m_animations.end()) {
+            continue;
+        }
+        if (delay < 0.0) {
+            if (it->second.suspended) {
+                m_suspendedCount--;
+            }
+            m_animations.erase(it);
+            removed++;
+            Logger::debug("AnimationManager: Auto-removed animation #" + std::to_string(id) + " (returned stop)");
+            continue;
         }
 
-        Logger::debug("AnimationManager: Remaining animations: " + std::to_string(m_animations.size()));
+        // Suspended by its own callback or an earlier one; setSuspended schedules it again on resume
+        if (it->second.suspended) {
+            continue;
+        }
+        it->second.due = now + std::max(delay, frameTime);
+        m_deadlines.emplace(it->second.due, id);
+    }
 
-        if (m_animations.empty() && m_timerRunning.load()) {
-            Logger::info("AnimationManager: Stopping timer (no animations remaining after cleanup)");
-            stopTimer();
-            return;
+    if (removed > 0) {
+        Logger::debug("AnimationManager: Remaining animations: " + std::to_string(m_animations.size()));
+        if (m_animations.empty()) {
+            Logger::info("AnimationManager: Stopping scheduler (no animations remaining after cleanup)");
         }
     }
 
-    Fl::repeat_timeout(getFrameTime(), timerCallback, this);
+    scheduleWakeLocked();
 }
 
 void AnimationManager::timerCallback(void *data) {
@@ -0,0 +1,211 @@
+#include "ui/AnimationRegistry.h"
+
+#include "ui/AnimationManager.h"
+#include "ui/GifAnimation.h"
+#include "utils/Images.h"
+#include "utils/Logger.h"
+
+namespace {
+
+constexpr size_t kMaxCircularDiameters = 4;
+
+} // namespace
+
+SharedAnimation::SharedAnimation(std::string url, std::unique_ptr<GifAnimation> animation)
+    : url_(std::move(url)), animation_(std::move(animation)) {}
+
+SharedAnimation::~SharedAnimation() = default;
+
+bool SharedAnimation::isAnimated() const { return animation_->isAnimated(); }
+
+size_t SharedAnimation::currentFrameIndex() const { return animation_->getCurrentFrameIndex(); }
+
+Fl_RGB_Image *SharedAnimation::currentFrame() { return animation_->currentFrame(); }
+
+Fl_Image *SharedAnimation::scaledFrame(int width, int height) { return animation_->getScaledFrame(width, height); }
+
+Fl_RGB_Image *SharedAnimation::circularFrame(int diameter) {
+    if (diameter <= 0) {
+        return nullptr;
+    }
+
+    // A new size beyond the cap is usually a zoom or resize, so the sizes kept so far are likely stale
+    if (circularFrames_.size() >= kMaxCircularDiameters && circularFrames_.count(diameter) == 0) {
+        circularFrames_.clear();
+    }
+    auto &frames = circularFrames_[diameter];
+    if (frames.size() != animation_->frameCount()) {
+        frames.resize(animation_->frameCount());
+    }
+
+    const size_t index = animation_->getCurrentFrameIndex();
+    if (index >= frames.size()) {
+        return nullptr;
+    }
+    if (!frames[index]) {
+        Fl_RGB_Image *frame = animation_->currentFrame();
+        if (!frame) {
+            return nullptr;
+        }
+        dropEvictedCircularFrames();
+        frames[index].reset(Images::makeCircular(frame, diameter));
+    }
+    return frames[index].get();
+}
+
+void SharedAnimation::dropEvictedCircularFrames() {
+    for (auto &[diameter, frames] : circularFrames_) {
+        for (size_t i = 0; i < frames.size(); ++i) {
+            if (frames[i] && !animation_->isFrameResident(i)) {
+                frames[i].reset();
+            }
+        }
+    }
+}
+
+void SharedAnimation::play() {
+    if (isSuspended()) {
+        animation_->resume();
+    }
+    if (players_++ == suspended_) {
+        syncedClock_ = AnimationManager::get().getClock();
+    }
+}
+
+void SharedAnimation::stop() {
+    if (players_ == 0) {
+        return;
+    }
+    if (--players_ == 0) {
+        suspended_ = 0;
+        animation_->resume();
+        animation_->reset();
+    } else if (suspended_ == players_) {
+        animation_->suspend();
+        circularFrames_.clear();
+    }
+}
+
+void SharedAnimation::suspend() {
+    if (suspended_ >= players_) {
+        return;
+    }
+    if (++suspended_ == players_) {
+        animation_->suspend();
+        circularFrames_.clear();
+    }
+}
+
+void SharedAnimation::resume() {
+    if (suspended_ == 0) {
+        return;
+    }
+    if (suspended_-- == players_) {
+        animation_->resume();
+        syncedClock_ = AnimationManager::get().getClock();
+    }
+}
+
+bool SharedAnimation::sync() {
+    const double now = AnimationManager::get().getClock();
+    if (now != syncedClock_) {
+        const double elapsed = now - syncedClock_;
+        syncedClock_ = now;
+        if (players_ > suspended_ && elapsed > 0.0 && animation_->advance(elapsed)) {
+            changedClock_ = now;
+        }
+    }
+    return changedClock_ == now;
+}
+
+double SharedAnimation::timeUntilNextFrame() const { return animation_->timeUntilNextFrame(); }
+
+namespace AnimationRegistry {
+
+namespace {
+
+std::unordered_map<std::string, std::weak_ptr<SharedAnimation>> live_animations;
+std::unordered_map<std::string, std::vector<LoadCallback>> pending_loads;
+
+void finishLoad(const std::string &url, const Handle &handle) {
+    auto it = pending_loads.find(url);
+    if (it == pending_loads.end()) {
+        return;
+    }
+
+    std::vector<LoadCallback> callbacks = std::move(it->second);
+    pending_loads.erase(it);
+    for (auto &callback : callbacks) {
+        if (callback) {
+            callback(handle);
+        }
+    }
+}
+
+Handle decode(const std::string &url) {
+    auto data = Images::readCachedFile(url, "gif");
+    if (!data) {
+        return nullptr;
+    }
+
+    auto animation = std::make_unique<GifAnimation>(reinterpret_cast<const unsigned char *>(data->data()),
+                                                    data->size(), GifAnimation::ScalingStrategy::Lazy);
+    if (!animation->isValid()) {
+        Logger::warn("AnimationRegistry: Failed to decode " + url + ": " + animation->getLastError());
+        return nullptr;
+    }
+    return std::make_shared<SharedAnimation>(url, std::move(animation));
+}
+
+} // namespace
+
+Handle find(const std::string &url) {
+    auto it = live_animations.find(url);
+    if (it == live_animations.end()) {
+        return nullptr;
+    }
+    if (Handle handle = it->second.lock()) {
+        return handle;
+    }
+    live_animations.erase(it);
+    return nullptr;
+}
+
+void load(const std::string &url, LoadCallback callback) {
+    if (Handle handle = find(url)) {
+        if (callback) {
+            callback(handle);
+        }
+        return;
+    }
+
+    auto [it, inserted] = pending_loads.try_emplace(url);
+    it->second.push_back(std::move(callback));
+    if (!inserted) {
+        return;
+    }
+
+    Images::loadImageAsync(url, [url](Fl_RGB_Image *image) {
+        Handle handle = image ? decode(url) : nullptr;
+        if (handle) {
+            live_animations[url] = handle;
+        }
+        finishLoad(url, handle);
+        if (handle) {
+            Images::evictFromMemory(url);
+        }
+    });
+}
+
+size_t liveCount() {
+    for (auto it = live_animations.begin(); it != live_animations.end();) {
+        if (it->second.expired()) {
+            it = live_animations.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return live_animations.size();
+}
+
+} // namespace AnimationRegistry
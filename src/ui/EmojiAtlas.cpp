@@ -0,0 +1,241 @@
+#include "ui/EmojiAtlas.h"
+
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace EmojiAtlas {
+
+namespace {
+
+constexpr int kAtlasDepth = 4;
+constexpr uint32_t kNoCell = UINT32_MAX;
+
+struct Page {
+    std::vector<unsigned char> pixels;
+    std::unique_ptr<Fl_RGB_Image> image; // Views pixels
+    uint32_t usedCells = 0;
+    bool dirty = false; // Pixels changed since FLTK last uploaded the page
+};
+
+struct Sheet {
+    int size = 0;
+    int columns = 0;
+    uint32_t cellsPerPage = 0;
+    std::vector<std::unique_ptr<Page>> pages;
+    std::vector<std::string> cellKeys; // Key per cell across all pages, empty when free
+    std::vector<uint32_t> freeCells;   // Popped from the back, so low cells fill first
+};
+
+struct Entry {
+    int size = 0;
+    uint32_t cell = kNoCell;
+    uint64_t lastUse = 0;
+};
+
+std::unordered_map<int, Sheet> sheets;
+std::unordered_map<std::string, Entry> entries;
+uint64_t use_clock = 0;
+Stats stats;
+
+Sheet &sheetFor(int size) {
+    auto [it, inserted] = sheets.try_emplace(size);
+    if (inserted) {
+        it->second.size = size;
+        it->second.columns = std::max(1, PAGE_SIZE / size);
+        it->second.cellsPerPage = static_cast<uint32_t>(it->second.columns * it->second.columns);
+    }
+    return it->second;
+}
+
+int pageExtent(const Sheet &sheet) { return sheet.columns * sheet.size; }
+
+bool addPage(Sheet &sheet) {
+    if (sheet.pages.size() >= static_cast<size_t>(MAX_PAGES_PER_SIZE)) {
+        return false;
+    }
+    const int extent = pageExtent(sheet);
+    auto page = std::make_unique<Page>();
+    page->pixels.assign(static_cast<size_t>(extent) * extent * kAtlasDepth, 0);
+    page->image = std::make_unique<Fl_RGB_Image>(page->pixels.data(), extent, extent, kAtlasDepth);
+
+    const uint32_t first = static_cast<uint32_t>(sheet.pages.size()) * sheet.cellsPerPage;
+    sheet.pages.push_back(std::move(page));
+    sheet.cellKeys.resize(sheet.cellKeys.size() + sheet.cellsPerPage);
+    for (uint32_t cell = first + sheet.cellsPerPage; cell > first; --cell) {
+        sheet.freeCells.push_back(cell - 1);
+    }
+    return true;
+}
+
+void releaseCell(Sheet &sheet, uint32_t cell) {
+    sheet.cellKeys[cell].clear();
+    sheet.pages[cell / sheet.cellsPerPage]->usedCells--;
+    sheet.freeCells.push_back(cell);
+}
+
+uint32_t evictLeastRecentlyUsed(Sheet &sheet) {
+    uint32_t victim = kNoCell;
+    uint64_t oldest = UINT64_MAX;
+    for (uint32_t cell = 0; cell < sheet.cellKeys.size(); ++cell) {
+        auto it = entries.find(sheet.cellKeys[cell]);
+        if (it != entries.end() && it->second.lastUse < oldest) {
+            oldest = it->second.lastUse;
+            victim = cell;
+        }
+    }
+    if (victim != kNoCell) {
+        entries.erase(sheet.cellKeys[victim]);
+        releaseCell(sheet, victim);
+        stats.evictions++;
+    }
+    return victim;
+}
+
+uint32_t allocateCell(Sheet &sheet) {
+    if (sheet.freeCells.empty() && !addPage(sheet) && evictLeastRecentlyUsed(sheet) == kNoCell) {
+        return kNoCell;
+    }
+    uint32_t cell = sheet.freeCells.back();
+    sheet.freeCells.pop_back();
+    sheet.pages[cell / sheet.cellsPerPage]->usedCells++;
+    return cell;
+}
+
+void copyIntoCell(Sheet &sheet, uint32_t cell, const Fl_RGB_Image *image) {
+    Page &page = *sheet.pages[cell / sheet.cellsPerPage];
+    const uint32_t local = cell % sheet.cellsPerPage;
+    const int cellX = static_cast<int>(local % sheet.columns) * sheet.size;
+    const int cellY = static_cast<int>(local / sheet.columns) * sheet.size;
+    const int stride = pageExtent(sheet) * kAtlasDepth;
+
+    const int depth = image->d();
+    const auto *src = reinterpret_cast<const unsigned char *>(image->data()[0]);
+    const int srcStride = image->ld() ? image->ld() : image->w() * depth;
+    for (int row = 0; row < sheet.size; ++row) {
+        const unsigned char *in = src + row * srcStride;
+        unsigned char *out = page.pixels.data() + (cellY + row) * stride + cellX * kAtlasDepth;
+        if (depth == kAtlasDepth) {
+            std::copy(in, in + sheet.size * kAtlasDepth, out);
+            continue;
+        }
+        for (int col = 0; col < sheet.size; ++col, in += depth, out += kAtlasDepth) {
+            const bool hasColor = depth >= 3;
+            out[0] = in[0];
+            out[1] = hasColor ? in[1] : in[0];
+            out[2] = hasColor ? in[2] : in[0];
+            out[3] = (depth == 2) ? in[1] : 255;
+        }
+    }
+    page.dirty = true;
+}
+
+} // namespace
+
+bool insert(const std::string &key, int size, const Fl_RGB_Image *image) {
+    if (key.empty() || size <= 0 || !image || image->w() != size || image->h() != size || image->d() < 1 ||
+        image->d() > 4 || !image->data() || !image->data()[0]) {
+        return false;
+    }
+
+    Sheet &sheet = sheetFor(size);
+    auto existing = entries.find(key);
+    if (existing != entries.end() && existing->second.size != size) {
+        releaseCell(sheets[existing->second.size], existing->second.cell);
+        entries.erase(existing);
+        existing = entries.end();
+    }
+
+    uint32_t cell = existing != entries.end() ? existing->second.cell : allocateCell(sheet);
+    if (cell == kNoCell) {
+        return false;
+    }
+    copyIntoCell(sheet, cell, image);
+    sheet.cellKeys[cell] = key;
+    entries[key] = Entry{size, cell, ++use_clock};
+    return true;
+}
+
+bool contains(const std::string &key) { return entries.find(key) != entries.end(); }
+
+bool draw(const std::string &key, int x, int y) {
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        stats.misses++;
+        return false;
+    }
+    stats.hits++;
+    it->second.lastUse = ++use_clock;
+
+    Sheet &sheet = sheets[it->second.size];
+    Page &page = *sheet.pages[it->second.cell / sheet.cellsPerPage];
+    if (page.dirty) {
+        page.image->uncache();
+        page.dirty = false;
+    }
+    const uint32_t local = it->second.cell % sheet.cellsPerPage;
+    const int cellX = static_cast<int>(local % sheet.columns) * sheet.size;
+    const int cellY = static_cast<int>(local / sheet.columns) * sheet.size;
+    page.image->draw(x, y, sheet.size, sheet.size, cellX, cellY);
+    return true;
+}
+
+void prune(const std::unordered_set<std::string> &keepKeys, std::string_view keyPrefix) {
+    size_t freed = 0;
+    for (auto it = entries.begin(); it != entries.end();) {
+        const std::string &key = it->first;
+        if (key.compare(0, keyPrefix.size(), keyPrefix) != 0 || keepKeys.find(key) != keepKeys.end()) {
+            ++it;
+            continue;
+        }
+        releaseCell(sheets[it->second.size], it->second.cell);
+        it = entries.erase(it);
+        freed++;
+    }
+    if (freed == 0) {
+        return;
+    }
+
+    for (auto &[size, sheet] : sheets) {
+        while (!sheet.pages.empty() && sheet.pages.back()->usedCells == 0) {
+            const uint32_t first = static_cast<uint32_t>(sheet.pages.size() - 1) * sheet.cellsPerPage;
+            sheet.freeCells.erase(std::remove_if(sheet.freeCells.begin(), sheet.freeCells.end(),
+                                                 [first](uint32_t cell) { return cell >= first; }),
+                                  sheet.freeCells.end());
+            sheet.cellKeys.resize(first);
+            sheet.pages.pop_back();
+        }
+    }
+
+    Stats current = getStats();
+    Logger::debug("EmojiAtlas: Pruned " + std::to_string(freed) + " emoji, " + std::to_string(current.cellsUsed) +
+                  "/" + std::to_string(current.cellsCapacity) + " cells in " + std::to_string(current.pages) +
+                  " pages, ~" + std::to_string(current.bytes / 1024) + " KiB");
+}
+
+void clear() {
+    sheets.clear();
+    entries.clear();
+}
+
+Stats getStats() {
+    Stats result = stats;
+    for (const auto &[size, sheet] : sheets) {
+        if (sheet.pages.empty()) {
+            continue;
+        }
+        result.sheets++;
+        result.pages += sheet.pages.size();
+        result.cellsCapacity += sheet.pages.size() * sheet.cellsPerPage;
+        for (const auto &page : sheet.pages) {
+            result.cellsUsed += page->usedCells;
+            result.bytes += page->pixels.size();
+        }
+    }
+    return result;
+}
+
+} // namespace EmojiAtlas
@@ -1,15 +1,17 @@
 #include "ui/EmojiManager.h"
 
+#include "ui/EmojiAtlas.h"
 #include "utils/Images.h"
 #include "utils/Logger.h"
 
 #include <FL/Fl.H>
 #include <FL/Fl_RGB_Image.H>
 
-#include <nlohmann/json.hpp>
-
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
@@ -18,40 +20,111 @@
 #include <unordered_set>
 #include <vector>
 
+#ifdef EMOJIS_EMBEDDED
+#include "emojis/emoji_index.h"
+#endif
+
 namespace EmojiManager {
 
 namespace fs = std::filesystem;
-using Json = nlohmann::json;
 
 namespace {
 
-struct EmojiRecord {
-    std::string emoji;
-    std::string name;
-    std::string sheetUrl;
-    int bgPosX = 0;
-    int bgPosY = 0;
-    int bgSizeW = 0;
-    int bgSizeH = 0;
-    int tileW = 0;
-    int tileH = 0;
+constexpr uint32_t kIndexMagic = 0x4A4D4544; // "DEMJ"
+constexpr uint32_t kIndexVersion = 1;
+constexpr uint32_t kHasAsciiOnlyEmojiFlag = 1;
+
+// Binary layout of a compiled emoji index. cmake/generate_emoji_index.py is its only writer, so every struct
+// here is plain 32-bit fields in the order the script packs them; bump kIndexVersion with the script's VERSION.
+struct IndexHeader {
+    uint32_t magic = kIndexMagic;
+    uint32_t version = kIndexVersion;
+    uint32_t recordCount = 0;
+    uint32_t nodeCount = 0;
+    uint32_t edgeCount = 0;
+    uint32_t stringBytes = 0;
+    uint32_t flags = 0;
+    uint32_t reserved = 0;
 };
 
-std::once_flag init_once;
-std::mutex manager_mutex;
+struct PoolString {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+};
 
-bool loaded = false;
-fs::path root_path;
-std::unordered_map<std::string, EmojiRecord> emoji_map;
-std::vector<std::string> emoji_keys;
+struct EmojiRecord {
+    PoolString emoji;
+    PoolString name;
+    PoolString sheetUrl;
+    int32_t bgPosX = 0;
+    int32_t bgPosY = 0;
+    int32_t bgSizeW = 0;
+    int32_t bgSizeH = 0;
+    int32_t tileW = 0;
+    int32_t tileH = 0;
+    uint32_t acceptsSkinTone = 0; // Drawn from a base-yellow sheet, so a Fitzpatrick modifier may follow
+};
 
 struct TrieNode {
-    std::unordered_map<unsigned char, int> next;
-    int terminalIndex = -1;
+    uint32_t firstEdge = 0;
+    uint32_t edgeCount = 0;
+    int32_t record = -1;
+};
+
+static_assert(sizeof(IndexHeader) == 32 && sizeof(EmojiRecord) == 52 && sizeof(TrieNode) == 12,
+              "emoji index layout must match cmake/generate_emoji_index.py");
+
+/**
+ * Immutable emoji dataset, viewed in place over a compiled index blob (embedded in the executable, or
+ * read from an emoji_index.bin the same script wrote). A trie over the UTF-8 bytes of every emoji is stored as
+ * flat arrays: each node's outgoing edges are a contiguous, byte-sorted slice of edgeBytes/edgeTargets,
+ * and the root's edges are expanded into a direct table since almost every lookup starts (and most
+ * end) there.
+ */
+struct EmojiIndex {
+    std::vector<unsigned char> storage; // Owns the blob when it was read from a file
+    const uint32_t *rootEdges = nullptr; // Child node per first byte; 0 is the root itself, i.e. no edge
+    const EmojiRecord *records = nullptr;
+    const TrieNode *nodes = nullptr;
+    const uint32_t *edgeTargets = nullptr;
+    const unsigned char *edgeBytes = nullptr;
+    const char *strings = nullptr;
+    uint32_t recordCount = 0;
+    bool hasAsciiOnlyEmoji = false;
+
+    std::string_view str(PoolString s) const { return std::string_view(strings + s.offset, s.length); }
+
+    uint32_t child(uint32_t node, unsigned char byte) const {
+        const TrieNode &n = nodes[node];
+        const unsigned char *begin = edgeBytes + n.firstEdge;
+        const unsigned char *end = begin + n.edgeCount;
+        const unsigned char *it = n.edgeCount <= 8 ? std::find(begin, end, byte) : std::lower_bound(begin, end, byte);
+        if (it == end || *it != byte) {
+            return 0;
+        }
+        return edgeTargets[n.firstEdge + static_cast<uint32_t>(it - begin)];
+    }
+
+    const EmojiRecord *find(std::string_view emoji) const {
+        if (emoji.empty()) {
+            return nullptr;
+        }
+        uint32_t node = rootEdges[static_cast<unsigned char>(emoji[0])];
+        for (size_t i = 1; node != 0 && i < emoji.size(); ++i) {
+            node = child(node, static_cast<unsigned char>(emoji[i]));
+        }
+        return (node != 0 && nodes[node].record >= 0) ? &records[nodes[node].record] : nullptr;
+    }
 };
-std::vector<TrieNode> emoji_trie;
 
-std::unordered_map<std::string, std::unique_ptr<Fl_Image>> emoji_image_cache;
+std::once_flag init_once;
+std::mutex manager_mutex;
+
+// Readers load the published index without locking. Replaced indexes are retired rather than freed
+// because a reader may still be walking them; reloading only happens through initialize().
+std::atomic<const EmojiIndex *> current_index{nullptr};
+std::vector<std::unique_ptr<const EmojiIndex>> retired_indexes;
+fs::path root_path;
 
 std::unordered_set<std::string> pending_atlas_urls;
 std::mutex atlas_mutex;
@@ -64,50 +137,6 @@ std::string readFileToString(const fs::path &path) {
     return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
 }
 
-bool parsePxPair(const std::string &s, int &outA, int &outB) {
-    auto parseOne = [](const std::string &v, size_t &i, int &out) -> bool {
-        while (i < v.size() && v[i] == ' ') {
-            ++i;
-        }
-        if (i >= v.size()) {
-            return false;
-        }
-        int sign = 1;
-        if (v[i] == '-') {
-            sign = -1;
-            ++i;
-        } else if (v[i] == '+') {
-            ++i;
-        }
-        if (i >= v.size() || v[i] < '0' || v[i] > '9') {
-            return false;
-        }
-        int value = 0;
-        while (i < v.size() && v[i] >= '0' && v[i] <= '9') {
-            value = value * 10 + (v[i] - '0');
-            ++i;
-        }
-        while (i < v.size() && v[i] != ' ') {
-            ++i;
-        }
-        out = value * sign;
-        return true;
-    };
-
-    size_t i = 0;
-    int a = 0;
-    int b = 0;
-    if (!parseOne(s, i, a)) {
-        return false;
-    }
-    if (!parseOne(s, i, b)) {
-        return false;
-    }
-    outA = a;
-    outB = b;
-    return true;
-}
-
 std::unique_ptr<Fl_RGB_Image> copyRegionScaled(Fl_RGB_Image *src, int x, int y, int w, int h, int targetSize) {
     if (!src || w <= 0 || h <= 0 || targetSize <= 0) {
         return nullptr;
@@ -150,32 +179,9 @@ std::unique_ptr<Fl_RGB_Image> copyRegionScaled(Fl_RGB_Image *src, int x, int y,
     return std::unique_ptr<Fl_RGB_Image>(static_cast<Fl_RGB_Image *>(scaled));
 }
 
-std::string extractDiscordAssetHashPng(const std::string &url) {
-    size_t start = url.rfind("assets/");
-    if (start == std::string::npos) {
-        return "";
-    }
-    start += std::string("assets/").size();
-    size_t end = url.find(".png", start);
-    if (end == std::string::npos || end <= start) {
-        return "";
-    }
-    std::string hash = url.substr(start, end - start);
-    for (char c : hash) {
-        bool ok = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
-        if (!ok) {
-            return "";
-        }
-    }
-    std::transform(hash.begin(), hash.end(), hash.begin(),
-                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
-    return hash;
-}
-
+constexpr const char *kCacheKeyPrefix = "unicode:";
 constexpr const char *kDiscordAssetsBaseUrl = "https://discord.com/assets/";
 
-bool isBaseYellowAtlasHash(const std::string &hash) { return hash == "9d6f7bad0b4786fd" || hash == "668ed2f8f314c3b7"; }
-
 std::string discordAssetPngUrl(const char *hash) { return std::string(kDiscordAssetsBaseUrl) + hash + ".png"; }
 
 std::string atlasUrlForFitzpatrick(uint32_t modifier) {
@@ -195,7 +201,7 @@ std::string atlasUrlForFitzpatrick(uint32_t modifier) {
     }
 }
 
-bool decodeNextUtf8Codepoint(const std::string &s, size_t &ioPos, uint32_t &outCp) {
+bool decodeNextUtf8Codepoint(std::string_view s, size_t &ioPos, uint32_t &outCp) {
     if (ioPos >= s.size()) {
         return false;
     }
@@ -274,130 +280,157 @@ bool findFitzpatrickModifier(const std::string &emoji, uint32_t &outModifier, si
 
 fs::path findDefaultRoot() {
     fs::path bundled = fs::path("assets") / "emojis";
-    if (fs::exists(bundled / "mappings.json")) {
+    if (fs::exists(bundled / "emoji_index.bin")) {
         return bundled;
     }
     return {};
 }
 
-bool loadFromRootUnlocked(const fs::path &root) {
-    fs::path jsonPath = root / "mappings.json";
-    if (!fs::exists(jsonPath)) {
+// Points index at a compiled blob in place. The blob is bounds-checked so a stale or corrupt one can
+// never send a lookup out of range, but nothing is parsed or copied.
+bool attachIndex(EmojiIndex &index, const unsigned char *data, size_t size) {
+    if (!data || size < sizeof(IndexHeader) || reinterpret_cast<uintptr_t>(data) % alignof(uint32_t) != 0) {
+        return false;
+    }
+    const auto *header = reinterpret_cast<const IndexHeader *>(data);
+    if (header->magic != kIndexMagic) {
+        return false;
+    }
+    if (header->version != kIndexVersion) {
+        Logger::warn("EmojiManager: emoji index has format version " + std::to_string(header->version) +
+                     ", expected " + std::to_string(kIndexVersion) +
+                     "; regenerate it with cmake/generate_emoji_index.py");
+        return false;
+    }
+    if (header->nodeCount == 0) {
+        return false;
+    }
+    const uint64_t expectedSize = sizeof(IndexHeader) + 256 * sizeof(uint32_t) +
+                                  uint64_t(header->recordCount) * sizeof(EmojiRecord) +
+                                  uint64_t(header->nodeCount) * sizeof(TrieNode) +
+                                  uint64_t(header->edgeCount) * (sizeof(uint32_t) + 1) + header->stringBytes;
+    if (size != expectedSize) {
         return false;
     }
 
-    try {
-        std::ifstream file(jsonPath);
-        if (!file.is_open()) {
+    const unsigned char *cursor = data + sizeof(IndexHeader);
+    index.rootEdges = reinterpret_cast<const uint32_t *>(cursor);
+    cursor += 256 * sizeof(uint32_t);
+    index.records = reinterpret_cast<const EmojiRecord *>(cursor);
+    cursor += header->recordCount * sizeof(EmojiRecord);
+    index.nodes = reinterpret_cast<const TrieNode *>(cursor);
+    cursor += header->nodeCount * sizeof(TrieNode);
+    index.edgeTargets = reinterpret_cast<const uint32_t *>(cursor);
+    cursor += header->edgeCount * sizeof(uint32_t);
+    index.edgeBytes = cursor;
+    cursor += header->edgeCount;
+    index.strings = reinterpret_cast<const char *>(cursor);
+    index.recordCount = header->recordCount;
+    index.hasAsciiOnlyEmoji = (header->flags & kHasAsciiOnlyEmojiFlag) != 0;
+
+    auto validNode = [&](uint32_t node) { return node < header->nodeCount; };
+    auto validString = [&](PoolString s) { return uint64_t(s.offset) + s.length <= header->stringBytes; };
+    if (!std::all_of(index.rootEdges, index.rootEdges + 256, validNode) ||
+        !std::all_of(index.edgeTargets, index.edgeTargets + header->edgeCount, validNode)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < header->nodeCount; ++i) {
+        const TrieNode &node = index.nodes[i];
+        if (uint64_t(node.firstEdge) + node.edgeCount > header->edgeCount ||
+            node.record >= int32_t(header->recordCount)) {
             return false;
         }
-
-        Json data;
-        file >> data;
-
-        if (!data.contains("items") || !data["items"].is_array()) {
+    }
+    for (uint32_t i = 0; i < header->recordCount; ++i) {
+        const EmojiRecord &rec = index.records[i];
+        if (!validString(rec.emoji) || !validString(rec.name) || !validString(rec.sheetUrl)) {
             return false;
         }
+    }
+    return true;
+}
 
-        std::unordered_map<std::string, EmojiRecord> newMap;
-
-        for (const auto &it : data["items"]) {
-            if (!it.is_object()) {
-                continue;
-            }
-            if (!it.contains("surrogates") || !it["surrogates"].is_string()) {
-                continue;
-            }
-
-            EmojiRecord rec;
-            rec.emoji = it["surrogates"].get<std::string>();
-            if (rec.emoji.empty()) {
-                continue;
-            }
-
-            if (it.contains("name") && it["name"].is_string()) {
-                rec.name = it["name"].get<std::string>();
-            }
-
-            if (it.contains("sheetUrl") && it["sheetUrl"].is_string()) {
-                rec.sheetUrl = it["sheetUrl"].get<std::string>();
-            }
-
-            if (it.contains("bgPos") && it["bgPos"].is_string()) {
-                parsePxPair(it["bgPos"].get<std::string>(), rec.bgPosX, rec.bgPosY);
-            }
-
-            if (it.contains("bgSize") && it["bgSize"].is_string()) {
-                parsePxPair(it["bgSize"].get<std::string>(), rec.bgSizeW, rec.bgSizeH);
-            }
-
-            if (it.contains("w") && it["w"].is_number()) {
-                rec.tileW = it["w"].get<int>();
-            }
-            if (it.contains("h") && it["h"].is_number()) {
-                rec.tileH = it["h"].get<int>();
-            }
-
-            std::string key = rec.emoji;
-            newMap.emplace(key, std::move(rec));
-        }
+void publishIndexUnlocked(std::unique_ptr<EmojiIndex> index) {
+    if (const EmojiIndex *previous = current_index.exchange(index.release(), std::memory_order_acq_rel)) {
+        retired_indexes.emplace_back(previous);
+    }
+    {
+        std::scoped_lock lock(atlas_mutex);
+        pending_atlas_urls.clear();
+    }
+}
 
-        std::vector<std::string> newKeys;
-        newKeys.reserve(newMap.size());
-        for (const auto &kv : newMap) {
-            newKeys.push_back(kv.first);
-        }
+#ifdef EMOJIS_EMBEDDED
+bool loadEmbeddedUnlocked() {
+    auto index = std::make_unique<EmojiIndex>();
+    if (!attachIndex(*index, EmbeddedEmojis::EMOJI_INDEX_DATA, EmbeddedEmojis::EMOJI_INDEX_DATA_size)) {
+        Logger::warn("EmojiManager: embedded emoji index is invalid, falling back to assets/emojis/emoji_index.bin");
+        return false;
+    }
+    const bool hasRecords = index->recordCount > 0;
+    publishIndexUnlocked(std::move(index));
+    return hasRecords;
+}
+#endif
 
-        std::vector<TrieNode> newTrie;
-        newTrie.emplace_back();
-        for (size_t idx = 0; idx < newKeys.size(); ++idx) {
-            const std::string &emoji = newKeys[idx];
-            int node = 0;
-            for (unsigned char ch : emoji) {
-                auto it = newTrie[node].next.find(ch);
-                if (it == newTrie[node].next.end()) {
-                    int nextIndex = static_cast<int>(newTrie.size());
-                    newTrie[node].next.emplace(ch, nextIndex);
-                    newTrie.emplace_back();
-                    node = nextIndex;
-                } else {
-                    node = it->second;
-                }
-            }
-            newTrie[node].terminalIndex = static_cast<int>(idx);
-        }
+bool loadFromRootUnlocked(const fs::path &root) {
+    const fs::path indexPath = root / "emoji_index.bin";
+    std::ifstream file(indexPath, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
 
-        root_path = root;
-        emoji_map = std::move(newMap);
-        emoji_keys = std::move(newKeys);
-        emoji_trie = std::move(newTrie);
-        emoji_image_cache.clear();
-        {
-            std::scoped_lock lock(atlas_mutex);
-            pending_atlas_urls.clear();
-        }
-        loaded = !emoji_map.empty();
-        return loaded;
-    } catch (const std::exception &e) {
-        Logger::warn(std::string("EmojiManager failed to parse emoji map: ") + e.what());
+    auto index = std::make_unique<EmojiIndex>();
+    index->storage.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (!attachIndex(*index, index->storage.data(), index->storage.size())) {
+        Logger::warn("EmojiManager: " + indexPath.string() + " is not a valid emoji index");
         return false;
     }
+
+    root_path = root;
+    const bool hasRecords = index->recordCount > 0;
+    publishIndexUnlocked(std::move(index));
+    return hasRecords;
 }
 
 void ensureInitialized() {
     std::call_once(init_once, []() {
-        fs::path root = findDefaultRoot();
-        if (root.empty()) {
-            Logger::warn("EmojiManager: bundled emoji dataset not found at assets/emojis/mappings.json");
-            return;
+        const auto started = std::chrono::steady_clock::now();
+        std::string source;
+        {
+            std::scoped_lock lock(manager_mutex);
+#ifdef EMOJIS_EMBEDDED
+            if (loadEmbeddedUnlocked()) {
+                source = "embedded index";
+            }
+#endif
+            if (source.empty()) {
+                fs::path root = findDefaultRoot();
+                if (root.empty()) {
+                    Logger::warn("EmojiManager: no embedded emoji index and no assets/emojis/emoji_index.bin; "
+                                 "generate one with cmake/generate_emoji_index.py");
+                    return;
+                }
+                if (loadFromRootUnlocked(root)) {
+                    source = root_path.string();
+                }
+            }
         }
-        std::scoped_lock lock(manager_mutex);
-        if (loadFromRootUnlocked(root)) {
-            Logger::info("EmojiManager loaded unicode emoji dataset from: " + root_path.string());
+        if (!source.empty()) {
+            const auto elapsed =
+                std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+            Logger::info("EmojiManager loaded unicode emoji dataset from: " + source + " in " +
+                         std::to_string(elapsed.count()) + "us");
         }
     });
 }
 
+const EmojiIndex *loadedIndex() {
+    ensureInitialized();
+    const EmojiIndex *index = current_index.load(std::memory_order_acquire);
+    return (index && index->recordCount > 0) ? index : nullptr;
+}
+
 } // namespace
 
 bool initialize(const std::string &rootDir) {
@@ -407,18 +440,18 @@ bool initialize(const std::string &rootDir) {
 
 void initializeFromDefaultLocations() { ensureInitialized(); }
 
-bool isAvailable() {
-    ensureInitialized();
-    std::scoped_lock lock(manager_mutex);
-    return loaded;
-}
+bool isAvailable() { return loadedIndex() != nullptr; }
 
-std::string makeCacheKey(const std::string &emoji, int size) { return "unicode:" + emoji + "#" + std::to_string(size); }
+std::string makeCacheKey(const std::string &emoji, int size) {
+    return std::string(kCacheKeyPrefix) + emoji + "#" + std::to_string(size);
+}
 
 bool hasEmoji(const std::string &emoji) {
-    ensureInitialized();
-    std::scoped_lock lock(manager_mutex);
-    if (emoji_map.find(emoji) != emoji_map.end()) {
+    const EmojiIndex *index = loadedIndex();
+    if (!index) {
+        return false;
+    }
+    if (index->find(emoji)) {
         return true;
     }
 
@@ -431,154 +464,146 @@ bool hasEmoji(const std::string &emoji) {
 
     std::string base = emoji;
     base.erase(modPos, modLen);
-    auto it = emoji_map.find(base);
-    if (it == emoji_map.end()) {
-        return false;
-    }
-
-    std::string atlasHash = extractDiscordAssetHashPng(it->second.sheetUrl);
-    return isBaseYellowAtlasHash(atlasHash) && !atlasUrlForFitzpatrick(modifier).empty();
+    const EmojiRecord *rec = index->find(base);
+    return rec && rec->acceptsSkinTone && !atlasUrlForFitzpatrick(modifier).empty();
 }
 
-bool tryMatch(const std::string &text, size_t pos, size_t &outLength, std::string &outEmoji) {
-    ensureInitialized();
-    std::scoped_lock lock(manager_mutex);
-    if (!loaded || pos >= text.size()) {
+bool mayContainEmoji(std::string_view text) {
+    const EmojiIndex *index = loadedIndex();
+    if (!index) {
         return false;
     }
-
-    int node = 0;
-    int lastTerminal = -1;
-    size_t lastLen = 0;
-    for (size_t i = pos; i < text.size(); ++i) {
-        unsigned char ch = static_cast<unsigned char>(text[i]);
-        auto it = emoji_trie[node].next.find(ch);
-        if (it == emoji_trie[node].next.end()) {
-            break;
-        }
-        node = it->second;
-        if (emoji_trie[node].terminalIndex >= 0) {
-            lastTerminal = emoji_trie[node].terminalIndex;
-            lastLen = i - pos + 1;
-        }
+    if (index->hasAsciiOnlyEmoji) {
+        return !text.empty();
     }
 
-    if (lastTerminal >= 0 && static_cast<size_t>(lastTerminal) < emoji_keys.size()) {
-        const std::string &baseEmoji = emoji_keys[static_cast<size_t>(lastTerminal)];
-        outEmoji = baseEmoji;
-        outLength = lastLen;
-
-        auto it = emoji_map.find(baseEmoji);
-        if (it == emoji_map.end()) {
+    // Every emoji has a non-ASCII byte, so test for any high bit a word at a time
+    constexpr uint64_t kHighBits = 0x8080808080808080ULL;
+    const char *data = text.data();
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= text.size(); i += sizeof(uint64_t)) {
+        uint64_t word = 0;
+        std::memcpy(&word, data + i, sizeof(word));
+        if (word & kHighBits) {
             return true;
         }
-
-        std::string atlasHash = extractDiscordAssetHashPng(it->second.sheetUrl);
-        if (!isBaseYellowAtlasHash(atlasHash)) {
+    }
+    for (; i < text.size(); ++i) {
+        if (static_cast<unsigned char>(data[i]) & 0x80) {
             return true;
         }
+    }
+    return false;
+}
 
-        size_t nextPos = pos + lastLen;
-        if (nextPos >= text.size()) {
-            return true;
-        }
+bool tryMatch(std::string_view text, size_t pos, size_t &outLength, std::string &outEmoji) {
+    const EmojiIndex *index = loadedIndex();
+    if (!index || pos >= text.size()) {
+        return false;
+    }
 
-        size_t scanPos = nextPos;
-        uint32_t cp = 0;
-        if (!decodeNextUtf8Codepoint(text, scanPos, cp)) {
-            return true;
+    uint32_t node = index->rootEdges[static_cast<unsigned char>(text[pos])];
+    if (node == 0) {
+        return false;
+    }
+
+    int32_t lastRecord = index->nodes[node].record;
+    size_t lastLen = 1;
+    for (size_t i = pos + 1; i < text.size(); ++i) {
+        node = index->child(node, static_cast<unsigned char>(text[i]));
+        if (node == 0) {
+            break;
         }
-        if (cp < 0x1F3FB || cp > 0x1F3FF) {
-            return true;
+        if (index->nodes[node].record >= 0) {
+            lastRecord = index->nodes[node].record;
+            lastLen = i - pos + 1;
         }
+    }
 
-        if (atlasUrlForFitzpatrick(cp).empty()) {
-            return true;
-        }
+    if (lastRecord < 0) {
+        return false;
+    }
 
-        outLength = scanPos - pos;
-        outEmoji = text.substr(pos, outLength);
+    const EmojiRecord &rec = index->records[static_cast<size_t>(lastRecord)];
+    outEmoji = std::string(index->str(rec.emoji));
+    outLength = lastLen;
+    if (!rec.acceptsSkinTone) {
         return true;
     }
 
-    return false;
+    size_t scanPos = pos + lastLen;
+    uint32_t cp = 0;
+    if (scanPos >= text.size() || !decodeNextUtf8Codepoint(text, scanPos, cp)) {
+        return true;
+    }
+    if (cp < 0x1F3FB || cp > 0x1F3FF || atlasUrlForFitzpatrick(cp).empty()) {
+        return true;
+    }
+
+    outLength = scanPos - pos;
+    outEmoji = std::string(text.substr(pos, outLength));
+    return true;
 }
 
-Fl_Image *loadEmoji(const std::string &emoji, int size) {
+bool drawEmoji(const std::string &emoji, int size, int x, int y) {
     if (emoji.empty() || size <= 0) {
-        return nullptr;
+        return false;
     }
 
-    ensureInitialized();
-    std::string cacheKey;
-    EmojiRecord rec;
-    bool hasRecord = false;
+    std::string cacheKey = makeCacheKey(emoji, size);
+    if (EmojiAtlas::draw(cacheKey, x, y)) {
+        return true;
+    }
 
-    {
-        std::scoped_lock lock(manager_mutex);
-        if (!loaded) {
-            return nullptr;
-        }
+    const EmojiIndex *index = loadedIndex();
+    if (!index) {
+        return false;
+    }
 
-        cacheKey = makeCacheKey(emoji, size);
-        auto cached = emoji_image_cache.find(cacheKey);
-        if (cached != emoji_image_cache.end()) {
-            return cached->second.get();
+    const EmojiRecord *rec = index->find(emoji);
+    std::string sheetUrl;
+    if (rec) {
+        sheetUrl = std::string(index->str(rec->sheetUrl));
+    } else {
+        uint32_t modifier = 0;
+        size_t modPos = 0;
+        size_t modLen = 0;
+        if (!findFitzpatrickModifier(emoji, modifier, modPos, modLen)) {
+            return false;
         }
-
-        auto it = emoji_map.find(emoji);
-        if (it == emoji_map.end()) {
-            uint32_t modifier = 0;
-            size_t modPos = 0;
-            size_t modLen = 0;
-            if (!findFitzpatrickModifier(emoji, modifier, modPos, modLen)) {
-                return nullptr;
-            }
-            std::string base = emoji;
-            base.erase(modPos, modLen);
-            auto baseIt = emoji_map.find(base);
-            if (baseIt == emoji_map.end()) {
-                return nullptr;
-            }
-
-            std::string atlasHash = extractDiscordAssetHashPng(baseIt->second.sheetUrl);
-            if (!isBaseYellowAtlasHash(atlasHash)) {
-                return nullptr;
-            }
-
-            std::string toneUrl = atlasUrlForFitzpatrick(modifier);
-            if (toneUrl.empty()) {
-                return nullptr;
-            }
-
-            rec = baseIt->second;
-            rec.sheetUrl = toneUrl;
-            hasRecord = true;
-        } else {
-            rec = it->second;
-            hasRecord = true;
+        std::string base = emoji;
+        base.erase(modPos, modLen);
+        const EmojiRecord *baseRec = index->find(base);
+        if (!baseRec || !baseRec->acceptsSkinTone) {
+            return false;
         }
-    }
 
-    if (!hasRecord) {
-        return nullptr;
+        sheetUrl = atlasUrlForFitzpatrick(modifier);
+        if (sheetUrl.empty()) {
+            return false;
+        }
+        rec = baseRec;
     }
 
-    bool atlasAvailable = !rec.sheetUrl.empty() && rec.bgSizeW > 0 && rec.bgSizeH > 0 && rec.tileW > 0 && rec.tileH > 0;
+    bool atlasAvailable = !sheetUrl.empty() && rec->bgSizeW > 0 && rec->bgSizeH > 0 && rec->tileW > 0 && rec->tileH > 0;
     if (atlasAvailable) {
-        Fl_RGB_Image *atlas = Images::getCachedImage(rec.sheetUrl);
+        Fl_RGB_Image *atlas = Images::getCachedImage(sheetUrl);
         if (!atlas) {
             bool shouldRequest = false;
             {
                 std::scoped_lock lock(atlas_mutex);
-                if (pending_atlas_urls.find(rec.sheetUrl) == pending_atlas_urls.end()) {
-                    pending_atlas_urls.insert(rec.sheetUrl);
+                if (pending_atlas_urls.find(sheetUrl) == pending_atlas_urls.end()) {
+                    pending_atlas_urls.insert(sheetUrl);
                     shouldRequest = true;
                 }
             }
 
             if (shouldRequest) {
-                Images::loadImageAsync(rec.sheetUrl, [sheetUrl = rec.sheetUrl](Fl_RGB_Image *) {
+                Images::loadImageAsync(sheetUrl, [sheetUrl](Fl_RGB_Image *image) {
+                    // Sheets are drawn from on every frame with emoji, so keep them out of LRU eviction
+                    if (image) {
+                        Images::pinImage(sheetUrl);
+                    }
                     {
                         std::scoped_lock lock(atlas_mutex);
                         pending_atlas_urls.erase(sheetUrl);
@@ -586,54 +611,34 @@ Fl_Image *loadEmoji(const std::string &emoji, int size) {
                     Fl::redraw();
                 });
             }
-            return nullptr;
+            return false;
         }
 
         if (atlas->w() > 0 && atlas->h() > 0) {
-            double scaleX = static_cast<double>(atlas->w()) / static_cast<double>(rec.bgSizeW);
-            double scaleY = static_cast<double>(atlas->h()) / static_cast<double>(rec.bgSizeH);
+            double scaleX = static_cast<double>(atlas->w()) / static_cast<double>(rec->bgSizeW);
+            double scaleY = static_cast<double>(atlas->h()) / static_cast<double>(rec->bgSizeH);
 
-            int srcX = static_cast<int>(std::lround((-rec.bgPosX) * scaleX));
-            int srcY = static_cast<int>(std::lround((-rec.bgPosY) * scaleY));
-            int srcW = static_cast<int>(std::lround(rec.tileW * scaleX));
-            int srcH = static_cast<int>(std::lround(rec.tileH * scaleY));
+            int srcX = static_cast<int>(std::lround((-rec->bgPosX) * scaleX));
+            int srcY = static_cast<int>(std::lround((-rec->bgPosY) * scaleY));
+            int srcW = static_cast<int>(std::lround(rec->tileW * scaleX));
+            int srcH = static_cast<int>(std::lround(rec->tileH * scaleY));
 
             auto rgb = copyRegionScaled(atlas, srcX, srcY, srcW, srcH, size);
-            if (rgb) {
-                Fl_Image *result = rgb.get();
-                std::scoped_lock lock(manager_mutex);
-                emoji_image_cache[cacheKey] = std::move(rgb);
-                return result;
+            if (rgb && EmojiAtlas::insert(cacheKey, size, rgb.get())) {
+                return EmojiAtlas::draw(cacheKey, x, y);
             }
         }
     }
 
-    return nullptr;
+    return false;
 }
 
-void pruneCache(const std::unordered_set<std::string> &keepKeys) {
-    ensureInitialized();
-    std::scoped_lock lock(manager_mutex);
-    if (!loaded) {
-        return;
-    }
-
-    for (auto it = emoji_image_cache.begin(); it != emoji_image_cache.end();) {
-        if (keepKeys.find(it->first) == keepKeys.end()) {
-            it = emoji_image_cache.erase(it);
-        } else {
-            ++it;
-        }
-    }
-}
+void pruneCache(const std::unordered_set<std::string> &keepKeys) { EmojiAtlas::prune(keepKeys, kCacheKeyPrefix); }
 
 void clearCache() {
-    std::scoped_lock lock(manager_mutex);
-    emoji_image_cache.clear();
-    {
-        std::scoped_lock lock(atlas_mutex);
-        pending_atlas_urls.clear();
-    }
+    EmojiAtlas::prune({}, kCacheKeyPrefix);
+    std::scoped_lock lock(atlas_mutex);
+    pending_atlas_urls.clear();
 }
 
 } // namespace EmojiManager
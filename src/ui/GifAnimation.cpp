@@ -1,8 +1,22 @@
 #include "ui/GifAnimation.h"
 
+#include "utils/Images.h"
+#include "utils/Logger.h"
+#include "utils/PixelKernels.h"
+#include "utils/WorkerPool.h"
+
+#include <FL/Fl.H>
+
 #include <algorithm>
 #include <cstdio>
 #include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <mutex>
+
+#include <webp/demux.h>
 
 #ifdef _WIN32
 #ifndef WIN32_LEAN_AND_MEAN
@@ -12,6 +26,7 @@
 #define NOMINMAX
 #endif
 #include <windows.h>
+#include <objbase.h>
 #include <objidl.h>
 #include <gdiplus.h>
 
@@ -57,7 +72,6 @@ using GraphicsPtr = std::unique_ptr<Graphics, GdiplusDeleter<Graphics>>;
 
 #else
 #include <gif_lib.h>
-#include <vector>
 #endif
 
 #ifdef min
@@ -67,482 +81,1142 @@ using GraphicsPtr = std::unique_ptr<Graphics, GdiplusDeleter<Graphics>>;
 #undef max
 #endif
 
-std::atomic<bool> GifAnimation::s_globalPaused{false};
 
-void GifAnimation::setGlobalPaused(bool paused) { s_globalPaused.store(paused); }
+namespace {
 
-bool GifAnimation::isGlobalPaused() { return s_globalPaused.load(); }
+constexpr int kDefaultDelayMs = 100;
+constexpr size_t kMinResidentFrames = 2;
+constexpr size_t kNoFrame = static_cast<size_t>(-1);
 
-GifAnimation::GifAnimation(const std::string &filepath, ScalingStrategy strategy) : scalingStrategy_(strategy) {
-    if (!loadGif(filepath)) {
-        if (lastError_.empty()) {
-            lastError_ = "Failed to load GIF: " + filepath;
+/**
+ * Produces the composited RGBA frames of an animation in order. decodeNext(nullptr) advances without copying;
+ * after a failed frame the output holds the last good canvas so playback repeats it instead of going blank.
+ */
+class FrameDecoder {
+  public:
+    virtual ~FrameDecoder() = default;
+    virtual bool decodeNext(unsigned char *out) = 0;
+    virtual bool rewind() = 0;
+};
+
+struct StreamInfo {
+    int width = 0;
+    int height = 0;
+    std::vector<int> delays;
+};
+
+bool isWebpData(const std::vector<unsigned char> &data) {
+    return data.size() >= 12 && std::memcmp(data.data(), "RIFF", 4) == 0 &&
+           std::memcmp(data.data() + 8, "WEBP", 4) == 0;
+}
+
+class WebpFrameDecoder : public FrameDecoder {
+  public:
+    WebpFrameDecoder(WebPAnimDecoder *decoder, size_t frameBytes)
+        : decoder_(decoder, WebPAnimDecoderDelete), frameBytes_(frameBytes) {}
+
+    bool decodeNext(unsigned char *out) override {
+        uint8_t *canvas = nullptr;
+        int timestamp = 0;
+        bool decoded = WebPAnimDecoderHasMoreFrames(decoder_.get()) &&
+                       WebPAnimDecoderGetNext(decoder_.get(), &canvas, &timestamp) && canvas;
+        if (decoded) {
+            last_ = canvas;
         }
+        if (out) {
+            if (last_) {
+                std::memcpy(out, last_, frameBytes_);
+            } else {
+                std::memset(out, 0, frameBytes_);
+            }
+        }
+        return decoded;
     }
-}
 
-GifAnimation::~GifAnimation() = default;
+    bool rewind() override {
+        WebPAnimDecoderReset(decoder_.get());
+        last_ = nullptr;
+        return true;
+    }
+
+  private:
+    std::unique_ptr<WebPAnimDecoder, void (*)(WebPAnimDecoder *)> decoder_;
+    size_t frameBytes_ = 0;
+    const uint8_t *last_ = nullptr; // Canvas of the last decoded frame, owned by the decoder
+};
+
+std::unique_ptr<FrameDecoder> openWebp(const std::vector<unsigned char> &source, StreamInfo &info,
+                                       std::string &error) {
+    WebPData webpData{source.data(), source.size()};
 
-Fl_RGB_Image *GifAnimation::currentFrame() const {
-    if (frames_.empty() || currentFrameIndex_ >= frames_.size()) {
+    // The demuxer reads frame durations from the container without decoding any pixels
+    std::unique_ptr<WebPDemuxer, void (*)(WebPDemuxer *)> demux(WebPDemux(&webpData), WebPDemuxDelete);
+    if (!demux) {
+        error = "Failed to open WebP data";
         return nullptr;
     }
-    return frames_[currentFrameIndex_].image.get();
-}
-
-Fl_RGB_Image *GifAnimation::getFrame(size_t index) const {
-    if (index >= frames_.size()) {
+    info.width = static_cast<int>(WebPDemuxGetI(demux.get(), WEBP_FF_CANVAS_WIDTH));
+    info.height = static_cast<int>(WebPDemuxGetI(demux.get(), WEBP_FF_CANVAS_HEIGHT));
+    if (info.width <= 0 || info.height <= 0) {
+        error = "Invalid WebP dimensions";
         return nullptr;
     }
-    return frames_[index].image.get();
-}
 
-Fl_Image *GifAnimation::getScaledFrame(int width, int height) {
-    if (width <= 0 || height <= 0) {
-        return currentFrame();
+    WebPIterator iter;
+    if (WebPDemuxGetFrame(demux.get(), 1, &iter)) {
+        do {
+            info.delays.push_back(iter.duration > 0 ? iter.duration : kDefaultDelayMs);
+        } while (WebPDemuxNextFrame(&iter));
+        WebPDemuxReleaseIterator(&iter);
+    }
+    if (info.delays.empty()) {
+        error = "No frames were successfully loaded";
+        return nullptr;
     }
 
-    if (frames_.empty() || currentFrameIndex_ >= frames_.size()) {
+    WebPAnimDecoderOptions options;
+    WebPAnimDecoderOptionsInit(&options);
+    options.color_mode = MODE_RGBA;
+    WebPAnimDecoder *decoder = WebPAnimDecoderNew(&webpData, &options);
+    if (!decoder) {
+        error = "Failed to open WebP data";
         return nullptr;
     }
+    return std::make_unique<WebpFrameDecoder>(decoder, static_cast<size_t>(info.width) * info.height * 4);
+}
+
+#ifdef _WIN32
 
-    if (scalingStrategy_ == ScalingStrategy::None) {
-        return frames_[currentFrameIndex_].image.get();
+/**
+ * GDI+ composites GIF frames itself and can select any frame, so rewinding is free
+ */
+class GdiplusFrameDecoder : public FrameDecoder {
+  public:
+    GdiplusFrameDecoder(IStream *stream, ImagePtr image, GUID dimension, UINT frameCount, int width, int height)
+        : stream_(stream), image_(std::move(image)), dimension_(dimension), frameCount_(frameCount), width_(width),
+          height_(height), canvas_(static_cast<size_t>(width) * height * 4, 0) {}
+
+    ~GdiplusFrameDecoder() override {
+        image_.reset();
+        stream_->Release();
     }
 
-    if (width == lastScaledWidth_ && height == lastScaledHeight_ && lastScaledCache_) {
-        if (currentFrameIndex_ < lastScaledCache_->size() && (*lastScaledCache_)[currentFrameIndex_]) {
-            return (*lastScaledCache_)[currentFrameIndex_].get();
+    bool decodeNext(unsigned char *out) override {
+        bool decoded = true;
+        if (out) {
+            decoded = next_ < frameCount_ && drawFrame(next_);
+            std::memcpy(out, canvas_.data(), canvas_.size());
         }
+        next_++;
+        return decoded;
     }
 
-    return getOrCreateScaledFrame(currentFrameIndex_, width, height);
-}
+    bool rewind() override {
+        next_ = 0;
+        return true;
+    }
 
-int GifAnimation::currentDelay() const {
-    if (frames_.empty() || currentFrameIndex_ >= frames_.size()) {
-        return 100;
+  private:
+    bool drawFrame(UINT index) {
+        if (image_->SelectActiveFrame(&dimension_, index) != Ok) {
+            return false;
+        }
+
+        BitmapPtr bitmap(new Bitmap(width_, height_, PixelFormat32bppARGB));
+        if (!bitmap || bitmap->GetLastStatus() != Ok) {
+            return false;
+        }
+
+        GraphicsPtr graphics(Graphics::FromImage(bitmap.get()));
+        if (!graphics || graphics->GetLastStatus() != Ok ||
+            graphics->DrawImage(image_.get(), 0, 0, width_, height_) != Ok) {
+            return false;
+        }
+
+        BitmapData bitmapData;
+        Rect rect(0, 0, width_, height_);
+        if (bitmap->LockBits(&rect, ImageLockModeRead, PixelFormat32bppARGB, &bitmapData) != Ok) {
+            return false;
+        }
+
+        const unsigned char *src = static_cast<const unsigned char *>(bitmapData.Scan0);
+        for (int y = 0; y < height_; y++) {
+            for (int x = 0; x < width_; x++) {
+                int srcIdx = y * bitmapData.Stride + x * 4;
+                int dstIdx = (y * width_ + x) * 4;
+
+                canvas_[dstIdx + 0] = src[srcIdx + 2];
+                canvas_[dstIdx + 1] = src[srcIdx + 1];
+                canvas_[dstIdx + 2] = src[srcIdx + 0];
+                canvas_[dstIdx + 3] = src[srcIdx + 3];
+            }
+        }
+
+        bitmap->UnlockBits(&bitmapData);
+        return true;
     }
-    return frames_[currentFrameIndex_].delay;
-}
 
-void GifAnimation::nextFrame() {
-    if (frames_.size() <= 1) {
-        return;
+    IStream *stream_;
+    ImagePtr image_;
+    GUID dimension_;
+    UINT frameCount_ = 0;
+    UINT next_ = 0;
+    int width_ = 0;
+    int height_ = 0;
+    std::vector<unsigned char> canvas_;
+};
+
+std::unique_ptr<FrameDecoder> openGif(const std::vector<unsigned char> &source, StreamInfo &info,
+                                      std::string &error) {
+    if (!GdiplusInitializer::getInstance().isInitialized()) {
+        error = "GDI+ initialization failed";
+        return nullptr;
     }
-    currentFrameIndex_ = (currentFrameIndex_ + 1) % frames_.size();
-}
 
-void GifAnimation::previousFrame() {
-    if (frames_.size() <= 1) {
-        return;
+    HGLOBAL buffer = GlobalAlloc(GMEM_MOVEABLE, source.size());
+    if (!buffer) {
+        error = "Failed to allocate GIF stream buffer";
+        return nullptr;
     }
-    currentFrameIndex_ = (currentFrameIndex_ == 0) ? frames_.size() - 1 : currentFrameIndex_ - 1;
-}
 
-void GifAnimation::setFrame(size_t index) {
-    if (index < frames_.size()) {
-        currentFrameIndex_ = index;
+    void *bufferData = GlobalLock(buffer);
+    std::memcpy(bufferData, source.data(), source.size());
+    GlobalUnlock(buffer);
+
+    IStream *stream = nullptr;
+    if (CreateStreamOnHGlobal(buffer, TRUE, &stream) != S_OK) {
+        GlobalFree(buffer);
+        error = "Failed to create GIF memory stream";
+        return nullptr;
     }
-}
+    std::unique_ptr<IStream, void (*)(IStream *)> streamGuard(stream, [](IStream *s) { s->Release(); });
 
-bool GifAnimation::advance(double deltaSeconds) {
-    if (GifAnimation::isGlobalPaused()) {
-        return false;
+    ImagePtr image(new Image(stream));
+    if (!image || image->GetLastStatus() != Ok) {
+        error = "Failed to decode image stream";
+        return nullptr;
     }
 
-    if (!isAnimated() || deltaSeconds <= 0.0) {
-        return false;
+    UINT dimensionCount = image->GetFrameDimensionsCount();
+    if (dimensionCount == 0) {
+        error = "No frame dimensions found";
+        return nullptr;
     }
 
-    timeAccumulatorSeconds_ += deltaSeconds;
-    bool advanced = false;
+    std::vector<GUID> dimensionIDs(dimensionCount);
+    image->GetFrameDimensionsList(dimensionIDs.data(), dimensionCount);
 
-    double delaySeconds = static_cast<double>(currentDelay()) / 1000.0;
-    if (delaySeconds <= 0.0) {
-        delaySeconds = 0.1;
+    UINT frameCount = image->GetFrameCount(&dimensionIDs[0]);
+    if (frameCount == 0) {
+        error = "No frames found in image";
+        return nullptr;
     }
 
-    while (timeAccumulatorSeconds_ >= delaySeconds) {
-        timeAccumulatorSeconds_ -= delaySeconds;
-        nextFrame();
-        advanced = true;
-        delaySeconds = static_cast<double>(currentDelay()) / 1000.0;
-        if (delaySeconds <= 0.0) {
-            delaySeconds = 0.1;
+    UINT propSize = image->GetPropertyItemSize(PropertyTagFrameDelay);
+    if (propSize > 0) {
+        std::vector<unsigned char> propBuffer(propSize);
+        PropertyItem *propItem = reinterpret_cast<PropertyItem *>(propBuffer.data());
+
+        if (image->GetPropertyItem(PropertyTagFrameDelay, propSize, propItem) == Ok) {
+            UINT *delayArray = static_cast<UINT *>(propItem->value);
+            UINT delayCount = propItem->length / sizeof(UINT);
+            for (UINT i = 0; i < frameCount && i < delayCount; i++) {
+                int delay = delayArray[i] * 10;
+                info.delays.push_back(delay == 0 ? kDefaultDelayMs : delay);
+            }
         }
     }
 
-    return advanced;
+    while (info.delays.size() < frameCount) {
+        info.delays.push_back(kDefaultDelayMs);
+    }
+
+    info.width = static_cast<int>(image->GetWidth());
+    info.height = static_cast<int>(image->GetHeight());
+    if (info.width <= 0 || info.height <= 0) {
+        error = "Invalid GIF dimensions";
+        return nullptr;
+    }
+
+    return std::make_unique<GdiplusFrameDecoder>(streamGuard.release(), std::move(image), dimensionIDs[0],
+                                                 frameCount, info.width, info.height);
 }
 
-void GifAnimation::reset() {
-    setFrame(0);
-    timeAccumulatorSeconds_ = 0.0;
+#else
+
+struct GifMemoryReader {
+    const unsigned char *data;
+    size_t size;
+    size_t offset;
+};
+
+int readGifFromMemory(GifFileType *gif, GifByteType *dest, int length) {
+    auto *reader = static_cast<GifMemoryReader *>(gif->UserData);
+    size_t available = reader->size - reader->offset;
+    size_t count = std::min(available, static_cast<size_t>(std::max(length, 0)));
+    std::memcpy(dest, reader->data + reader->offset, count);
+    reader->offset += count;
+    return static_cast<int>(count);
 }
 
-void GifAnimation::setScalingStrategy(ScalingStrategy strategy) {
-    if (scalingStrategy_ != strategy) {
-        scalingStrategy_ = strategy;
-        scaledCache_.clear();
-        lastScaledCache_ = nullptr;
+struct GifFrameControl {
+    int delay = kDefaultDelayMs;
+    int disposal = DISPOSAL_UNSPECIFIED;
+    int transparent = NO_TRANSPARENT_COLOR;
+};
+
+// Reads one extension record, keeping the graphic control block that applies to the next image
+bool readExtension(GifFileType *gif, GifFrameControl &control) {
+    int code = 0;
+    GifByteType *block = nullptr;
+    if (DGifGetExtension(gif, &code, &block) == GIF_ERROR) {
+        return false;
     }
+    while (block) {
+        if (code == GRAPHICS_EXT_FUNC_CODE && block[0] >= 4) {
+            GifByteType packed = block[1];
+            int delay = ((block[3] << 8) | block[2]) * 10;
+            control.delay = delay == 0 ? kDefaultDelayMs : delay;
+            control.disposal = (packed >> 2) & 0x07;
+            control.transparent = (packed & 0x01) ? block[4] : NO_TRANSPARENT_COLOR;
+        }
+        if (DGifGetExtensionNext(gif, &block) == GIF_ERROR) {
+            return false;
+        }
+    }
+    return true;
 }
 
-void GifAnimation::clearScaledCache() {
-    scaledCache_.clear();
-    lastScaledCache_ = nullptr;
-    lastScaledWidth_ = 0;
-    lastScaledHeight_ = 0;
+// Steps over the LZW data of the current image without decompressing it
+bool skipImageData(GifFileType *gif) {
+    int codeSize = 0;
+    GifByteType *block = nullptr;
+    if (DGifGetCode(gif, &codeSize, &block) == GIF_ERROR) {
+        return false;
+    }
+    while (block) {
+        if (DGifGetCodeNext(gif, &block) == GIF_ERROR) {
+            return false;
+        }
+    }
+    return true;
 }
 
-Fl_Image *GifAnimation::getOrCreateScaledFrame(size_t frameIndex, int width, int height) {
-    if (frameIndex >= frames_.size() || !frames_[frameIndex].image) {
-        return nullptr;
+class GiflibFrameDecoder : public FrameDecoder {
+  public:
+    GiflibFrameDecoder(const std::vector<unsigned char> &source, int width, int height)
+        : reader_{source.data(), source.size(), 0}, width_(width), height_(height),
+          canvas_(static_cast<size_t>(width) * height * 4, 0) {}
+
+    ~GiflibFrameDecoder() override { close(); }
+
+    bool open() {
+        close();
+        reader_.offset = 0;
+        std::fill(canvas_.begin(), canvas_.end(), 0);
+        int errorCode = 0;
+        gif_ = DGifOpen(&reader_, readGifFromMemory, &errorCode);
+        return gif_ != nullptr;
     }
 
-    ScaledFrameKey key{width, height};
-    auto it = scaledCache_.find(key);
-    if (it != scaledCache_.end()) {
-        auto &frameCache = it->second;
-        lastScaledWidth_ = width;
-        lastScaledHeight_ = height;
-        lastScaledCache_ = &frameCache;
-
-        if (frameIndex < frameCache.size() && frameCache[frameIndex]) {
-            return frameCache[frameIndex].get();
+    bool decodeNext(unsigned char *out) override {
+        GifFrameControl control;
+        bool decoded = gif_ && readNextImage(control);
+        if (out) {
+            std::memcpy(out, canvas_.data(), canvas_.size());
         }
-    }
-
-    if (scalingStrategy_ == ScalingStrategy::Eager && it == scaledCache_.end()) {
-        preScaleAllFrames(width, height);
-        it = scaledCache_.find(key);
-        if (it != scaledCache_.end() && frameIndex < it->second.size()) {
-            lastScaledWidth_ = width;
-            lastScaledHeight_ = height;
-            lastScaledCache_ = &it->second;
-            return it->second[frameIndex].get();
+        if (decoded) {
+            dispose(control);
         }
+        return decoded;
     }
 
-    if (it == scaledCache_.end()) {
-        scaledCache_[key] = std::vector<std::unique_ptr<Fl_Image>>(frames_.size());
-        it = scaledCache_.find(key);
-    }
+    bool rewind() override { return open(); }
 
-    auto &frameCache = it->second;
-    if (frameIndex >= frameCache.size()) {
-        frameCache.resize(frames_.size());
+  private:
+    void close() {
+        if (gif_) {
+            int errorCode = 0;
+            DGifCloseFile(gif_, &errorCode);
+            gif_ = nullptr;
+        }
     }
 
-    Fl_Image *scaled = frames_[frameIndex].image->copy(width, height);
-    if (!scaled) {
-        return frames_[frameIndex].image.get();
+    bool readNextImage(GifFrameControl &control) {
+        GifRecordType type = UNDEFINED_RECORD_TYPE;
+        for (;;) {
+            if (DGifGetRecordType(gif_, &type) == GIF_ERROR || type == TERMINATE_RECORD_TYPE) {
+                return false;
+            }
+            if (type == EXTENSION_RECORD_TYPE) {
+                if (!readExtension(gif_, control)) {
+                    return false;
+                }
+            } else if (type == IMAGE_DESC_RECORD_TYPE) {
+                return DGifGetImageDesc(gif_) != GIF_ERROR && drawImage(control);
+            }
+        }
     }
 
-    frameCache[frameIndex].reset(scaled);
+    bool drawImage(const GifFrameControl &control) {
+        const GifImageDesc &desc = gif_->Image;
+        if (desc.Width <= 0 || desc.Height <= 0) {
+            return skipImageData(gif_);
+        }
 
-    lastScaledWidth_ = width;
-    lastScaledHeight_ = height;
-    lastScaledCache_ = &frameCache;
+        raster_.resize(static_cast<size_t>(desc.Width) * desc.Height);
+        if (desc.Interlace) {
+            static constexpr int kOffsets[] = {0, 4, 2, 1};
+            static constexpr int kJumps[] = {8, 8, 4, 2};
+            for (int pass = 0; pass < 4; pass++) {
+                for (int y = kOffsets[pass]; y < desc.Height; y += kJumps[pass]) {
+                    if (DGifGetLine(gif_, raster_.data() + static_cast<size_t>(y) * desc.Width, desc.Width) ==
+                        GIF_ERROR) {
+                        return false;
+                    }
+                }
+            }
+        } else if (DGifGetLine(gif_, raster_.data(), desc.Width * desc.Height) == GIF_ERROR) {
+            return false;
+        }
 
-    return scaled;
-}
+        frameLeft_ = desc.Left;
+        frameTop_ = desc.Top;
+        frameWidth_ = desc.Width;
+        frameHeight_ = desc.Height;
+        if (control.disposal == DISPOSE_PREVIOUS) {
+            previousCanvas_ = canvas_;
+        }
 
-void GifAnimation::preScaleAllFrames(int width, int height) {
-    ScaledFrameKey key{width, height};
-    auto &frameCache = scaledCache_[key];
-    frameCache.clear();
-    frameCache.reserve(frames_.size());
+        ColorMapObject *colorMap = desc.ColorMap ? desc.ColorMap : gif_->SColorMap;
+        if (!colorMap) {
+            return true;
+        }
 
-    for (const auto &frame : frames_) {
-        if (!frame.image) {
-            frameCache.push_back(nullptr);
-            continue;
+        // Zero entries (the transparent index, indices past the color map) leave the canvas pixel as it is
+        uint32_t palette[256] = {};
+        const int colorCount = std::min(colorMap->ColorCount, 256);
+        for (int i = 0; i < colorCount; i++) {
+            if (i == control.transparent) {
+                continue;
+            }
+            const GifColorType &color = colorMap->Colors[i];
+            const unsigned char rgba[4] = {color.Red, color.Green, color.Blue, 255};
+            std::memcpy(&palette[i], rgba, 4);
         }
 
-        Fl_Image *scaled = frame.image->copy(width, height);
-        frameCache.emplace_back(scaled);
+        const int left = std::max(desc.Left, 0);
+        const int right = std::min(desc.Left + desc.Width, width_);
+        if (right <= left) {
+            return true;
+        }
+        for (int y = std::max(-desc.Top, 0); y < desc.Height && desc.Top + y < height_; y++) {
+            const GifByteType *indices = raster_.data() + static_cast<size_t>(y) * desc.Width + (left - desc.Left);
+            unsigned char *row = canvas_.data() + (static_cast<size_t>(desc.Top + y) * width_ + left) * 4;
+            PixelKernels::expandPalette(indices, static_cast<size_t>(right - left), palette, row);
+        }
+        return true;
     }
-}
 
-#ifdef _WIN32
+    void dispose(const GifFrameControl &control) {
+        switch (control.disposal) {
+        case DISPOSE_BACKGROUND:
+            for (int y = std::max(frameTop_, 0); y < frameTop_ + frameHeight_ && y < height_; y++) {
+                int left = std::max(frameLeft_, 0);
+                int right = std::min(frameLeft_ + frameWidth_, width_);
+                if (right > left) {
+                    unsigned char *row = canvas_.data() + (static_cast<size_t>(y) * width_ + left) * 4;
+                    std::memset(row, 0, static_cast<size_t>(right - left) * 4);
+                }
+            }
+            break;
 
-bool GifAnimation::loadGif(const std::string &filepath) {
-    if (!GdiplusInitializer::getInstance().isInitialized()) {
-        lastError_ = "GDI+ initialization failed";
-        return false;
+        case DISPOSE_PREVIOUS:
+            if (!previousCanvas_.empty()) {
+                canvas_.swap(previousCanvas_);
+            }
+            break;
+
+        case DISPOSE_DO_NOT:
+        default:
+            break;
+        }
     }
 
-    int size = MultiByteToWideChar(CP_UTF8, 0, filepath.c_str(), -1, nullptr, 0);
-    if (size <= 0) {
-        lastError_ = "Failed to convert filepath to wide string";
-        return false;
+    GifMemoryReader reader_;
+    GifFileType *gif_ = nullptr;
+    int width_ = 0;
+    int height_ = 0;
+    std::vector<unsigned char> canvas_;
+    std::vector<unsigned char> previousCanvas_;
+    std::vector<GifByteType> raster_;
+    int frameLeft_ = 0;
+    int frameTop_ = 0;
+    int frameWidth_ = 0;
+    int frameHeight_ = 0;
+};
+
+std::unique_ptr<FrameDecoder> openGif(const std::vector<unsigned char> &source, StreamInfo &info,
+                                      std::string &error) {
+    GifMemoryReader reader{source.data(), source.size(), 0};
+    int errorCode = 0;
+    GifFileType *gif = DGifOpen(&reader, readGifFromMemory, &errorCode);
+    if (!gif) {
+        error = "Failed to open GIF data (error " + std::to_string(errorCode) + ")";
+        return nullptr;
     }
 
-    std::wstring wpath(size, 0);
-    MultiByteToWideChar(CP_UTF8, 0, filepath.c_str(), -1, &wpath[0], size);
+    info.width = gif->SWidth;
+    info.height = gif->SHeight;
+
+    // Walk the records to count frames and read their delays; image data is skipped, not decompressed.
+    // A truncated file keeps the frames that were read completely.
+    GifFrameControl control;
+    GifRecordType type = UNDEFINED_RECORD_TYPE;
+    while (DGifGetRecordType(gif, &type) != GIF_ERROR && type != TERMINATE_RECORD_TYPE) {
+        if (type == EXTENSION_RECORD_TYPE) {
+            if (!readExtension(gif, control)) {
+                break;
+            }
+        } else if (type == IMAGE_DESC_RECORD_TYPE) {
+            if (DGifGetImageDesc(gif) == GIF_ERROR || !skipImageData(gif)) {
+                break;
+            }
+            info.delays.push_back(control.delay);
+            control = GifFrameControl{};
+        }
+    }
+    DGifCloseFile(gif, &errorCode);
 
-    ImagePtr image(new Image(wpath.c_str()));
-    if (!image || image->GetLastStatus() != Ok) {
-        lastError_ = "Failed to load image file";
-        return false;
+    if (info.width <= 0 || info.height <= 0) {
+        error = "Invalid GIF dimensions";
+        return nullptr;
+    }
+    if (info.delays.empty()) {
+        error = "No frames were successfully loaded";
+        return nullptr;
     }
 
-    UINT dimensionCount = image->GetFrameDimensionsCount();
-    if (dimensionCount == 0) {
-        lastError_ = "No frame dimensions found";
-        return false;
+    auto decoder = std::make_unique<GiflibFrameDecoder>(source, info.width, info.height);
+    if (!decoder->open()) {
+        error = "Failed to open GIF data";
+        return nullptr;
     }
+    return decoder;
+}
 
-    std::vector<GUID> dimensionIDs(dimensionCount);
-    image->GetFrameDimensionsList(dimensionIDs.data(), dimensionCount);
+#endif
 
-    UINT frameCount = image->GetFrameCount(&dimensionIDs[0]);
-    if (frameCount == 0) {
-        lastError_ = "No frames found in image";
-        return false;
+} // namespace
+
+/**
+ * Decoder and resident frames shared with the decode workers. Only the UI thread evicts frames, so pixels it
+ * has handed out stay valid until it drops them itself; a worker scaling a frame holds its own reference.
+ * The decoder only ever runs on a worker, one job per animation at a time, so the UI thread never waits on it.
+ */
+struct GifAnimation::Stream {
+    struct ScaleRequest {
+        ScaledFrameKey key;
+        size_t index;
+    };
+
+    std::vector<unsigned char> source; // Compressed file, read by the decoder
+    size_t frameCount = 0;
+    size_t frameBytes = 0;
+    int width = 0;
+    int height = 0;
+
+    std::mutex decoderMutex; // Held while the decoder runs on a worker
+    std::unique_ptr<FrameDecoder> decoder;
+    size_t cursor = 0; // Index the decoder produces next
+    bool reportedFailure = false;
+
+    std::mutex mutex; // Guards the members below
+    std::vector<std::shared_ptr<unsigned char[]>> frames; // Resident pixels by frame, null when not decoded
+    size_t playhead = 0;
+    size_t capacity = 0;
+    size_t wanted = kNoFrame; // Frame the UI thread asked for and did not have, decoded before the window
+    size_t looseIndex = kNoFrame;
+    std::unique_ptr<unsigned char[]> looseFrame; // Wanted frame that fell outside the window, for getFrame()
+    bool decodeScheduled = false;
+    std::deque<ScaleRequest> scaleRequests;
+    std::vector<std::pair<ScaleRequest, std::unique_ptr<Fl_RGB_Image>>> scaledFrames; // Finished, null on failure
+    bool scaleScheduled = false;
+
+    std::atomic<bool> notifyReady{false};
+    std::function<void()> onReady; // UI thread only
+
+    bool inWindow(size_t index) const { return (index + frameCount - playhead) % frameCount < capacity; }
+
+    size_t nextMissingLocked() const {
+        for (size_t offset = 0; offset < capacity; ++offset) {
+            size_t index = (playhead + offset) % frameCount;
+            if (!frames[index]) {
+                return index;
+            }
+        }
+        return kNoFrame;
     }
 
-    std::vector<int> delays;
-    UINT propSize = image->GetPropertyItemSize(PropertyTagFrameDelay);
-    if (propSize > 0) {
-        std::vector<unsigned char> propBuffer(propSize);
-        PropertyItem *propItem = reinterpret_cast<PropertyItem *>(propBuffer.data());
+    size_t nextJobLocked() const { return wanted != kNoFrame ? wanted : nextMissingLocked(); }
 
-        if (image->GetPropertyItem(PropertyTagFrameDelay, propSize, propItem) == Ok) {
-            UINT *delayArray = static_cast<UINT *>(propItem->value);
-            for (UINT i = 0; i < frameCount; i++) {
-                int delay = delayArray[i] * 10;
-                delays.push_back(delay == 0 ? 100 : delay);
+    std::unique_ptr<unsigned char[]> decode(size_t index) {
+        std::scoped_lock lock(decoderMutex);
+        if (!decoder || index >= frameCount) {
+            return nullptr;
+        }
+        if (index < cursor) {
+            if (!decoder->rewind()) {
+                return nullptr;
             }
+            cursor = 0;
         }
+        while (cursor < index) {
+            step(nullptr);
+        }
+        auto pixels = std::make_unique<unsigned char[]>(frameBytes);
+        step(pixels.get());
+        return pixels;
     }
 
-    while (delays.size() < frameCount) {
-        delays.push_back(100);
+    void step(unsigned char *out) {
+        if (!decoder->decodeNext(out) && !reportedFailure) {
+            reportedFailure = true;
+            Logger::warn("GifAnimation: Failed to decode frame " + std::to_string(cursor) +
+                         ", repeating the previous frame");
+        }
+        cursor++;
     }
 
-    width_ = image->GetWidth();
-    height_ = image->GetHeight();
+    static void requestDecodeAhead(const std::shared_ptr<Stream> &stream) {
+        {
+            std::scoped_lock lock(stream->mutex);
+            if (stream->decodeScheduled || stream->nextJobLocked() == kNoFrame) {
+                return;
+            }
+            stream->decodeScheduled = true;
+        }
+        WorkerPool::post([weak = std::weak_ptr<Stream>(stream)]() { decodeAhead(weak); });
+    }
 
-    frames_.reserve(frameCount);
-    for (UINT frameIdx = 0; frameIdx < frameCount; frameIdx++) {
-        if (image->SelectActiveFrame(&dimensionIDs[0], frameIdx) != Ok) {
-            lastError_ = "Failed to select frame " + std::to_string(frameIdx);
-            continue;
+    // Puts index ahead of the window; the ready callback runs once it is decoded
+    static void requestFrame(const std::shared_ptr<Stream> &stream, size_t index) {
+        {
+            std::scoped_lock lock(stream->mutex);
+            if (stream->frames[index] || stream->looseIndex == index) {
+                return;
+            }
+            stream->wanted = index;
         }
+        requestDecodeAhead(stream);
+    }
 
-        int frameWidth = image->GetWidth();
-        int frameHeight = image->GetHeight();
+    // Decodes one frame per job, the wanted one first and then the window's missing ones, so that many
+    // animations share the workers fairly
+    static void decodeAhead(const std::weak_ptr<Stream> &weak) {
+        auto stream = weak.lock();
+        if (!stream) {
+            return;
+        }
 
-        BitmapPtr bitmap(new Bitmap(frameWidth, frameHeight, PixelFormat32bppARGB));
-        if (!bitmap || bitmap->GetLastStatus() != Ok) {
-            lastError_ = "Failed to create bitmap for frame " + std::to_string(frameIdx);
-            continue;
+        size_t index;
+        {
+            std::scoped_lock lock(stream->mutex);
+            index = stream->nextJobLocked();
+            if (index == kNoFrame) {
+                stream->decodeScheduled = false;
+                return;
+            }
         }
 
-        GraphicsPtr graphics(Graphics::FromImage(bitmap.get()));
-        if (!graphics || graphics->GetLastStatus() != Ok) {
-            lastError_ = "Failed to create graphics for frame " + std::to_string(frameIdx);
-            continue;
+        auto pixels = stream->decode(index);
+        bool wantedReady = false;
+        bool more = false;
+        {
+            std::scoped_lock lock(stream->mutex);
+            if (stream->wanted == index) {
+                stream->wanted = kNoFrame;
+                wantedReady = pixels != nullptr;
+            }
+            if (!pixels) {
+                stream->decodeScheduled = false;
+                return;
+            }
+            if (!stream->frames[index] && stream->inWindow(index)) {
+                stream->frames[index] = std::move(pixels);
+            } else if (wantedReady && !stream->inWindow(index)) {
+                stream->looseIndex = index;
+                stream->looseFrame = std::move(pixels);
+            }
+            more = stream->nextJobLocked() != kNoFrame;
+            stream->decodeScheduled = more;
+        }
+        if (wantedReady && stream->notifyReady.load()) {
+            notifyUiThread(weak);
         }
+        if (more) {
+            WorkerPool::post([weak]() { decodeAhead(weak); });
+        }
+    }
 
-        if (graphics->DrawImage(image.get(), 0, 0, frameWidth, frameHeight) != Ok) {
-            lastError_ = "Failed to draw frame " + std::to_string(frameIdx);
-            continue;
+    static void requestScale(const std::shared_ptr<Stream> &stream, const ScaledFrameKey &key, size_t index) {
+        {
+            std::scoped_lock lock(stream->mutex);
+            stream->scaleRequests.push_back(ScaleRequest{key, index});
+            if (stream->scaleScheduled) {
+                return;
+            }
+            stream->scaleScheduled = true;
         }
+        WorkerPool::post([weak = std::weak_ptr<Stream>(stream)]() { scaleNext(weak); });
+    }
 
-        BitmapData bitmapData;
-        Rect rect(0, 0, frameWidth, frameHeight);
+    // Scales one requested frame per job, sharing the workers with decoding the same way decodeAhead does
+    static void scaleNext(const std::weak_ptr<Stream> &weak) {
+        auto stream = weak.lock();
+        if (!stream) {
+            return;
+        }
 
-        if (bitmap->LockBits(&rect, ImageLockModeRead, PixelFormat32bppARGB, &bitmapData) != Ok) {
-            lastError_ = "Failed to lock bitmap bits for frame " + std::to_string(frameIdx);
-            continue;
+        ScaleRequest request;
+        std::shared_ptr<unsigned char[]> pixels;
+        {
+            std::scoped_lock lock(stream->mutex);
+            if (stream->scaleRequests.empty()) {
+                stream->scaleScheduled = false;
+                return;
+            }
+            request = stream->scaleRequests.front();
+            stream->scaleRequests.pop_front();
+            pixels = stream->frames[request.index];
         }
 
-        unsigned char *fltkData = new unsigned char[frameWidth * frameHeight * 4];
-        unsigned char *src = static_cast<unsigned char *>(bitmapData.Scan0);
+        // A frame evicted since it was requested yields no image, which still clears its pending mark
+        std::unique_ptr<Fl_RGB_Image> scaled;
+        if (pixels) {
+            Fl_RGB_Image frame(pixels.get(), stream->width, stream->height, 4);
+            scaled.reset(Images::scaleImage(&frame, request.key.width, request.key.height, request.key.mode));
+        }
 
-        for (int y = 0; y < frameHeight; y++) {
-            for (int x = 0; x < frameWidth; x++) {
-                int srcIdx = y * bitmapData.Stride + x * 4;
-                int dstIdx = (y * frameWidth + x) * 4;
+        bool first = false;
+        bool more = false;
+        {
+            std::scoped_lock lock(stream->mutex);
+            first = stream->scaledFrames.empty();
+            stream->scaledFrames.emplace_back(request, std::move(scaled));
+            more = !stream->scaleRequests.empty();
+            stream->scaleScheduled = more;
+        }
+        if (first && stream->notifyReady.load()) {
+            notifyUiThread(weak);
+        }
+        if (more) {
+            WorkerPool::post([weak]() { scaleNext(weak); });
+        }
+    }
 
-                fltkData[dstIdx + 0] = src[srcIdx + 2];
-                fltkData[dstIdx + 1] = src[srcIdx + 1];
-                fltkData[dstIdx + 2] = src[srcIdx + 0];
-                fltkData[dstIdx + 3] = src[srcIdx + 3];
-            }
+    static void notifyUiThread(const std::weak_ptr<Stream> &weak) {
+        Fl::awake(
+            [](void *data) {
+                std::unique_ptr<std::weak_ptr<Stream>> weakPtr(static_cast<std::weak_ptr<Stream> *>(data));
+                auto stream = weakPtr->lock();
+                if (stream && stream->onReady) {
+                    stream->onReady();
+                }
+            },
+            new std::weak_ptr<Stream>(weak));
+    }
+};
+
+std::atomic<bool> GifAnimation::s_globalPaused{false};
+std::atomic<size_t> GifAnimation::s_defaultMemoryBudget{GifAnimation::DEFAULT_MEMORY_BUDGET};
+
+void GifAnimation::setGlobalPaused(bool paused) { s_globalPaused.store(paused); }
+
+bool GifAnimation::isGlobalPaused() { return s_globalPaused.load(); }
+
+void GifAnimation::setDefaultMemoryBudget(size_t bytes) { s_defaultMemoryBudget.store(bytes); }
+
+GifAnimation::GifAnimation(const std::string &filepath, ScalingStrategy strategy)
+    : memoryBudget_(s_defaultMemoryBudget.load()), scalingStrategy_(strategy) {
+    if (!loadGif(filepath)) {
+        if (lastError_.empty()) {
+            lastError_ = "Failed to load GIF: " + filepath;
         }
+    }
+}
 
-        bitmap->UnlockBits(&bitmapData);
+GifAnimation::GifAnimation(const unsigned char *data, size_t size, ScalingStrategy strategy)
+    : memoryBudget_(s_defaultMemoryBudget.load()), scalingStrategy_(strategy) {
+    std::vector<unsigned char> bytes;
+    if (data) {
+        bytes.assign(data, data + size);
+    }
+    if (!loadFromMemory(std::move(bytes))) {
+        if (lastError_.empty()) {
+            lastError_ = "Failed to decode animation from memory";
+        }
+    }
+}
 
-        auto *fltkImage = new Fl_RGB_Image(fltkData, frameWidth, frameHeight, 4);
-        fltkImage->alloc_array = 1;
+GifAnimation::~GifAnimation() {
+    if (stream_) {
+        stream_->notifyReady.store(false);
+        stream_->onReady = nullptr;
+    }
+}
 
-        Frame frame;
-        frame.image.reset(fltkImage);
-        frame.delay = delays[frameIdx];
-        frames_.push_back(std::move(frame));
+Fl_RGB_Image *GifAnimation::residentFrame(size_t index) const {
+    if (!stream_ || index >= views_.size()) {
+        return nullptr;
+    }
+    if (views_[index]) {
+        return views_[index].get();
     }
 
-    if (frames_.empty()) {
-        lastError_ = "No frames were successfully loaded";
-        return false;
+    const unsigned char *pixels = nullptr;
+    {
+        std::scoped_lock lock(stream_->mutex);
+        pixels = stream_->frames[index].get();
+    }
+    if (!pixels) {
+        return nullptr;
     }
+    views_[index] = std::make_unique<Fl_RGB_Image>(pixels, width_, height_, 4);
+    return views_[index].get();
+}
 
-    lastError_.clear();
-    return true;
+Fl_RGB_Image *GifAnimation::ensureFrame(size_t index) {
+    if (auto *frame = residentFrame(index)) {
+        return frame;
+    }
+    if (!stream_ || index >= frameCount()) {
+        return nullptr;
+    }
+
+    // Outside the playback window a worker decodes into a private copy rather than growing past the budget
+    std::unique_ptr<unsigned char[]> loose;
+    {
+        std::scoped_lock lock(stream_->mutex);
+        if (stream_->looseIndex == index) {
+            loose = std::move(stream_->looseFrame);
+            stream_->looseIndex = kNoFrame;
+        }
+    }
+    if (loose) {
+        auto *scratch = new Fl_RGB_Image(loose.release(), width_, height_, 4);
+        scratch->alloc_array = 1;
+        scratchFrame_.reset(scratch);
+        scratchIndex_ = index;
+    }
+    if (scratchFrame_ && scratchIndex_ == index) {
+        return scratchFrame_.get();
+    }
+
+    Stream::requestFrame(stream_, index);
+    if (auto *frame = currentFrame()) {
+        return frame;
+    }
+    return scratchFrame_.get();
 }
 
-#else
+void GifAnimation::moveTo(size_t index) {
+    currentFrameIndex_ = index;
+    if (!stream_) {
+        return;
+    }
+    currentReady_ = residentFrame(index) != nullptr;
+
+    std::vector<size_t> evicted;
+    {
+        std::scoped_lock lock(stream_->mutex);
+        stream_->playhead = index;
+        if (stream_->capacity < stream_->frameCount) {
+            for (size_t i = 0; i < stream_->frames.size(); ++i) {
+                if (stream_->frames[i] && !stream_->inWindow(i)) {
+                    stream_->frames[i].reset();
+                    evicted.push_back(i);
+                }
+            }
+        }
+    }
 
-bool GifAnimation::loadGif(const std::string &filepath) {
-    int errorCode = 0;
-    GifFileType *gif = DGifOpenFileName(filepath.c_str(), &errorCode);
+    for (size_t i : evicted) {
+        views_[i].reset();
+        for (auto &[key, cache] : scaledCache_) {
+            if (i < cache.frames.size() && cache.frames[i].get() != cache.shown) {
+                cache.frames[i].reset();
+            }
+        }
+    }
 
-    if (!gif) {
-        lastError_ = "Failed to open GIF file (error " + std::to_string(errorCode) + ")";
-        return false;
+    if (isAnimated()) {
+        Stream::requestDecodeAhead(stream_);
     }
+}
 
-    if (DGifSlurp(gif) == GIF_ERROR) {
-        lastError_ = "Failed to read GIF data";
-        DGifCloseFile(gif, &errorCode);
-        return false;
+void GifAnimation::applyCapacity() {
+    if (!stream_) {
+        return;
     }
+    const size_t count = frameCount();
+    const size_t fit = stream_->frameBytes > 0 ? memoryBudget_ / stream_->frameBytes : count;
+    std::scoped_lock lock(stream_->mutex);
+    stream_->capacity = std::clamp(fit, std::min(kMinResidentFrames, count), count);
+}
 
-    width_ = gif->SWidth;
-    height_ = gif->SHeight;
+Fl_RGB_Image *GifAnimation::currentFrame() const { return residentFrame(currentFrameIndex_); }
 
-    if (width_ <= 0 || height_ <= 0) {
-        lastError_ = "Invalid GIF dimensions";
-        DGifCloseFile(gif, &errorCode);
-        return false;
+Fl_RGB_Image *GifAnimation::getFrame(size_t index) { return ensureFrame(index); }
+
+Fl_RGB_Image *GifAnimation::getScaledFrame(int width, int height, Images::ScaleMode mode) {
+    Fl_RGB_Image *frame = currentFrame();
+    if (!frame || width <= 0 || height <= 0 || scalingStrategy_ == ScalingStrategy::None) {
+        return frame;
     }
+    return getOrCreateScaledFrame(currentFrameIndex_, ScaledFrameKey{width, height, mode});
+}
 
-    std::vector<unsigned char> canvas(width_ * height_ * 4, 0);
-    std::vector<unsigned char> previousCanvas;
+void GifAnimation::setFrameReadyCallback(std::function<void()> callback) {
+    if (!stream_) {
+        return;
+    }
+    stream_->notifyReady.store(static_cast<bool>(callback));
+    stream_->onReady = std::move(callback);
+}
 
-    ColorMapObject *globalColorMap = gif->SColorMap;
+int GifAnimation::currentDelay() const {
+    if (currentFrameIndex_ >= delays_.size()) {
+        return kDefaultDelayMs;
+    }
+    return delays_[currentFrameIndex_];
+}
 
-    frames_.reserve(gif->ImageCount);
+void GifAnimation::nextFrame() {
+    if (frameCount() <= 1) {
+        return;
+    }
+    setFrame((currentFrameIndex_ + 1) % frameCount());
+}
 
-    for (int i = 0; i < gif->ImageCount; i++) {
-        SavedImage *image = &gif->SavedImages[i];
-        GifImageDesc *desc = &image->ImageDesc;
+void GifAnimation::previousFrame() {
+    if (frameCount() <= 1) {
+        return;
+    }
+    setFrame(currentFrameIndex_ == 0 ? frameCount() - 1 : currentFrameIndex_ - 1);
+}
 
-        ColorMapObject *colorMap = desc->ColorMap ? desc->ColorMap : globalColorMap;
-        if (!colorMap) {
-            lastError_ = "No color map found for frame " + std::to_string(i);
-            continue;
-        }
+void GifAnimation::setFrame(size_t index) {
+    if (index >= frameCount()) {
+        return;
+    }
+    moveTo(index);
+    ensureFrame(index);
+}
 
-        int transparentColor = -1;
-        int delayTime = 100;
-        int disposalMode = DISPOSE_DO_NOT;
+bool GifAnimation::advance(double deltaSeconds) {
+    if (GifAnimation::isGlobalPaused()) {
+        return false;
+    }
 
-        for (int j = 0; j < image->ExtensionBlockCount; j++) {
-            ExtensionBlock *ext = &image->ExtensionBlocks[j];
-            if (ext->Function == GRAPHICS_EXT_FUNC_CODE && ext->ByteCount >= 4) {
-                unsigned char *bytes = ext->Bytes;
-                unsigned char packed = bytes[0];
+    if (suspended_ || !isAnimated() || deltaSeconds <= 0.0) {
+        return false;
+    }
 
-                delayTime = (bytes[2] << 8) | bytes[1];
-                delayTime *= 10;
-                if (delayTime == 0) {
-                    delayTime = 100;
-                }
+    timeAccumulatorSeconds_ += deltaSeconds;
 
-                disposalMode = (packed >> 2) & 0x07;
+    // The current frame arriving from the worker is a change too, e.g. the first one after loading
+    const bool wasReady = currentReady_;
+    currentReady_ = currentFrame() != nullptr;
+    bool advanced = currentReady_ && !wasReady;
 
-                if (packed & 0x01) {
-                    transparentColor = bytes[3];
-                }
-            }
-        }
+    double delaySeconds = static_cast<double>(currentDelay()) / 1000.0;
+    if (delaySeconds <= 0.0) {
+        delaySeconds = 0.1;
+    }
 
-        if (disposalMode == DISPOSE_PREVIOUS) {
-            previousCanvas = canvas;
+    while (timeAccumulatorSeconds_ >= delaySeconds) {
+        size_t next = (currentFrameIndex_ + 1) % frameCount();
+        if (!residentFrame(next)) {
+            // The decoder is behind: hold this frame rather than skip ahead or block the UI thread
+            timeAccumulatorSeconds_ = delaySeconds;
+            Stream::requestDecodeAhead(stream_);
+            break;
+        }
+        timeAccumulatorSeconds_ -= delaySeconds;
+        moveTo(next);
+        advanced = true;
+        delaySeconds = static_cast<double>(currentDelay()) / 1000.0;
+        if (delaySeconds <= 0.0) {
+            delaySeconds = 0.1;
         }
+    }
 
-        for (int y = 0; y < desc->Height; y++) {
-            for (int x = 0; x < desc->Width; x++) {
-                int frameX = desc->Left + x;
-                int frameY = desc->Top + y;
+    return advanced;
+}
 
-                if (frameX >= width_ || frameY >= height_ || frameX < 0 || frameY < 0) {
-                    continue;
-                }
+void GifAnimation::reset() {
+    setFrame(0);
+    timeAccumulatorSeconds_ = 0.0;
+}
 
-                int srcIdx = y * desc->Width + x;
-                int dstIdx = (frameY * width_ + frameX) * 4;
+void GifAnimation::suspend() {
+    if (suspended_ || !stream_) {
+        return;
+    }
+    suspended_ = true;
+    {
+        std::scoped_lock lock(stream_->mutex);
+        stream_->capacity = std::min<size_t>(1, stream_->frameCount);
+        stream_->looseFrame.reset();
+        stream_->looseIndex = kNoFrame;
+    }
+    moveTo(currentFrameIndex_);
+    scaledCache_.clear();
+    scratchFrame_.reset();
+}
 
-                unsigned char colorIndex = image->RasterBits[srcIdx];
+void GifAnimation::resume() {
+    if (!suspended_) {
+        return;
+    }
+    suspended_ = false;
+    applyCapacity();
+    moveTo(currentFrameIndex_);
+}
 
-                if (colorIndex == transparentColor) {
-                    continue;
-                }
+double GifAnimation::timeUntilNextFrame() const {
+    double delaySeconds = static_cast<double>(currentDelay()) / 1000.0;
+    if (delaySeconds <= 0.0) {
+        delaySeconds = 0.1;
+    }
+    return std::max(0.0, delaySeconds - timeAccumulatorSeconds_);
+}
 
-                if (colorIndex >= colorMap->ColorCount) {
-                    continue;
-                }
+void GifAnimation::setScalingStrategy(ScalingStrategy strategy) {
+    if (scalingStrategy_ != strategy) {
+        scalingStrategy_ = strategy;
+        scaledCache_.clear();
+    }
+}
 
-                GifColorType color = colorMap->Colors[colorIndex];
+void GifAnimation::clearScaledCache() { scaledCache_.clear(); }
 
-                canvas[dstIdx + 0] = color.Red;
-                canvas[dstIdx + 1] = color.Green;
-                canvas[dstIdx + 2] = color.Blue;
-                canvas[dstIdx + 3] = 255;
-            }
-        }
+void GifAnimation::setMemoryBudget(size_t bytes) {
+    memoryBudget_ = bytes;
+    if (suspended_) {
+        return;
+    }
+    applyCapacity();
+    moveTo(currentFrameIndex_);
+}
 
-        unsigned char *frameData = new unsigned char[width_ * height_ * 4];
-        std::memcpy(frameData, canvas.data(), width_ * height_ * 4);
+size_t GifAnimation::memoryUsage() const {
+    if (!stream_) {
+        return 0;
+    }
+    std::scoped_lock lock(stream_->mutex);
+    size_t resident = std::count_if(stream_->frames.begin(), stream_->frames.end(),
+                                    [](const std::shared_ptr<unsigned char[]> &pixels) { return pixels != nullptr; });
+    return resident * stream_->frameBytes;
+}
 
-        auto *fltkImage = new Fl_RGB_Image(frameData, width_, height_, 4);
-        fltkImage->alloc_array = 1;
+Fl_RGB_Image *GifAnimation::getOrCreateScaledFrame(size_t frameIndex, const ScaledFrameKey &key) {
+    collectScaledFrames();
+    if (!residentFrame(frameIndex)) {
+        return nullptr;
+    }
 
-        Frame frame;
-        frame.image.reset(fltkImage);
-        frame.delay = delayTime;
-        frames_.push_back(std::move(frame));
+    auto &cache = scaledCache_[key];
+    if (cache.frames.size() != frameCount()) {
+        cache.frames.resize(frameCount());
+        cache.pending.resize(frameCount());
+    }
 
-        switch (disposalMode) {
-        case DISPOSE_BACKGROUND:
-            for (int y = desc->Top; y < desc->Top + desc->Height && y < height_; y++) {
-                for (int x = desc->Left; x < desc->Left + desc->Width && x < width_; x++) {
-                    int idx = (y * width_ + x) * 4;
-                    canvas[idx + 0] = 0;
-                    canvas[idx + 1] = 0;
-                    canvas[idx + 2] = 0;
-                    canvas[idx + 3] = 0;
-                }
-            }
-            break;
+    requestScaledFrames(key, cache, frameIndex);
+    if (cache.frames[frameIndex]) {
+        cache.shown = cache.frames[frameIndex].get();
+    }
+    return cache.shown;
+}
 
-        case DISPOSE_PREVIOUS:
-            if (!previousCanvas.empty()) {
-                canvas = previousCanvas;
-            }
-            break;
+// Lazy asks for the frame being drawn and the one after it, so playback rarely waits on a worker; Eager asks
+// for every frame that is decoded
+void GifAnimation::requestScaledFrames(const ScaledFrameKey &key, ScaledFrames &cache, size_t fromIndex) {
+    const size_t count = scalingStrategy_ == ScalingStrategy::Eager ? frameCount() : std::min<size_t>(2, frameCount());
+    for (size_t offset = 0; offset < count; ++offset) {
+        const size_t index = (fromIndex + offset) % frameCount();
+        if (cache.frames[index] || cache.pending[index] || !residentFrame(index)) {
+            continue;
+        }
+        cache.pending[index] = true;
+        Stream::requestScale(stream_, key, index);
+    }
+}
 
-        case DISPOSE_DO_NOT:
-        default:
-            break;
+void GifAnimation::collectScaledFrames() {
+    std::vector<std::pair<Stream::ScaleRequest, std::unique_ptr<Fl_RGB_Image>>> finished;
+    {
+        std::scoped_lock lock(stream_->mutex);
+        finished.swap(stream_->scaledFrames);
+    }
+
+    for (auto &[request, image] : finished) {
+        // The cache may have been cleared, or the source frame evicted, while the worker was scaling
+        auto it = scaledCache_.find(request.key);
+        if (it == scaledCache_.end() || request.index >= it->second.frames.size()) {
+            continue;
+        }
+        ScaledFrames &cache = it->second;
+        cache.pending[request.index] = false;
+        if (image && !cache.frames[request.index] && residentFrame(request.index)) {
+            cache.frames[request.index] = std::move(image);
         }
     }
+}
+
+bool GifAnimation::loadGif(const std::string &filepath) {
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file) {
+        lastError_ = "Failed to open GIF file: " + filepath;
+        return false;
+    }
 
-    DGifCloseFile(gif, &errorCode);
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return loadFromMemory(std::move(data));
+}
 
-    if (frames_.empty()) {
-        lastError_ = "No frames were successfully loaded";
+bool GifAnimation::loadFromMemory(std::vector<unsigned char> data) {
+    if (data.empty()) {
+        lastError_ = "Empty GIF buffer";
         return false;
     }
 
+    auto stream = std::make_shared<Stream>();
+    stream->source = std::move(data);
+
+    StreamInfo info;
+    stream->decoder = isWebpData(stream->source) ? openWebp(stream->source, info, lastError_)
+                                                  : openGif(stream->source, info, lastError_);
+    if (!stream->decoder) {
+        return false;
+    }
+
+    width_ = info.width;
+    height_ = info.height;
+    delays_ = std::move(info.delays);
+    stream->frameCount = delays_.size();
+    stream->frameBytes = static_cast<size_t>(width_) * height_ * 4;
+    stream->width = width_;
+    stream->height = height_;
+    stream->frames.resize(delays_.size());
+    views_.resize(delays_.size());
+    stream_ = std::move(stream);
+
+    // Only the records were read here; every frame, the first included, is decoded on a worker
+    applyCapacity();
+    Stream::requestFrame(stream_, 0);
+
     lastError_.clear();
     return true;
 }
-
-#endif
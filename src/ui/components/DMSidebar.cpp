@@ -5,13 +5,13 @@
 #include "ui/IconManager.h"
 #include "ui/LayoutConstants.h"
 #include "ui/AnimationManager.h"
-#include "ui/GifAnimation.h"
 #include "ui/RoundedWidget.h"
 #include "ui/Theme.h"
 #include "data/Database.h"
 #include "models/Message.h"
 #include "models/User.h"
 #include "utils/Fonts.h"
+#include "utils/FrameProfiler.h"
 #include "utils/Images.h"
 #include "utils/Logger.h"
 
@@ -20,7 +20,6 @@
 
 #include <algorithm>
 #include <cctype>
-#include <filesystem>
 
 namespace {
 std::string ellipsizeText(const std::string &text, int maxWidth) {
@@ -92,69 +91,11 @@ std::string makeStaticAvatarUrl(const std::string &url) {
     std::string staticUrl = url;
     size_t pos = staticUrl.rfind(".gif");
     if (pos != std::string::npos) {
-        staticUrl.replace(pos, 4, ".png");
+        staticUrl.replace(pos, 4, ".webp");
     }
     return staticUrl;
 }
 
-struct DMChannelSignature {
-    std::string id;
-    std::string name;
-    std::string icon;
-    std::string lastMessageId;
-    int type = 0;
-    std::vector<std::string> recipientIds;
-    std::vector<std::string> recipients;
-
-    bool operator==(const DMChannelSignature &other) const {
-        return id == other.id && name == other.name && icon == other.icon && lastMessageId == other.lastMessageId &&
-               type == other.type && recipientIds == other.recipientIds && recipients == other.recipients;
-    }
-
-    bool operator!=(const DMChannelSignature &other) const { return !(*this == other); }
-};
-
-std::vector<DMChannelSignature> buildDMChannelSignatures(const AppState &state) {
-    std::vector<DMChannelSignature> sigs;
-    sigs.reserve(state.privateChannels.size());
-
-    for (const auto &channel : state.privateChannels) {
-        if (!channel) {
-            continue;
-        }
-
-        DMChannelSignature sig;
-        sig.id = channel->id;
-        sig.name = channel->name.value_or("");
-        sig.icon = channel->icon.value_or("");
-        sig.lastMessageId = channel->lastMessageId.value_or("");
-        sig.type = static_cast<int>(channel->type);
-
-        sig.recipientIds = channel->recipientIds;
-        std::sort(sig.recipientIds.begin(), sig.recipientIds.end());
-
-        sig.recipients.reserve(channel->recipients.size());
-        for (const auto &user : channel->recipients) {
-            std::string entry;
-            entry.reserve(96);
-            entry += user.id;
-            entry += "|";
-            entry += user.username;
-            entry += "|";
-            entry += user.discriminator;
-            entry += "|";
-            entry += user.globalName.value_or("");
-            entry += "|";
-            entry += user.avatar.value_or("");
-            sig.recipients.push_back(std::move(entry));
-        }
-        std::sort(sig.recipients.begin(), sig.recipients.end());
-
-        sigs.push_back(std::move(sig));
-    }
-    return sigs;
-}
-
 bool statusesEqual(const std::unordered_map<std::string, std::string> &a, const std::unordered_map<std::string, std::string> &b) {
     if (a.size() != b.size()) {
         return false;
@@ -221,54 +162,21 @@ DMSidebar::DMSidebar(int x, int y, int w, int h, const char *label) : Fl_Group(x
 
     m_isAlive = std::make_shared<bool>(true);
 
-    m_storeListenerId = Store::get().subscribe<std::vector<DMChannelSignature>>(
-        [alive = m_isAlive](const AppState &state) {
-            if (!alive || !*alive) {
-                return std::vector<DMChannelSignature>{};
-            }
-            return buildDMChannelSignatures(state);
-        },
-        [this, alive = m_isAlive](const std::vector<DMChannelSignature> &) {
-            if (!alive || !*alive) {
-                return;
-            }
-            loadDMsFromState();
-            redraw();
-        },
-        [](const std::vector<DMChannelSignature> &a, const std::vector<DMChannelSignature> &b) {
-            if (a.size() != b.size()) {
-                return false;
-            }
-            for (size_t i = 0; i < a.size(); ++i) {
-                if (a[i] != b[i]) {
-                    return false;
-                }
-            }
-            return true;
-        },
-        true);
-
-    m_statusListenerId = Store::get().subscribe<std::unordered_map<std::string, std::string>>(
-        [](const AppState &state) { return state.userStatuses; },
-        [this, alive = m_isAlive](const std::unordered_map<std::string, std::string> &statuses) {
-            if (!alive || !*alive) {
-                return;
-            }
-            updateStatuses(statuses);
-            redraw();
-        },
-        statusesEqual, true);
+    Store::get().read([this](const AppState &state) {
+        m_channelsRevision = state.privateChannelsRevision;
+        m_usersRevision = state.usersRevision;
+        m_statuses = state.userStatuses;
+        syncDMs(state.privateChannels);
+    });
 
-    m_userListenerId = Store::get().subscribe<uint64_t>(
-        [](const AppState &state) { return state.usersRevision; },
-        [this, alive = m_isAlive](uint64_t) {
-            if (!alive || !*alive) {
-                return;
-            }
-            loadDMsFromState();
+    m_storeListenerId = Store::get().subscribe([this, alive = m_isAlive](const AppState &state) {
+        if (!alive || !*alive) {
+            return;
+        }
+        if (syncFromState(state)) {
             redraw();
-        },
-        std::equal_to<uint64_t>{}, true);
+        }
+    });
 }
 
 DMSidebar::~DMSidebar() {
@@ -284,12 +192,7 @@ DMSidebar::~DMSidebar() {
     if (m_storeListenerId) {
         Store::get().unsubscribe(m_storeListenerId);
     }
-    if (m_statusListenerId) {
-        Store::get().unsubscribe(m_statusListenerId);
-    }
-    if (m_userListenerId) {
-        Store::get().unsubscribe(m_userListenerId);
-    }
+    Fl::remove_timeout(resolveTimerCallback, this);
 }
 
 void DMSidebar::setScrollOffset(int offset) {
@@ -308,6 +211,7 @@ void DMSidebar::setScrollOffset(int offset) {
 }
 
 void DMSidebar::draw() {
+    FrameProfiler::Scope profile("DMSidebar::draw");
     if (!damage() || damage() == FL_DAMAGE_CHILD) {
         return;
     }
@@ -347,10 +251,11 @@ void DMSidebar::draw() {
     if (firstIndex < 0)
         firstIndex = 0;
     if (lastIndex >= 0) {
+        scheduleResolve(firstIndex, lastIndex);
+
         for (int i = firstIndex; i <= lastIndex; ++i) {
-            auto &dm = m_dms[static_cast<size_t>(i)];
+            const auto &dm = m_dms[static_cast<size_t>(i)];
             int itemY = scrollStartY + i * DM_HEIGHT;
-            dm.yPos = itemY;
 
             bool selected = (dm.id == m_selectedDMId);
             bool hovered = (m_hoveredDMIndex == i);
@@ -530,7 +435,8 @@ void DMSidebar::drawDM(const DMItem &dm, int yPos, bool selected, bool hovered)
         int statusX = avatarX + avatarSize - statusSize + 2;
         int statusY = avatarY + avatarSize - statusSize + 2;
 
-        fl_color(statusToColor(dm.status));
+        auto status = m_statuses.find(dm.recipientId);
+        fl_color(statusToColor(status != m_statuses.end() ? status->second : std::string()));
         fl_pie(statusX, statusY, statusSize, statusSize, 0, 360);
 
         Fl_Color ringColor = ThemeColors::BG_SECONDARY;
@@ -545,6 +451,7 @@ void DMSidebar::drawDM(const DMItem &dm, int yPos, bool selected, bool hovered)
 }
 
 int DMSidebar::handle(int event) {
+    FrameProfiler::Scope profile("DMSidebar::handle");
     switch (event) {
     case FL_PUSH: {
         if (Fl::event_button() == FL_LEFT_MOUSE) {
@@ -607,6 +514,12 @@ int DMSidebar::handle(int event) {
         redraw();
         return 1;
     }
+
+    case FL_HIDE:
+        // Avatars only animate under the mouse, and a hidden sidebar has no hover
+        m_hoveredDMIndex = -1;
+        setHoveredAvatarKey("");
+        break;
     }
 
     return Fl_Group::handle(event);
@@ -650,16 +563,147 @@ int DMSidebar::calculateContentHeight() const {
     return totalHeight;
 }
 
-void DMSidebar::loadDMsFromState() {
-    m_dms.clear();
-    m_hoveredDMIndex = -1;
+bool DMSidebar::syncFromState(const AppState &state) {
+    bool changed = false;
+
+    if (state.privateChannelsRevision != m_channelsRevision) {
+        m_channelsRevision = state.privateChannelsRevision;
+        changed |= syncDMs(state.privateChannels);
+    }
+
+    if (state.usersRevision != m_usersRevision) {
+        m_usersRevision = state.usersRevision;
+        for (auto &dm : m_dms) {
+            dm.resolved = false;
+        }
+        changed = true;
+    }
+
+    if (!statusesEqual(state.userStatuses, m_statuses)) {
+        m_statuses = state.userStatuses;
+        changed = true;
+    }
+
+    return changed;
+}
+
+bool DMSidebar::syncDMs(const std::vector<std::shared_ptr<DMChannel>> &channels) {
+    // Usually a single channel moved up after a new message; rotating its row into place keeps every other row and
+    // what it already resolved
+    bool changed = false;
+    size_t row = 0;
+    for (const auto &channel : channels) {
+        if (!channel) {
+            continue;
+        }
+
+        if (row >= m_dms.size() || m_dms[row].id != channel->id) {
+            auto found = std::find_if(m_dms.begin() + static_cast<std::ptrdiff_t>(row), m_dms.end(),
+                                      [&](const DMItem &dm) { return dm.id == channel->id; });
+            if (found != m_dms.end()) {
+                std::rotate(m_dms.begin() + static_cast<std::ptrdiff_t>(row), found, found + 1);
+            } else {
+                DMItem item;
+                item.id = channel->id;
+                m_dms.insert(m_dms.begin() + static_cast<std::ptrdiff_t>(row), std::move(item));
+            }
+            changed = true;
+        }
+
+        DMItem &dm = m_dms[row++];
+        if (dm.channel != channel) {
+            dm.channel = channel;
+            dm.resolved = false;
+            changed = true;
+        }
+    }
+
+    if (row < m_dms.size()) {
+        m_dms.erase(m_dms.begin() + static_cast<std::ptrdiff_t>(row), m_dms.end());
+        changed = true;
+    }
+
+    if (changed) {
+        m_hoveredDMIndex = -1;
+    }
+    return changed;
+}
+
+void DMSidebar::scheduleResolve(int firstIndex, int lastIndex) {
+    m_resolveFirst = firstIndex;
+    m_resolveLast = lastIndex;
+    if (m_resolveScheduled) {
+        return;
+    }
+    for (int i = firstIndex; i <= lastIndex; ++i) {
+        const DMItem &dm = m_dms[static_cast<size_t>(i)];
+        if (!dm.resolved && dm.channel) {
+            m_resolveScheduled = true;
+            Fl::add_timeout(0.0, resolveTimerCallback, this);
+            return;
+        }
+    }
+}
+
+void DMSidebar::resolveTimerCallback(void *data) {
+    auto *sidebar = static_cast<DMSidebar *>(data);
+    sidebar->m_resolveScheduled = false;
+    // Rows may have been removed since the range was drawn
+    const int lastIndex = std::min(sidebar->m_resolveLast, static_cast<int>(sidebar->m_dms.size()) - 1);
+    if (sidebar->resolveDMs(sidebar->m_resolveFirst, lastIndex)) {
+        sidebar->redraw();
+    }
+}
+
+bool DMSidebar::resolveDMs(int firstIndex, int lastIndex) {
+    std::vector<DMItem *> pending;
+    for (int i = firstIndex; i <= lastIndex; ++i) {
+        DMItem &dm = m_dms[static_cast<size_t>(i)];
+        if (!dm.resolved && dm.channel) {
+            pending.push_back(&dm);
+        }
+    }
+    if (pending.empty()) {
+        return false;
+    }
+
+    // Copy out only the users these rows refer to rather than snapshotting the whole state
+    std::unordered_map<std::string, User> knownUsers;
+    Store::get().read([&](const AppState &state) {
+        for (const DMItem *dm : pending) {
+            for (const auto &userId : dm->channel->recipientIds) {
+                auto it = state.usersById.find(userId);
+                if (it != state.usersById.end()) {
+                    knownUsers.emplace(userId, it->second);
+                }
+            }
+        }
+    });
 
-    AppState state = Store::get().snapshot();
     std::unordered_map<std::string, User> discoveredUsers;
+    for (DMItem *dm : pending) {
+        resolveDM(*dm, knownUsers, discoveredUsers);
+    }
 
+    if (!discoveredUsers.empty()) {
+        Store::get().update([users = std::move(discoveredUsers)](AppState &state) mutable {
+            bool changed = false;
+            for (auto &entry : users) {
+                changed |= upsertUser(state.usersById, entry.second);
+            }
+            if (changed) {
+                state.usersRevision++;
+            }
+        });
+    }
+    return true;
+}
+
+void DMSidebar::resolveDM(DMItem &item, const std::unordered_map<std::string, User> &knownUsers,
+                          std::unordered_map<std::string, User> &discoveredUsers) {
     auto findUser = [&](const std::string &userId) -> const User * {
-        auto it = state.usersById.find(userId);
-        if (it != state.usersById.end()) {
+        auto it = knownUsers.find(userId);
+        if (it != knownUsers.end()) {
             return &it->second;
         }
         auto dt = discoveredUsers.find(userId);
@@ -669,17 +713,25 @@ void DMSidebar::loadDMsFromState() {
         return nullptr;
     };
 
-    auto tryDiscoverUserFromDb = [&](const std::string &channelId, const std::string &userId) {
+    // Rows are resolved again whenever any user changes, so a channel whose stored messages did not name the
+    // user is not searched again until it gets a new message
+    auto tryDiscoverUserFromDb = [&](const DMChannel &channel, const std::string &userId) {
         if (userId.empty() || findUser(userId) != nullptr) {
             return;
         }
+        const std::string lastMessageId = channel.lastMessageId.value_or("");
+        auto searched = m_searchedChannels.find(channel.id);
+        if (searched != m_searchedChannels.end() && searched->second == lastMessageId) {
+            return;
+        }
+        m_searchedChannels[channel.id] = lastMessageId;
 
-        auto messages = Data::Database::get().getChannelMessages(channelId, 50);
+        // One query covers every recipient of the channel, so pick up all of them while at it
+        std::unordered_set<std::string> recipientIds(channel.recipientIds.begin(), channel.recipientIds.end());
+        auto messages = Data::Database::get().getChannelMessages(channel.id, 50);
         for (const auto &msg : messages) {
-            if (msg.authorId != userId) {
-                continue;
-            }
-            if (msg.authorUsername.empty()) {
+            if (msg.authorUsername.empty() || recipientIds.count(msg.authorId) == 0 ||
+                findUser(msg.authorId) != nullptr) {
                 continue;
             }
 
@@ -694,8 +746,7 @@ void DMSidebar::loadDMsFromState() {
                 user.avatar = msg.authorAvatarHash;
             }
 
-            discoveredUsers[userId] = std::move(user);
-            break;
+            discoveredUsers[msg.authorId] = std::move(user);
         }
     };
 
@@ -713,162 +764,130 @@ void DMSidebar::loadDMsFromState() {
         return "";
     };
 
-    for (const auto &channel : state.privateChannels) {
-        if (!channel)
-            continue;
-
-        DMItem item;
-        item.id = channel->id;
-
-        const bool isGroup = channel->type == ChannelType::GROUP_DM || channel->recipientIds.size() > 1;
-        std::string channelIconUrl = isGroup ? channel->getIconUrl(64) : "";
-        std::string channelIconStaticUrl = makeStaticAvatarUrl(channelIconUrl);
-        std::string channelIconAnimatedUrl = isGifUrl(channelIconUrl) ? channelIconUrl : "";
-
-        if (isGroup) {
-            if (channel->name.has_value() && !channel->name->empty()) {
-                item.displayName = *channel->name;
+    // Start from a blank row so nothing resolved from an earlier version of the channel is left behind
+    DMItem blank;
+    blank.id = std::move(item.id);
+    blank.channel = std::move(item.channel);
+    blank.resolved = true;
+    item = std::move(blank);
+    const DMChannel &channel = *item.channel;
+
+    const bool isGroup = channel.type == ChannelType::GROUP_DM || channel.recipientIds.size() > 1;
+    std::string channelIconUrl = isGroup ? channel.getIconUrl(64) : "";
+    std::string channelIconStaticUrl = makeStaticAvatarUrl(channelIconUrl);
+    std::string channelIconAnimatedUrl = isGifUrl(channelIconUrl) ? channelIconUrl : "";
+
+    if (isGroup) {
+        if (channel.name.has_value() && !channel.name->empty()) {
+            item.displayName = *channel.name;
+        } else {
+            if (!channel.recipients.empty()) {
+                item.displayName = buildGroupDisplayName(channel);
             } else {
-                if (!channel->recipients.empty()) {
-                    item.displayName = buildGroupDisplayName(*channel);
-                } else {
-                    std::vector<std::string> names;
-                    for (const auto &id : channel->recipientIds) {
-                        tryDiscoverUserFromDb(channel->id, id);
-                        std::string name = resolveDisplayName(id);
-                        if (!name.empty()) {
-                            names.push_back(std::move(name));
-                        }
-                        if (names.size() >= 3) {
-                            break;
-                        }
+                std::vector<std::string> names;
+                for (const auto &id : channel.recipientIds) {
+                    tryDiscoverUserFromDb(channel, id);
+                    std::string name = resolveDisplayName(id);
+                    if (!name.empty()) {
+                        names.push_back(std::move(name));
                     }
-
-                    if (names.empty()) {
-                        item.displayName = "Group DM";
-                    } else if (names.size() == 1) {
-                        item.displayName = names[0];
-                    } else if (names.size() == 2) {
-                        item.displayName = names[0] + ", " + names[1];
-                    } else {
-                        item.displayName = names[0] + ", " + names[1] + " +" + std::to_string(names.size() - 2);
+                    if (names.size() >= 3) {
+                        break;
                     }
                 }
+
+                if (names.empty()) {
+                    item.displayName = "Group DM";
+                } else if (names.size() == 1) {
+                    item.displayName = names[0];
+                } else if (names.size() == 2) {
+                    item.displayName = names[0] + ", " + names[1];
+                } else {
+                    item.displayName = names[0] + ", " + names[1] + " +" + std::to_string(names.size() - 2);
+                }
             }
+        }
 
-            item.showStatus = false;
+        item.showStatus = false;
 
-            if (!channelIconUrl.empty()) {
-                item.avatarUrl = channelIconStaticUrl;
-                item.animatedAvatarUrl = channelIconAnimatedUrl;
-                item.avatarLabel = item.displayName;
-            } else if (!channel->recipients.empty() || !channel->recipientIds.empty()) {
-                std::vector<User> users;
-                users.reserve(2);
+        if (!channelIconUrl.empty()) {
+            item.avatarUrl = channelIconStaticUrl;
+            item.animatedAvatarUrl = channelIconAnimatedUrl;
+            item.avatarLabel = item.displayName;
+        } else if (!channel.recipients.empty() || !channel.recipientIds.empty()) {
+            std::vector<User> users;
+            users.reserve(2);
 
-                for (const auto &u : channel->recipients) {
-                    users.push_back(u);
-                    if (users.size() >= 2) {
-                        break;
-                    }
+            for (const auto &u : channel.recipients) {
+                users.push_back(u);
+                if (users.size() >= 2) {
+                    break;
                 }
+            }
 
-                for (const auto &id : channel->recipientIds) {
-                    if (users.size() >= 2) {
-                        break;
-                    }
-                    if (std::any_of(users.begin(), users.end(), [&](const User &u) { return u.id == id; })) {
-                        continue;
-                    }
-
-                    tryDiscoverUserFromDb(channel->id, id);
-                    if (const User *found = findUser(id)) {
-                        users.push_back(*found);
-                    }
+            for (const auto &id : channel.recipientIds) {
+                if (users.size() >= 2) {
+                    break;
                 }
-
-                if (!users.empty()) {
-                    std::string avatarUrl = users[0].getAvatarUrl(64);
-                    item.avatarUrl = makeStaticAvatarUrl(avatarUrl);
-                    item.animatedAvatarUrl = isGifUrl(avatarUrl) ? avatarUrl : "";
-                    item.avatarLabel = users[0].getDisplayName();
-                } else {
-                    item.avatarLabel = item.displayName;
+                if (std::any_of(users.begin(), users.end(), [&](const User &u) { return u.id == id; })) {
+                    continue;
                 }
 
-                if (users.size() > 1) {
-                    std::string avatar2Url = users[1].getAvatarUrl(64);
-                    item.secondaryAvatarUrl = makeStaticAvatarUrl(avatar2Url);
-                    item.secondaryAnimatedAvatarUrl = isGifUrl(avatar2Url) ? avatar2Url : "";
-                    item.secondaryAvatarLabel = users[1].getDisplayName();
+                tryDiscoverUserFromDb(channel, id);
+                if (const User *found = findUser(id)) {
+                    users.push_back(*found);
                 }
-            } else {
-                item.avatarLabel = item.displayName;
             }
-        } else {
-            if (!channel->recipients.empty()) {
-                const User &user = channel->recipients[0];
-                item.displayName = user.getDisplayName();
-                item.recipientId = user.id;
-                std::string avatarUrl = user.getAvatarUrl(64);
+
+            if (!users.empty()) {
+                std::string avatarUrl = users[0].getAvatarUrl(64);
                 item.avatarUrl = makeStaticAvatarUrl(avatarUrl);
                 item.animatedAvatarUrl = isGifUrl(avatarUrl) ? avatarUrl : "";
-                item.avatarLabel = item.displayName;
-            } else if (!channel->recipientIds.empty()) {
-                item.recipientId = channel->recipientIds[0];
-                tryDiscoverUserFromDb(channel->id, item.recipientId);
-
-                if (std::string name = resolveDisplayName(item.recipientId); !name.empty()) {
-                    item.displayName = std::move(name);
-                } else {
-                    enqueueUserResolve(item.recipientId);
-                    item.displayName = "User " + item.recipientId.substr(0, 8);
-                }
-
-                if (std::string avatarUrl = resolveAvatarUrl(item.recipientId); !avatarUrl.empty()) {
-                    item.avatarUrl = makeStaticAvatarUrl(avatarUrl);
-                    item.animatedAvatarUrl = isGifUrl(avatarUrl) ? avatarUrl : "";
-                }
-                item.avatarLabel = item.displayName;
+                item.avatarLabel = users[0].getDisplayName();
             } else {
-                item.displayName = "Unknown DM";
                 item.avatarLabel = item.displayName;
             }
 
-            item.showStatus = !item.recipientId.empty();
-        }
-
-        m_dms.push_back(item);
-    }
-
-    updateStatuses(state.userStatuses);
-
-    if (!discoveredUsers.empty()) {
-        Store::get().update([users = std::move(discoveredUsers)](AppState &state) mutable {
-            bool changed = false;
-            for (auto &entry : users) {
-                changed |= upsertUser(state.usersById, entry.second);
-            }
-            if (changed) {
-                state.usersRevision++;
+            if (users.size() > 1) {
+                std::string avatar2Url = users[1].getAvatarUrl(64);
+                item.secondaryAvatarUrl = makeStaticAvatarUrl(avatar2Url);
+                item.secondaryAnimatedAvatarUrl = isGifUrl(avatar2Url) ? avatar2Url : "";
+                item.secondaryAvatarLabel = users[1].getDisplayName();
             }
-        });
-    }
-}
-
-void DMSidebar::updateStatuses(const std::unordered_map<std::string, std::string> &statuses) {
-    for (auto &dm : m_dms) {
-        if (!dm.showStatus || dm.recipientId.empty()) {
-            dm.status = "offline";
-            continue;
+        } else {
+            item.avatarLabel = item.displayName;
         }
+    } else {
+        if (!channel.recipients.empty()) {
+            const User &user = channel.recipients[0];
+            item.displayName = user.getDisplayName();
+            item.recipientId = user.id;
+            std::string avatarUrl = user.getAvatarUrl(64);
+            item.avatarUrl = makeStaticAvatarUrl(avatarUrl);
+            item.animatedAvatarUrl = isGifUrl(avatarUrl) ? avatarUrl : "";
+            item.avatarLabel = item.displayName;
+        } else if (!channel.recipientIds.empty()) {
+            item.recipientId = channel.recipientIds[0];
+            tryDiscoverUserFromDb(channel, item.recipientId);
+
+            if (std::string name = resolveDisplayName(item.recipientId); !name.empty()) {
+                item.displayName = std::move(name);
+            } else {
+                enqueueUserResolve(item.recipientId);
+                item.displayName = "User " + item.recipientId.substr(0, 8);
+            }
 
-        auto it = statuses.find(dm.recipientId);
-        if (it != statuses.end()) {
-            dm.status = it->second;
+            if (std::string avatarUrl = resolveAvatarUrl(item.recipientId); !avatarUrl.empty()) {
+                item.avatarUrl = makeStaticAvatarUrl(avatarUrl);
+                item.animatedAvatarUrl = isGifUrl(avatarUrl) ? avatarUrl : "";
+            }
+            item.avatarLabel = item.displayName;
         } else {
-            dm.status = "offline";
+            item.displayName = "Unknown DM";
+            item.avatarLabel = item.displayName;
         }
+
+        item.showStatus = !item.recipientId.empty();
     }
 }
 
@@ -883,7 +902,7 @@ Fl_RGB_Image *DMSidebar::getCircularAvatar(const std::string &url, int size) {
         return it->second.get();
     }
 
-    if (Fl_RGB_Image *cached = Images::getCachedImage(url)) {
+    if (Fl_RGB_Image *cached = Images::getCachedImage(Images::scaledCacheKey(url, size, size))) {
         if (Fl_RGB_Image *circular = Images::makeCircular(cached, size)) {
             m_avatarCache[key] = std::unique_ptr<Fl_RGB_Image>(circular);
             return circular;
@@ -908,7 +927,7 @@ void DMSidebar::requestCircularAvatar(const std::string &url, int size) {
 
     m_avatarPending.insert(key);
     auto alive = m_isAlive;
-    Images::loadImageAsync(url, [this, alive, url, key, size](Fl_RGB_Image *image) {
+    Images::loadScaledImageAsync(url, size, size, [this, alive, key, size](Fl_RGB_Image *image) {
         if (!alive || !*alive) {
             return;
         }
@@ -941,16 +960,11 @@ Fl_RGB_Image *DMSidebar::getAnimatedAvatarFrame(const std::string &gifUrl, int s
     }
 
     auto &state = it->second;
-    if (!state.animation || state.frames.empty()) {
-        return nullptr;
-    }
-
-    size_t index = state.animation->getCurrentFrameIndex();
-    if (index >= state.frames.size() || !state.frames[index]) {
+    if (!state.animation) {
         return nullptr;
     }
 
-    return state.frames[index].get();
+    return state.animation->circularFrame(size);
 }
 
 void DMSidebar::ensureAnimatedAvatar(const std::string &gifUrl, int size) {
@@ -973,50 +987,19 @@ void DMSidebar::ensureAnimatedAvatar(const std::string &gifUrl, int size) {
     m_avatarGifPending.insert(cacheKey);
 
     auto alive = m_isAlive;
-    Images::loadImageAsync(gifUrl, [this, alive, gifUrl, size, cacheKey](Fl_RGB_Image *image) {
+    AnimationRegistry::load(gifUrl, [this, alive, cacheKey](AnimationRegistry::Handle animation) {
         if (!alive || !*alive) {
             return;
         }
 
         m_avatarGifPending.erase(cacheKey);
 
-        if (!image) {
-            return;
-        }
-
-        std::string gifPath = Images::getCacheFilePath(gifUrl, "gif");
-        if (!std::filesystem::exists(gifPath)) {
-            return;
-        }
-
-        auto animation = std::make_unique<GifAnimation>(gifPath, GifAnimation::ScalingStrategy::Lazy);
-        if (!animation || !animation->isValid() || !animation->isAnimated()) {
+        if (!animation || !animation->isAnimated()) {
             return;
         }
 
         AnimatedAvatarState state;
         state.animation = std::move(animation);
-
-        size_t frameCount = state.animation->frameCount();
-        state.frames.reserve(frameCount);
-
-        for (size_t i = 0; i < frameCount; ++i) {
-            Fl_RGB_Image *frame = state.animation->getFrame(i);
-            if (!frame) {
-                state.frames.emplace_back(nullptr);
-                continue;
-            }
-            Fl_RGB_Image *circularFrame = Images::makeCircular(frame, size);
-            state.frames.emplace_back(circularFrame);
-        }
-
-        bool hasFrame = std::any_of(state.frames.begin(), state.frames.end(),
-                                    [](const std::unique_ptr<Fl_RGB_Image> &frame) { return frame != nullptr; });
-        if (!hasFrame) {
-            return;
-        }
-
-        state.animation->setFrame(0);
         m_avatarGifCache[cacheKey] = std::move(state);
 
         if (m_hoveredAvatarKey == cacheKey) {
@@ -1043,23 +1026,22 @@ void DMSidebar::setHoveredAvatarKey(const std::string &key) {
     }
 }
 
-bool DMSidebar::updateAvatarAnimation(const std::string &key) {
+double DMSidebar::updateAvatarAnimation(const std::string &key) {
     auto it = m_avatarGifCache.find(key);
     if (it == m_avatarGifCache.end()) {
-        return false;
+        return AnimationManager::STOP;
     }
 
     auto &state = it->second;
-    if (!state.animation || !state.animation->isAnimated() || state.frames.empty()) {
-        return false;
+    if (!state.animation || !state.animation->isAnimated()) {
+        return AnimationManager::STOP;
     }
 
-    bool advanced = state.animation->advance(AnimationManager::get().getFrameTime());
-    if (advanced) {
+    if (state.animation->sync()) {
         redraw();
     }
 
-    return true;
+    return state.animation->timeUntilNextFrame();
 }
 
 void DMSidebar::startAvatarAnimation(const std::string &key) {
@@ -1074,14 +1056,15 @@ void DMSidebar::startAvatarAnimation(const std::string &key) {
     }
 
     state.running = true;
-    state.frameTimeAccumulated = 0.0;
+    state.animation->play();
 
     if (state.animationId != 0) {
         AnimationManager::get().unregisterAnimation(state.animationId);
         state.animationId = 0;
     }
 
-    state.animationId = AnimationManager::get().registerAnimation([this, key]() { return updateAvatarAnimation(key); });
+    state.animationId = AnimationManager::get().registerScheduledAnimation(
+        [this, key](double) { return updateAvatarAnimation(key); }, state.animation->timeUntilNextFrame());
 }
 
 void DMSidebar::stopAvatarAnimation(const std::string &key) {
@@ -1101,9 +1084,8 @@ void DMSidebar::stopAvatarAnimation(const std::string &key) {
     }
 
     state.running = false;
-    state.frameTimeAccumulated = 0.0;
     if (state.animation) {
-        state.animation->reset();
+        state.animation->stop();
     }
 }
 
@@ -18,6 +18,7 @@
 #include "ui/Theme.h"
 #include "ui/components/GuildFolderWidget.h"
 #include "ui/components/GuildIcon.h"
+#include "utils/FrameProfiler.h"
 #include "utils/Logger.h"
 
 namespace {
@@ -229,10 +230,30 @@ void GuildBar::setOnGuildSelected(std::function<void(const std::string &)> cb) {
 }
 
 void GuildBar::draw() {
+    FrameProfiler::Scope profile("GuildBar::draw");
     if (!damage()) {
         return;
     }
 
+    // Animated icons and indicators damage only themselves; repaint the bar row behind each of them
+    // instead of every icon in the bar
+    if (damage() == FL_DAMAGE_CHILD) {
+        fl_push_clip(x(), y(), w(), h());
+        for (int i = 0; i < children(); i++) {
+            Fl_Widget &widget = *child(i);
+            if (!widget.visible() || !widget.damage()) {
+                continue;
+            }
+            fl_push_clip(x(), widget.y(), w(), widget.h());
+            fl_color(color());
+            fl_rectf(x(), widget.y(), w(), widget.h());
+            draw_child(widget);
+            fl_pop_clip();
+        }
+        fl_pop_clip();
+        return;
+    }
+
     draw_box();
     draw_children();
 }
@@ -283,12 +304,42 @@ void GuildBar::refresh() {
     }
 
     if (needsRebuild) {
+        // Guild icons are kept across the rebuild, keyed by whether they sat in a folder, so they keep their
+        // loaded image and rendered body instead of redecoding and remasking every icon of the bar
+        std::unordered_map<std::string, GuildIcon *> reusableIcons;
+        auto keepIcon = [&reusableIcons](GuildIcon *icon, bool inFolder) {
+            return reusableIcons.emplace((inFolder ? "f:" : "g:") + icon->guildId(), icon).second;
+        };
         while (children() > 0) {
             auto *w = child(children() - 1);
             remove(w);
+            if (auto *icon = dynamic_cast<GuildIcon *>(w); icon && keepIcon(icon, false)) {
+                continue;
+            }
+            if (auto *folder = dynamic_cast<GuildFolderWidget *>(w)) {
+                while (folder->children() > 0) {
+                    auto *preview = folder->child(folder->children() - 1);
+                    folder->remove(preview);
+                    auto *icon = dynamic_cast<GuildIcon *>(preview);
+                    if (!icon || !keepIcon(icon, true)) {
+                        delete preview;
+                    }
+                }
+            }
             delete w;
         }
 
+        auto makeIcon = [&](const GuildInfo &guild, bool inFolder) {
+            auto it = reusableIcons.find((inFolder ? "f:" : "g:") + guild.id);
+            if (it != reusableIcons.end() && it->second->shows(guild.icon, guild.name, iconSize)) {
+                GuildIcon *icon = it->second;
+                reusableIcons.erase(it);
+                add(icon);
+                return icon;
+            }
+            return new GuildIcon(0, 0, iconSize, guild.id, guild.icon, guild.name);
+        };
+
         begin();
 
         auto *home = new HomeIcon(0, 0, iconSize, iconSize);
@@ -336,8 +387,7 @@ void GuildBar::refresh() {
                 for (const auto &guildId : folder.guildIds) {
                     const GuildInfo *guild = findGuild(guildId);
                     if (guild) {
-                        auto *icon = new GuildIcon(0, 0, iconSize, guild->id, guild->icon, guild->name);
-                        bindGuildIcon(icon);
+                        bindGuildIcon(makeIcon(*guild, false));
                     }
                 }
             } else {
@@ -349,7 +399,7 @@ void GuildBar::refresh() {
                 for (const auto &guildId : folder.guildIds) {
                     const GuildInfo *guild = findGuild(guildId);
                     if (guild) {
-                        auto *icon = new GuildIcon(0, 0, iconSize, guild->id, guild->icon, guild->name);
+                        auto *icon = makeIcon(*guild, true);
                         bindGuildIcon(icon);
                         folderWidget->addGuild(icon);
                     }
@@ -361,12 +411,14 @@ void GuildBar::refresh() {
 
         for (const auto &guild : guilds) {
             if (guildsInAnyFolder.find(guild.id) == guildsInAnyFolder.end()) {
-                auto *icon = new GuildIcon(0, 0, iconSize, guild.id, guild.icon, guild.name);
-                bindGuildIcon(icon);
+                bindGuildIcon(makeIcon(guild, false));
             }
         }
 
         end();
+        for (const auto &[key, icon] : reusableIcons) {
+            delete icon;
+        }
         m_layoutSignature = std::move(newSignature);
     }
 
@@ -477,6 +529,7 @@ void GuildBar::resize(int x, int y, int w, int h) {
 }
 
 int GuildBar::handle(int event) {
+    FrameProfiler::Scope profile("GuildBar::handle");
     if (event == FL_MOUSEWHEEL) {
         if (!Fl::event_inside(this)) {
             return Fl_Group::handle(event);
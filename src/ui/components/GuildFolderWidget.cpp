@@ -12,6 +12,7 @@
 #include "ui/Theme.h"
 #include "ui/components/GuildBar.h"
 #include "ui/components/GuildIcon.h"
+#include "utils/Images.h"
 
 namespace {
 int getGuildBarLeftX(const Fl_Widget *widget) {
@@ -44,6 +45,16 @@ void drawIndicatorBar(int leftX, int y, int height, Fl_Color color) {
     fl_pie(leftX + width - (radius * 2), y, radius * 2, radius * 2, 0, 90);
     fl_pie(leftX + width - (radius * 2), y + barHeight - (radius * 2), radius * 2, radius * 2, 270, 360);
 }
+
+Fl_RGB_Image *makeRoundedFill(Fl_Color color, int width, int height, int radius) {
+    uchar red = 0;
+    uchar green = 0;
+    uchar blue = 0;
+    Fl::get_color(color, red, green, blue);
+    const uchar pixel[3] = {red, green, blue};
+    Fl_RGB_Image swatch(pixel, 1, 1, 3);
+    return Images::makeRoundedRect(&swatch, width, height, radius);
+}
 } // namespace
 
 GuildFolderWidget::GuildFolderWidget(int x, int y, int size) : Fl_Group(x, y, size, size), iconSize_(size) {
@@ -286,14 +297,26 @@ void GuildFolderWidget::draw() {
 
     Fl_Color folderColor = color_ ? color_ : ThemeColors::BG_TERTIARY;
 
-    const int r = cornerRadius_;
-    fl_color(folderColor);
-    fl_pie(x(), y(), r * 2, r * 2, 90, 180);
-    fl_pie(x() + iconSize_ - r * 2, y(), r * 2, r * 2, 0, 90);
-    fl_pie(x(), y() + h() - r * 2, r * 2, r * 2, 180, 270);
-    fl_pie(x() + iconSize_ - r * 2, y() + h() - r * 2, r * 2, r * 2, 270, 360);
-    fl_rectf(x() + r, y(), iconSize_ - r * 2, h());
-    fl_rectf(x(), y() + r, iconSize_, h() - r * 2);
+    // A settled folder reuses one rendered background; while it expands or collapses the height changes
+    // every frame, so it is drawn directly
+    const bool settled = !animating_ && iconSize_ > 0 && h() > 0;
+    if (settled && (!background_ || background_->w() != iconSize_ || background_->h() != h() ||
+                    backgroundColor_ != folderColor)) {
+        background_.reset(makeRoundedFill(folderColor, iconSize_, h(), cornerRadius_));
+        backgroundColor_ = folderColor;
+    }
+    if (settled && background_) {
+        background_->draw(x(), y());
+    } else {
+        const int r = cornerRadius_;
+        fl_color(folderColor);
+        fl_pie(x(), y(), r * 2, r * 2, 90, 180);
+        fl_pie(x() + iconSize_ - r * 2, y(), r * 2, r * 2, 0, 90);
+        fl_pie(x(), y() + h() - r * 2, r * 2, r * 2, 180, 270);
+        fl_pie(x() + iconSize_ - r * 2, y() + h() - r * 2, r * 2, r * 2, 270, 360);
+        fl_rectf(x() + r, y(), iconSize_ - r * 2, h());
+        fl_rectf(x(), y() + r, iconSize_, h() - r * 2);
+    }
 
     int leftX = getGuildBarLeftX(this);
     int clipW = (x() + w()) - leftX;
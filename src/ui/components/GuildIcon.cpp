@@ -1,6 +1,7 @@
 #include "ui/components/GuildIcon.h"
 
 #include <FL/Fl.H>
+#include <FL/Fl_Image_Surface.H>
 #include <FL/Fl_RGB_Image.H>
 #include <FL/Fl_Window.H>
 #include <FL/fl_draw.H>
@@ -9,11 +10,10 @@
 
 #include <algorithm>
 #include <cmath>
-#include <filesystem>
 #include <mutex>
 #include <unordered_set>
 
-#include "ui/GifAnimation.h"
+#include "ui/AnimationRegistry.h"
 #include "ui/LayoutConstants.h"
 #include "ui/Theme.h"
 #include "ui/components/GuildBar.h"
@@ -70,6 +70,22 @@ void drawIndicatorBar(int leftX, int y, int height, Fl_Color color) {
     fl_pie(leftX + width - (radius * 2), y, radius * 2, radius * 2, 0, 90);
     fl_pie(leftX + width - (radius * 2), y + barHeight - (radius * 2), radius * 2, radius * 2, 270, 360);
 }
+
+std::string fallbackLabelFor(const std::string &guildName) { return guildName.empty() ? "?" : guildName.substr(0, 1); }
+
+// The initial shown for a guild without an icon, on its tile with transparent rounded corners
+Fl_RGB_Image *renderFallback(const std::string &label, int fontSize, int width, int height, int radius) {
+    Fl_Image_Surface surface(width, height);
+    Fl_Surface_Device::push_current(&surface);
+    fl_color(ThemeColors::BG_TERTIARY);
+    fl_rectf(0, 0, width, height);
+    fl_color(ThemeColors::TEXT_NORMAL);
+    fl_font(FL_HELVETICA_BOLD, fontSize);
+    fl_draw(label.c_str(), 0, 0, width, height, FL_ALIGN_CENTER);
+    std::unique_ptr<Fl_RGB_Image> tile(surface.image());
+    Fl_Surface_Device::pop_current();
+    return tile ? Images::makeRoundedRect(tile.get(), width, height, radius) : nullptr;
+}
 } // namespace
 
 GuildIcon::GuildIcon(int x, int y, int size, const std::string &guildId, const std::string &iconHash,
@@ -84,15 +100,12 @@ GuildIcon::GuildIcon(int x, int y, int size, const std::string &guildId, const s
 
     isAnimated_ = !iconHash.empty() && iconHash.rfind("a_", 0) == 0;
 
-    if (!guildName.empty()) {
-        fallbackLabel_ = guildName.substr(0, 1);
-    } else {
-        fallbackLabel_ = "?";
-    }
+    fallbackLabel_ = fallbackLabelFor(guildName);
 
     if (!iconHash.empty()) {
-        std::string url = CDNUtils::getGuildIconUrl(guildId, iconHash, size, false);
-        Images::loadImageAsync(url, [this](Fl_RGB_Image *img) {
+        std::string url = CDNUtils::getGuildIconUrl(guildId, iconHash, size);
+        std::string imageKey = Images::scaledCacheKey(url, size, size);
+        Images::loadScaledImageAsync(url, size, size, [this, imageKey](Fl_RGB_Image *img) {
             {
                 std::scoped_lock lock(iconsMutex);
                 if (validIcons.find(this) == validIcons.end()) {
@@ -100,7 +113,12 @@ GuildIcon::GuildIcon(int x, int y, int size, const std::string &guildId, const s
                 }
             }
             if (img && img->w() > 0 && img->h() > 0) {
+                if (imageKey_.empty()) {
+                    Images::pinImage(imageKey);
+                    imageKey_ = imageKey;
+                }
                 image_ = img;
+                invalidateCache();
                 redraw();
             }
         });
@@ -112,6 +130,9 @@ GuildIcon::~GuildIcon() {
         std::scoped_lock lock(iconsMutex);
         validIcons.erase(this);
     }
+    if (!imageKey_.empty()) {
+        Images::unpinImage(imageKey_);
+    }
     stopAnimation();
     if (indicatorAnimationId_ != 0) {
         AnimationManager::get().unregisterAnimation(indicatorAnimationId_);
@@ -119,6 +140,10 @@ GuildIcon::~GuildIcon() {
     }
 }
 
+bool GuildIcon::shows(const std::string &iconHash, const std::string &guildName, int size) const {
+    return iconHash_ == iconHash && fallbackLabel_ == fallbackLabelFor(guildName) && iconSize_ == size;
+}
+
 int GuildIcon::handle(int event) {
     switch (event) {
     case FL_ENTER:
@@ -143,6 +168,12 @@ int GuildIcon::handle(int event) {
         }
         return 1;
 
+    case FL_HIDE:
+        // Collapsed into a folder or hidden with the guild bar; the hover that started the animation is over
+        isHovered_ = false;
+        stopAnimation();
+        return Fl_Box::handle(event);
+
     default:
         return Fl_Box::handle(event);
     }
@@ -219,7 +250,9 @@ bool GuildIcon::updateIndicatorAnimation() {
 void GuildIcon::startAnimation() {
     if (!animationRunning_ && gifAnimation_ && gifAnimation_->isAnimated()) {
         animationRunning_ = true;
-        animationId_ = AnimationManager::get().registerAnimation([this]() { return updateAnimation(); });
+        gifAnimation_->play();
+        animationId_ = AnimationManager::get().registerScheduledAnimation(
+            [this](double) { return updateAnimation(); }, gifAnimation_->timeUntilNextFrame());
     }
 }
 
@@ -230,26 +263,28 @@ void GuildIcon::stopAnimation() {
             animationId_ = 0;
         }
         animationRunning_ = false;
+        if (gifAnimation_) {
+            gifAnimation_->stop();
+        }
     }
 }
 
-bool GuildIcon::updateAnimation() {
+double GuildIcon::updateAnimation() {
     if (!gifAnimation_ || !gifAnimation_->isAnimated() || !animationRunning_) {
         animationId_ = 0;
         animationRunning_ = false;
-        return false;
+        return AnimationManager::STOP;
     }
 
     if (window() && !window()->shown()) {
-        return true;
+        return gifAnimation_->timeUntilNextFrame();
     }
 
-    bool advanced = gifAnimation_->advance(AnimationManager::get().getFrameTime());
-    if (advanced && visible_r()) {
+    if (gifAnimation_->sync() && visible_r()) {
         redraw();
     }
 
-    return true;
+    return gifAnimation_->timeUntilNextFrame();
 }
 
 bool GuildIcon::ensureGifLoaded() {
@@ -258,43 +293,33 @@ bool GuildIcon::ensureGifLoaded() {
     if (gifAnimation_)
         return true;
 
-    std::string url = CDNUtils::getGuildIconUrl(guildId_, iconHash_, iconSize_, false);
-    std::string gifPath = Images::getCacheFilePath(url, "gif");
+    std::string url = CDNUtils::getGuildIconUrl(guildId_, iconHash_, iconSize_);
+    if (auto animation = AnimationRegistry::find(url)) {
+        gifAnimation_ = std::move(animation);
+        return true;
+    }
 
-    if (!std::filesystem::exists(gifPath)) {
-        Images::loadImageAsync(url, [this](Fl_RGB_Image *img) {
-            {
-                std::scoped_lock lock(iconsMutex);
-                if (validIcons.find(this) == validIcons.end()) {
-                    return;
-                }
-            }
-            if (!img) {
+    AnimationRegistry::load(url, [this](AnimationRegistry::Handle animation) {
+        {
+            std::scoped_lock lock(iconsMutex);
+            if (validIcons.find(this) == validIcons.end()) {
                 return;
             }
-            if (ensureGifLoaded() && isHovered_) {
-                startAnimation();
-            }
-            redraw();
-        });
-        Logger::debug("GIF not yet cached for animated icon: " + guildId_);
-        return false;
-    }
-
-    try {
-        gifAnimation_ = std::make_unique<GifAnimation>(gifPath, GifAnimation::ScalingStrategy::Lazy);
-        if (!gifAnimation_->isValid()) {
-            Logger::warn("Failed to load GIF animation from: " + gifPath);
-            gifAnimation_.reset();
-            return false;
         }
-        Logger::debug("Loaded GIF animation for guild: " + guildId_);
-        return true;
-    } catch (const std::exception &e) {
-        Logger::error("Exception loading GIF animation: " + std::string(e.what()));
-        gifAnimation_.reset();
-        return false;
-    }
+        if (!animation) {
+            Logger::warn("Failed to load GIF animation for guild: " + guildId_);
+            return;
+        }
+        if (!gifAnimation_) {
+            gifAnimation_ = std::move(animation);
+            Logger::debug("Loaded GIF animation for guild: " + guildId_);
+        }
+        if (isHovered_) {
+            startAnimation();
+        }
+        redraw();
+    });
+    return false;
 }
 
 void GuildIcon::draw() {
@@ -304,22 +329,83 @@ void GuildIcon::draw() {
         drawIndicatorBar(getGuildBarLeftX(this), indicatorY, indicatorHeight, ThemeColors::TEXT_NORMAL);
     }
 
-    Fl_Image *displayImage = nullptr;
+    // A playing GIF changes every frame, so it is drawn straight to the window. Animated frames are scaled on
+    // a worker; the still icon stays up until the first one is ready.
     if (isAnimated_ && isHovered_ && gifAnimation_) {
-        displayImage = gifAnimation_->currentFrame();
-    } else {
-        displayImage = image_;
+        if (Fl_Image *frame = gifAnimation_->scaledFrame(w(), h())) {
+            drawBody(x(), y(), frame);
+            return;
+        }
+    }
+
+    // The still icon, or the initial shown until it loads, is rendered once into an image with transparent
+    // corners, so the bar or folder behind it shows through, and FLTK keeps the converted image for the blits
+    // of later draws
+    if (Fl_RGB_Image *body = cachedBody()) {
+        body->draw(x(), y());
+        return;
+    }
+    drawBody(x(), y(), image_);
+}
+
+void GuildIcon::resize(int x, int y, int w, int h) {
+    if (w != this->w() || h != this->h()) {
+        invalidateCache();
+    }
+    Fl_Box::resize(x, y, w, h);
+}
+
+void GuildIcon::setCornerRadius(int radius) {
+    if (cornerRadius_ == radius) {
+        return;
+    }
+    cornerRadius_ = radius;
+    invalidateCache();
+    redraw();
+}
+
+void GuildIcon::setMaskColor(Fl_Color color) {
+    if (maskColor_ == color) {
+        return;
+    }
+    maskColor_ = color;
+    redraw();
+}
+
+void GuildIcon::setFallbackFontSize(int size) {
+    if (fallbackFontSize_ == size) {
+        return;
+    }
+    fallbackFontSize_ = size;
+    if (!image_) {
+        invalidateCache();
+    }
+}
+
+void GuildIcon::invalidateCache() { cache_.reset(); }
+
+Fl_RGB_Image *GuildIcon::cachedBody() {
+    if (cache_ || w() <= 0 || h() <= 0) {
+        return cache_.get();
     }
+    if (!image_) {
+        cache_.reset(renderFallback(fallbackLabel_, fallbackFontSize_, w(), h(), cornerRadius_));
+    } else if (auto *source = dynamic_cast<Fl_RGB_Image *>(image_); source && !source->fail()) {
+        cache_.reset(Images::makeRoundedRect(source, w(), h(), cornerRadius_));
+    }
+    return cache_.get();
+}
 
-    if (displayImage && !displayImage->fail()) {
-        Fl_Image *scaledImage = displayImage;
-        if (displayImage->w() != w() || displayImage->h() != h()) {
-            scaledImage = displayImage->copy(w(), h());
+void GuildIcon::drawBody(int X, int Y, Fl_Image *image) {
+    if (image && !image->fail()) {
+        Fl_Image *scaledImage = image;
+        if (image->w() != w() || image->h() != h()) {
+            scaledImage = image->copy(w(), h());
         }
 
-        scaledImage->draw(x(), y());
+        scaledImage->draw(X, Y);
 
-        if (scaledImage != displayImage) {
+        if (scaledImage != image) {
             delete scaledImage;
         }
 
@@ -330,57 +416,57 @@ void GuildIcon::draw() {
         const int steps = 45;
 
         fl_begin_polygon();
-        fl_vertex(x() - 1, y() - 1);
-        fl_vertex(x() + r + 1, y() - 1);
+        fl_vertex(X - 1, Y - 1);
+        fl_vertex(X + r + 1, Y - 1);
         for (int i = 1; i < steps; i++) {
             double angle = M_PI * 1.5 - (M_PI * 0.5 * i / steps);
-            fl_vertex(x() + r + std::cos(angle) * r, y() + r + std::sin(angle) * r);
+            fl_vertex(X + r + std::cos(angle) * r, Y + r + std::sin(angle) * r);
         }
-        fl_vertex(x() - 1, y() + r + 1);
+        fl_vertex(X - 1, Y + r + 1);
         fl_end_polygon();
 
         fl_begin_polygon();
-        fl_vertex(x() + w() - r - 1, y() - 1);
-        fl_vertex(x() + w() + 1, y() - 1);
-        fl_vertex(x() + w() + 1, y() + r + 1);
+        fl_vertex(X + w() - r - 1, Y - 1);
+        fl_vertex(X + w() + 1, Y - 1);
+        fl_vertex(X + w() + 1, Y + r + 1);
         for (int i = 1; i < steps; i++) {
             double angle = M_PI * 2.0 - (M_PI * 0.5 * i / steps);
-            fl_vertex(x() + w() - r + std::cos(angle) * r, y() + r + std::sin(angle) * r);
+            fl_vertex(X + w() - r + std::cos(angle) * r, Y + r + std::sin(angle) * r);
         }
         fl_end_polygon();
 
         fl_begin_polygon();
-        fl_vertex(x() - 1, y() + h() - r - 1);
+        fl_vertex(X - 1, Y + h() - r - 1);
         for (int i = 1; i < steps; i++) {
             double angle = M_PI - (M_PI * 0.5 * i / steps);
-            fl_vertex(x() + r + std::cos(angle) * r, y() + h() - r + std::sin(angle) * r);
+            fl_vertex(X + r + std::cos(angle) * r, Y + h() - r + std::sin(angle) * r);
         }
-        fl_vertex(x() + r + 1, y() + h() + 1);
-        fl_vertex(x() - 1, y() + h() + 1);
+        fl_vertex(X + r + 1, Y + h() + 1);
+        fl_vertex(X - 1, Y + h() + 1);
         fl_end_polygon();
 
         fl_begin_polygon();
-        fl_vertex(x() + w() + 1, y() + h() - r - 1);
-        fl_vertex(x() + w() + 1, y() + h() + 1);
-        fl_vertex(x() + w() - r - 1, y() + h() + 1);
+        fl_vertex(X + w() + 1, Y + h() - r - 1);
+        fl_vertex(X + w() + 1, Y + h() + 1);
+        fl_vertex(X + w() - r - 1, Y + h() + 1);
         for (int i = 1; i < steps; i++) {
             double angle = M_PI * 0.5 - (M_PI * 0.5 * i / steps);
-            fl_vertex(x() + w() - r + std::cos(angle) * r, y() + h() - r + std::sin(angle) * r);
+            fl_vertex(X + w() - r + std::cos(angle) * r, Y + h() - r + std::sin(angle) * r);
         }
         fl_end_polygon();
     } else {
         fl_color(ThemeColors::BG_TERTIARY);
 
         const int r = cornerRadius_;
-        fl_pie(x(), y(), r * 2, r * 2, 90, 180);
-        fl_pie(x() + w() - r * 2, y(), r * 2, r * 2, 0, 90);
-        fl_pie(x(), y() + h() - r * 2, r * 2, r * 2, 180, 270);
-        fl_pie(x() + w() - r * 2, y() + h() - r * 2, r * 2, r * 2, 270, 360);
-        fl_rectf(x() + r, y(), w() - r * 2, h());
-        fl_rectf(x(), y() + r, w(), h() - r * 2);
+        fl_pie(X, Y, r * 2, r * 2, 90, 180);
+        fl_pie(X + w() - r * 2, Y, r * 2, r * 2, 0, 90);
+        fl_pie(X, Y + h() - r * 2, r * 2, r * 2, 180, 270);
+        fl_pie(X + w() - r * 2, Y + h() - r * 2, r * 2, r * 2, 270, 360);
+        fl_rectf(X + r, Y, w() - r * 2, h());
+        fl_rectf(X, Y + r, w(), h() - r * 2);
 
         fl_color(ThemeColors::TEXT_NORMAL);
         fl_font(FL_HELVETICA_BOLD, fallbackFontSize_);
-        fl_draw(fallbackLabel_.c_str(), x(), y(), w(), h(), FL_ALIGN_CENTER);
+        fl_draw(fallbackLabel_.c_str(), X, Y, w(), h(), FL_ALIGN_CENTER);
     }
 }
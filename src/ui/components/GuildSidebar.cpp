@@ -20,7 +20,6 @@
 
 #include <algorithm>
 #include <cstring>
-#include <filesystem>
 #include <functional>
 #include <fstream>
 #include <map>
@@ -166,6 +165,7 @@ GuildSidebar::~GuildSidebar() {
         *m_isAlive = false;
     }
     stopBannerAnimation();
+    releaseBannerImage();
     if (m_storeListenerId) {
         Store::get().unsubscribe(m_storeListenerId);
     }
@@ -308,10 +308,13 @@ void GuildSidebar::drawBanner() {
     int bannerW = w();
     const int bannerHeight = LayoutConstants::kGuildBannerHeight;
 
+    // Animated frames arrive already cropped and scaled to the banner from a worker; the still banner is
+    // shown until the first one is ready
     Fl_RGB_Image *sourceImage = nullptr;
     if (m_bannerGif && m_bannerGif->isValid()) {
-        sourceImage = m_bannerGif->currentFrame();
-    } else if (m_bannerImage) {
+        sourceImage = m_bannerGif->getScaledFrame(bannerW, bannerHeight, Images::ScaleMode::Cover);
+    }
+    if (!sourceImage) {
         sourceImage = m_bannerImage;
     }
 
@@ -333,12 +336,15 @@ void GuildSidebar::drawBanner() {
         const float sourceAspect = static_cast<float>(sourceImage->w()) / static_cast<float>(sourceImage->h());
 
         int cropX = 0, cropY = 0, cropW = sourceImage->w(), cropH = sourceImage->h();
-        if (sourceAspect > targetAspect) {
-            cropW = static_cast<int>(sourceImage->h() * targetAspect);
-            cropX = (sourceImage->w() - cropW) / 2;
-        } else if (sourceAspect < targetAspect) {
-            cropH = static_cast<int>(sourceImage->w() / targetAspect);
-            cropY = (sourceImage->h() - cropH) / 2;
+        // A frame already scaled to the banner is copied as is
+        if (sourceImage->w() != bannerW || sourceImage->h() != bannerHeight) {
+            if (sourceAspect > targetAspect) {
+                cropW = static_cast<int>(sourceImage->h() * targetAspect);
+                cropX = (sourceImage->w() - cropW) / 2;
+            } else if (sourceAspect < targetAspect) {
+                cropH = static_cast<int>(sourceImage->w() / targetAspect);
+                cropY = (sourceImage->h() - cropH) / 2;
+            }
         }
 
         const char *const *dataArray = sourceImage->data();
@@ -610,6 +616,11 @@ int GuildSidebar::handle(int event) {
         redraw();
         return 1;
     }
+
+    case FL_SHOW:
+    case FL_HIDE:
+        setBannerAnimationSuspended(event == FL_HIDE);
+        break;
     }
 
     return Fl_Group::handle(event);
@@ -624,7 +635,7 @@ void GuildSidebar::setGuild(const std::string &guildId, const std::string &guild
 void GuildSidebar::setBannerUrl(const std::string &bannerUrl) {
     if (m_bannerUrl != bannerUrl) {
         m_bannerUrl = bannerUrl;
-        m_bannerImage = nullptr;
+        releaseBannerImage();
         if (!m_bannerUrl.empty()) {
             loadBannerImage();
         }
@@ -638,6 +649,14 @@ void GuildSidebar::setBoostInfo(int premiumTier, int subscriptionCount) {
     redraw();
 }
 
+void GuildSidebar::releaseBannerImage() {
+    m_bannerImage = nullptr;
+    if (!m_pinnedBannerUrl.empty()) {
+        Images::unpinImage(m_pinnedBannerUrl);
+        m_pinnedBannerUrl.clear();
+    }
+}
+
 void GuildSidebar::loadBannerImage() {
     if (m_bannerUrl.empty())
         return;
@@ -645,8 +664,11 @@ void GuildSidebar::loadBannerImage() {
     m_bannerHasPlayedOnce = false;
     m_bannerHovered = false;
 
-    Images::loadImageAsync(m_bannerUrl, [this](Fl_RGB_Image *image) {
-        if (image) {
+    Images::loadImageAsync(m_bannerUrl, [this, url = m_bannerUrl](Fl_RGB_Image *image) {
+        if (image && url == m_bannerUrl) {
+            releaseBannerImage();
+            Images::pinImage(url);
+            m_pinnedBannerUrl = url;
             m_bannerImage = image;
 
             if (m_isAnimatedBanner && ensureBannerGifLoaded()) {
@@ -669,20 +691,21 @@ bool GuildSidebar::ensureBannerGifLoaded() {
     if (m_bannerGif)
         return true;
 
-    std::string gifPath = Images::getCacheFilePath(m_bannerUrl, "gif");
-
-    if (!std::filesystem::exists(gifPath)) {
+    auto gifData = Images::readCachedFile(m_bannerUrl, "gif");
+    if (!gifData) {
         Logger::debug("GIF not yet cached for animated banner: " + m_guildId);
         return false;
     }
 
     try {
-        m_bannerGif = std::make_unique<GifAnimation>(gifPath, GifAnimation::ScalingStrategy::Lazy);
+        m_bannerGif = std::make_unique<GifAnimation>(reinterpret_cast<const unsigned char *>(gifData->data()),
+                                                     gifData->size(), GifAnimation::ScalingStrategy::Lazy);
         if (!m_bannerGif->isValid()) {
-            Logger::warn("Failed to load GIF animation from: " + gifPath);
+            Logger::warn("Failed to load GIF animation for guild banner: " + m_guildId);
             m_bannerGif.reset();
             return false;
         }
+        m_bannerGif->setFrameReadyCallback([this]() { redraw(); });
         Logger::debug("Loaded GIF animation for guild banner: " + m_guildId);
         return true;
     } catch (const std::exception &e) {
@@ -692,11 +715,11 @@ bool GuildSidebar::ensureBannerGifLoaded() {
     }
 }
 
-bool GuildSidebar::updateBannerAnimation() {
+double GuildSidebar::updateBannerAnimation(double elapsed) {
     if (!m_bannerGif || !m_bannerGif->isAnimated())
-        return false;
+        return AnimationManager::STOP;
 
-    bool advanced = m_bannerGif->advance(AnimationManager::get().getFrameTime());
+    bool advanced = m_bannerGif->advance(elapsed);
     if (advanced) {
         size_t currentFrame = m_bannerGif->getCurrentFrameIndex();
 
@@ -705,14 +728,14 @@ bool GuildSidebar::updateBannerAnimation() {
             if (!m_bannerHovered) {
                 stopBannerAnimation();
                 redraw();
-                return false;
+                return AnimationManager::STOP;
             }
         }
 
         redraw();
     }
 
-    return true;
+    return m_bannerGif->timeUntilNextFrame();
 }
 
 void GuildSidebar::startBannerAnimation() {
@@ -720,7 +743,9 @@ void GuildSidebar::startBannerAnimation() {
         return;
 
     auto &animMgr = AnimationManager::get();
-    m_bannerAnimationId = animMgr.registerAnimation([this]() { return updateBannerAnimation(); });
+    m_bannerAnimationId = animMgr.registerScheduledAnimation(
+        [this](double elapsed) { return updateBannerAnimation(elapsed); }, m_bannerGif->timeUntilNextFrame());
+    setBannerAnimationSuspended(!visible_r());
 }
 
 void GuildSidebar::stopBannerAnimation() {
@@ -730,6 +755,20 @@ void GuildSidebar::stopBannerAnimation() {
     }
 }
 
+void GuildSidebar::setBannerAnimationSuspended(bool suspended) {
+    if (!m_bannerGif) {
+        return;
+    }
+    if (suspended) {
+        m_bannerGif->suspend();
+    } else {
+        m_bannerGif->resume();
+    }
+    if (m_bannerAnimationId != 0) {
+        AnimationManager::get().setSuspended(m_bannerAnimationId, suspended);
+    }
+}
+
 void GuildSidebar::addTextChannel(const std::string &channelId, const std::string &channelName) {
     ChannelItem item;
     item.id = channelId;
@@ -809,7 +848,7 @@ void GuildSidebar::setGuildId(const std::string &guildId) {
             } else {
                 m_bannerHash.clear();
                 m_bannerUrl.clear();
-                m_bannerImage = nullptr;
+                releaseBannerImage();
                 m_isAnimatedBanner = false;
                 m_bannerHasPlayedOnce = false;
                 m_bannerHovered = false;
@@ -1,25 +1,30 @@
 #include "ui/components/MessageWidget.h"
 
 #include "ui/AnimationManager.h"
+#include "ui/AnimationRegistry.h"
+#include "ui/EmojiAtlas.h"
 #include "ui/EmojiManager.h"
-#include "ui/GifAnimation.h"
 #include "ui/IconManager.h"
 #include "ui/RoundedWidget.h"
 #include "ui/Theme.h"
 #include "utils/Fonts.h"
 #include "utils/CDN.h"
 #include "utils/Images.h"
+#include "utils/Logger.h"
+#include "utils/TextMetrics.h"
+#include "utils/WorkerPool.h"
 
 #include <FL/fl_draw.H>
 
 #include <algorithm>
+#include <array>
 #include <cctype>
 #include <cmath>
 #include <ctime>
-#include <filesystem>
 #include <functional>
 #include <iomanip>
 #include <sstream>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -78,6 +83,7 @@ constexpr int kReplyLineThickness = 2;
 constexpr int kEmojiSize = 22;
 constexpr int kEmojiOnlySize = 48;
 constexpr int kEmojiRequestSize = 48;
+constexpr const char *kCustomEmojiUrlPrefix = "https://cdn.discordapp.com/emojis/";
 constexpr int kEmojiBaselineOffset = 3;
 constexpr int kCodeBlockPaddingX = 10;
 constexpr int kCodeBlockPaddingY = 10;
@@ -129,21 +135,28 @@ size_t utf8CharLength(unsigned char lead) {
     return 1;
 }
 
-struct AnimatedAvatarState {
-    std::unique_ptr<GifAnimation> animation;
-    std::vector<std::unique_ptr<Fl_RGB_Image>> frames;
-    AnimationManager::AnimationId animationId = 0;
-    double frameTimeAccumulated = 0.0;
-    bool running = false;
-};
-
+// Per draw key (URL and size) state of an animation shared through AnimationRegistry
 struct AnimatedMediaState {
-    std::unique_ptr<GifAnimation> animation;
+    AnimationRegistry::Handle animation;
     AnimationManager::AnimationId animationId = 0;
     bool running = false;
+    bool suspended = false; // Running but drawn outside the viewport
 };
 
-std::unordered_map<std::string, AnimatedAvatarState> avatar_gif_cache;
+void setAnimationSuspended(AnimatedMediaState &state, bool suspended) {
+    if (!state.running || !state.animation || state.suspended == suspended) {
+        return;
+    }
+    state.suspended = suspended;
+    if (suspended) {
+        state.animation->suspend();
+    } else {
+        state.animation->resume();
+    }
+    AnimationManager::get().setSuspended(state.animationId, suspended);
+}
+
+std::unordered_map<std::string, AnimatedMediaState> avatar_gif_cache;
 std::unordered_set<std::string> avatar_gif_pending;
 std::string hovered_avatar_key;
 std::string hovered_attachment_download_key;
@@ -151,6 +164,51 @@ std::string hovered_attachment_download_key;
 std::string buildAvatarCacheKey(const std::string &url, int size) { return url + "#" + std::to_string(size); }
 std::string buildEmojiCacheKey(const std::string &url, int size) { return url + "#" + std::to_string(size); }
 
+struct AnimatedRect {
+    int x = 0;
+    int y = 0;
+    int w = 0;
+    int h = 0;
+
+    bool operator==(const AnimatedRect &other) const {
+        return x == other.x && y == other.y && w == other.w && h == other.h;
+    }
+};
+
+// Window rectangles each animation key was drawn at since the owning view last cleared them, so a new
+// frame damages just those rectangles instead of redrawing every window
+std::unordered_map<std::string, std::vector<AnimatedRect>> animated_rects;
+int animated_rect_origin_x = 0;
+int animated_rect_origin_y = 0;
+const void *damage_handler_owner = nullptr;
+MessageWidget::DamageHandler damage_handler;
+
+void reportAnimatedRect(const std::string &key, int x, int y, int w, int h) {
+    if (key.empty() || w <= 0 || h <= 0) {
+        return;
+    }
+    AnimatedRect rect{x + animated_rect_origin_x, y + animated_rect_origin_y, w, h};
+    auto &rects = animated_rects[key];
+    if (std::find(rects.begin(), rects.end(), rect) == rects.end()) {
+        rects.push_back(rect);
+    }
+}
+
+void damageAnimation(const std::string &key) {
+    if (!damage_handler) {
+        Fl::redraw();
+        return;
+    }
+    // Nothing recorded means the animation is not on screen, so there is nothing to repaint
+    auto it = animated_rects.find(key);
+    if (it == animated_rects.end()) {
+        return;
+    }
+    for (const auto &rect : it->second) {
+        damage_handler(rect.x, rect.y, rect.w, rect.h);
+    }
+}
+
 bool isGifUrl(const std::string &url) {
     size_t pos = url.rfind(".gif");
     if (pos == std::string::npos) {
@@ -168,7 +226,7 @@ std::string makeStaticAvatarUrl(const std::string &url) {
     std::string staticUrl = url;
     size_t pos = staticUrl.rfind(".gif");
     if (pos != std::string::npos) {
-        staticUrl.replace(pos, 4, ".png");
+        staticUrl.replace(pos, 4, ".webp");
     }
     return staticUrl;
 }
@@ -189,33 +247,31 @@ std::string getAnimatedAvatarUrl(const Message &msg, int size) {
     return url;
 }
 
-bool updateAvatarAnimation(const std::string &key) {
+double updateAvatarAnimation(const std::string &key) {
     auto it = avatar_gif_cache.find(key);
     if (it == avatar_gif_cache.end()) {
-        return false;
+        return AnimationManager::STOP;
     }
 
     auto &state = it->second;
-    if (!state.running || !state.animation || state.frames.empty()) {
+    if (!state.running || !state.animation) {
         state.running = false;
         state.animationId = 0;
-        return false;
+        return AnimationManager::STOP;
     }
 
     if (key != hovered_avatar_key) {
         state.running = false;
         state.animationId = 0;
-        state.frameTimeAccumulated = 0.0;
-        state.animation->reset();
-        return false;
+        state.animation->stop();
+        return AnimationManager::STOP;
     }
 
-    bool advanced = state.animation->advance(AnimationManager::get().getFrameTime());
-    if (advanced) {
-        Fl::redraw();
+    if (state.animation->sync()) {
+        damageAnimation(key);
     }
 
-    return true;
+    return state.animation->timeUntilNextFrame();
 }
 
 void startAvatarAnimation(const std::string &key) {
@@ -225,12 +281,14 @@ void startAvatarAnimation(const std::string &key) {
     }
 
     auto &state = it->second;
-    if (state.running || !state.animation || !state.animation->isAnimated() || state.frames.size() <= 1) {
+    if (state.running || !state.animation || !state.animation->isAnimated()) {
         return;
     }
 
     state.running = true;
-    state.animationId = AnimationManager::get().registerAnimation([key]() { return updateAvatarAnimation(key); });
+    state.animation->play();
+    state.animationId = AnimationManager::get().registerScheduledAnimation(
+        [key](double) { return updateAvatarAnimation(key); }, state.animation->timeUntilNextFrame());
 }
 
 void stopAvatarAnimation(const std::string &key) {
@@ -244,40 +302,39 @@ void stopAvatarAnimation(const std::string &key) {
         return;
     }
 
+    setAnimationSuspended(state, false);
     if (state.animationId != 0) {
         AnimationManager::get().unregisterAnimation(state.animationId);
         state.animationId = 0;
     }
 
     state.running = false;
-    state.frameTimeAccumulated = 0.0;
     if (state.animation) {
-        state.animation->reset();
+        state.animation->stop();
     }
 }
 
 std::unordered_map<std::string, AnimatedMediaState> emoji_gif_cache;
 std::unordered_set<std::string> emoji_gif_pending;
 
-bool updateEmojiAnimation(const std::string &key) {
+double updateEmojiAnimation(const std::string &key) {
     auto it = emoji_gif_cache.find(key);
     if (it == emoji_gif_cache.end()) {
-        return false;
+        return AnimationManager::STOP;
     }
 
     auto &state = it->second;
     if (!state.running || !state.animation || !state.animation->isAnimated()) {
         state.running = false;
         state.animationId = 0;
-        return false;
+        return AnimationManager::STOP;
     }
 
-    bool advanced = state.animation->advance(AnimationManager::get().getFrameTime());
-    if (advanced) {
-        Fl::redraw();
+    if (state.animation->sync()) {
+        damageAnimation(key);
     }
 
-    return true;
+    return state.animation->timeUntilNextFrame();
 }
 
 void startEmojiAnimation(const std::string &key) {
@@ -292,7 +349,9 @@ void startEmojiAnimation(const std::string &key) {
     }
 
     state.running = true;
-    state.animationId = AnimationManager::get().registerAnimation([key]() { return updateEmojiAnimation(key); });
+    state.animation->play();
+    state.animationId = AnimationManager::get().registerScheduledAnimation(
+        [key](double) { return updateEmojiAnimation(key); }, state.animation->timeUntilNextFrame());
 }
 
 void stopEmojiAnimation(const std::string &key) {
@@ -306,6 +365,7 @@ void stopEmojiAnimation(const std::string &key) {
         return;
     }
 
+    setAnimationSuspended(state, false);
     if (state.animationId != 0) {
         AnimationManager::get().unregisterAnimation(state.animationId);
         state.animationId = 0;
@@ -313,7 +373,7 @@ void stopEmojiAnimation(const std::string &key) {
 
     state.running = false;
     if (state.animation) {
-        state.animation->reset();
+        state.animation->stop();
     }
 }
 
@@ -334,32 +394,16 @@ bool ensureAnimatedEmoji(const std::string &gifUrl, int size) {
 
     emoji_gif_pending.insert(cacheKey);
 
-    Images::loadImageAsync(gifUrl, [gifUrl, cacheKey](Fl_RGB_Image *image) {
-        auto clearPending = [&]() { emoji_gif_pending.erase(cacheKey); };
-
-        if (!image) {
-            clearPending();
-            return;
-        }
-
-        std::string gifPath = Images::getCacheFilePath(gifUrl, "gif");
-        if (!std::filesystem::exists(gifPath)) {
-            clearPending();
-            return;
-        }
-
-        auto animation = std::make_unique<GifAnimation>(gifPath, GifAnimation::ScalingStrategy::Lazy);
-        if (!animation || !animation->isValid()) {
-            clearPending();
+    AnimationRegistry::load(gifUrl, [cacheKey](AnimationRegistry::Handle animation) {
+        emoji_gif_pending.erase(cacheKey);
+        if (!animation) {
             return;
         }
 
         AnimatedMediaState state;
         state.animation = std::move(animation);
-        state.animation->reset();
         emoji_gif_cache[cacheKey] = std::move(state);
-        Images::evictFromMemory(gifUrl);
-        clearPending();
+
         Fl::redraw();
     });
 
@@ -374,7 +418,7 @@ bool ensureAnimatedAvatar(const std::string &gifUrl, int size) {
     std::string cacheKey = buildAvatarCacheKey(gifUrl, size);
     auto existing = avatar_gif_cache.find(cacheKey);
     if (existing != avatar_gif_cache.end()) {
-        return !existing->second.frames.empty();
+        return existing->second.animation != nullptr;
     }
 
     if (avatar_gif_pending.find(cacheKey) != avatar_gif_pending.end()) {
@@ -383,52 +427,15 @@ bool ensureAnimatedAvatar(const std::string &gifUrl, int size) {
 
     avatar_gif_pending.insert(cacheKey);
 
-    Images::loadImageAsync(gifUrl, [gifUrl, size, cacheKey](Fl_RGB_Image *image) {
-        auto clearPending = [&]() { avatar_gif_pending.erase(cacheKey); };
-
-        if (!image) {
-            clearPending();
+    AnimationRegistry::load(gifUrl, [cacheKey](AnimationRegistry::Handle animation) {
+        avatar_gif_pending.erase(cacheKey);
+        if (!animation) {
             return;
         }
 
-        std::string gifPath = Images::getCacheFilePath(gifUrl, "gif");
-        if (!std::filesystem::exists(gifPath)) {
-            clearPending();
-            return;
-        }
-
-        auto animation = std::make_unique<GifAnimation>(gifPath, GifAnimation::ScalingStrategy::Lazy);
-        if (!animation || !animation->isValid()) {
-            clearPending();
-            return;
-        }
-
-        AnimatedAvatarState state;
+        AnimatedMediaState state;
         state.animation = std::move(animation);
-
-        size_t frameCount = state.animation->frameCount();
-        state.frames.reserve(frameCount);
-
-        for (size_t i = 0; i < frameCount; ++i) {
-            Fl_RGB_Image *frame = state.animation->getFrame(i);
-            if (!frame) {
-                state.frames.emplace_back(nullptr);
-                continue;
-            }
-            Fl_RGB_Image *circularFrame = Images::makeCircular(frame, size);
-            state.frames.emplace_back(circularFrame);
-        }
-
-        bool hasFrame = std::any_of(state.frames.begin(), state.frames.end(),
-                                    [](const std::unique_ptr<Fl_RGB_Image> &frame) { return frame != nullptr; });
-        if (!hasFrame) {
-            clearPending();
-            return;
-        }
-
-        state.animation->setFrame(0);
         avatar_gif_cache[cacheKey] = std::move(state);
-        clearPending();
 
         if (hovered_avatar_key == cacheKey) {
             startAvatarAnimation(cacheKey);
@@ -454,16 +461,16 @@ Fl_RGB_Image *getAvatarImage(const Message &msg, int size) {
 
     if (avatar_pending.find(cacheKey) == avatar_pending.end()) {
         avatar_pending.insert(cacheKey);
-        Images::loadImageAsync(url, [cacheKey, size](Fl_RGB_Image *image) {
-            if (image && image->w() > 0 && image->h() > 0) {
-                Fl_RGB_Image *circular = Images::makeCircular(image, size);
+        Images::takeScaledImageAsync(
+            url, size, size,
+            [cacheKey](std::unique_ptr<Fl_RGB_Image> circular) {
                 if (circular) {
-                    avatar_cache[cacheKey] = std::unique_ptr<Fl_RGB_Image>(circular);
+                    avatar_cache[cacheKey] = std::move(circular);
                 }
-            }
-            avatar_pending.erase(cacheKey);
-            Fl::redraw();
-        });
+                avatar_pending.erase(cacheKey);
+                Fl::redraw();
+            },
+            Images::ScaleMode::Fill, [size](Fl_RGB_Image *image) { return Images::makeCircular(image, size); });
     }
 
     return nullptr;
@@ -472,25 +479,24 @@ Fl_RGB_Image *getAvatarImage(const Message &msg, int size) {
 std::unordered_map<std::string, AnimatedMediaState> sticker_gif_cache;
 std::unordered_set<std::string> sticker_gif_pending;
 
-bool updateStickerAnimation(const std::string &key) {
+double updateStickerAnimation(const std::string &key) {
     auto it = sticker_gif_cache.find(key);
     if (it == sticker_gif_cache.end()) {
-        return false;
+        return AnimationManager::STOP;
     }
 
     auto &state = it->second;
     if (!state.running || !state.animation || !state.animation->isAnimated()) {
         state.running = false;
         state.animationId = 0;
-        return false;
+        return AnimationManager::STOP;
     }
 
-    bool advanced = state.animation->advance(AnimationManager::get().getFrameTime());
-    if (advanced) {
-        Fl::redraw();
+    if (state.animation->sync()) {
+        damageAnimation(key);
     }
 
-    return true;
+    return state.animation->timeUntilNextFrame();
 }
 
 void startStickerAnimation(const std::string &key) {
@@ -505,7 +511,9 @@ void startStickerAnimation(const std::string &key) {
     }
 
     state.running = true;
-    state.animationId = AnimationManager::get().registerAnimation([key]() { return updateStickerAnimation(key); });
+    state.animation->play();
+    state.animationId = AnimationManager::get().registerScheduledAnimation(
+        [key](double) { return updateStickerAnimation(key); }, state.animation->timeUntilNextFrame());
 }
 
 void stopStickerAnimation(const std::string &key) {
@@ -519,6 +527,7 @@ void stopStickerAnimation(const std::string &key) {
         return;
     }
 
+    setAnimationSuspended(state, false);
     if (state.animationId != 0) {
         AnimationManager::get().unregisterAnimation(state.animationId);
         state.animationId = 0;
@@ -526,7 +535,7 @@ void stopStickerAnimation(const std::string &key) {
 
     state.running = false;
     if (state.animation) {
-        state.animation->reset();
+        state.animation->stop();
     }
 }
 
@@ -546,32 +555,16 @@ bool ensureAnimatedSticker(const std::string &gifUrl, const std::string &cacheKe
 
     sticker_gif_pending.insert(cacheKey);
 
-    Images::loadImageAsync(gifUrl, [gifUrl, cacheKey](Fl_RGB_Image *image) {
-        auto clearPending = [&]() { sticker_gif_pending.erase(cacheKey); };
-
-        if (!image) {
-            clearPending();
-            return;
-        }
-
-        std::string gifPath = Images::getCacheFilePath(gifUrl, "gif");
-        if (!std::filesystem::exists(gifPath)) {
-            clearPending();
-            return;
-        }
-
-        auto animation = std::make_unique<GifAnimation>(gifPath, GifAnimation::ScalingStrategy::Lazy);
-        if (!animation || !animation->isValid()) {
-            clearPending();
+    AnimationRegistry::load(gifUrl, [cacheKey](AnimationRegistry::Handle animation) {
+        sticker_gif_pending.erase(cacheKey);
+        if (!animation) {
             return;
         }
 
         AnimatedMediaState state;
         state.animation = std::move(animation);
-        state.animation->reset();
         sticker_gif_cache[cacheKey] = std::move(state);
-        Images::evictFromMemory(gifUrl);
-        clearPending();
+
         Fl::redraw();
     });
 
@@ -582,9 +575,14 @@ std::unordered_map<std::string, std::unique_ptr<Fl_RGB_Image>> sticker_cache;
 std::unordered_set<std::string> sticker_pending;
 std::unordered_map<std::string, std::unique_ptr<Fl_RGB_Image>> attachment_cache;
 std::unordered_set<std::string> attachment_pending;
-std::unordered_map<std::string, std::unique_ptr<Fl_RGB_Image>> emoji_cache;
 std::unordered_set<std::string> emoji_pending;
 
+// Cleared during MessageWidget::draw by anything that can look different on a later frame without the
+// layout changing: placeholders for images still loading, animation frames and hover state
+bool draw_is_static = true;
+
+void markDrawDynamic() { draw_is_static = false; }
+
 std::string getAttachmentUrl(const Attachment &attachment) {
     if (attachment.contentType.has_value() && attachment.isImage()) {
         if (!attachment.url.empty()) {
@@ -605,51 +603,6 @@ std::string buildStickerCacheKey(const std::string &url, int width, int height)
     return url + "#" + std::to_string(width) + "x" + std::to_string(height);
 }
 
-Fl_RGB_Image *cropAndScaleToSquare(Fl_RGB_Image *source, int size) {
-    if (!source || size <= 0 || source->w() <= 0 || source->h() <= 0) {
-        return nullptr;
-    }
-
-    int srcW = source->w();
-    int srcH = source->h();
-    int depth = source->d();
-    if (depth <= 0) {
-        return nullptr;
-    }
-
-    const char *const *dataArray = source->data();
-    if (!dataArray || !dataArray[0]) {
-        return nullptr;
-    }
-    const unsigned char *srcData = reinterpret_cast<const unsigned char *>(dataArray[0]);
-    int srcLineSize = source->ld() ? source->ld() : srcW * depth;
-
-    int cropSize = std::min(srcW, srcH);
-    int cropX = (srcW - cropSize) / 2;
-    int cropY = (srcH - cropSize) / 2;
-
-    std::vector<unsigned char> buffer(cropSize * cropSize * depth);
-    for (int y = 0; y < cropSize; ++y) {
-        const unsigned char *srcRow = srcData + (cropY + y) * srcLineSize + cropX * depth;
-        unsigned char *dstRow = buffer.data() + y * cropSize * depth;
-        std::memcpy(dstRow, srcRow, cropSize * depth);
-    }
-
-    unsigned char *heapData = new unsigned char[buffer.size()];
-    std::memcpy(heapData, buffer.data(), buffer.size());
-
-    auto *cropped = new Fl_RGB_Image(heapData, cropSize, cropSize, depth);
-    cropped->alloc_array = 1;
-
-    Fl_Image *scaled = cropped->copy(size, size);
-    delete cropped;
-    if (!scaled) {
-        return nullptr;
-    }
-
-    return static_cast<Fl_RGB_Image *>(scaled);
-}
-
 bool isAttachmentImage(const Attachment &attachment) {
     if (attachment.contentType.has_value()) {
         return attachment.isImage();
@@ -694,32 +647,20 @@ Fl_RGB_Image *getAttachmentImage(const Attachment &attachment, int width, int he
 
     if (attachment_pending.find(cacheKey) == attachment_pending.end()) {
         attachment_pending.insert(cacheKey);
-        Images::loadImageAsync(url, [cacheKey, url, width, height, squareCrop](Fl_RGB_Image *image) {
-            if (image && image->w() > 0 && image->h() > 0) {
-                Fl_RGB_Image *scaledRgb = nullptr;
-                if (squareCrop) {
-                    scaledRgb = cropAndScaleToSquare(image, width);
-                } else {
-                    Fl_Image *scaled = image->copy(width, height);
-                    if (scaled) {
-                        scaledRgb = static_cast<Fl_RGB_Image *>(scaled);
-                    }
+        Images::ScaleMode mode = squareCrop ? Images::ScaleMode::Cover : Images::ScaleMode::Fill;
+        Images::takeScaledImageAsync(
+            url, width, height,
+            [cacheKey](std::unique_ptr<Fl_RGB_Image> rounded) {
+                if (rounded) {
+                    attachment_cache[cacheKey] = std::move(rounded);
                 }
-
-                if (scaledRgb) {
-                    Fl_RGB_Image *rounded = Images::makeRoundedRect(scaledRgb, width, height, kAttachmentCornerRadius);
-                    if (rounded) {
-                        attachment_cache[cacheKey] = std::unique_ptr<Fl_RGB_Image>(rounded);
-                        delete scaledRgb;
-                    } else {
-                        attachment_cache[cacheKey] = std::unique_ptr<Fl_RGB_Image>(scaledRgb);
-                    }
-                    Images::evictFromMemory(url);
-                }
-            }
-            attachment_pending.erase(cacheKey);
-            Fl::redraw();
-        });
+                attachment_pending.erase(cacheKey);
+                Fl::redraw();
+            },
+            mode,
+            [width, height](Fl_RGB_Image *image) {
+                return Images::makeRoundedRect(image, width, height, kAttachmentCornerRadius);
+            });
     }
 
     return nullptr;
@@ -738,13 +679,9 @@ Fl_RGB_Image *getStickerImage(const std::string &url, int width, int height) {
 
     if (sticker_pending.find(cacheKey) == sticker_pending.end()) {
         sticker_pending.insert(cacheKey);
-        Images::loadImageAsync(url, [cacheKey, url, width, height](Fl_RGB_Image *image) {
-            if (image && image->w() > 0 && image->h() > 0) {
-                Fl_Image *scaled = image->copy(width, height);
-                if (scaled) {
-                    sticker_cache[cacheKey] = std::unique_ptr<Fl_RGB_Image>(static_cast<Fl_RGB_Image *>(scaled));
-                    Images::evictFromMemory(url);
-                }
+        Images::takeScaledImageAsync(url, width, height, [cacheKey](std::unique_ptr<Fl_RGB_Image> image) {
+            if (image) {
+                sticker_cache[cacheKey] = std::move(image);
             }
             sticker_pending.erase(cacheKey);
             Fl::redraw();
@@ -928,68 +865,90 @@ SystemMessageSpec buildSystemMessageSpec(const Message &msg, const std::string &
     }
 }
 
-std::vector<MessageWidget::InlineItem> tokenizeStyledText(const std::string &text, Fl_Font font, int size,
-                                                          Fl_Color color, const std::string &linkUrl = "",
-                                                          bool underline = false, bool strikethrough = false) {
-    std::vector<MessageWidget::InlineItem> tokens;
-    std::string current;
+// Appends tokens to a ShapedContent, copying their text into its arena and interning URLs and cache keys
+struct TokenSink {
+    explicit TokenSink(MessageWidget::ShapedContent &target) : content(target) {}
 
-    auto flushCurrent = [&]() {
-        if (!current.empty()) {
-            MessageWidget::InlineItem item;
-            item.kind = MessageWidget::InlineItem::Kind::Text;
-            item.text = current;
-            item.font = font;
-            item.size = size;
-            item.color = color;
-            item.linkUrl = linkUrl;
-            item.isLink = !linkUrl.empty();
-            item.underline = underline;
-            item.strikethrough = strikethrough;
-            tokens.push_back(std::move(item));
-            current.clear();
+    MessageWidget::InlineItem &append(MessageWidget::InlineItem item, std::string_view text = {}) {
+        item.textOffset = static_cast<uint32_t>(content.text.size());
+        item.textLength = static_cast<uint32_t>(text.size());
+        content.text.append(text);
+        content.tokens.push_back(item);
+        return content.tokens.back();
+    }
+
+    uint32_t intern(std::string_view value) {
+        if (value.empty()) {
+            return 0;
         }
+        auto [it, inserted] = ids.try_emplace(std::string(value), 0);
+        if (inserted) {
+            content.strings.push_back(it->first);
+            it->second = static_cast<uint32_t>(content.strings.size());
+        }
+        return it->second;
+    }
+
+    MessageWidget::ShapedContent &content;
+    std::unordered_map<std::string, uint32_t> ids;
+};
+
+void tokenizeStyledText(TokenSink &sink, std::string_view text, Fl_Font font, int size, Fl_Color color,
+                        std::string_view linkUrl = {}, bool underline = false, bool strikethrough = false) {
+    const auto &tokens = sink.content.tokens;
+    const size_t firstToken = tokens.size();
+    const uint32_t linkId = sink.intern(linkUrl);
+
+    MessageWidget::InlineItem style;
+    style.font = font;
+    style.size = size;
+    style.color = color;
+    style.underline = underline;
+    style.strikethrough = strikethrough;
+
+    MessageWidget::InlineItem textStyle = style;
+    textStyle.kind = MessageWidget::InlineItem::Kind::Text;
+    textStyle.linkUrl = linkId;
+    textStyle.isLink = linkId != 0;
+
+    size_t wordStart = 0;
+    auto flushWord = [&](size_t end) {
+        if (end > wordStart) {
+            sink.append(textStyle, text.substr(wordStart, end - wordStart));
+        }
+        wordStart = end + 1;
     };
 
-    for (char ch : text) {
+    for (size_t i = 0; i < text.size(); ++i) {
+        char ch = text[i];
         if (ch == '\n') {
-            flushCurrent();
-            MessageWidget::InlineItem item;
-            item.kind = MessageWidget::InlineItem::Kind::LineBreak;
-            item.font = font;
-            item.size = size;
-            item.color = color;
-            item.underline = underline;
-            item.strikethrough = strikethrough;
-            tokens.push_back(std::move(item));
+            flushWord(i);
+            MessageWidget::InlineItem lineBreak = style;
+            lineBreak.kind = MessageWidget::InlineItem::Kind::LineBreak;
+            sink.append(lineBreak);
         } else if (ch == ' ' || ch == '\t' || ch == '\r') {
-            flushCurrent();
-            if (tokens.empty() || tokens.back().kind == MessageWidget::InlineItem::Kind::LineBreak ||
-                tokens.back().text != " ") {
-                MessageWidget::InlineItem item;
-                item.kind = MessageWidget::InlineItem::Kind::Text;
-                item.text = " ";
-                item.font = font;
-                item.size = size;
-                item.color = color;
-                item.linkUrl = linkUrl;
-                item.isLink = !linkUrl.empty();
-                item.underline = underline;
-                item.strikethrough = strikethrough;
-                tokens.push_back(std::move(item));
+            flushWord(i);
+            if (tokens.size() == firstToken || tokens.back().kind == MessageWidget::InlineItem::Kind::LineBreak ||
+                sink.content.textOf(tokens.back()) != " ") {
+                sink.append(textStyle, " ");
             }
-        } else {
-            current.push_back(ch);
         }
     }
 
-    flushCurrent();
-    return tokens;
+    flushWord(text.size());
 }
 
-std::vector<MessageWidget::InlineItem> tokenizeLiteralText(const std::string &text, Fl_Font font, int size, Fl_Color color,
-                                                           bool preserveWhitespace, bool isCodeBlock) {
-    std::vector<MessageWidget::InlineItem> tokens;
+void tokenizeLiteralText(TokenSink &sink, std::string_view text, Fl_Font font, int size, Fl_Color color,
+                         bool preserveWhitespace, bool isCodeBlock) {
+    MessageWidget::InlineItem style;
+    style.kind = MessageWidget::InlineItem::Kind::Text;
+    style.font = font;
+    style.size = size;
+    style.color = color;
+    style.preserveWhitespace = preserveWhitespace;
+    style.isCodeBlock = isCodeBlock;
+
+    // Carriage returns are dropped, so a run is gathered before it is copied into the arena
     std::string current;
     bool currentWhitespace = false;
 
@@ -997,15 +956,7 @@ std::vector<MessageWidget::InlineItem> tokenizeLiteralText(const std::string &te
         if (current.empty()) {
             return;
         }
-        MessageWidget::InlineItem item;
-        item.kind = MessageWidget::InlineItem::Kind::Text;
-        item.text = current;
-        item.font = font;
-        item.size = size;
-        item.color = color;
-        item.preserveWhitespace = preserveWhitespace;
-        item.isCodeBlock = isCodeBlock;
-        tokens.push_back(std::move(item));
+        sink.append(style, current);
         current.clear();
     };
 
@@ -1015,14 +966,9 @@ std::vector<MessageWidget::InlineItem> tokenizeLiteralText(const std::string &te
         }
         if (ch == '\n') {
             flushCurrent();
-            MessageWidget::InlineItem item;
-            item.kind = MessageWidget::InlineItem::Kind::LineBreak;
-            item.font = font;
-            item.size = size;
-            item.color = color;
-            item.preserveWhitespace = preserveWhitespace;
-            item.isCodeBlock = isCodeBlock;
-            tokens.push_back(std::move(item));
+            MessageWidget::InlineItem lineBreak = style;
+            lineBreak.kind = MessageWidget::InlineItem::Kind::LineBreak;
+            sink.append(lineBreak);
             currentWhitespace = false;
         } else {
             if (preserveWhitespace) {
@@ -1037,29 +983,11 @@ std::vector<MessageWidget::InlineItem> tokenizeLiteralText(const std::string &te
     }
 
     flushCurrent();
-
-    return tokens;
 }
 
-struct LinkRun {
-    std::string text;
-    std::string linkUrl;
-    Fl_Color color = ThemeColors::TEXT_NORMAL;
-};
-
-struct MarkdownRun {
-    std::string text;
-    bool bold = false;
-    bool italic = false;
-    bool underline = false;
-    bool strikethrough = false;
-    std::string linkUrl;
-    Fl_Color color = ThemeColors::TEXT_NORMAL;
-};
+bool isHttpUrl(std::string_view url) { return url.rfind("https://", 0) == 0 || url.rfind("http://", 0) == 0; }
 
-bool isHttpUrl(const std::string &url) { return url.rfind("https://", 0) == 0 || url.rfind("http://", 0) == 0; }
-
-bool isUrlStartAt(const std::string &text, size_t pos) {
+bool isUrlStartAt(std::string_view text, size_t pos) {
     return text.compare(pos, 8, "https://") == 0 || text.compare(pos, 7, "http://") == 0;
 }
 
@@ -1080,18 +1008,18 @@ bool isTrailingPunct(char ch) {
     }
 }
 
-bool isAllDigits(const std::string &text) {
+bool isAllDigits(std::string_view text) {
     return !text.empty() &&
            std::all_of(text.begin(), text.end(), [](unsigned char ch) { return std::isdigit(ch) != 0; });
 }
 
 std::string buildEmojiUrl(const std::string &id, bool animated) {
     std::ostringstream out;
-    out << "https://cdn.discordapp.com/emojis/" << id << (animated ? ".gif" : ".png") << "?size=" << kEmojiRequestSize;
+    out << kCustomEmojiUrlPrefix << id << (animated ? ".gif" : ".webp") << "?size=" << kEmojiRequestSize;
     return out.str();
 }
 
-bool tryParseTimestamp(const std::string &text, size_t pos, size_t &outLength, std::string &outFormatted) {
+bool tryParseTimestamp(std::string_view text, size_t pos, size_t &outLength, std::string &outFormatted) {
     if (pos >= text.size() || text[pos] != '<') {
         return false;
     }
@@ -1115,7 +1043,7 @@ bool tryParseTimestamp(const std::string &text, size_t pos, size_t &outLength, s
         return false;
     }
 
-    std::string timestampStr = text.substr(start, colonOrEnd - start);
+    std::string timestampStr(text.substr(start, colonOrEnd - start));
     if (!isAllDigits(timestampStr)) {
         return false;
     }
@@ -1211,7 +1139,7 @@ bool tryParseTimestamp(const std::string &text, size_t pos, size_t &outLength, s
     }
 }
 
-bool tryParseMention(const std::string &text, size_t pos, size_t &outLength, std::string &outId, char &outType) {
+bool tryParseMention(std::string_view text, size_t pos, size_t &outLength, std::string &outId, char &outType) {
     if (pos >= text.size() || text[pos] != '<') {
         return false;
     }
@@ -1238,21 +1166,21 @@ bool tryParseMention(const std::string &text, size_t pos, size_t &outLength, std
     }
 
     size_t idEnd = text.find('>', start);
-    if (idEnd == std::string::npos) {
+    if (idEnd == std::string_view::npos) {
         return false;
     }
 
-    std::string id = text.substr(start, idEnd - start);
+    std::string_view id = text.substr(start, idEnd - start);
     if (!isAllDigits(id)) {
         return false;
     }
 
-    outId = id;
+    outId = std::string(id);
     outLength = idEnd - pos + 1;
     return true;
 }
 
-bool tryParseEmoji(const std::string &text, size_t pos, size_t &outLength, std::string &outUrl) {
+bool tryParseEmoji(std::string_view text, size_t pos, size_t &outLength, std::string &outUrl) {
     if (pos >= text.size() || text[pos] != '<') {
         return false;
     }
@@ -1269,418 +1197,545 @@ bool tryParseEmoji(const std::string &text, size_t pos, size_t &outLength, std::
 
     size_t nameStart = start + 1;
     size_t nameEnd = text.find(':', nameStart);
-    if (nameEnd == std::string::npos) {
+    if (nameEnd == std::string_view::npos) {
         return false;
     }
 
     size_t idStart = nameEnd + 1;
     size_t idEnd = text.find('>', idStart);
-    if (idEnd == std::string::npos) {
+    if (idEnd == std::string_view::npos) {
         return false;
     }
 
-    std::string id = text.substr(idStart, idEnd - idStart);
+    std::string_view id = text.substr(idStart, idEnd - idStart);
     if (!isAllDigits(id)) {
         return false;
     }
 
-    outUrl = buildEmojiUrl(id, animated);
+    outUrl = buildEmojiUrl(std::string(id), animated);
     outLength = idEnd - pos + 1;
     return true;
 }
 
-Fl_RGB_Image *getEmojiImage(const std::string &url, int size) {
+// Custom emoji live in the shared EmojiAtlas; the downloaded bitmap is only kept until it is copied in
+bool drawCustomEmoji(const std::string &url, int size, int x, int y) {
     if (url.empty() || size <= 0) {
-        return nullptr;
+        return false;
     }
 
     std::string cacheKey = buildEmojiCacheKey(url, size);
-    auto it = emoji_cache.find(cacheKey);
-    if (it != emoji_cache.end()) {
-        return it->second.get();
+    if (EmojiAtlas::draw(cacheKey, x, y)) {
+        return true;
     }
 
+    markDrawDynamic();
     if (emoji_pending.find(cacheKey) == emoji_pending.end()) {
         emoji_pending.insert(cacheKey);
-        Images::loadImageAsync(url, [cacheKey, url, size](Fl_RGB_Image *image) {
-            if (image && image->w() > 0 && image->h() > 0) {
-                Fl_Image *scaled = image->copy(size, size);
-                if (scaled) {
-                    emoji_cache[cacheKey] = std::unique_ptr<Fl_RGB_Image>(static_cast<Fl_RGB_Image *>(scaled));
-                }
-                Images::evictFromMemory(url);
+        Images::takeScaledImageAsync(url, size, size, [cacheKey, size](std::unique_ptr<Fl_RGB_Image> image) {
+            if (image) {
+                EmojiAtlas::insert(cacheKey, size, image.get());
             }
             emoji_pending.erase(cacheKey);
             Fl::redraw();
         });
     }
 
-    return nullptr;
+    return false;
 }
 
-std::vector<LinkRun> parseLinkRuns(const std::string &text, Fl_Color baseColor, Fl_Color linkColor) {
-    std::vector<LinkRun> runs;
-    size_t i = 0;
-    size_t last = 0;
+Fl_Font resolveMarkdownFont(Fl_Font baseFont, bool bold, bool italic) {
+    if (bold && italic) {
+        return FontLoader::Fonts::INTER_BOLD_ITALIC;
+    }
+    if (bold) {
+        return FontLoader::Fonts::INTER_BOLD;
+    }
+    if (italic) {
+        return FontLoader::Fonts::INTER_REGULAR_ITALIC;
+    }
+    return baseFont;
+}
 
-    auto flushNormal = [&](size_t start, size_t end) {
-        if (end > start) {
-            runs.push_back({text.substr(start, end - start), "", baseColor});
+std::string resolveMentionText(const Message *msg, const std::string &mentionId, char mentionType) {
+    if (mentionType == '#') {
+        return "#unknown-channel";
+    }
+    if (mentionType == '&') {
+        if (msg && msg->guildId.has_value()) {
+            // TODO: Look up role name from AppState
         }
+        return "@Unknown Role";
+    }
+    if (msg) {
+        for (size_t j = 0; j < msg->mentionIds.size(); ++j) {
+            if (msg->mentionIds[j] == mentionId) {
+                if (j < msg->mentionDisplayNames.size() && !msg->mentionDisplayNames[j].empty()) {
+                    return "@" + msg->mentionDisplayNames[j];
+                }
+                break;
+            }
+        }
+    }
+    return "@Unknown User";
+}
+
+enum CharClass : uint8_t {
+    kPlainChar = 0,
+    kMarkerChar = 1 << 0,      // May start an emphasis marker
+    kLinkStartChar = 1 << 1,   // May start [label](url) or a bare http(s) URL
+    kInlineStartChar = 1 << 2, // May start a mention, timestamp, custom emoji or @everyone/@here
+    kEmojiStartChar = 1 << 3,  // May start a Unicode emoji (UTF-8 lead bytes and keycap bases)
+};
+
+constexpr std::array<uint8_t, 256> buildCharClasses() {
+    std::array<uint8_t, 256> classes{};
+    classes['*'] = kMarkerChar | kEmojiStartChar;
+    classes['_'] = kMarkerChar;
+    classes['~'] = kMarkerChar;
+    classes['['] = kLinkStartChar;
+    classes['h'] = kLinkStartChar;
+    classes['<'] = kInlineStartChar;
+    classes['@'] = kInlineStartChar;
+    classes['#'] = kEmojiStartChar;
+    for (int ch = '0'; ch <= '9'; ++ch) {
+        classes[ch] = kEmojiStartChar;
+    }
+    for (int ch = 0xC0; ch <= 0xFF; ++ch) {
+        classes[ch] = kEmojiStartChar;
+    }
+    return classes;
+}
+
+constexpr std::array<uint8_t, 256> kCharClasses = buildCharClasses();
+
+// Checked in this order at every position, so "***" wins over "**" and "*"
+constexpr std::array<std::string_view, 6> kEmphasisMarkers = {"***", "**", "__", "~~", "*", "_"};
+enum EmphasisMarker : size_t { kBoldItalic, kBold, kUnderline, kStrikethrough, kItalicStar, kItalicUnderscore };
+
+/**
+ * Tokenizes one markdown line in a single left-to-right scan: links, emphasis, mentions, timestamps and
+ * emoji are recognised where they start and appended straight to the sink, so no intermediate runs or
+ * substrings are built. Whether an emphasis marker opens depends on a closing marker further along the
+ * line; the last position of each marker is found once per line, the first time it is needed.
+ */
+class LineTokenizer {
+  public:
+    LineTokenizer(TokenSink &sink, const std::string &text, size_t begin, size_t end, Fl_Font baseFont, int size,
+                  Fl_Color color, const Message *msg)
+        : sink(sink), line(std::string_view(text).substr(0, end)), begin(begin), baseFont(baseFont), size(size),
+          color(color), msg(msg), emojiPossible(EmojiManager::mayContainEmoji(line.substr(begin))) {}
+
+    void tokenize() { scanRun(begin, line.size(), {color, {}, true, true}); }
+
+  private:
+    struct RunStyle {
+        Fl_Color color;
+        std::string_view linkUrl;
+        bool markdown;
+        bool detectLinks;
     };
 
-    while (i < text.size()) {
-        if (text[i] == '[') {
-            size_t close = text.find(']', i + 1);
-            if (close != std::string::npos && close + 1 < text.size() && text[close + 1] == '(') {
-                size_t urlStart = close + 2;
-                size_t urlEnd = text.find(')', urlStart);
-                if (urlEnd != std::string::npos) {
-                    std::string label = text.substr(i + 1, close - i - 1);
-                    std::string url = text.substr(urlStart, urlEnd - urlStart);
+    struct InlineMatch {
+        enum class Kind { Keyword, Timestamp, Mention, CustomEmoji, UnicodeEmoji };
 
+        Kind kind = Kind::Keyword;
+        size_t length = 0;
+        std::string value; // Keyword, formatted timestamp, mention id, emoji URL or Unicode emoji
+        char mentionType = 0;
+    };
+
+    struct LinkMatch {
+        size_t textBegin = 0;
+        size_t textEnd = 0;
+        size_t suffixEnd = 0; // Trailing punctuation of a bare URL, kept out of the link
+        size_t end = 0;
+        std::string_view url;
+        bool bare = false;
+    };
+
+    uint8_t classAt(size_t pos) const { return kCharClasses[static_cast<unsigned char>(line[pos])]; }
+
+    // Every ']' and ')' of the line, collected in one scan the first time a '[' needs them, so a line full
+    // of unmatched brackets costs a binary search per '[' rather than a scan to the end of the line
+    void findBrackets() {
+        for (size_t pos = begin; pos < line.size(); ++pos) {
+            if (line[pos] == ']') {
+                closeBrackets.push_back(pos);
+            } else if (line[pos] == ')') {
+                closeParens.push_back(pos);
+            }
+        }
+        bracketsFound = true;
+    }
+
+    static size_t nextPosition(const std::vector<size_t> &positions, size_t from) {
+        auto it = std::lower_bound(positions.begin(), positions.end(), from);
+        return it != positions.end() ? *it : std::string_view::npos;
+    }
+
+    bool matchLink(size_t pos, LinkMatch &out) {
+        if (line[pos] == '[') {
+            if (!bracketsFound) {
+                findBrackets();
+            }
+            size_t close = nextPosition(closeBrackets, pos + 1);
+            if (close != std::string_view::npos && close + 1 < line.size() && line[close + 1] == '(') {
+                size_t urlStart = close + 2;
+                size_t urlEnd = nextPosition(closeParens, urlStart);
+                if (urlEnd != std::string_view::npos) {
+                    std::string_view url = line.substr(urlStart, urlEnd - urlStart);
                     if (!url.empty() && url.front() == '<' && url.back() == '>') {
                         url = url.substr(1, url.size() - 2);
                     }
-
                     if (isHttpUrl(url)) {
-                        flushNormal(last, i);
-                        runs.push_back({label, url, linkColor});
-                        i = urlEnd + 1;
-                        last = i;
-                        continue;
+                        out.textBegin = pos + 1;
+                        out.textEnd = close;
+                        out.suffixEnd = close;
+                        out.end = urlEnd + 1;
+                        out.url = url;
+                        out.bare = false;
+                        return true;
                     }
                 }
             }
         }
 
-        if (isUrlStartAt(text, i)) {
-            flushNormal(last, i);
-            size_t end = i;
-            while (end < text.size() && !std::isspace(static_cast<unsigned char>(text[end]))) {
-                end++;
-            }
+        if (!isUrlStartAt(line, pos)) {
+            return false;
+        }
+        size_t end = pos;
+        while (end < line.size() && !std::isspace(static_cast<unsigned char>(line[end]))) {
+            end++;
+        }
+        size_t urlEnd = end;
+        while (urlEnd > pos && isTrailingPunct(line[urlEnd - 1])) {
+            urlEnd--;
+        }
+        out.textBegin = pos;
+        out.textEnd = urlEnd;
+        out.suffixEnd = end;
+        out.end = end;
+        out.url = line.substr(pos, urlEnd - pos);
+        out.bare = true;
+        return true;
+    }
 
-            std::string url = text.substr(i, end - i);
-            std::string suffix;
-            while (!url.empty() && isTrailingPunct(url.back())) {
-                suffix.insert(suffix.begin(), url.back());
-                url.pop_back();
+    // Closing markers are only looked for in text markdown can see, i.e. outside link syntax
+    void findClosers() {
+        closers.fill(std::string_view::npos);
+        auto scanRegion = [&](size_t from, size_t to) {
+            for (size_t pos = from; pos < to; ++pos) {
+                if (!(classAt(pos) & kMarkerChar)) {
+                    continue;
+                }
+                for (size_t m = 0; m < kEmphasisMarkers.size(); ++m) {
+                    const auto marker = kEmphasisMarkers[m];
+                    if (pos + marker.size() <= to && line.compare(pos, marker.size(), marker) == 0) {
+                        closers[m] = pos;
+                    }
+                }
             }
+        };
 
-            if (!url.empty()) {
-                runs.push_back({url, url, linkColor});
-            }
-            if (!suffix.empty()) {
-                runs.push_back({suffix, "", baseColor});
+        size_t runStart = begin;
+        size_t pos = begin;
+        while (pos < line.size()) {
+            LinkMatch link;
+            if ((classAt(pos) & kLinkStartChar) && matchLink(pos, link)) {
+                scanRegion(runStart, pos);
+                scanRegion(link.textBegin, link.textEnd);
+                scanRegion(link.textEnd, link.suffixEnd);
+                pos = runStart = link.end;
+                continue;
             }
-
-            i = end;
-            last = i;
-            continue;
+            pos++;
         }
-
-        i++;
+        scanRegion(runStart, line.size());
+        closersFound = true;
     }
 
-    flushNormal(last, text.size());
-    return runs;
-}
-
-bool hasClosingMarker(const std::vector<LinkRun> &runs, size_t runIndex, size_t start, const std::string &marker) {
-    for (size_t i = runIndex; i < runs.size(); ++i) {
-        const std::string &text = runs[i].text;
-        size_t offset = (i == runIndex) ? start : 0;
-        if (text.find(marker, offset) != std::string::npos) {
-            return true;
+    bool hasCloser(size_t marker, size_t from) {
+        if (!closersFound) {
+            findClosers();
         }
+        return closers[marker] != std::string_view::npos && closers[marker] >= from;
     }
-    return false;
-}
 
-std::vector<MarkdownRun> parseMarkdownRuns(const std::vector<LinkRun> &runs) {
-    std::vector<MarkdownRun> output;
-    bool bold = false;
-    bool italic = false;
-    bool underline = false;
-    bool strikethrough = false;
-
-    for (size_t runIndex = 0; runIndex < runs.size(); ++runIndex) {
-        const auto &run = runs[runIndex];
-        std::string current;
-        auto flushCurrent = [&]() {
-            if (!current.empty()) {
-                MarkdownRun out;
-                out.text = current;
-                out.bold = bold;
-                out.italic = italic;
-                out.underline = underline;
-                out.strikethrough = strikethrough;
-                out.linkUrl = run.linkUrl;
-                out.color = run.color;
-                output.push_back(std::move(out));
-                current.clear();
+    // Index of the marker that toggles emphasis at pos, or -1 when the text there is literal
+    int toggleAt(size_t pos, size_t end) {
+        for (size_t m = 0; m < kEmphasisMarkers.size(); ++m) {
+            const auto marker = kEmphasisMarkers[m];
+            if (pos + marker.size() > end || line.compare(pos, marker.size(), marker) != 0) {
+                continue;
             }
-        };
+            const size_t after = pos + marker.size();
+            bool canToggle = false;
+            switch (m) {
+            case kBoldItalic:
+                canToggle = (bold && italic) || (!bold && !italic && hasCloser(m, after));
+                break;
+            case kBold:
+                canToggle = bold || hasCloser(m, after);
+                break;
+            case kUnderline:
+                canToggle = underline || hasCloser(m, after);
+                break;
+            case kStrikethrough:
+                canToggle = strikethrough || hasCloser(m, after);
+                break;
+            default:
+                canToggle = italic || hasCloser(m, after);
+                break;
+            }
+            if (canToggle) {
+                return static_cast<int>(m);
+            }
+        }
+        return -1;
+    }
 
-        bool skipMarkdown = !run.linkUrl.empty() && run.text == run.linkUrl && isHttpUrl(run.text);
-        if (skipMarkdown) {
-            current = run.text;
-            flushCurrent();
-            continue;
+    void applyToggle(int marker) {
+        switch (marker) {
+        case kBoldItalic:
+            bold = !bold;
+            italic = !italic;
+            break;
+        case kBold:
+            bold = !bold;
+            break;
+        case kUnderline:
+            underline = !underline;
+            break;
+        case kStrikethrough:
+            strikethrough = !strikethrough;
+            break;
+        default:
+            italic = !italic;
+            break;
         }
+    }
 
-        size_t i = 0;
-        while (i < run.text.size()) {
-            if (run.text.compare(i, 3, "***") == 0) {
-                bool canToggle =
-                    (bold && italic) || (!bold && !italic && hasClosingMarker(runs, runIndex, i + 3, "***"));
-                if (canToggle) {
-                    flushCurrent();
-                    bold = !bold;
-                    italic = !italic;
-                    i += 3;
-                    continue;
-                }
-            }
-            if (run.text.compare(i, 2, "**") == 0) {
-                bool canToggle = bold || hasClosingMarker(runs, runIndex, i + 2, "**");
-                if (canToggle) {
-                    flushCurrent();
-                    bold = !bold;
-                    i += 2;
-                    continue;
-                }
-            }
-            if (run.text.compare(i, 2, "__") == 0) {
-                bool canToggle = underline || hasClosingMarker(runs, runIndex, i + 2, "__");
-                if (canToggle) {
-                    flushCurrent();
-                    underline = !underline;
-                    i += 2;
-                    continue;
-                }
-            }
-            if (run.text.compare(i, 2, "~~") == 0) {
-                bool canToggle = strikethrough || hasClosingMarker(runs, runIndex, i + 2, "~~");
-                if (canToggle) {
-                    flushCurrent();
-                    strikethrough = !strikethrough;
-                    i += 2;
-                    continue;
-                }
+    // An inline construct cannot straddle a link or an emphasis toggle; those split the text first
+    bool isUnbroken(size_t from, size_t to, const RunStyle &style) {
+        for (size_t pos = from + 1; pos < to; ++pos) {
+            uint8_t cls = classAt(pos);
+            LinkMatch link;
+            if (style.detectLinks && (cls & kLinkStartChar) && matchLink(pos, link)) {
+                return false;
             }
-            if (run.text[i] == '*') {
-                bool canToggle = italic || hasClosingMarker(runs, runIndex, i + 1, "*");
-                if (canToggle) {
-                    flushCurrent();
-                    italic = !italic;
-                    i += 1;
-                    continue;
-                }
+            if (style.markdown && (cls & kMarkerChar) && toggleAt(pos, to) >= 0) {
+                return false;
             }
-            if (run.text[i] == '_') {
-                bool canToggle = italic || hasClosingMarker(runs, runIndex, i + 1, "_");
-                if (canToggle) {
-                    flushCurrent();
-                    italic = !italic;
-                    i += 1;
-                    continue;
+        }
+        return true;
+    }
+
+    // Recognises a mention, timestamp, emoji or @everyone/@here starting at pos
+    bool matchInline(size_t pos, size_t end, const RunStyle &style, InlineMatch &out) {
+        std::string_view run = line.substr(0, end);
+
+        if (line[pos] == '@') {
+            for (std::string_view keyword : {std::string_view("@everyone"), std::string_view("@here")}) {
+                if (run.compare(pos, keyword.size(), keyword) == 0) {
+                    out.kind = InlineMatch::Kind::Keyword;
+                    out.value = std::string(keyword);
+                    out.length = keyword.size();
+                    return true;
                 }
             }
+            return false;
+        }
 
-            current.push_back(run.text[i]);
-            i += 1;
+        if (line[pos] == '<') {
+            if (tryParseTimestamp(run, pos, out.length, out.value)) {
+                out.kind = InlineMatch::Kind::Timestamp;
+            } else if (tryParseMention(run, pos, out.length, out.value, out.mentionType)) {
+                out.kind = InlineMatch::Kind::Mention;
+            } else if (tryParseEmoji(run, pos, out.length, out.value)) {
+                out.kind = InlineMatch::Kind::CustomEmoji;
+            } else {
+                return false;
+            }
+            return isUnbroken(pos, pos + out.length, style);
         }
 
-        flushCurrent();
+        if (emojiPossible && EmojiManager::tryMatch(run, pos, out.length, out.value)) {
+            out.kind = InlineMatch::Kind::UnicodeEmoji;
+            return true;
+        }
+        return false;
     }
 
-    return output;
-}
+    void emitInline(const InlineMatch &match) {
+        MessageWidget::InlineItem emoji;
+        emoji.kind = MessageWidget::InlineItem::Kind::Emoji;
+        emoji.emojiSize = kEmojiSize;
+        emoji.width = kEmojiSize;
 
-Fl_Font resolveMarkdownFont(Fl_Font baseFont, bool bold, bool italic) {
-    if (bold && italic) {
-        return FontLoader::Fonts::INTER_BOLD_ITALIC;
-    }
-    if (bold) {
-        return FontLoader::Fonts::INTER_BOLD;
-    }
-    if (italic) {
-        return FontLoader::Fonts::INTER_REGULAR_ITALIC;
+        switch (match.kind) {
+        case InlineMatch::Kind::Keyword:
+            tokenizeStyledText(sink, match.value, FontLoader::Fonts::INTER_SEMIBOLD, size, ThemeColors::TEXT_LINK);
+            break;
+        case InlineMatch::Kind::Timestamp:
+            tokenizeStyledText(sink, match.value, resolveMarkdownFont(baseFont, bold, italic), size,
+                               ThemeColors::TEXT_LINK, {}, true, false);
+            break;
+        case InlineMatch::Kind::Mention:
+            tokenizeStyledText(sink, resolveMentionText(msg, match.value, match.mentionType),
+                               FontLoader::Fonts::INTER_SEMIBOLD, size, ThemeColors::TEXT_LINK);
+            break;
+        case InlineMatch::Kind::CustomEmoji:
+            emoji.emojiUrl = sink.intern(match.value);
+            emoji.emojiCacheKey = sink.intern(buildEmojiCacheKey(match.value, kEmojiSize));
+            sink.append(emoji);
+            break;
+        case InlineMatch::Kind::UnicodeEmoji:
+            emoji.emojiCacheKey = sink.intern(EmojiManager::makeCacheKey(match.value, kEmojiSize));
+            sink.append(emoji, match.value);
+            break;
+        }
     }
-    return baseFont;
-}
-
-std::vector<MessageWidget::InlineItem> tokenizeEmojiText(const std::string &text, Fl_Font font, int size,
-                                                         Fl_Color color, const std::string &linkUrl, bool underline,
-                                                         bool strikethrough, const Message *msg) {
-    std::vector<MessageWidget::InlineItem> tokens;
-    std::string current;
-    size_t i = 0;
 
-    auto flushText = [&]() {
-        if (!current.empty()) {
-            auto textTokens = tokenizeStyledText(current, font, size, color, linkUrl, underline, strikethrough);
-            tokens.insert(tokens.end(), textTokens.begin(), textTokens.end());
-            current.clear();
+    void emitLink(const LinkMatch &link) {
+        // A bare URL, or a label that repeats its URL, is shown verbatim without emphasis parsing
+        std::string_view label = line.substr(link.textBegin, link.textEnd - link.textBegin);
+        bool verbatim = link.bare || (label == link.url && isHttpUrl(label));
+        scanRun(link.textBegin, link.textEnd, {ThemeColors::TEXT_LINK, link.url, !verbatim, false});
+        if (link.suffixEnd > link.textEnd) {
+            scanRun(link.textEnd, link.suffixEnd, {color, {}, true, false});
         }
-    };
-
-    while (i < text.size()) {
-        size_t length = 0;
+    }
 
-        if (text.compare(i, 9, "@everyone") == 0) {
-            flushText();
-            auto mentionTokens = tokenizeStyledText("@everyone", FontLoader::Fonts::INTER_SEMIBOLD, size,
-                                                    ThemeColors::TEXT_LINK, "", false, false);
-            tokens.insert(tokens.end(), mentionTokens.begin(), mentionTokens.end());
-            i += 9;
-            continue;
-        }
+    void scanRun(size_t runBegin, size_t runEnd, const RunStyle &style) {
+        size_t pending = runBegin;
+        auto flush = [&](size_t until) {
+            if (until > pending) {
+                tokenizeStyledText(sink, line.substr(pending, until - pending),
+                                   resolveMarkdownFont(baseFont, bold, italic), size, style.color, style.linkUrl,
+                                   underline, strikethrough);
+            }
+        };
 
-        if (text.compare(i, 5, "@here") == 0) {
-            flushText();
-            auto mentionTokens = tokenizeStyledText("@here", FontLoader::Fonts::INTER_SEMIBOLD, size,
-                                                    ThemeColors::TEXT_LINK, "", false, false);
-            tokens.insert(tokens.end(), mentionTokens.begin(), mentionTokens.end());
-            i += 5;
-            continue;
-        }
+        size_t pos = runBegin;
+        while (pos < runEnd) {
+            const uint8_t cls = classAt(pos);
+            if (cls == kPlainChar) {
+                pos++;
+                continue;
+            }
 
-        std::string timestampText;
-        if (tryParseTimestamp(text, i, length, timestampText)) {
-            flushText();
-            auto timestampTokens =
-                tokenizeStyledText(timestampText, font, size, ThemeColors::TEXT_LINK, "", true, false);
-            tokens.insert(tokens.end(), timestampTokens.begin(), timestampTokens.end());
-            i += length;
-            continue;
-        }
+            LinkMatch link;
+            if (style.detectLinks && (cls & kLinkStartChar) && matchLink(pos, link)) {
+                flush(pos);
+                emitLink(link);
+                pos = pending = link.end;
+                continue;
+            }
 
-        std::string mentionId;
-        char mentionType;
-        if (tryParseMention(text, i, length, mentionId, mentionType)) {
-            flushText();
-            std::string mentionText;
-            if (mentionType == '#') {
-                mentionText = "#unknown-channel";
-            } else if (mentionType == '&') {
-                mentionText = "@Unknown Role";
-                if (msg && msg->guildId.has_value()) {
-                    // TODO: Look up role name from AppState
-                }
-            } else {
-                mentionText = "@Unknown User";
-                if (msg) {
-                    for (size_t j = 0; j < msg->mentionIds.size(); ++j) {
-                        if (msg->mentionIds[j] == mentionId) {
-                            if (j < msg->mentionDisplayNames.size() && !msg->mentionDisplayNames[j].empty()) {
-                                mentionText = "@" + msg->mentionDisplayNames[j];
-                            }
-                            break;
-                        }
-                    }
+            if (style.markdown && (cls & kMarkerChar)) {
+                int marker = toggleAt(pos, runEnd);
+                if (marker >= 0) {
+                    flush(pos);
+                    applyToggle(marker);
+                    pos = pending = pos + kEmphasisMarkers[static_cast<size_t>(marker)].size();
+                    continue;
                 }
             }
-            auto mentionTokens = tokenizeStyledText(mentionText, FontLoader::Fonts::INTER_SEMIBOLD, size,
-                                                    ThemeColors::TEXT_LINK, "", false, false);
-            tokens.insert(tokens.end(), mentionTokens.begin(), mentionTokens.end());
-            i += length;
-            continue;
-        }
 
-        std::string emojiUrl;
-        if (tryParseEmoji(text, i, length, emojiUrl)) {
-            flushText();
-            MessageWidget::InlineItem item;
-            item.kind = MessageWidget::InlineItem::Kind::Emoji;
-            item.emojiUrl = emojiUrl;
-            item.emojiSize = kEmojiSize;
-            item.width = kEmojiSize;
-            item.emojiCacheKey = buildEmojiCacheKey(emojiUrl, kEmojiSize);
-            tokens.push_back(std::move(item));
-            i += length;
-            continue;
-        }
+            InlineMatch match;
+            if ((cls & (kInlineStartChar | kEmojiStartChar)) && matchInline(pos, runEnd, style, match)) {
+                flush(pos);
+                emitInline(match);
+                pos = pending = pos + match.length;
+                continue;
+            }
 
-        std::string unicodeEmoji;
-        if (EmojiManager::tryMatch(text, i, length, unicodeEmoji)) {
-            flushText();
-            MessageWidget::InlineItem item;
-            item.kind = MessageWidget::InlineItem::Kind::Emoji;
-            item.text = unicodeEmoji;
-            item.emojiSize = kEmojiSize;
-            item.width = kEmojiSize;
-            item.emojiCacheKey = EmojiManager::makeCacheKey(unicodeEmoji, kEmojiSize);
-            tokens.push_back(std::move(item));
-            i += length;
-            continue;
+            pos = nextCodepoint(pos, runEnd);
         }
 
-        size_t charLen = utf8CharLength(static_cast<unsigned char>(text[i]));
-        if (i + charLen > text.size()) {
-            charLen = text.size() - i;
+        flush(runEnd);
+    }
+
+    // Steps over a UTF-8 sequence so emoji are only matched where a codepoint starts
+    size_t nextCodepoint(size_t pos, size_t end) const {
+        const size_t sequenceEnd = std::min(end, pos + utf8CharLength(static_cast<unsigned char>(line[pos])));
+        size_t next = pos + 1;
+        while (next < sequenceEnd && (static_cast<unsigned char>(line[next]) & 0xC0) == 0x80) {
+            next++;
         }
-        current.append(text, i, charLen);
-        i += charLen;
+        return next;
     }
 
-    flushText();
-    return tokens;
-}
+    TokenSink &sink;
+    std::string_view line;
+    size_t begin;
+    Fl_Font baseFont;
+    int size;
+    Fl_Color color;
+    const Message *msg;
+    bool emojiPossible;
+    bool bold = false;
+    bool italic = false;
+    bool underline = false;
+    bool strikethrough = false;
+    bool closersFound = false;
+    std::array<size_t, kEmphasisMarkers.size()> closers{};
+    bool bracketsFound = false;
+    std::vector<size_t> closeBrackets;
+    std::vector<size_t> closeParens;
+};
 
-int drawInlineItem(const MessageWidget::InlineItem &item, int x, int baseline, int lineHeight, int lineAscent, bool useMuted) {
+int drawInlineItem(const MessageWidget::ShapedContent &content, const MessageWidget::InlineItem &item, int x,
+                   int baseline, int lineHeight, int lineAscent, bool useMuted) {
+    std::string_view text = content.textOf(item);
     if (item.kind == MessageWidget::InlineItem::Kind::Emoji) {
         int size = item.emojiSize > 0 ? item.emojiSize : kEmojiSize;
         int lineTop = baseline - lineAscent;
         int drawY = lineTop + (lineHeight - size) / 2;
 
-        if (!item.emojiUrl.empty()) {
+        if (item.emojiUrl != 0) {
+            const std::string &emojiUrl = content.stringOf(item.emojiUrl);
             std::string cacheKey =
-                item.emojiCacheKey.empty() ? buildEmojiCacheKey(item.emojiUrl, size) : item.emojiCacheKey;
-            if (isGifUrl(item.emojiUrl)) {
-                if (ensureAnimatedEmoji(item.emojiUrl, size)) {
+                item.emojiCacheKey == 0 ? buildEmojiCacheKey(emojiUrl, size) : content.stringOf(item.emojiCacheKey);
+            if (isGifUrl(emojiUrl)) {
+                if (ensureAnimatedEmoji(emojiUrl, size)) {
                     startEmojiAnimation(cacheKey);
                 }
 
                 auto it = emoji_gif_cache.find(cacheKey);
                 if (it != emoji_gif_cache.end() && it->second.animation) {
-                    if (auto *frame = it->second.animation->getScaledFrame(size, size)) {
+                    if (auto *frame = it->second.animation->scaledFrame(size, size)) {
                         frame->draw(x, drawY);
+                        reportAnimatedRect(cacheKey, x, drawY, size, size);
+                        markDrawDynamic();
                         return size;
                     }
                 }
             }
 
-            Fl_RGB_Image *emoji = getEmojiImage(item.emojiUrl, size);
-            if (emoji && emoji->w() > 0 && emoji->h() > 0) {
-                emoji->draw(x, drawY);
-            }
-        } else if (!item.text.empty()) {
-            Fl_Image *emoji = EmojiManager::loadEmoji(item.text, size);
-            if (emoji && emoji->w() > 0 && emoji->h() > 0) {
-                emoji->draw(x, drawY);
-            } else {
+            drawCustomEmoji(emojiUrl, size, x, drawY);
+        } else if (!text.empty()) {
+            if (!EmojiManager::drawEmoji(std::string(text), size, x, drawY)) {
+                markDrawDynamic();
                 fl_color(useMuted ? ThemeColors::TEXT_MUTED : ThemeColors::TEXT_NORMAL);
                 fl_font(FontLoader::Fonts::INTER_REGULAR, item.size > 0 ? item.size : kContentFontSize);
-                fl_draw(item.text.c_str(), x, baseline);
+                fl_draw(text.data(), static_cast<int>(text.size()), x, baseline);
             }
         }
         return size;
     }
 
-    if (item.kind != MessageWidget::InlineItem::Kind::Text || item.text.empty()) {
+    if (item.kind != MessageWidget::InlineItem::Kind::Text || text.empty()) {
         return 0;
     }
 
     fl_color(useMuted ? ThemeColors::TEXT_MUTED : item.color);
     fl_font(item.font, item.size);
-    fl_draw(item.text.c_str(), x, baseline);
+    fl_draw(text.data(), static_cast<int>(text.size()), x, baseline);
 
     int width = item.width;
     if (width <= 0) {
-        width = static_cast<int>(fl_width(item.text.c_str()));
+        width = static_cast<int>(fl_width(text.data(), static_cast<int>(text.size())));
     }
 
     if (item.underline) {
@@ -1701,93 +1756,72 @@ std::string ellipsizeText(const std::string &text, int maxWidth, Fl_Font font, i
         return "";
     }
 
-    fl_font(font, size);
-    int fullWidth = static_cast<int>(fl_width(text.c_str()));
-    if (fullWidth <= maxWidth) {
+    if (TextMetrics::width(text, font, size) <= maxWidth) {
         return text;
     }
 
     const char *ellipsis = "...";
-    int ellipsisWidth = static_cast<int>(fl_width(ellipsis));
+    int ellipsisWidth = TextMetrics::width(ellipsis, font, size);
     if (ellipsisWidth >= maxWidth) {
         return "";
     }
 
-    std::string trimmed = text;
-    while (!trimmed.empty()) {
-        trimmed.pop_back();
-        int width = static_cast<int>(fl_width(trimmed.c_str()));
-        if (width <= maxWidth - ellipsisWidth) {
-            break;
-        }
-    }
-
-    return trimmed.empty() ? std::string(ellipsis) : trimmed + ellipsis;
+    size_t keep = TextMetrics::fitPrefix(text, maxWidth - ellipsisWidth, font, size);
+    return text.substr(0, keep) + ellipsis;
 }
 
-std::vector<MessageWidget::InlineItem> buildSystemTokens(const std::string &templ, const std::string &username,
-                                                         Fl_Font baseFont, Fl_Font highlightFont, int size,
-                                                         Fl_Color baseColor, Fl_Color highlightColor) {
-    std::vector<MessageWidget::InlineItem> tokens;
-    const std::string token = "{user}";
-    size_t pos = 0;
-    while (pos < templ.size()) {
-        size_t found = templ.find(token, pos);
-        if (found == std::string::npos) {
-            auto partTokens = tokenizeStyledText(templ.substr(pos), baseFont, size, baseColor);
-            tokens.insert(tokens.end(), partTokens.begin(), partTokens.end());
+void buildSystemTokens(TokenSink &sink, const std::string &templ, const std::string &username, Fl_Font baseFont,
+                       Fl_Font highlightFont, int size, Fl_Color baseColor, Fl_Color highlightColor) {
+    std::string_view remaining(templ);
+    const std::string_view token = "{user}";
+    while (!remaining.empty()) {
+        size_t found = remaining.find(token);
+        if (found == std::string_view::npos) {
+            tokenizeStyledText(sink, remaining, baseFont, size, baseColor);
             break;
         }
 
-        if (found > pos) {
-            auto partTokens = tokenizeStyledText(templ.substr(pos, found - pos), baseFont, size, baseColor);
-            tokens.insert(tokens.end(), partTokens.begin(), partTokens.end());
+        if (found > 0) {
+            tokenizeStyledText(sink, remaining.substr(0, found), baseFont, size, baseColor);
         }
 
-        auto userTokens = tokenizeStyledText(username, highlightFont, size, highlightColor);
-        tokens.insert(tokens.end(), userTokens.begin(), userTokens.end());
-        pos = found + token.size();
+        tokenizeStyledText(sink, username, highlightFont, size, highlightColor);
+        remaining.remove_prefix(found + token.size());
     }
-
-    return tokens;
 }
 
-std::vector<MessageWidget::InlineItem> tokenizeTextWithMessage(const std::string &text, Fl_Font font, int size,
-                                                               Fl_Color color, const Message *msg) {
-    std::vector<MessageWidget::InlineItem> tokens;
-
-    auto appendMarkdownSegment = [&](const std::string &segment) {
-        size_t lineStart = 0;
-        while (lineStart <= segment.size()) {
-            size_t lineEnd = segment.find('\n', lineStart);
-            bool hasNewline = (lineEnd != std::string::npos);
-            std::string line = hasNewline ? segment.substr(lineStart, lineEnd - lineStart) : segment.substr(lineStart);
+void tokenizeTextWithMessage(TokenSink &sink, const std::string &text, Fl_Font font, int size, Fl_Color color,
+                             const Message *msg) {
+    const std::string_view source(text);
+    auto appendMarkdownSegment = [&](size_t segmentBegin, size_t segmentEnd) {
+        size_t lineStart = segmentBegin;
+        while (lineStart <= segmentEnd) {
+            size_t lineEnd = source.substr(0, segmentEnd).find('\n', lineStart);
+            bool hasNewline = (lineEnd != std::string_view::npos);
+            if (!hasNewline) {
+                lineEnd = segmentEnd;
+            }
+            std::string_view line = source.substr(lineStart, lineEnd - lineStart);
 
+            size_t contentStart = lineStart;
             int lineSize = size;
             Fl_Font lineBaseFont = font;
 
             if (line.rfind("### ", 0) == 0) {
-                line = line.substr(4);
+                contentStart += 4;
                 lineSize = size + 2;
                 lineBaseFont = FontLoader::Fonts::INTER_BOLD;
             } else if (line.rfind("## ", 0) == 0) {
-                line = line.substr(3);
+                contentStart += 3;
                 lineSize = size + 4;
                 lineBaseFont = FontLoader::Fonts::INTER_BOLD;
             } else if (line.rfind("# ", 0) == 0) {
-                line = line.substr(2);
+                contentStart += 2;
                 lineSize = size + 6;
                 lineBaseFont = FontLoader::Fonts::INTER_BOLD;
             }
 
-            auto runs = parseLinkRuns(line, color, ThemeColors::TEXT_LINK);
-            auto mdRuns = parseMarkdownRuns(runs);
-            for (const auto &mdRun : mdRuns) {
-                Fl_Font runFont = resolveMarkdownFont(lineBaseFont, mdRun.bold, mdRun.italic);
-                auto runTokens = tokenizeEmojiText(mdRun.text, runFont, lineSize, mdRun.color, mdRun.linkUrl, mdRun.underline,
-                                                   mdRun.strikethrough, msg);
-                tokens.insert(tokens.end(), runTokens.begin(), runTokens.end());
-            }
+            LineTokenizer(sink, text, contentStart, lineEnd, lineBaseFont, lineSize, color, msg).tokenize();
 
             if (hasNewline) {
                 MessageWidget::InlineItem br;
@@ -1795,7 +1829,7 @@ std::vector<MessageWidget::InlineItem> tokenizeTextWithMessage(const std::string
                 br.font = font;
                 br.size = size;
                 br.color = color;
-                tokens.push_back(std::move(br));
+                sink.append(br);
                 lineStart = lineEnd + 1;
             } else {
                 break;
@@ -1807,49 +1841,38 @@ std::vector<MessageWidget::InlineItem> tokenizeTextWithMessage(const std::string
     while (pos < text.size()) {
         size_t fence = text.find("```", pos);
         if (fence == std::string::npos) {
-            appendMarkdownSegment(text.substr(pos));
+            appendMarkdownSegment(pos, text.size());
             break;
         }
 
         if (fence > pos) {
-            appendMarkdownSegment(text.substr(pos, fence - pos));
+            appendMarkdownSegment(pos, fence);
         }
 
         size_t langStart = fence + 3;
         size_t firstNewline = text.find('\n', langStart);
         if (firstNewline == std::string::npos) {
-            appendMarkdownSegment(text.substr(fence));
+            appendMarkdownSegment(fence, text.size());
             break;
         }
 
         size_t codeStart = firstNewline + 1;
         size_t close = text.find("```", codeStart);
         if (close == std::string::npos) {
-            appendMarkdownSegment(text.substr(fence));
+            appendMarkdownSegment(fence, text.size());
             break;
         }
 
-        std::string codeText = text.substr(codeStart, close - codeStart);
-        auto codeTokens =
-            tokenizeLiteralText(codeText, FL_COURIER_BOLD, std::max(10, size - 1), ThemeColors::TEXT_NORMAL, true, true);
-        tokens.insert(tokens.end(), codeTokens.begin(), codeTokens.end());
+        tokenizeLiteralText(sink, std::string_view(text).substr(codeStart, close - codeStart), FL_COURIER_BOLD,
+                            std::max(10, size - 1), ThemeColors::TEXT_NORMAL, true, true);
 
         pos = close + 3;
     }
-
-    return tokens;
 }
 } // namespace
 
-MessageWidget::Layout MessageWidget::buildLayout(const Message &msg, int viewWidth, bool isGrouped, bool compactBottom,
-                                                 const ReplyPreview *replyPreview) {
-    Layout layout;
-    layout.isSystem = msg.isSystemMessage();
-    layout.grouped = isGrouped;
-    layout.username = msg.getAuthorDisplayName();
-    layout.viewWidth = viewWidth;
-    layout.avatarSize = kAvatarSize;
-
+namespace {
+std::string formatMessageTime(const Message &msg) {
     auto msgTime = std::chrono::system_clock::to_time_t(msg.timestamp);
     std::tm msgTm;
     localtime_s(&msgTm, &msgTime);
@@ -1880,7 +1903,155 @@ MessageWidget::Layout MessageWidget::buildLayout(const Message &msg, int viewWid
         timeStream << std::put_time(&msgTm, "%d/%m/%Y %I:%M %p");
     }
 
-    layout.time = timeStream.str();
+    return timeStream.str();
+}
+
+// Bytes a string holds outside its own object; short strings live inline and hold none
+size_t heapBytes(const std::string &value) {
+    const auto *object = reinterpret_cast<const char *>(&value);
+    const bool isInline = value.data() >= object && value.data() < object + sizeof(value);
+    return isInline ? 0 : value.capacity() + 1;
+}
+} // namespace
+
+std::string_view MessageWidget::ShapedContent::textOf(const InlineItem &item) const {
+    return std::string_view(text).substr(item.textOffset, item.textLength);
+}
+
+const std::string &MessageWidget::ShapedContent::stringOf(uint32_t id) const {
+    static const std::string empty;
+    return (id == 0 || id > strings.size()) ? empty : strings[id - 1];
+}
+
+size_t MessageWidget::ShapedContent::memoryBytes() const {
+    size_t bytes = sizeof(ShapedContent) + heapBytes(text) + tokens.capacity() * sizeof(InlineItem) +
+                   strings.capacity() * sizeof(std::string) + heapBytes(username) + heapBytes(time) +
+                   heapBytes(systemIconName);
+    for (const auto &value : strings) {
+        bytes += heapBytes(value);
+    }
+    return bytes;
+}
+
+size_t MessageWidget::Layout::memoryBytes() const {
+    size_t bytes = sizeof(Layout) + items.capacity() * sizeof(InlineItem) + lines.capacity() * sizeof(LayoutLine) +
+                   stickers.capacity() * sizeof(StickerLayout) + attachments.capacity() * sizeof(AttachmentLayout) +
+                   reactions.capacity() * sizeof(ReactionLayout) + heapBytes(username) + heapBytes(time) +
+                   heapBytes(systemIconName);
+    if (shaped) {
+        bytes += shaped->memoryBytes();
+    }
+    if (reply) {
+        bytes += reply->memoryBytes();
+    }
+    return bytes;
+}
+
+uint64_t MessageWidget::shapingGeneration() {
+    auto nowTime = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    std::tm nowTm;
+    localtime_s(&nowTm, &nowTime);
+    auto day = static_cast<uint64_t>(nowTm.tm_year) * 366 + static_cast<uint64_t>(nowTm.tm_yday);
+    return (day << 32) | (TextMetrics::epoch() & 0xFFFFFFFFu);
+}
+
+std::shared_ptr<const MessageWidget::ShapedContent> MessageWidget::shapeMessage(const Message &msg) {
+    auto shaped = std::make_shared<ShapedContent>();
+    TokenSink sink(*shaped);
+    // Taken before anything is formatted or measured, so a day or metrics change mid-shape reads as stale
+    shaped->generation = shapingGeneration();
+    shaped->username = msg.getAuthorDisplayName();
+    shaped->time = formatMessageTime(msg);
+
+    if (msg.isSystemMessage()) {
+        std::vector<std::string> mentionNames =
+            msg.mentionDisplayNames.empty() ? msg.mentionIds : msg.mentionDisplayNames;
+        SystemMessageSpec spec = buildSystemMessageSpec(msg, shaped->username, mentionNames);
+        shaped->systemIconName = spec.iconName;
+        shaped->systemIconColor = spec.iconColor;
+        buildSystemTokens(sink, spec.templateText, shaped->username, FontLoader::Fonts::INTER_REGULAR,
+                          FontLoader::Fonts::INTER_SEMIBOLD, kSystemFontSize, ThemeColors::TEXT_MUTED,
+                          spec.highlightColor);
+    } else {
+        auto &tokens = shaped->tokens;
+        tokenizeTextWithMessage(sink, msg.content, FontLoader::Fonts::INTER_REGULAR, kContentFontSize,
+                                ThemeColors::TEXT_NORMAL, &msg);
+        bool emojiOnly = true;
+        int maxEmojiSize = 0;
+        for (const auto &token : tokens) {
+            if (token.kind == InlineItem::Kind::Emoji) {
+                maxEmojiSize = std::max(maxEmojiSize, token.emojiSize > 0 ? token.emojiSize : kEmojiSize);
+                continue;
+            }
+            if (token.kind == InlineItem::Kind::LineBreak) {
+                continue;
+            }
+            if (token.kind == InlineItem::Kind::Text &&
+                shaped->textOf(token).find_first_not_of(" \t\r\n") == std::string_view::npos) {
+                continue;
+            }
+            emojiOnly = false;
+            break;
+        }
+
+        if (emojiOnly && maxEmojiSize > 0) {
+            for (auto &token : tokens) {
+                if (token.kind == InlineItem::Kind::Emoji) {
+                    token.emojiSize = kEmojiOnlySize;
+                    token.width = kEmojiOnlySize;
+                    if (token.emojiUrl != 0) {
+                        token.emojiCacheKey =
+                            sink.intern(buildEmojiCacheKey(shaped->stringOf(token.emojiUrl), kEmojiOnlySize));
+                    } else if (token.textLength > 0) {
+                        token.emojiCacheKey =
+                            sink.intern(EmojiManager::makeCacheKey(std::string(shaped->textOf(token)), kEmojiOnlySize));
+                    }
+                }
+            }
+            maxEmojiSize = kEmojiOnlySize;
+        }
+
+        shaped->hasContent = msg.content.find_first_not_of(" \t\r\n") != std::string::npos;
+        if (shaped->hasContent && msg.wasEdited()) {
+            tokenizeStyledText(sink, " (edited)", FontLoader::Fonts::INTER_REGULAR, kEditedFontSize,
+                               ThemeColors::TEXT_MUTED);
+        }
+
+        int maxTextSize = kContentFontSize;
+        for (const auto &token : tokens) {
+            if (token.kind == InlineItem::Kind::Text && token.size > maxTextSize) {
+                maxTextSize = token.size;
+            }
+        }
+        shaped->maxTextSize = maxTextSize;
+        shaped->maxEmojiSize = maxEmojiSize;
+    }
+
+    for (auto &token : shaped->tokens) {
+        if (token.kind == InlineItem::Kind::Text && token.textLength > 0) {
+            token.width = TextMetrics::width(shaped->textOf(token), token.font, token.size);
+        }
+    }
+
+    return shaped;
+}
+
+MessageWidget::Layout MessageWidget::buildLayout(const Message &msg, int viewWidth, bool isGrouped, bool compactBottom,
+                                                 const ReplyPreview *replyPreview) {
+    return buildLayout(msg, shapeMessage(msg), viewWidth, isGrouped, compactBottom, replyPreview);
+}
+
+MessageWidget::Layout MessageWidget::buildLayout(const Message &msg, std::shared_ptr<const ShapedContent> shaped,
+                                                 int viewWidth, bool isGrouped, bool compactBottom,
+                                                 const ReplyPreview *replyPreview) {
+    Layout layout;
+    layout.isSystem = msg.isSystemMessage();
+    layout.grouped = isGrouped;
+    layout.username = shaped->username;
+    layout.viewWidth = viewWidth;
+    layout.avatarSize = kAvatarSize;
+    layout.time = shaped->time;
+    layout.shaped = shaped;
 
     layout.avatarX = kLeftMargin;
     layout.avatarY = 0;
@@ -1900,9 +2071,8 @@ MessageWidget::Layout MessageWidget::buildLayout(const Message &msg, int viewWid
             layout.replyLineX = kLeftMargin;
         }
 
-        fl_font(FontLoader::Fonts::INTER_REGULAR, kReplyFontSize);
-        int replyFontHeight = fl_height();
-        int replyAscent = replyFontHeight - fl_descent();
+        int replyFontHeight = TextMetrics::height(FontLoader::Fonts::INTER_REGULAR, kReplyFontSize);
+        int replyAscent = replyFontHeight - TextMetrics::descent(FontLoader::Fonts::INTER_REGULAR, kReplyFontSize);
         layout.replyHeight = replyFontHeight;
 
         int replyTop = isGrouped ? kGroupedTopPadding : kReplyTopPadding;
@@ -1913,25 +2083,24 @@ MessageWidget::Layout MessageWidget::buildLayout(const Message &msg, int viewWid
         int maxReplyWidth = layout.contentWidth;
         std::string snippet = replyPreview->content;
 
-        fl_font(FontLoader::Fonts::INTER_SEMIBOLD, kReplyFontSize);
-        int authorWidth = static_cast<int>(fl_width(replyPreview->author.c_str()));
-        fl_font(FontLoader::Fonts::INTER_REGULAR, kReplyFontSize);
-        int spaceWidth = static_cast<int>(fl_width(" "));
+        int authorWidth = TextMetrics::width(replyPreview->author, FontLoader::Fonts::INTER_SEMIBOLD, kReplyFontSize);
+        int spaceWidth = TextMetrics::width(" ", FontLoader::Fonts::INTER_REGULAR, kReplyFontSize);
         int availableSnippetWidth = std::max(0, maxReplyWidth - authorWidth - spaceWidth);
         if (availableSnippetWidth > 0 && !snippet.empty()) {
             snippet = ellipsizeText(snippet, availableSnippetWidth, FontLoader::Fonts::INTER_REGULAR, kReplyFontSize);
         }
 
-        layout.replyItems = tokenizeStyledText(replyPreview->author, FontLoader::Fonts::INTER_SEMIBOLD, kReplyFontSize,
-                                               ThemeColors::TEXT_NORMAL);
+        auto reply = std::make_shared<ShapedContent>();
+        TokenSink replySink(*reply);
+        tokenizeStyledText(replySink, replyPreview->author, FontLoader::Fonts::INTER_SEMIBOLD, kReplyFontSize,
+                           ThemeColors::TEXT_NORMAL);
         if (!snippet.empty()) {
-            auto spacer =
-                tokenizeStyledText(" ", FontLoader::Fonts::INTER_REGULAR, kReplyFontSize, ThemeColors::TEXT_MUTED);
-            layout.replyItems.insert(layout.replyItems.end(), spacer.begin(), spacer.end());
-            auto snippetItems =
-                tokenizeStyledText(snippet, FontLoader::Fonts::INTER_REGULAR, kReplyFontSize, ThemeColors::TEXT_MUTED);
-            layout.replyItems.insert(layout.replyItems.end(), snippetItems.begin(), snippetItems.end());
+            tokenizeStyledText(replySink, " ", FontLoader::Fonts::INTER_REGULAR, kReplyFontSize,
+                               ThemeColors::TEXT_MUTED);
+            tokenizeStyledText(replySink, snippet, FontLoader::Fonts::INTER_REGULAR, kReplyFontSize,
+                               ThemeColors::TEXT_MUTED);
         }
+        layout.reply = std::move(reply);
 
         if (!isGrouped) {
             layout.avatarY = replyTop + layout.replyHeight + kReplyToHeaderPadding;
@@ -1939,40 +2108,33 @@ MessageWidget::Layout MessageWidget::buildLayout(const Message &msg, int viewWid
     }
 
     if (!layout.isSystem && !isGrouped) {
-        fl_font(FontLoader::Fonts::INTER_SEMIBOLD, kUsernameFontSize);
-        int usernameAscent = fl_height() - fl_descent();
+        int usernameAscent = TextMetrics::height(FontLoader::Fonts::INTER_SEMIBOLD, kUsernameFontSize) -
+                             TextMetrics::descent(FontLoader::Fonts::INTER_SEMIBOLD, kUsernameFontSize);
         layout.headerBaseline = layout.avatarY + kHeaderTopPadding + usernameAscent;
-        int usernameWidth = static_cast<int>(fl_width(layout.username.c_str()));
+        int usernameWidth = TextMetrics::width(layout.username, FontLoader::Fonts::INTER_SEMIBOLD, kUsernameFontSize);
 
-        fl_font(FontLoader::Fonts::INTER_REGULAR, kTimestampFontSize);
-        int timeAscent = fl_height() - fl_descent();
+        int timeAscent = TextMetrics::height(FontLoader::Fonts::INTER_REGULAR, kTimestampFontSize) -
+                         TextMetrics::descent(FontLoader::Fonts::INTER_REGULAR, kTimestampFontSize);
         layout.timeX = layout.usernameX + usernameWidth + kTimestampGap;
         layout.timeBaseline = layout.avatarY + kHeaderTopPadding + timeAscent + kTimestampBaselineAdjust;
     }
 
-    std::vector<std::string> mentionNames = msg.mentionDisplayNames.empty() ? msg.mentionIds : msg.mentionDisplayNames;
     int lineAscent = 0;
     int contentHeight = 0;
     int contentTop = 0;
 
     if (layout.isSystem) {
-        SystemMessageSpec spec = buildSystemMessageSpec(msg, layout.username, mentionNames);
-        layout.systemIconName = spec.iconName;
-        layout.systemIconColor = spec.iconColor;
+        layout.systemIconName = shaped->systemIconName;
+        layout.systemIconColor = shaped->systemIconColor;
         layout.systemIconSize = kSystemIconSize;
 
         layout.contentX = kLeftMargin + kSystemIconSize + kSystemIconGap;
         layout.contentWidth = std::max(0, viewWidth - kRightMargin - layout.contentX);
 
-        auto tokens = buildSystemTokens(spec.templateText, layout.username, FontLoader::Fonts::INTER_REGULAR,
-                                        FontLoader::Fonts::INTER_SEMIBOLD, kSystemFontSize, ThemeColors::TEXT_MUTED,
-                                        spec.highlightColor);
-
-        fl_font(FontLoader::Fonts::INTER_REGULAR, kSystemFontSize);
-        int fontHeight = fl_height();
-        int fontAscent = fontHeight - fl_descent();
+        int fontHeight = TextMetrics::height(FontLoader::Fonts::INTER_REGULAR, kSystemFontSize);
+        int fontAscent = fontHeight - TextMetrics::descent(FontLoader::Fonts::INTER_REGULAR, kSystemFontSize);
 
-        layout.lines = wrapTokens(tokens, layout.contentWidth, layout.contentWidth);
+        layout.lines = wrapTokens(*shaped, layout.contentWidth, layout.contentWidth, layout.items);
         layout.lineHeight = std::max(fontHeight, kSystemIconSize);
         layout.lineSpacing = kSystemLineSpacing;
         lineAscent = fontAscent;
@@ -1985,8 +2147,7 @@ MessageWidget::Layout MessageWidget::buildLayout(const Message &msg, int viewWid
         int lastLineWidth = (layout.lines.empty() ? 0 : layout.lines.back().width);
         int lastLineBaseline = layout.contentBaseline + (lineCount - 1) * (layout.lineHeight + layout.lineSpacing);
 
-        fl_font(FontLoader::Fonts::INTER_REGULAR, kTimestampFontSize);
-        int timeWidth = static_cast<int>(fl_width(layout.time.c_str()));
+        int timeWidth = TextMetrics::width(layout.time, FontLoader::Fonts::INTER_REGULAR, kTimestampFontSize);
         int timeXCandidate = layout.contentX + lastLineWidth + kSystemTimeGap;
         int contentRight = layout.contentX + layout.contentWidth;
 
@@ -2004,72 +2165,27 @@ MessageWidget::Layout MessageWidget::buildLayout(const Message &msg, int viewWid
         layout.systemIconX = kLeftMargin;
         layout.systemIconY = contentTop + (layout.lineHeight - kSystemIconSize) / 2;
     } else {
-        auto tokens = tokenizeTextWithMessage(msg.content, FontLoader::Fonts::INTER_REGULAR, kContentFontSize,
-                                              ThemeColors::TEXT_NORMAL, &msg);
-        bool emojiOnly = true;
-        int maxEmojiSize = 0;
-        for (const auto &token : tokens) {
-            if (token.kind == InlineItem::Kind::Emoji) {
-                maxEmojiSize = std::max(maxEmojiSize, token.emojiSize > 0 ? token.emojiSize : kEmojiSize);
-                continue;
-            }
-            if (token.kind == InlineItem::Kind::LineBreak) {
-                continue;
-            }
-            if (token.kind == InlineItem::Kind::Text && token.text.find_first_not_of(" \t\r\n") == std::string::npos) {
-                continue;
-            }
-            emojiOnly = false;
-            break;
-        }
-
-        if (emojiOnly && maxEmojiSize > 0) {
-            for (auto &token : tokens) {
-                if (token.kind == InlineItem::Kind::Emoji) {
-                    token.emojiSize = kEmojiOnlySize;
-                    token.width = kEmojiOnlySize;
-                    if (!token.emojiUrl.empty()) {
-                        token.emojiCacheKey = buildEmojiCacheKey(token.emojiUrl, kEmojiOnlySize);
-                    } else if (!token.text.empty()) {
-                        token.emojiCacheKey = EmojiManager::makeCacheKey(token.text, kEmojiOnlySize);
-                    }
-                }
-            }
-            maxEmojiSize = kEmojiOnlySize;
-        }
-
-        bool hasContent = msg.content.find_first_not_of(" \t\r\n") != std::string::npos;
-        if (hasContent && msg.wasEdited()) {
-            auto editedTokens = tokenizeStyledText(" (edited)", FontLoader::Fonts::INTER_REGULAR, kEditedFontSize,
-                                                   ThemeColors::TEXT_MUTED);
-            tokens.insert(tokens.end(), editedTokens.begin(), editedTokens.end());
-        }
-
-        int maxTextSize = kContentFontSize;
-        for (const auto &token : tokens) {
-            if (token.kind == InlineItem::Kind::Text && token.size > maxTextSize) {
-                maxTextSize = token.size;
-            }
-        }
-
-        fl_font(FontLoader::Fonts::INTER_REGULAR, maxTextSize);
-        int maxFontHeight = fl_height();
-        fl_font(FontLoader::Fonts::INTER_REGULAR, kContentFontSize);
+        bool hasContent = shaped->hasContent;
+        int maxEmojiSize = shaped->maxEmojiSize;
+        int maxFontHeight = TextMetrics::height(FontLoader::Fonts::INTER_REGULAR, shaped->maxTextSize);
+        int contentDescent = TextMetrics::descent(FontLoader::Fonts::INTER_REGULAR, kContentFontSize);
         int maxWidthByView = std::max(1, (layout.viewWidth * 3) / 4);
         int codeBlockMaxWidth = std::min(layout.contentWidth, std::min(kCodeBlockMaxWidthPx, maxWidthByView));
-        layout.lines = wrapTokens(tokens, layout.contentWidth, codeBlockMaxWidth);
-        layout.lineHeight = std::max(fl_height(), maxFontHeight);
+        layout.lines = wrapTokens(*shaped, layout.contentWidth, codeBlockMaxWidth, layout.items);
+        layout.lineHeight =
+            std::max(TextMetrics::height(FontLoader::Fonts::INTER_REGULAR, kContentFontSize), maxFontHeight);
         layout.lineSpacing = kLineSpacing;
-        lineAscent = layout.lineHeight - fl_descent();
+        lineAscent = layout.lineHeight - contentDescent;
 
         if (!hasContent) {
             layout.lines.clear();
+            layout.items.clear();
             contentHeight = 0;
             lineAscent = 0;
         } else {
             if (maxEmojiSize > 0) {
                 layout.lineHeight = std::max(layout.lineHeight, maxEmojiSize);
-                lineAscent = layout.lineHeight - fl_descent();
+                lineAscent = layout.lineHeight - contentDescent;
             }
             if (!layout.lines.empty()) {
                 size_t i = 0;
@@ -2303,9 +2419,6 @@ MessageWidget::Layout MessageWidget::buildLayout(const Message &msg, int viewWid
             int cursorX = 0;
             int cursorY = 0;
 
-            fl_font(FontLoader::Fonts::INTER_SEMIBOLD, kReactionFontSize);
-            fl_font(FontLoader::Fonts::INTER_SEMIBOLD, kReactionEmojiFontSize);
-
             for (const auto &reaction : msg.reactions) {
                 MessageWidget::ReactionLayout reactionLayout;
                 reactionLayout.me = reaction.me;
@@ -2328,9 +2441,9 @@ MessageWidget::Layout MessageWidget::buildLayout(const Message &msg, int viewWid
                         reactionLayout.emojiCacheKey =
                             EmojiManager::makeCacheKey(reactionLayout.emojiName, reactionLayout.emojiSize);
                     } else {
-                        fl_font(FontLoader::Fonts::INTER_SEMIBOLD, kReactionEmojiFontSize);
                         if (!reactionLayout.emojiName.empty()) {
-                            emojiWidth = static_cast<int>(fl_width(reactionLayout.emojiName.c_str()));
+                            emojiWidth = TextMetrics::width(reactionLayout.emojiName, FontLoader::Fonts::INTER_SEMIBOLD,
+                                                            kReactionEmojiFontSize);
                         }
                     }
                 }
@@ -2339,8 +2452,8 @@ MessageWidget::Layout MessageWidget::buildLayout(const Message &msg, int viewWid
                 }
                 reactionLayout.emojiWidth = emojiWidth;
 
-                fl_font(FontLoader::Fonts::INTER_SEMIBOLD, kReactionFontSize);
-                int countWidth = static_cast<int>(fl_width(reactionLayout.countText.c_str()));
+                int countWidth =
+                    TextMetrics::width(reactionLayout.countText, FontLoader::Fonts::INTER_SEMIBOLD, kReactionFontSize);
                 int pillWidth = kReactionPaddingX + emojiWidth + kReactionEmojiGap + countWidth + kReactionPaddingX;
                 if (pillWidth < kReactionHeight) {
                     pillWidth = kReactionHeight;
@@ -2392,7 +2505,8 @@ MessageWidget::Layout MessageWidget::buildLayout(const Message &msg, int viewWid
     return layout;
 }
 
-void MessageWidget::draw(const Message &msg, const Layout &layout, int originX, int originY, bool avatarHovered) {
+bool MessageWidget::draw(const Message &msg, const Layout &layout, int originX, int originY, bool avatarHovered) {
+    draw_is_static = true;
     const bool isPending = msg.isPending;
     if (layout.isSystem) {
         if (!layout.systemIconName.empty()) {
@@ -2408,8 +2522,9 @@ void MessageWidget::draw(const Message &msg, const Layout &layout, int originX,
         int lineY = originY + layout.contentBaseline;
         for (const auto &line : layout.lines) {
             int cursorX = originX + layout.contentX;
-            for (const auto &item : line.items) {
-                cursorX += drawInlineItem(item, cursorX, lineY, layout.lineHeight, sysAscent, isPending);
+            for (uint32_t i = line.firstItem; i < line.firstItem + line.itemCount; ++i) {
+                cursorX += drawInlineItem(*layout.shaped, layout.items[i], cursorX, lineY, layout.lineHeight, sysAscent,
+                                          isPending);
             }
             lineY += layout.lineHeight + layout.lineSpacing;
         }
@@ -2417,7 +2532,7 @@ void MessageWidget::draw(const Message &msg, const Layout &layout, int originX,
         fl_color(ThemeColors::TEXT_MUTED);
         fl_font(FontLoader::Fonts::INTER_REGULAR, kTimestampFontSize);
         fl_draw(layout.time.c_str(), originX + layout.timeX, originY + layout.timeBaseline);
-        return;
+        return draw_is_static;
     }
 
     if (!layout.grouped) {
@@ -2427,6 +2542,7 @@ void MessageWidget::draw(const Message &msg, const Layout &layout, int originX,
         Fl_RGB_Image *avatar = nullptr;
 
         if (avatarHovered) {
+            markDrawDynamic();
             std::string gifUrl = getAnimatedAvatarUrl(msg, layout.avatarSize);
             if (!gifUrl.empty()) {
                 std::string gifKey = buildAvatarCacheKey(gifUrl, layout.avatarSize);
@@ -2436,9 +2552,10 @@ void MessageWidget::draw(const Message &msg, const Layout &layout, int originX,
                     }
                     auto it = avatar_gif_cache.find(gifKey);
                     if (it != avatar_gif_cache.end() && it->second.animation) {
-                        size_t frameIndex = it->second.animation->getCurrentFrameIndex();
-                        if (frameIndex < it->second.frames.size() && it->second.frames[frameIndex]) {
-                            avatar = it->second.frames[frameIndex].get();
+                        if (Fl_RGB_Image *frame = it->second.animation->circularFrame(layout.avatarSize)) {
+                            avatar = frame;
+                            reportAnimatedRect(gifKey, originX + layout.avatarX, originY + layout.avatarY,
+                                               layout.avatarSize, layout.avatarSize);
                         }
                     }
                 }
@@ -2452,6 +2569,10 @@ void MessageWidget::draw(const Message &msg, const Layout &layout, int originX,
         if (avatar && avatar->w() > 0 && avatar->h() > 0) {
             avatar->draw(originX + layout.avatarX, originY + layout.avatarY);
         } else {
+            // The initial stands in until the avatar loads; an author without one keeps it
+            if (!getStaticAvatarUrl(msg, layout.avatarSize).empty()) {
+                markDrawDynamic();
+            }
             fl_color(isPending ? ThemeColors::TEXT_MUTED : ThemeColors::TEXT_NORMAL);
             fl_font(FontLoader::Fonts::INTER_SEMIBOLD, 20);
             std::string initial = layout.username.empty() ? "U" : std::string(1, layout.username[0]);
@@ -2470,7 +2591,7 @@ void MessageWidget::draw(const Message &msg, const Layout &layout, int originX,
         fl_draw(layout.time.c_str(), originX + layout.timeX, originY + layout.timeBaseline);
     }
 
-    if (layout.hasReply && !layout.replyItems.empty()) {
+    if (layout.hasReply && layout.reply && !layout.reply->tokens.empty()) {
         fl_color(ThemeColors::BG_MODIFIER_ACCENT);
         fl_line_style(FL_SOLID, kReplyLineThickness);
         int lineX = originX + layout.replyLineX;
@@ -2518,8 +2639,8 @@ void MessageWidget::draw(const Message &msg, const Layout &layout, int originX,
         int replyY = originY + layout.replyBaseline;
         int cursorX = originX + layout.replyX;
         int replyAscent = layout.replyBaseline - layout.replyLineTop;
-        for (const auto &item : layout.replyItems) {
-            cursorX += drawInlineItem(item, cursorX, replyY, layout.replyHeight, replyAscent, isPending);
+        for (const auto &item : layout.reply->tokens) {
+            cursorX += drawInlineItem(*layout.reply, item, cursorX, replyY, layout.replyHeight, replyAscent, isPending);
         }
     }
 
@@ -2536,8 +2657,9 @@ void MessageWidget::draw(const Message &msg, const Layout &layout, int originX,
         if (!layout.lines[lineIndex].isCodeBlock) {
             const auto &line = layout.lines[lineIndex];
             int cursorX = originX + layout.contentX;
-            for (const auto &item : line.items) {
-                cursorX += drawInlineItem(item, cursorX, lineY, layout.lineHeight, baseAscent, isPending);
+            for (uint32_t i = line.firstItem; i < line.firstItem + line.itemCount; ++i) {
+                cursorX += drawInlineItem(*layout.shaped, layout.items[i], cursorX, lineY, layout.lineHeight, baseAscent,
+                                          isPending);
             }
 
             lineY += layout.lineHeight + layout.lineSpacing;
@@ -2581,8 +2703,10 @@ void MessageWidget::draw(const Message &msg, const Layout &layout, int originX,
         int baseline = firstLineBaseline;
         for (size_t i = start; i < end; ++i) {
             int cursorX = boxX + kCodeBlockPaddingX;
-            for (const auto &item : layout.lines[i].items) {
-                cursorX += drawInlineItem(item, cursorX, baseline, layout.lineHeight, baseAscent, isPending);
+            const auto &line = layout.lines[i];
+            for (uint32_t j = line.firstItem; j < line.firstItem + line.itemCount; ++j) {
+                cursorX += drawInlineItem(*layout.shaped, layout.items[j], cursorX, baseline, layout.lineHeight,
+                                          baseAscent, isPending);
             }
             baseline += layout.lineHeight + kCodeBlockLineSpacing;
         }
@@ -2613,8 +2737,10 @@ void MessageWidget::draw(const Message &msg, const Layout &layout, int originX,
 
                     auto it = sticker_gif_cache.find(stickerLayout.cacheKey);
                     if (it != sticker_gif_cache.end() && it->second.animation) {
-                        if (auto *frame = it->second.animation->getScaledFrame(boxW, boxH)) {
+                        if (auto *frame = it->second.animation->scaledFrame(boxW, boxH)) {
                             frame->draw(boxX, boxY);
+                            reportAnimatedRect(stickerLayout.cacheKey, boxX, boxY, boxW, boxH);
+                            markDrawDynamic();
                             continue;
                         }
                     }
@@ -2625,6 +2751,7 @@ void MessageWidget::draw(const Message &msg, const Layout &layout, int originX,
                     image->draw(boxX, boxY);
                     continue;
                 }
+                markDrawDynamic();
             }
 
             RoundedStyle::drawRoundedRect(boxX, boxY, boxW, boxH, kAttachmentCornerRadius, kAttachmentCornerRadius,
@@ -2671,6 +2798,7 @@ void MessageWidget::draw(const Message &msg, const Layout &layout, int originX,
                 if (image && image->w() > 0 && image->h() > 0) {
                     image->draw(boxX, boxY);
                 } else {
+                    markDrawDynamic();
                     RoundedStyle::drawRoundedRect(boxX, boxY, boxW, boxH, kAttachmentCornerRadius,
                                                   kAttachmentCornerRadius, kAttachmentCornerRadius,
                                                   kAttachmentCornerRadius, ThemeColors::BG_SECONDARY);
@@ -2738,6 +2866,7 @@ void MessageWidget::draw(const Message &msg, const Layout &layout, int originX,
                 fl_draw(meta.c_str(), textStartX, metaBaseline);
 
                 if (attachmentLayout.downloadSize > 0) {
+                    markDrawDynamic();
                     int downloadX = boxX + attachmentLayout.downloadXOffset;
                     int downloadY = boxY + attachmentLayout.downloadYOffset;
                     std::string downloadKey = getAttachmentDownloadKey(msg, i);
@@ -2797,19 +2926,19 @@ void MessageWidget::draw(const Message &msg, const Layout &layout, int originX,
 
                     auto it = emoji_gif_cache.find(reactionLayout.emojiCacheKey);
                     if (it != emoji_gif_cache.end() && it->second.animation) {
-                        if (auto *frame = it->second.animation->getScaledFrame(reactionLayout.emojiSize, reactionLayout.emojiSize)) {
+                        if (auto *frame = it->second.animation->scaledFrame(reactionLayout.emojiSize,
+                                                                            reactionLayout.emojiSize)) {
                             frame->draw(emojiX, emojiY);
+                            reportAnimatedRect(reactionLayout.emojiCacheKey, emojiX, emojiY, reactionLayout.emojiSize,
+                                               reactionLayout.emojiSize);
+                            markDrawDynamic();
                             drewEmoji = true;
                         }
                     }
                 }
 
                 if (!drewEmoji) {
-                    Fl_RGB_Image *emoji = getEmojiImage(reactionLayout.emojiUrl, reactionLayout.emojiSize);
-                    if (emoji && emoji->w() > 0 && emoji->h() > 0) {
-                        emoji->draw(emojiX, emojiY);
-                        drewEmoji = true;
-                    }
+                    drewEmoji = drawCustomEmoji(reactionLayout.emojiUrl, reactionLayout.emojiSize, emojiX, emojiY);
                 }
 
                 if (!drewEmoji && !reactionLayout.emojiName.empty()) {
@@ -2819,14 +2948,8 @@ void MessageWidget::draw(const Message &msg, const Layout &layout, int originX,
                     fl_draw(reactionLayout.emojiName.c_str(), emojiX, emojiBaseline);
                 }
             } else if (!reactionLayout.emojiName.empty()) {
-                bool drewEmoji = false;
-                Fl_Image *emoji = EmojiManager::loadEmoji(reactionLayout.emojiName, reactionLayout.emojiSize);
-                if (emoji && emoji->w() > 0 && emoji->h() > 0) {
-                    emoji->draw(emojiX, emojiY);
-                    drewEmoji = true;
-                }
-
-                if (!drewEmoji) {
+                if (!EmojiManager::drawEmoji(reactionLayout.emojiName, reactionLayout.emojiSize, emojiX, emojiY)) {
+                    markDrawDynamic();
                     fl_color(kReactionTextColor);
                     fl_font(FontLoader::Fonts::INTER_SEMIBOLD, kReactionEmojiFontSize);
                     int emojiBaseline = boxY + (reactionLayout.height + fl_height()) / 2 - fl_descent();
@@ -2842,6 +2965,8 @@ void MessageWidget::draw(const Message &msg, const Layout &layout, int originX,
             }
         }
     }
+
+    return draw_is_static;
 }
 
 std::string MessageWidget::getAnimatedAvatarKey(const Message &msg, int size) {
@@ -2884,6 +3009,46 @@ void MessageWidget::setHoveredAttachmentDownloadKey(const std::string &key) {
     hovered_attachment_download_key = key;
 }
 
+void MessageWidget::setDamageHandler(const void *owner, DamageHandler handler) {
+    damage_handler_owner = owner;
+    damage_handler = std::move(handler);
+    animated_rects.clear();
+}
+
+void MessageWidget::clearDamageHandler(const void *owner) {
+    if (damage_handler_owner != owner) {
+        return;
+    }
+    damage_handler_owner = nullptr;
+    damage_handler = nullptr;
+    animated_rects.clear();
+}
+
+void MessageWidget::clearAnimatedRects() { animated_rects.clear(); }
+
+void MessageWidget::setAnimatedRectOrigin(int x, int y) {
+    animated_rect_origin_x = x;
+    animated_rect_origin_y = y;
+}
+
+void MessageWidget::setAnimationViewport(int x, int y, int w, int h) {
+    auto isOnScreen = [&](const std::string &key) {
+        auto it = animated_rects.find(key);
+        if (it == animated_rects.end()) {
+            return false;
+        }
+        return std::any_of(it->second.begin(), it->second.end(), [&](const AnimatedRect &rect) {
+            return rect.x < x + w && rect.x + rect.w > x && rect.y < y + h && rect.y + rect.h > y;
+        });
+    };
+
+    for (auto *cache : {&avatar_gif_cache, &emoji_gif_cache, &sticker_gif_cache}) {
+        for (auto &[key, state] : *cache) {
+            setAnimationSuspended(state, !isOnScreen(key));
+        }
+    }
+}
+
 void MessageWidget::pruneAvatarCache(const std::unordered_set<std::string> &keepKeys) {
     for (auto it = avatar_cache.begin(); it != avatar_cache.end();) {
         if (keepKeys.find(it->first) == keepKeys.end()) {
@@ -2919,10 +3084,6 @@ void MessageWidget::pruneAnimatedEmojiCache(const std::unordered_set<std::string
 void MessageWidget::pruneStickerCache(const std::unordered_set<std::string> &keepKeys) {
     for (auto it = sticker_cache.begin(); it != sticker_cache.end();) {
         if (keepKeys.find(it->first) == keepKeys.end()) {
-            size_t split = it->first.find('#');
-            if (split != std::string::npos) {
-                Images::evictFromMemory(it->first.substr(0, split));
-            }
             it = sticker_cache.erase(it);
         } else {
             ++it;
@@ -2944,10 +3105,6 @@ void MessageWidget::pruneAnimatedStickerCache(const std::unordered_set<std::stri
 void MessageWidget::pruneAttachmentCache(const std::unordered_set<std::string> &keepKeys) {
     for (auto it = attachment_cache.begin(); it != attachment_cache.end();) {
         if (keepKeys.find(it->first) == keepKeys.end()) {
-            size_t split = it->first.find('#');
-            if (split != std::string::npos) {
-                Images::evictFromMemory(it->first.substr(0, split));
-            }
             it = attachment_cache.erase(it);
         } else {
             ++it;
@@ -2956,33 +3113,14 @@ void MessageWidget::pruneAttachmentCache(const std::unordered_set<std::string> &
 }
 
 void MessageWidget::pruneEmojiCache(const std::unordered_set<std::string> &keepKeys) {
-    for (auto it = emoji_cache.begin(); it != emoji_cache.end();) {
-        if (keepKeys.find(it->first) == keepKeys.end()) {
-            size_t split = it->first.find('#');
-            if (split != std::string::npos) {
-                Images::evictFromMemory(it->first.substr(0, split));
-            }
-            it = emoji_cache.erase(it);
-        } else {
-            ++it;
-        }
-    }
-}
-
-std::vector<MessageWidget::InlineItem> MessageWidget::tokenizeText(const std::string &text, Fl_Font font, int size,
-                                                                   Fl_Color color) {
-    return tokenizeTextWithMessage(text, font, size, color, nullptr);
-}
-
-std::vector<MessageWidget::LayoutLine> MessageWidget::wrapText(const std::string &text, int maxWidth) {
-    auto tokens = tokenizeText(text, FontLoader::Fonts::INTER_REGULAR, kContentFontSize, ThemeColors::TEXT_NORMAL);
-    return wrapTokens(tokens, maxWidth, maxWidth);
+    EmojiAtlas::prune(keepKeys, kCustomEmojiUrlPrefix);
 }
 
-std::vector<MessageWidget::LayoutLine> MessageWidget::wrapTokens(const std::vector<InlineItem> &tokens, int maxWidth,
-                                                                 int codeBlockMaxWidth) {
+std::vector<MessageWidget::LayoutLine> MessageWidget::wrapTokens(const ShapedContent &content, int maxWidth,
+                                                                 int codeBlockMaxWidth, std::vector<InlineItem> &items) {
     std::vector<LayoutLine> lines;
     LayoutLine currentLine;
+    currentLine.firstItem = static_cast<uint32_t>(items.size());
     int currentWidth = 0;
     bool currentLineCodeBlock = false;
 
@@ -2991,66 +3129,77 @@ std::vector<MessageWidget::LayoutLine> MessageWidget::wrapTokens(const std::vect
         return lines;
     }
 
+    auto lineIsEmpty = [&]() { return items.size() == currentLine.firstItem; };
+
     auto pushLine = [&]() {
+        currentLine.itemCount = static_cast<uint32_t>(items.size()) - currentLine.firstItem;
         currentLine.width = currentWidth;
         currentLine.isCodeBlock = currentLineCodeBlock;
         lines.push_back(currentLine);
         currentLine = LayoutLine{};
+        currentLine.firstItem = static_cast<uint32_t>(items.size());
         currentWidth = 0;
         currentLineCodeBlock = false;
     };
 
-    auto trimLeadingWhitespace = [](const std::string &str) -> std::string {
+    auto leadingWhitespace = [&](const InlineItem &token) -> size_t {
+        std::string_view text = content.textOf(token);
         size_t start = 0;
-        while (start < str.size() && (str[start] == ' ' || str[start] == '\t')) {
+        while (start < text.size() && (text[start] == ' ' || text[start] == '\t')) {
             start++;
         }
-        return str.substr(start);
+        return start;
     };
 
-    auto trimWrappedCodeWhitespace = [&](InlineItem &token) {
-        if (!token.isCodeBlock || token.kind != InlineItem::Kind::Text || token.text.empty()) {
-            return;
-        }
-        size_t start = 0;
-        while (start < token.text.size() && (token.text[start] == ' ' || token.text[start] == '\t')) {
-            start++;
-        }
-        if (start == 0) {
-            return;
-        }
-        token.text.erase(0, start);
-        if (token.text.empty()) {
+    // Narrows the token's span past count bytes; returns false when nothing is left
+    auto dropPrefix = [&](InlineItem &token, size_t count) -> bool {
+        token.textOffset += static_cast<uint32_t>(count);
+        token.textLength -= static_cast<uint32_t>(count);
+        if (token.textLength == 0) {
             token.width = 0;
-            return;
+            return false;
         }
-        fl_font(token.font, token.size);
-        token.width = static_cast<int>(fl_width(token.text.c_str()));
+        token.width = TextMetrics::width(content.textOf(token), token.font, token.size);
+        return true;
     };
 
-    auto isWhitespaceToken = [](const InlineItem &token) -> bool {
-        if (token.kind != InlineItem::Kind::Text || token.text.empty()) {
+    // Returns false when the token consisted only of leading whitespace and should be skipped
+    auto trimLeadingWhitespace = [&](InlineItem &token) -> bool {
+        size_t count = leadingWhitespace(token);
+        if (count == token.textLength) {
             return false;
         }
-        for (char ch : token.text) {
-            if (ch != ' ' && ch != '\t') {
-                return false;
-            }
+        if (count > 0) {
+            dropPrefix(token, count);
         }
         return true;
     };
 
+    auto trimWrappedCodeWhitespace = [&](InlineItem &token) {
+        if (!token.isCodeBlock || token.kind != InlineItem::Kind::Text || token.textLength == 0) {
+            return;
+        }
+        size_t count = leadingWhitespace(token);
+        if (count > 0) {
+            dropPrefix(token, count);
+        }
+    };
+
+    auto isWhitespaceToken = [&](const InlineItem &token) -> bool {
+        return token.kind == InlineItem::Kind::Text && token.textLength > 0 && leadingWhitespace(token) == token.textLength;
+    };
+
     auto trimTrailingWhitespaceTokens = [&]() {
-        while (!currentLine.items.empty() && isWhitespaceToken(currentLine.items.back())) {
-            currentWidth -= std::max(0, currentLine.items.back().width);
-            currentLine.items.pop_back();
+        while (!lineIsEmpty() && isWhitespaceToken(items.back())) {
+            currentWidth -= std::max(0, items.back().width);
+            items.pop_back();
         }
         if (currentWidth < 0) {
             currentWidth = 0;
         }
     };
 
-    for (auto token : tokens) {
+    for (auto token : content.tokens) {
         if (token.kind == InlineItem::Kind::LineBreak) {
             currentLineCodeBlock = currentLineCodeBlock || token.isCodeBlock;
             pushLine();
@@ -3058,10 +3207,10 @@ std::vector<MessageWidget::LayoutLine> MessageWidget::wrapTokens(const std::vect
             continue;
         }
 
-        if (token.isCodeBlock && !currentLineCodeBlock && !currentLine.items.empty()) {
+        if (token.isCodeBlock && !currentLineCodeBlock && !lineIsEmpty()) {
             pushLine();
         }
-        if (!token.isCodeBlock && currentLineCodeBlock && !currentLine.items.empty()) {
+        if (!token.isCodeBlock && currentLineCodeBlock && !lineIsEmpty()) {
             pushLine();
         }
         currentLineCodeBlock = currentLineCodeBlock || token.isCodeBlock;
@@ -3077,14 +3226,14 @@ std::vector<MessageWidget::LayoutLine> MessageWidget::wrapTokens(const std::vect
                 token.width = token.emojiSize > 0 ? token.emojiSize : kEmojiSize;
             }
 
-            if (currentWidth + token.width > effectiveMaxWidth && !currentLine.items.empty()) {
+            if (currentWidth + token.width > effectiveMaxWidth && !lineIsEmpty()) {
                 if (currentLineCodeBlock) {
                     trimTrailingWhitespaceTokens();
                 }
                 pushLine();
                 currentLineCodeBlock = token.isCodeBlock;
                 trimWrappedCodeWhitespace(token);
-                if (token.kind == InlineItem::Kind::Text && token.text.empty()) {
+                if (token.kind == InlineItem::Kind::Text && token.textLength == 0) {
                     continue;
                 }
                 if (currentLineCodeBlock) {
@@ -3095,69 +3244,57 @@ std::vector<MessageWidget::LayoutLine> MessageWidget::wrapTokens(const std::vect
                 }
             }
 
-            currentLine.items.push_back(token);
+            items.push_back(token);
             currentWidth += token.width;
             continue;
         }
 
         if (token.kind == InlineItem::Kind::Text) {
-            if (currentLine.items.empty() && !token.text.empty() && !token.preserveWhitespace) {
-                std::string trimmed = trimLeadingWhitespace(token.text);
-                if (trimmed.empty()) {
+            if (lineIsEmpty() && token.textLength > 0 && !token.preserveWhitespace) {
+                if (!trimLeadingWhitespace(token)) {
                     continue;
                 }
-                if (trimmed != token.text) {
-                    token.text = trimmed;
-                    fl_font(token.font, token.size);
-                    token.width = static_cast<int>(fl_width(token.text.c_str()));
-                }
             }
         }
 
-        fl_font(token.font, token.size);
-        token.width = static_cast<int>(fl_width(token.text.c_str()));
-        if (token.width > effectiveMaxWidth && token.text != " ") {
-            auto splitTokens = splitLongToken(token, effectiveMaxWidth);
+        if (token.width <= 0) {
+            token.width = TextMetrics::width(content.textOf(token), token.font, token.size);
+        }
+        const bool isSingleSpace = content.textOf(token) == " ";
+        if (token.width > effectiveMaxWidth && !isSingleSpace) {
+            auto splitTokens = splitLongToken(content, token, effectiveMaxWidth);
             for (auto part : splitTokens) {
-                if (currentWidth + part.width > effectiveMaxWidth && !currentLine.items.empty()) {
+                if (currentWidth + part.width > effectiveMaxWidth && !lineIsEmpty()) {
                     if (currentLineCodeBlock) {
                         trimTrailingWhitespaceTokens();
                     }
                     pushLine();
                     currentLineCodeBlock = part.isCodeBlock;
                     trimWrappedCodeWhitespace(part);
-                    if (part.kind == InlineItem::Kind::Text && part.text.empty()) {
+                    if (part.kind == InlineItem::Kind::Text && part.textLength == 0) {
                         continue;
                     }
                 }
-                if (currentLine.items.empty() && part.kind == InlineItem::Kind::Text) {
-                    if (!part.preserveWhitespace) {
-                        std::string trimmed = trimLeadingWhitespace(part.text);
-                        if (trimmed.empty()) {
-                            continue;
-                        }
-                        if (trimmed != part.text) {
-                            part.text = trimmed;
-                            fl_font(part.font, part.size);
-                            part.width = static_cast<int>(fl_width(part.text.c_str()));
-                        }
+                if (lineIsEmpty() && part.kind == InlineItem::Kind::Text) {
+                    if (!part.preserveWhitespace && !trimLeadingWhitespace(part)) {
+                        continue;
                     }
                 }
-                currentLine.items.push_back(part);
+                items.push_back(part);
                 currentWidth += part.width;
             }
             continue;
         }
 
-        if (token.text == " " && currentLine.items.empty() && !token.preserveWhitespace) {
+        if (isSingleSpace && lineIsEmpty() && !token.preserveWhitespace) {
             continue;
         }
 
-        if (currentWidth + token.width > effectiveMaxWidth && !currentLine.items.empty()) {
+        if (currentWidth + token.width > effectiveMaxWidth && !lineIsEmpty()) {
             if (currentLineCodeBlock) {
                 trimTrailingWhitespaceTokens();
                 if (currentWidth + token.width <= effectiveMaxWidth) {
-                    currentLine.items.push_back(token);
+                    items.push_back(token);
                     currentWidth += token.width;
                     continue;
                 }
@@ -3165,85 +3302,115 @@ std::vector<MessageWidget::LayoutLine> MessageWidget::wrapTokens(const std::vect
             pushLine();
             currentLineCodeBlock = token.isCodeBlock;
             trimWrappedCodeWhitespace(token);
-            if (token.kind == InlineItem::Kind::Text && token.text.empty()) {
+            if (token.kind == InlineItem::Kind::Text && token.textLength == 0) {
                 continue;
             }
             if (token.kind == InlineItem::Kind::Text) {
-                if (!token.preserveWhitespace) {
-                    std::string trimmed = trimLeadingWhitespace(token.text);
-                    if (trimmed.empty()) {
-                        continue;
-                    }
-                    if (trimmed != token.text) {
-                        token.text = trimmed;
-                        fl_font(token.font, token.size);
-                        token.width = static_cast<int>(fl_width(token.text.c_str()));
-                    }
+                if (!token.preserveWhitespace && !trimLeadingWhitespace(token)) {
+                    continue;
                 }
             }
         }
 
-        currentLine.items.push_back(token);
+        items.push_back(token);
         currentWidth += token.width;
     }
 
+    currentLine.itemCount = static_cast<uint32_t>(items.size()) - currentLine.firstItem;
     currentLine.width = currentWidth;
     currentLine.isCodeBlock = currentLineCodeBlock;
     lines.push_back(currentLine);
     return lines;
 }
 
-std::vector<MessageWidget::InlineItem> MessageWidget::splitLongToken(const InlineItem &token, int maxWidth) {
+std::vector<MessageWidget::InlineItem> MessageWidget::splitLongToken(const ShapedContent &content,
+                                                                     const InlineItem &token, int maxWidth) {
     std::vector<InlineItem> parts;
-    if (token.text.empty() || maxWidth <= 0) {
+    if (token.textLength == 0 || maxWidth <= 0) {
         return parts;
     }
 
-    std::string current;
-    for (char ch : token.text) {
-        std::string candidate = current;
-        candidate.push_back(ch);
-        fl_font(token.font, token.size);
-        int candidateWidth = static_cast<int>(fl_width(candidate.c_str()));
-        if (!current.empty() && candidateWidth > maxWidth) {
-            InlineItem part;
-            part.kind = InlineItem::Kind::Text;
-            part.text = current;
-            part.width = static_cast<int>(fl_width(current.c_str()));
-            part.font = token.font;
-            part.size = token.size;
-            part.color = token.color;
-            part.linkUrl = token.linkUrl;
-            part.isLink = token.isLink;
-            part.underline = token.underline;
-            part.strikethrough = token.strikethrough;
-            part.preserveWhitespace = token.preserveWhitespace;
-            part.isCodeBlock = token.isCodeBlock;
-            parts.push_back(std::move(part));
-            current.clear();
-            current.push_back(ch);
-        } else {
-            current = candidate;
+    std::string_view remaining = content.textOf(token);
+    uint32_t offset = token.textOffset;
+    while (!remaining.empty()) {
+        double partWidth = 0.0;
+        size_t length = TextMetrics::fitPrefix(remaining, maxWidth, token.font, token.size, &partWidth);
+        if (length == 0) {
+            length = TextMetrics::codepointLength(remaining);
+            partWidth = TextMetrics::advance(remaining.substr(0, length), token.font, token.size);
         }
-    }
 
-    if (!current.empty()) {
-        fl_font(token.font, token.size);
-        InlineItem part;
+        InlineItem part = token;
         part.kind = InlineItem::Kind::Text;
-        part.text = current;
-        part.width = static_cast<int>(fl_width(current.c_str()));
-        part.font = token.font;
-        part.size = token.size;
-        part.color = token.color;
-        part.linkUrl = token.linkUrl;
-        part.isLink = token.isLink;
-        part.underline = token.underline;
-        part.strikethrough = token.strikethrough;
-        part.preserveWhitespace = token.preserveWhitespace;
-        part.isCodeBlock = token.isCodeBlock;
-        parts.push_back(std::move(part));
+        part.textOffset = offset;
+        part.textLength = static_cast<uint32_t>(length);
+        part.width = static_cast<int>(partWidth);
+        parts.push_back(part);
+        offset += static_cast<uint32_t>(length);
+        remaining.remove_prefix(length);
     }
 
     return parts;
 }
+
+namespace {
+struct LayoutJob {
+    MessageWidget::LayoutRequest request;
+    MessageWidget::LayoutCallback callback;
+    int attempts = 0;
+};
+
+// A second pass can only miss glyphs that failed to measure; accept its estimate rather than loop
+constexpr int kMaxLayoutAttempts = 2;
+
+void runOnUiThread(std::function<void()> task) {
+    auto *heapTask = new std::function<void()>(std::move(task));
+    Fl::awake(
+        [](void *data) {
+            std::unique_ptr<std::function<void()>> owned(static_cast<std::function<void()> *>(data));
+            (*owned)();
+        },
+        heapTask);
+}
+
+void enqueueLayoutJob(LayoutJob job);
+
+void runLayoutJob(LayoutJob job) {
+    std::shared_ptr<const MessageWidget::Layout> layout;
+    bool missed = false;
+    try {
+        TextMetrics::WorkerScope metricsScope;
+        const MessageWidget::ReplyPreview *reply =
+            job.request.replyPreview.has_value() ? &*job.request.replyPreview : nullptr;
+        auto shaped = job.request.shaped ? job.request.shaped : MessageWidget::shapeMessage(job.request.message);
+        layout = std::make_shared<const MessageWidget::Layout>(
+            MessageWidget::buildLayout(job.request.message, std::move(shaped), job.request.viewWidth,
+                                       job.request.grouped, job.request.compactBottom, reply));
+        missed = metricsScope.missed();
+    } catch (const std::exception &e) {
+        Logger::warn("Failed to build layout for message " + job.request.message.id + ": " + e.what());
+    }
+
+    job.attempts++;
+    if (layout && missed && job.attempts < kMaxLayoutAttempts) {
+        runOnUiThread([job = std::move(job)]() mutable {
+            TextMetrics::resolvePending();
+            enqueueLayoutJob(std::move(job));
+        });
+        return;
+    }
+
+    runOnUiThread([callback = std::move(job.callback), layout = std::move(layout)]() { callback(layout); });
+}
+
+void enqueueLayoutJob(LayoutJob job) {
+    WorkerPool::post([job = std::move(job)]() mutable { runLayoutJob(std::move(job)); });
+}
+} // namespace
+
+void MessageWidget::buildLayoutAsync(LayoutRequest request, LayoutCallback callback) {
+    LayoutJob job;
+    job.request = std::move(request);
+    job.callback = std::move(callback);
+    enqueueLayoutJob(std::move(job));
+}
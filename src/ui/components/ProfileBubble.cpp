@@ -1,7 +1,7 @@
 #include "ui/components/ProfileBubble.h"
 
 #include "ui/AnimationManager.h"
-#include "ui/GifAnimation.h"
+#include "ui/AnimationRegistry.h"
 #include "ui/IconManager.h"
 #include "ui/RoundedWidget.h"
 #include "ui/Theme.h"
@@ -13,8 +13,25 @@
 #include <FL/Fl_Window.H>
 #include <FL/fl_draw.H>
 #include <algorithm>
-#include <filesystem>
-#include <sstream>
+
+namespace {
+
+// Pause this widget's playback of a shared animation, and the callback driving it, while it cannot be seen
+void suspendAnimation(const AnimationRegistry::Handle &animation, AnimationManager::AnimationId id, bool &suspended,
+                      bool suspend) {
+    if (!animation || suspended == suspend) {
+        return;
+    }
+    suspended = suspend;
+    if (suspend) {
+        animation->suspend();
+    } else {
+        animation->resume();
+    }
+    AnimationManager::get().setSuspended(id, suspend);
+}
+
+} // namespace
 
 ProfileBubble::ProfileBubble(int x, int y, int w, int h, const char *label) : Fl_Widget(x, y, w, h, label) {
     box(FL_NO_BOX);
@@ -27,6 +44,14 @@ ProfileBubble::~ProfileBubble() {
     if (m_emojiAnimationId != 0) {
         AnimationManager::get().unregisterAnimation(m_emojiAnimationId);
     }
+    if (m_avatarGif) {
+        suspendAnimation(m_avatarGif, m_avatarAnimationId, m_avatarSuspended, false);
+        m_avatarGif->stop();
+    }
+    if (m_emojiGif) {
+        suspendAnimation(m_emojiGif, m_emojiAnimationId, m_emojiSuspended, false);
+        m_emojiGif->stop();
+    }
 
     if (m_circularAvatar) {
         delete m_circularAvatar;
@@ -113,12 +138,9 @@ void ProfileBubble::draw() {
         int statusY = usernameBaseline + 17;
         int currentX = textX;
 
-        Fl_RGB_Image *emojiToShow = nullptr;
-        if (m_emojiGif && m_emojiGif->isAnimated() && !m_emojiFrames.empty()) {
-            size_t frameIndex = m_emojiGif->getCurrentFrameIndex();
-            if (frameIndex < m_emojiFrames.size()) {
-                emojiToShow = m_emojiFrames[frameIndex].get();
-            }
+        Fl_Image *emojiToShow = nullptr;
+        if (m_emojiGif) {
+            emojiToShow = m_emojiGif->scaledFrame(CUSTOM_STATUS_EMOJI_SIZE, CUSTOM_STATUS_EMOJI_SIZE);
         } else {
             emojiToShow = m_customStatusEmoji;
         }
@@ -164,11 +186,8 @@ void ProfileBubble::drawAvatar(int avatarX, int avatarY) {
 
     Fl_RGB_Image *frameToShow = nullptr;
 
-    if (m_avatarGif && m_avatarGif->isAnimated() && !m_circularFrames.empty()) {
-        size_t frameIndex = m_avatarGif->getCurrentFrameIndex();
-        if (frameIndex < m_circularFrames.size()) {
-            frameToShow = m_circularFrames[frameIndex].get();
-        }
+    if (m_avatarGif) {
+        frameToShow = m_avatarGif->circularFrame(AVATAR_SIZE);
     } else {
         frameToShow = m_circularAvatar;
     }
@@ -342,6 +361,12 @@ int ProfileBubble::handle(int event) {
         }
         return 1;
     }
+
+    case FL_SHOW:
+    case FL_HIDE:
+        suspendAnimation(m_avatarGif, m_avatarAnimationId, m_avatarSuspended, event == FL_HIDE);
+        suspendAnimation(m_emojiGif, m_emojiAnimationId, m_emojiSuspended, event == FL_HIDE);
+        break;
     }
 
     return Fl_Widget::handle(event);
@@ -357,12 +382,13 @@ void ProfileBubble::loadAvatar() {
         delete m_circularAvatar;
         m_circularAvatar = nullptr;
     }
-    m_circularFrames.clear();
-    m_avatarGif.reset();
-    m_avatarFrameTimeAccumulated = 0.0;
+    if (m_avatarGif) {
+        suspendAnimation(m_avatarGif, m_avatarAnimationId, m_avatarSuspended, false);
+        m_avatarGif->stop();
+        m_avatarGif.reset();
+    }
 
     if (m_avatarUrl.empty()) {
-        m_avatarImage = nullptr;
         return;
     }
 
@@ -371,89 +397,41 @@ void ProfileBubble::loadAvatar() {
     bool isGif = (urlLower.find(".gif") != std::string::npos);
 
     if (isGif) {
-        Images::loadImageAsync(m_avatarUrl, [this](Fl_RGB_Image *image) {
-            if (!image) {
-                Logger::warn("Failed to load GIF avatar");
-                redraw();
-                return;
-            }
-            std::string cacheDir;
-#ifdef _WIN32
-            char *appData = nullptr;
-            size_t len;
-            if (_dupenv_s(&appData, &len, "LOCALAPPDATA") == 0 && appData != nullptr) {
-                cacheDir = std::string(appData) + "\\Discove\\cache";
-                free(appData);
-            } else {
-                cacheDir = "C:\\Temp\\Discove\\cache";
-            }
-#else
-            const char *home = getenv("HOME");
-            if (home) {
-                cacheDir = std::string(home) + "/.cache/discove";
-            } else {
-                cacheDir = "/tmp/discove_cache";
-            }
-#endif
-
-            std::hash<std::string> hasher;
-            size_t hash = hasher(m_avatarUrl);
-            std::ostringstream oss;
-            oss << std::hex << hash;
-            std::string cacheFile = cacheDir + "/" + oss.str() + ".gif";
-
-            if (!std::filesystem::exists(cacheFile)) {
-                Logger::warn("GIF cache file not found: " + cacheFile);
-                m_circularAvatar = Images::makeCircular(image, AVATAR_SIZE);
-                redraw();
+        std::string url = m_avatarUrl;
+        AnimationRegistry::load(url, [this, url](AnimationRegistry::Handle animation) {
+            if (url != m_avatarUrl || m_avatarGif || m_circularAvatar) {
                 return;
             }
 
-            m_avatarGif = std::make_unique<GifAnimation>(cacheFile);
-            if (!m_avatarGif->isValid()) {
-                Logger::warn("Failed to load GIF animation from: " + cacheFile);
-                m_circularAvatar = Images::makeCircular(image, AVATAR_SIZE);
-                m_avatarGif.reset();
+            if (!animation || !animation->isAnimated()) {
+                Fl_RGB_Image *still = animation ? animation->currentFrame() : Images::getCachedImage(url);
+                if (still) {
+                    m_circularAvatar = Images::makeCircular(still, AVATAR_SIZE);
+                } else {
+                    Logger::warn("Failed to load GIF avatar");
+                }
                 redraw();
                 return;
             }
 
-            size_t frameCount = m_avatarGif->frameCount();
-            m_circularFrames.reserve(frameCount);
-
-            for (size_t i = 0; i < frameCount; i++) {
-                Fl_RGB_Image *frame = m_avatarGif->getFrame(i);
-                if (frame) {
-                    Fl_RGB_Image *circularFrame = Images::makeCircular(frame, AVATAR_SIZE);
-                    if (circularFrame) {
-                        m_circularFrames.push_back(std::unique_ptr<Fl_RGB_Image>(circularFrame));
-                    }
-                }
-            }
-
-            if (!m_circularFrames.empty() && m_avatarGif->isAnimated()) {
-                m_avatarGif->setFrame(0);
-                m_avatarFrameTimeAccumulated = 0.0;
-                m_avatarAnimationId =
-                    AnimationManager::get().registerAnimation([this]() { return updateAvatarAnimation(); });
-            } else {
-                m_circularAvatar = Images::makeCircular(image, AVATAR_SIZE);
-                m_avatarGif.reset();
-            }
-
+            m_avatarGif = std::move(animation);
+            m_avatarGif->play();
+            m_avatarAnimationId = AnimationManager::get().registerScheduledAnimation(
+                [this](double) { return updateAvatarAnimation(); }, m_avatarGif->timeUntilNextFrame());
+            suspendAnimation(m_avatarGif, m_avatarAnimationId, m_avatarSuspended, !visible_r());
             redraw();
         });
     } else {
-        m_avatarImage = Images::getCachedImage(m_avatarUrl);
-
-        if (m_avatarImage) {
-            m_circularAvatar = Images::makeCircular(m_avatarImage, AVATAR_SIZE);
+        // Only the circular copy is kept; the cached bitmap may be evicted once it has been made
+        Fl_RGB_Image *cached = Images::getCachedImage(Images::scaledCacheKey(m_avatarUrl, AVATAR_SIZE, AVATAR_SIZE));
+        if (cached) {
+            m_circularAvatar = Images::makeCircular(cached, AVATAR_SIZE);
             redraw();
         } else {
-            Images::loadImageAsync(m_avatarUrl, [this](Fl_RGB_Image *image) {
-                m_avatarImage = image;
-                if (m_avatarImage) {
-                    m_circularAvatar = Images::makeCircular(m_avatarImage, AVATAR_SIZE);
+            std::string url = m_avatarUrl;
+            Images::loadScaledImageAsync(m_avatarUrl, AVATAR_SIZE, AVATAR_SIZE, [this, url](Fl_RGB_Image *image) {
+                if (image && url == m_avatarUrl && !m_circularAvatar) {
+                    m_circularAvatar = Images::makeCircular(image, AVATAR_SIZE);
                 }
                 redraw();
             });
@@ -493,9 +471,11 @@ void ProfileBubble::setCustomStatus(const std::string &customStatus, const std::
             delete m_customStatusEmoji;
             m_customStatusEmoji = nullptr;
         }
-        m_emojiFrames.clear();
-        m_emojiGif.reset();
-        m_emojiFrameTimeAccumulated = 0.0;
+        if (m_emojiGif) {
+            suspendAnimation(m_emojiGif, m_emojiAnimationId, m_emojiSuspended, false);
+            m_emojiGif->stop();
+            m_emojiGif.reset();
+        }
 
         if (!emojiUrl.empty()) {
             loadCustomStatusEmoji();
@@ -515,99 +495,39 @@ void ProfileBubble::loadCustomStatusEmoji() {
     bool isGif = (urlLower.find(".gif") != std::string::npos);
 
     if (isGif) {
-        Images::loadImageAsync(m_customStatusEmojiUrl, [this](Fl_RGB_Image *image) {
-            if (!image) {
-                Logger::warn("Failed to load GIF emoji");
-                redraw();
+        std::string url = m_customStatusEmojiUrl;
+        AnimationRegistry::load(url, [this, url](AnimationRegistry::Handle animation) {
+            if (url != m_customStatusEmojiUrl || m_emojiGif || m_customStatusEmoji) {
                 return;
             }
 
-            std::string cacheDir;
-#ifdef _WIN32
-            char *appData = nullptr;
-            size_t len;
-            if (_dupenv_s(&appData, &len, "LOCALAPPDATA") == 0 && appData != nullptr) {
-                cacheDir = std::string(appData) + "\\Discove\\cache";
-                free(appData);
-            } else {
-                cacheDir = "C:\\Temp\\Discove\\cache";
-            }
-#else
-            const char *home = getenv("HOME");
-            if (home) {
-                cacheDir = std::string(home) + "/.cache/discove";
-            } else {
-                cacheDir = "/tmp/discove_cache";
-            }
-#endif
-
-            std::hash<std::string> hasher;
-            size_t hash = hasher(m_customStatusEmojiUrl);
-            std::ostringstream oss;
-            oss << std::hex << hash;
-            std::string cacheFile = cacheDir + "/" + oss.str() + ".gif";
-
-            if (!std::filesystem::exists(cacheFile)) {
-                Logger::warn("GIF cache file not found: " + cacheFile);
-                Fl_Image *scaledImg = image->copy(CUSTOM_STATUS_EMOJI_SIZE, CUSTOM_STATUS_EMOJI_SIZE);
+            if (!animation || !animation->isAnimated()) {
+                Fl_RGB_Image *still = animation ? animation->currentFrame() : Images::getCachedImage(url);
+                Fl_Image *scaledImg = still ? still->copy(CUSTOM_STATUS_EMOJI_SIZE, CUSTOM_STATUS_EMOJI_SIZE) : nullptr;
                 if (scaledImg) {
                     m_customStatusEmoji = static_cast<Fl_RGB_Image *>(scaledImg);
+                } else {
+                    Logger::warn("Failed to load GIF emoji");
                 }
                 redraw();
                 return;
             }
 
-            m_emojiGif = std::make_unique<GifAnimation>(cacheFile);
-            if (!m_emojiGif->isValid()) {
-                Logger::warn("Failed to load GIF animation from: " + cacheFile);
-                Fl_Image *scaledImg = image->copy(CUSTOM_STATUS_EMOJI_SIZE, CUSTOM_STATUS_EMOJI_SIZE);
-                if (scaledImg) {
-                    m_customStatusEmoji = static_cast<Fl_RGB_Image *>(scaledImg);
-                }
-                m_emojiGif.reset();
-                redraw();
-                return;
-            }
-
-            size_t frameCount = m_emojiGif->frameCount();
-            m_emojiFrames.reserve(frameCount);
-
-            for (size_t i = 0; i < frameCount; i++) {
-                Fl_RGB_Image *frame = m_emojiGif->getFrame(i);
-                if (frame) {
-                    Fl_Image *scaledFrame = frame->copy(CUSTOM_STATUS_EMOJI_SIZE, CUSTOM_STATUS_EMOJI_SIZE);
-                    if (scaledFrame) {
-                        m_emojiFrames.push_back(
-                            std::unique_ptr<Fl_RGB_Image>(static_cast<Fl_RGB_Image *>(scaledFrame)));
-                    }
-                }
-            }
-
-            if (!m_emojiFrames.empty() && m_emojiGif->isAnimated()) {
-                m_emojiGif->setFrame(0);
-                m_emojiFrameTimeAccumulated = 0.0;
-                m_emojiAnimationId =
-                    AnimationManager::get().registerAnimation([this]() { return updateEmojiAnimation(); });
-            } else {
-                Fl_Image *scaledImg = image->copy(CUSTOM_STATUS_EMOJI_SIZE, CUSTOM_STATUS_EMOJI_SIZE);
-                if (scaledImg) {
-                    m_customStatusEmoji = static_cast<Fl_RGB_Image *>(scaledImg);
-                }
-                m_emojiGif.reset();
-            }
-
+            m_emojiGif = std::move(animation);
+            m_emojiGif->play();
+            m_emojiAnimationId = AnimationManager::get().registerScheduledAnimation(
+                [this](double) { return updateEmojiAnimation(); }, m_emojiGif->timeUntilNextFrame());
+            suspendAnimation(m_emojiGif, m_emojiAnimationId, m_emojiSuspended, !visible_r());
             redraw();
         });
     } else {
-        Images::loadImageAsync(m_customStatusEmojiUrl, [this](Fl_RGB_Image *image) {
-            if (image && image->w() > 0 && image->h() > 0) {
-                Fl_Image *scaledImg = image->copy(CUSTOM_STATUS_EMOJI_SIZE, CUSTOM_STATUS_EMOJI_SIZE);
-                if (scaledImg) {
-                    m_customStatusEmoji = static_cast<Fl_RGB_Image *>(scaledImg);
-                }
-                redraw();
-            }
-        });
+        Images::takeScaledImageAsync(m_customStatusEmojiUrl, CUSTOM_STATUS_EMOJI_SIZE, CUSTOM_STATUS_EMOJI_SIZE,
+                                     [this](std::unique_ptr<Fl_RGB_Image> image) {
+                                         if (image) {
+                                             m_customStatusEmoji = image.release();
+                                             redraw();
+                                         }
+                                     });
     }
 }
 
@@ -647,18 +567,17 @@ bool ProfileBubble::isChevronHovered(int btnX, int btnY, bool isToggle, int mx,
     return mx >= chevronX && mx < chevronX + CHEVRON_SECTION_WIDTH && my >= btnY && my < btnY + BUTTON_SIZE;
 }
 
-bool ProfileBubble::updateAvatarAnimation() {
-    if (!m_avatarGif || !m_avatarGif->isAnimated() || m_circularFrames.empty()) {
+double ProfileBubble::updateAvatarAnimation() {
+    if (!m_avatarGif || !m_avatarGif->isAnimated()) {
         m_avatarAnimationId = 0;
-        return false;
+        return AnimationManager::STOP;
     }
 
     if (window() && (!window()->shown() || !window()->active())) {
-        return true;
+        return m_avatarGif->timeUntilNextFrame();
     }
 
-    bool advanced = m_avatarGif->advance(AnimationManager::get().getFrameTime());
-    if (advanced) {
+    if (m_avatarGif->sync()) {
         if (visible_r()) {
             int bubbleH = h() - (BUBBLE_MARGIN * 2);
             int avatarX = x() + BUBBLE_MARGIN + (bubbleH - AVATAR_SIZE) / 2;
@@ -667,25 +586,24 @@ bool ProfileBubble::updateAvatarAnimation() {
         }
     }
 
-    return true;
+    return m_avatarGif->timeUntilNextFrame();
 }
 
-bool ProfileBubble::updateEmojiAnimation() {
-    if (!m_emojiGif || !m_emojiGif->isAnimated() || m_emojiFrames.empty()) {
+double ProfileBubble::updateEmojiAnimation() {
+    if (!m_emojiGif || !m_emojiGif->isAnimated()) {
         m_emojiAnimationId = 0;
-        return false;
+        return AnimationManager::STOP;
     }
 
     if (window() && (!window()->shown() || !window()->active())) {
-        return true;
+        return m_emojiGif->timeUntilNextFrame();
     }
 
-    bool advanced = m_emojiGif->advance(AnimationManager::get().getFrameTime());
-    if (advanced) {
+    if (m_emojiGif->sync()) {
         if (visible_r()) {
             damage(FL_DAMAGE_USER1, x(), y(), w(), h());
         }
     }
 
-    return true;
+    return m_emojiGif->timeUntilNextFrame();
 }
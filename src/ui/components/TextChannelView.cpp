@@ -10,15 +10,20 @@
 #include "ui/Theme.h"
 #include "ui/components/MessageWidget.h"
 #include "utils/Fonts.h"
+#include "utils/FrameProfiler.h"
 #include "utils/Logger.h"
 #include "utils/Permissions.h"
+#include "utils/PixelKernels.h"
+#include "utils/TextMetrics.h"
 
 #include <FL/Fl.H>
 #include <FL/Fl_PNG_Image.H>
+#include <FL/Fl_Window.H>
 #include <FL/fl_draw.H>
 
 #include <algorithm>
 #include <chrono>
+#include <climits>
 #include <cstring>
 #include <iomanip>
 #include <random>
@@ -329,37 +334,13 @@ std::unique_ptr<Fl_RGB_Image> tintEmojiFrame(Fl_RGB_Image *source, Fl_Color colo
     unsigned char tintG = ThemeColors::green(color);
     unsigned char tintB = ThemeColors::blue(color);
 
-    std::vector<unsigned char> buffer(width * height * depth);
+    const size_t rowBytes = static_cast<size_t>(width) * depth;
+    unsigned char *heapData = new unsigned char[rowBytes * height];
     for (int y = 0; y < height; ++y) {
-        const unsigned char *srcRow = src + y * srcLineSize;
-        unsigned char *dstRow = buffer.data() + y * width * depth;
-        for (int x = 0; x < width; ++x) {
-            int idx = x * depth;
-            unsigned char srcR = srcRow[idx + 0];
-            unsigned char srcG = srcRow[idx + 1];
-            unsigned char srcB = srcRow[idx + 2];
-            unsigned char srcA = (depth == 4) ? srcRow[idx + 3] : 255;
-            bool hasInk = (depth == 4) ? (srcA > 0) : (srcR || srcG || srcB);
-
-            if (hasInk) {
-                dstRow[idx + 0] = tintR;
-                dstRow[idx + 1] = tintG;
-                dstRow[idx + 2] = tintB;
-            } else {
-                dstRow[idx + 0] = srcR;
-                dstRow[idx + 1] = srcG;
-                dstRow[idx + 2] = srcB;
-            }
-
-            if (depth == 4) {
-                dstRow[idx + 3] = srcA;
-            }
-        }
+        PixelKernels::tint(src + static_cast<size_t>(y) * srcLineSize, depth, width, tintR, tintG, tintB,
+                           heapData + y * rowBytes);
     }
 
-    unsigned char *heapData = new unsigned char[buffer.size()];
-    std::memcpy(heapData, buffer.data(), buffer.size());
-
     auto *tinted = new Fl_RGB_Image(heapData, width, height, depth);
     tinted->alloc_array = 1;
 
@@ -421,6 +402,7 @@ TextChannelView::TextChannelView(int x, int y, int w, int h, const char *label)
     m_messageInput->hide();
     end();
 
+    m_isAlive = std::make_shared<bool>(true);
     m_storeListenerId = Store::get().subscribe([this](const AppState &state) {
         if (m_isDestroying || m_channelId.empty()) {
             return;
@@ -450,10 +432,11 @@ TextChannelView::TextChannelView(int x, int y, int w, int h, const char *label)
                         editedChanged) {
                         auto layoutIt = m_layoutCache.find(oldMsg.id);
                         if (layoutIt != m_layoutCache.end()) {
-                            m_heightEstimateCache[oldMsg.id] = layoutIt->second.layout.height;
+                            m_heightEstimateCache[oldMsg.id] = layoutIt->second.layout->height;
                         }
 
                         m_layoutCache.erase(oldMsg.id);
+                        m_pendingLayouts.erase(oldMsg.id);
                     }
                 }
             }
@@ -466,6 +449,7 @@ TextChannelView::TextChannelView(int x, int y, int w, int h, const char *label)
                 m_pendingMessages.clear();
             }
             m_messagesChanged = true;
+            m_drawnMessages.clear();
             redraw();
         } else {
             m_messages.clear();
@@ -476,25 +460,40 @@ TextChannelView::TextChannelView(int x, int y, int w, int h, const char *label)
                 m_pendingMessages.clear();
             }
             m_messagesChanged = true;
+            m_drawnMessages.clear();
             redraw();
         }
     });
+
+    MessageWidget::setDamageHandler(this,
+                                    [this](int rx, int ry, int rw, int rh) { damageMessageRect(rx, ry, rw, rh); });
 }
 
 TextChannelView::~TextChannelView() {
     m_isDestroying = true;
+    *m_isAlive = false;
 
     if (m_storeListenerId) {
         Store::get().unsubscribe(m_storeListenerId);
         m_storeListenerId = 0;
     }
+    MessageWidget::clearDamageHandler(this);
+    clearMessageTiles();
 }
 
 void TextChannelView::draw() {
+    FrameProfiler::Scope profile("TextChannelView::draw");
     if (m_isDestroying) {
         return;
     }
 
+    // Animation frames only damage their own rectangles, so repaint just the messages under them
+    bool damagedOnly = damage() == FL_DAMAGE_USER1 && drawDamagedMessages();
+    m_damageRects.clear();
+    if (damagedOnly) {
+        return;
+    }
+
     fl_push_clip(x(), y(), w(), h());
 
     fl_color(ThemeColors::BG_PRIMARY);
@@ -515,6 +514,9 @@ void TextChannelView::draw() {
         updateAvatarHover(0, 0, true);
         m_attachmentDownloadHitboxes.clear();
         updateAttachmentDownloadHover(0, 0, true);
+        m_drawnMessages.clear();
+        MessageWidget::clearAnimatedRects();
+        MessageWidget::setAnimationViewport(0, 0, 0, 0);
         drawWelcomeSection();
     } else {
         drawMessages();
@@ -554,6 +556,11 @@ void TextChannelView::draw() {
 }
 
 int TextChannelView::handle(int event) {
+    FrameProfiler::Scope profile("TextChannelView::handle");
+    if (event == FL_HIDE) {
+        MessageWidget::setAnimationViewport(0, 0, 0, 0);
+    }
+
     if (event == FL_PUSH && m_messageInput && m_messageInput->visible()) {
         int mx = Fl::event_x();
         int my = Fl::event_y();
@@ -693,6 +700,9 @@ void TextChannelView::setChannel(const std::string &channelId, const std::string
     m_shouldScrollToBottom = true;
     m_layoutCache.clear();
     m_heightEstimateCache.clear();
+    m_pendingLayouts.clear();
+    clearMessageTiles();
+    m_drawnMessages.clear();
     m_avatarHitboxes.clear();
     m_attachmentDownloadHitboxes.clear();
     m_hoveredAvatarMessageId.clear();
@@ -786,6 +796,10 @@ void TextChannelView::drawMessages() {
     m_messagesViewHeight = std::max(0, viewBottom - viewTop);
     m_avatarHitboxes.clear();
     m_attachmentDownloadHitboxes.clear();
+    m_drawnMessages.clear();
+    MessageWidget::clearAnimatedRects();
+    flushStaleMessageTiles();
+    m_tileFrame++;
 
     int renderTop = viewTop - kMessageRenderPadding;
     int renderBottom = viewBottom + kMessageRenderPadding;
@@ -844,7 +858,7 @@ void TextChannelView::drawMessages() {
         Type type;
         std::string date;
         const Message *msg = nullptr;
-        MessageWidget::Layout layout;
+        std::shared_ptr<const MessageWidget::Layout> layout;
         bool grouped = false;
         int yPos = 0;
     };
@@ -926,6 +940,15 @@ void TextChannelView::drawMessages() {
                 ++it;
             }
         }
+
+        size_t layoutBytes = 0;
+        for (const auto &[id, entry] : m_layoutCache) {
+            if (entry.layout) {
+                layoutBytes += entry.layout->memoryBytes();
+            }
+        }
+        Logger::debug("TextChannelView: Pruned layout cache to " + std::to_string(m_layoutCache.size()) +
+                      " layouts, ~" + std::to_string(layoutBytes / 1024) + " KiB");
     }
 
     m_itemYPositions.clear();
@@ -996,10 +1019,10 @@ void TextChannelView::drawMessages() {
             auto cacheIt = m_layoutCache.find(info.msg->id);
             if (cacheIt != m_layoutCache.end() && cacheIt->second.width == w() &&
                 cacheIt->second.grouped == info.grouped && cacheIt->second.compactBottom == compactBottom) {
-                messageHeight = cacheIt->second.layout.height;
+                messageHeight = cacheIt->second.layout->height;
             } else if (cacheIt != m_layoutCache.end() && cacheIt->second.grouped == info.grouped &&
                        cacheIt->second.compactBottom == compactBottom) {
-                messageHeight = cacheIt->second.layout.height;
+                messageHeight = cacheIt->second.layout->height;
             } else {
                 auto estimateIt = m_heightEstimateCache.find(info.msg->id);
                 if (estimateIt != m_heightEstimateCache.end()) {
@@ -1061,6 +1084,7 @@ void TextChannelView::drawMessages() {
     }
 
     int yPos = viewBottom - totalHeight + m_messagesScrollOffset;
+    const uint64_t shapingGeneration = MessageWidget::shapingGeneration();
     for (size_t i = 0; i < messageInfos.size(); ++i) {
         const auto &info = messageInfos[i];
 
@@ -1110,42 +1134,29 @@ void TextChannelView::drawMessages() {
 
         auto cacheIt = m_layoutCache.find(info.msg->id);
         bool needsLayout = (cacheIt == m_layoutCache.end() || cacheIt->second.width != w() ||
-                            cacheIt->second.grouped != info.grouped || cacheIt->second.compactBottom != compactBottom);
+                            cacheIt->second.grouped != info.grouped || cacheIt->second.compactBottom != compactBottom ||
+                            !cacheIt->second.layout || !cacheIt->second.layout->shaped ||
+                            cacheIt->second.layout->shaped->generation != shapingGeneration);
 
         if (needsLayout) {
-            try {
-                MessageWidget::ReplyPreview replyPreview;
-                MessageWidget::ReplyPreview *replyPtr = nullptr;
-                if (info.msg->isReply() && info.msg->referencedMessageId.has_value()) {
-                    auto refIt = messageById.find(*info.msg->referencedMessageId);
-                    const Message *referenced = (refIt != messageById.end()) ? refIt->second : nullptr;
-                    replyPreview = buildReplyPreview(referenced);
-                    replyPtr = &replyPreview;
-                }
-
-                MessageWidget::Layout layout =
-                    MessageWidget::buildLayout(*info.msg, w(), info.grouped, compactBottom, replyPtr);
-
-                int layoutHeight = layout.height;
-
-                LayoutCacheEntry cacheEntry;
-                cacheEntry.layout = std::move(layout);
-                cacheEntry.width = w();
-                cacheEntry.grouped = info.grouped;
-                cacheEntry.compactBottom = compactBottom;
-                m_layoutCache[info.msg->id] = std::move(cacheEntry);
-                m_heightEstimateCache[info.msg->id] = layoutHeight;
-            } catch (...) {
-                continue;
+            MessageWidget::ReplyPreview replyPreview;
+            MessageWidget::ReplyPreview *replyPtr = nullptr;
+            if (info.msg->isReply() && info.msg->referencedMessageId.has_value()) {
+                auto refIt = messageById.find(*info.msg->referencedMessageId);
+                const Message *referenced = (refIt != messageById.end()) ? refIt->second : nullptr;
+                replyPreview = buildReplyPreview(referenced);
+                replyPtr = &replyPreview;
             }
-            cacheIt = m_layoutCache.find(info.msg->id);
+            requestLayout(*info.msg, replyPtr, info.grouped, compactBottom);
         }
 
-        if (cacheIt == m_layoutCache.end()) {
+        // Until the worker delivers, a layout for another width or grouping is still drawable;
+        // messages with no layout at all occupy their estimated height
+        if (cacheIt == m_layoutCache.end() || !cacheIt->second.layout) {
             continue;
         }
 
-        int messageHeight = cacheIt->second.layout.height;
+        int messageHeight = cacheIt->second.layout->height;
         if (messageY + messageHeight < renderTop || messageY > renderBottom) {
             continue;
         }
@@ -1177,14 +1188,14 @@ void TextChannelView::drawMessages() {
                 bool avatarHovered = false;
                 if (!entry.grouped && !entry.msg->isSystemMessage()) {
                     AvatarHitbox hitbox;
-                    hitbox.x = x() + entry.layout.avatarX;
-                    hitbox.y = messageY + entry.layout.avatarY;
-                    hitbox.size = entry.layout.avatarSize;
+                    hitbox.x = x() + entry.layout->avatarX;
+                    hitbox.y = messageY + entry.layout->avatarY;
+                    hitbox.size = entry.layout->avatarSize;
                     hitbox.messageId = entry.msg->id;
-                    hitbox.hoverKey = MessageWidget::getAnimatedAvatarKey(*entry.msg, entry.layout.avatarSize);
+                    hitbox.hoverKey = MessageWidget::getAnimatedAvatarKey(*entry.msg, entry.layout->avatarSize);
 
                     std::string animatedAvatarKey = hitbox.hoverKey;
-                    std::string avatarKey = MessageWidget::getAvatarCacheKey(*entry.msg, entry.layout.avatarSize);
+                    std::string avatarKey = MessageWidget::getAvatarCacheKey(*entry.msg, entry.layout->avatarSize);
 
                     m_avatarHitboxes.push_back(std::move(hitbox));
                     avatarHovered = (entry.msg->id == m_hoveredAvatarMessageId);
@@ -1197,47 +1208,46 @@ void TextChannelView::drawMessages() {
                     }
                 }
 
-                for (const auto &attachmentLayout : entry.layout.attachments) {
+                for (const auto &attachmentLayout : entry.layout->attachments) {
                     if (!attachmentLayout.cacheKey.empty()) {
                         keepAttachmentKeys.insert(attachmentLayout.cacheKey);
                     }
                 }
 
-                for (const auto &stickerLayout : entry.layout.stickers) {
+                for (const auto &stickerLayout : entry.layout->stickers) {
                     if (!stickerLayout.cacheKey.empty()) {
                         keepStickerKeys.insert(stickerLayout.cacheKey);
                     }
                 }
 
-                for (const auto &line : entry.layout.lines) {
-                    for (const auto &item : line.items) {
-                        if (item.kind == MessageWidget::InlineItem::Kind::Emoji && !item.emojiCacheKey.empty()) {
-                            keepEmojiKeys.insert(item.emojiCacheKey);
-                        }
+                for (const auto &item : entry.layout->items) {
+                    if (item.kind == MessageWidget::InlineItem::Kind::Emoji && item.emojiCacheKey != 0) {
+                        keepEmojiKeys.insert(entry.layout->shaped->stringOf(item.emojiCacheKey));
                     }
                 }
 
-                for (const auto &reactionLayout : entry.layout.reactions) {
+                for (const auto &reactionLayout : entry.layout->reactions) {
                     if (!reactionLayout.emojiCacheKey.empty()) {
                         keepEmojiKeys.insert(reactionLayout.emojiCacheKey);
                     }
                 }
 
-                MessageWidget::draw(*entry.msg, entry.layout, x(), messageY, avatarHovered);
+                drawMessageTile(*entry.msg, entry.layout, messageY, avatarHovered);
+                m_drawnMessages.push_back({entry.msg, entry.layout, messageY, avatarHovered});
 
-                if (!entry.layout.isSystem && !entry.layout.attachments.empty() && !entry.msg->attachments.empty()) {
+                if (!entry.layout->isSystem && !entry.layout->attachments.empty() && !entry.msg->attachments.empty()) {
                     int attachmentsTop =
-                        messageY + entry.layout.contentTop + entry.layout.contentHeight + entry.layout.stickersHeight +
-                        entry.layout.attachmentsTopPadding;
-                    size_t count = std::min(entry.layout.attachments.size(), entry.msg->attachments.size());
+                        messageY + entry.layout->contentTop + entry.layout->contentHeight + entry.layout->stickersHeight +
+                        entry.layout->attachmentsTopPadding;
+                    size_t count = std::min(entry.layout->attachments.size(), entry.msg->attachments.size());
 
                     for (size_t i = 0; i < count; ++i) {
-                        const auto &attachmentLayout = entry.layout.attachments[i];
+                        const auto &attachmentLayout = entry.layout->attachments[i];
                         if (attachmentLayout.isImage || attachmentLayout.downloadSize <= 0) {
                             continue;
                         }
 
-                        int boxX = x() + entry.layout.contentX + attachmentLayout.xOffset;
+                        int boxX = x() + entry.layout->contentX + attachmentLayout.xOffset;
                         int boxY = attachmentsTop + attachmentLayout.yOffset;
                         int buttonX = boxX + attachmentLayout.downloadXOffset;
                         int buttonY = boxY + attachmentLayout.downloadYOffset;
@@ -1256,6 +1266,7 @@ void TextChannelView::drawMessages() {
         }
     }
 
+    pruneMessageTiles();
     MessageWidget::pruneAvatarCache(keepAvatarKeys);
     MessageWidget::pruneAnimatedAvatarCache(keepAnimatedAvatarKeys);
     MessageWidget::pruneAnimatedEmojiCache(keepEmojiKeys);
@@ -1265,6 +1276,9 @@ void TextChannelView::drawMessages() {
     MessageWidget::pruneEmojiCache(keepEmojiKeys);
     EmojiManager::pruneCache(keepEmojiKeys);
 
+    // Messages in the render padding keep their animations loaded but paused until scrolled into view
+    MessageWidget::setAnimationViewport(x(), contentY, w(), contentH);
+
     if (!m_hoveredAvatarMessageId.empty()) {
         bool stillVisible =
             std::any_of(m_avatarHitboxes.begin(), m_avatarHitboxes.end(),
@@ -1296,6 +1310,254 @@ void TextChannelView::drawMessages() {
     m_previousTotalHeight = totalHeight;
 }
 
+void TextChannelView::drawMessageTile(const Message &msg, const std::shared_ptr<const MessageWidget::Layout> &layout,
+                                      int messageY, bool avatarHovered) {
+    const int width = w();
+    const int height = layout->height;
+    MessageTile &tile = m_messageTiles[msg.id];
+    tile.lastUsedFrame = m_tileFrame;
+    if (tile.layout != layout || tile.width != width) {
+        tile.layout = layout;
+        tile.width = width;
+        tile.valid = false;
+        tile.dynamic = false;
+    }
+
+    if (tile.valid && !avatarHovered) {
+        fl_copy_offscreen(x(), messageY, width, height, tile.offscreen, 0, 0);
+        return;
+    }
+
+    // Messages that are animating, hovered or still loading images would be re-rendered every frame
+    // anyway, so they are drawn straight to the window until a draw reports them as final
+    if (avatarHovered || tile.dynamic || width <= 0 || height <= 0 || height > MAX_TILE_HEIGHT) {
+        tile.dynamic = !MessageWidget::draw(msg, *layout, x(), messageY, avatarHovered);
+        return;
+    }
+
+    if (!tile.offscreen || tile.offscreenW != width || tile.offscreenH != height) {
+        if (tile.offscreen) {
+            fl_delete_offscreen(tile.offscreen);
+            m_messageTileBytes -= static_cast<size_t>(tile.offscreenW) * tile.offscreenH * 4;
+        }
+        tile.offscreen = fl_create_offscreen(width, height);
+        tile.offscreenW = tile.offscreen ? width : 0;
+        tile.offscreenH = tile.offscreen ? height : 0;
+        m_messageTileBytes += static_cast<size_t>(tile.offscreenW) * tile.offscreenH * 4;
+    }
+    if (!tile.offscreen) {
+        tile.dynamic = !MessageWidget::draw(msg, *layout, x(), messageY, avatarHovered);
+        return;
+    }
+
+    fl_begin_offscreen(tile.offscreen);
+    fl_push_no_clip();
+    fl_color(ThemeColors::BG_PRIMARY);
+    fl_rectf(0, 0, width, height);
+    MessageWidget::setAnimatedRectOrigin(x(), messageY);
+    bool isStatic = MessageWidget::draw(msg, *layout, 0, 0, false);
+    MessageWidget::setAnimatedRectOrigin(0, 0);
+    fl_pop_clip();
+    fl_end_offscreen();
+
+    fl_copy_offscreen(x(), messageY, width, height, tile.offscreen, 0, 0);
+    tile.valid = isStatic;
+    tile.dynamic = !isStatic;
+}
+
+void TextChannelView::pruneMessageTiles() {
+    if (m_messageTileBytes <= MAX_TILE_BYTES) {
+        return;
+    }
+
+    std::vector<std::pair<uint64_t, std::string>> candidates;
+    for (const auto &[id, tile] : m_messageTiles) {
+        if (tile.lastUsedFrame != m_tileFrame) {
+            candidates.emplace_back(tile.lastUsedFrame, id);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    size_t evicted = 0;
+    for (const auto &[lastUsed, id] : candidates) {
+        if (m_messageTileBytes <= MAX_TILE_BYTES) {
+            break;
+        }
+        auto it = m_messageTiles.find(id);
+        if (it->second.offscreen) {
+            fl_delete_offscreen(it->second.offscreen);
+            m_messageTileBytes -= static_cast<size_t>(it->second.offscreenW) * it->second.offscreenH * 4;
+        }
+        m_messageTiles.erase(it);
+        evicted++;
+    }
+
+    Logger::debug("TextChannelView: Evicted " + std::to_string(evicted) + " message tiles, " +
+                  std::to_string(m_messageTiles.size()) + " left, ~" + std::to_string(m_messageTileBytes / 1024) +
+                  " KiB");
+}
+
+void TextChannelView::clearMessageTiles() {
+    for (auto &[id, tile] : m_messageTiles) {
+        if (tile.offscreen) {
+            fl_delete_offscreen(tile.offscreen);
+        }
+    }
+    m_messageTiles.clear();
+    m_messageTileBytes = 0;
+}
+
+void TextChannelView::flushStaleMessageTiles() {
+    // Offscreens are allocated in device pixels at the scale they were created under, and their pixels bake in
+    // the fonts (TextMetrics epoch, bumped on screen configuration and zoom events) and the theme colours
+    Fl_Window *win = window();
+    const float scale = Fl::screen_scale(win ? win->screen_num() : 0);
+    const uint64_t metricsEpoch = TextMetrics::epoch();
+    const Fl_Color background = Fl::get_color(FL_BACKGROUND_COLOR);
+    const Fl_Color foreground = Fl::get_color(FL_FOREGROUND_COLOR);
+    if (scale == m_tileScale && metricsEpoch == m_tileMetricsEpoch && background == m_tileBackground &&
+        foreground == m_tileForeground) {
+        return;
+    }
+
+    if (!m_messageTiles.empty()) {
+        Logger::debug("TextChannelView: Flushing " + std::to_string(m_messageTiles.size()) +
+                      " message tiles after a scale, font or theme change");
+    }
+    clearMessageTiles();
+    m_tileScale = scale;
+    m_tileMetricsEpoch = metricsEpoch;
+    m_tileBackground = background;
+    m_tileForeground = foreground;
+}
+
+void TextChannelView::damageMessageRect(int rx, int ry, int rw, int rh) {
+    if (m_isDestroying || !visible_r()) {
+        return;
+    }
+
+    int inputAreaHeight = m_canSendMessages ? MESSAGE_INPUT_HEIGHT : 0;
+    int left = std::max(rx, x());
+    int right = std::min(rx + rw, x() + w());
+    int top = std::max(ry, y() + HEADER_HEIGHT);
+    int bottom = std::min(ry + rh, y() + h() - inputAreaHeight);
+    if (right <= left || bottom <= top) {
+        return;
+    }
+
+    // Past this many rectangles per frame a full repaint is cheaper than clipping to each one
+    if (m_damageRects.size() >= MAX_DAMAGE_RECTS) {
+        redraw();
+        return;
+    }
+    m_damageRects.push_back({left, top, right - left, bottom - top});
+    damage(FL_DAMAGE_USER1, left, top, right - left, bottom - top);
+}
+
+bool TextChannelView::drawDamagedMessages() {
+    if (m_damageRects.empty() || m_drawnMessages.empty() || m_messagesChanged) {
+        return false;
+    }
+
+    int inputAreaHeight = m_canSendMessages ? MESSAGE_INPUT_HEIGHT : 0;
+    int contentY = y() + HEADER_HEIGHT;
+    int contentH = h() - HEADER_HEIGHT - inputAreaHeight;
+    fl_push_clip(x(), contentY, w(), contentH);
+
+    // The window already clips to the damaged region; each message is redrawn once within the
+    // bounds of the rectangles that touch it
+    for (const auto &drawn : m_drawnMessages) {
+        int messageTop = drawn.y;
+        int messageBottom = drawn.y + drawn.layout->height;
+        int left = INT_MAX;
+        int top = INT_MAX;
+        int right = INT_MIN;
+        int bottom = INT_MIN;
+        for (const auto &rect : m_damageRects) {
+            int rectTop = std::max(rect.y, messageTop);
+            int rectBottom = std::min(rect.y + rect.h, messageBottom);
+            if (rectBottom <= rectTop) {
+                continue;
+            }
+            left = std::min(left, rect.x);
+            right = std::max(right, rect.x + rect.w);
+            top = std::min(top, rectTop);
+            bottom = std::max(bottom, rectBottom);
+        }
+        if (right <= left || bottom <= top) {
+            continue;
+        }
+
+        fl_push_clip(left, top, right - left, bottom - top);
+        fl_color(ThemeColors::BG_PRIMARY);
+        fl_rectf(left, top, right - left, bottom - top);
+        drawMessageTile(*drawn.msg, drawn.layout, drawn.y, drawn.avatarHovered);
+        fl_pop_clip();
+    }
+
+    fl_pop_clip();
+    return true;
+}
+
+void TextChannelView::requestLayout(const Message &msg, const MessageWidget::ReplyPreview *replyPreview,
+                                    bool grouped, bool compactBottom) {
+    auto pendingIt = m_pendingLayouts.find(msg.id);
+    if (pendingIt != m_pendingLayouts.end() && pendingIt->second.width == w() && pendingIt->second.grouped == grouped &&
+        pendingIt->second.compactBottom == compactBottom) {
+        return;
+    }
+
+    PendingLayout pending;
+    pending.ticket = ++m_nextLayoutTicket;
+    pending.width = w();
+    pending.grouped = grouped;
+    pending.compactBottom = compactBottom;
+    m_pendingLayouts[msg.id] = pending;
+
+    MessageWidget::LayoutRequest request;
+    request.message = msg;
+    // Shaping does not depend on width or grouping, so a resize only re-wraps the cached runs, as long as the
+    // day (relative timestamps) and the font metrics are still the ones it was shaped with
+    auto cacheIt = m_layoutCache.find(msg.id);
+    if (cacheIt != m_layoutCache.end() && cacheIt->second.layout && cacheIt->second.layout->shaped &&
+        cacheIt->second.layout->shaped->generation == MessageWidget::shapingGeneration()) {
+        request.shaped = cacheIt->second.layout->shaped;
+    }
+    if (replyPreview) {
+        request.replyPreview = *replyPreview;
+    }
+    request.viewWidth = pending.width;
+    request.grouped = grouped;
+    request.compactBottom = compactBottom;
+
+    MessageWidget::buildLayoutAsync(
+        std::move(request), [this, alive = m_isAlive, messageId = msg.id,
+                             pending](std::shared_ptr<const MessageWidget::Layout> layout) {
+            if (!*alive) {
+                return;
+            }
+            auto it = m_pendingLayouts.find(messageId);
+            if (it == m_pendingLayouts.end() || it->second.ticket != pending.ticket) {
+                return;
+            }
+            m_pendingLayouts.erase(it);
+            // A failed build is not redrawn for; the message is requested again the next time it is drawn
+            if (!layout) {
+                Logger::warn("TextChannelView: Layout failed for message " + messageId);
+                return;
+            }
+
+            LayoutCacheEntry cacheEntry;
+            cacheEntry.layout = std::move(layout);
+            cacheEntry.width = pending.width;
+            cacheEntry.grouped = pending.grouped;
+            cacheEntry.compactBottom = pending.compactBottom;
+            m_heightEstimateCache[messageId] = cacheEntry.layout->height;
+            m_layoutCache[messageId] = std::move(cacheEntry);
+            redraw();
+        });
+}
+
 void TextChannelView::drawDateSeparator(const std::string &date, int &yPos) {
     yPos += kDateSeparatorPadding;
 
@@ -1569,6 +1831,7 @@ bool TextChannelView::getPlusButtonRect(int &outX, int &outY, int &outSize) cons
 }
 
 void TextChannelView::loadMessagesFromStore() {
+    m_drawnMessages.clear();
     auto state = Store::get().snapshot();
     auto it = state.channelMessages.find(m_channelId);
     if (it != state.channelMessages.end()) {
@@ -79,7 +79,7 @@ std::string getGuildDiscoverySplashUrl(const std::string &guildId, const std::st
 
 std::string getGuildBannerUrl(const std::string &guildId, const std::string &bannerHash, int size) {
     int normalizedSize = normalizeSize(size);
-    std::string ext = getImageExtension(bannerHash, false);
+    std::string ext = getImageExtension(bannerHash);
     std::ostringstream url;
     url << CDN_BASE << "/banners/" << guildId << "/" << bannerHash << ext << "?size=" << normalizedSize;
     return url.str();
@@ -97,7 +97,7 @@ std::string getMemberAvatarUrl(const std::string &guildId, const std::string &us
 
 std::string getEmojiUrl(const std::string &emojiId, bool animated, int size) {
     int normalizedSize = normalizeSize(size);
-    std::string ext = animated ? ".gif" : ".png";
+    std::string ext = animated ? ".gif" : ".webp";
     std::ostringstream url;
     url << CDN_BASE << "/emojis/" << emojiId << ext << "?size=" << normalizedSize;
     return url.str();
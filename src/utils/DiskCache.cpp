@@ -0,0 +1,591 @@
+#include "utils/DiskCache.h"
+
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace DiskCache {
+
+namespace {
+constexpr const char *INDEX_FILENAME = "index.tsv";
+constexpr const char *OPEN_MARKER_FILENAME = "index.open";
+constexpr const char *INDEX_HEADER = "discove-disk-cache 1";
+constexpr const char *TEMP_SUFFIX = ".tmp";
+constexpr size_t KEY_LENGTH = 32;
+constexpr int FLUSH_AFTER_CHANGES = 32;
+
+std::mutex cache_mutex;
+bool index_loaded = false;
+std::string cache_dir;
+std::unordered_map<std::string, Entry> entries;
+uint64_t total_bytes = 0;
+uint64_t max_bytes = DEFAULT_MAX_BYTES;
+uint64_t eviction_count = 0;
+uint64_t use_counter = 0; // Source of Entry::useOrder
+uint64_t temp_counter = 0;
+bool index_dirty = false;
+int changes_since_flush = 0;
+bool marked_open = false; // OPEN_MARKER_FILENAME exists for this session
+
+int64_t nowSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+std::string resolveCacheDirectory() {
+    std::string dir;
+#ifdef _WIN32
+    char *appData = nullptr;
+    size_t len;
+    if (_dupenv_s(&appData, &len, "LOCALAPPDATA") == 0 && appData != nullptr) {
+        dir = std::string(appData) + "\\Discove\\cache";
+        free(appData);
+    } else {
+        dir = "C:\\Temp\\Discove\\cache";
+    }
+#else
+    const char *home = getenv("HOME");
+    if (home) {
+        dir = std::string(home) + "/.cache/discove";
+    } else {
+        dir = "/tmp/discove_cache";
+    }
+#endif
+
+    try {
+        std::filesystem::create_directories(dir);
+    } catch (const std::exception &e) {
+        Logger::error("Failed to create cache directory: " + std::string(e.what()));
+    }
+
+    return dir;
+}
+
+std::string blobPath(const std::string &key, const std::string &format) { return cache_dir + "/" + key + "." + format; }
+
+std::string indexPath() { return cache_dir + "/" + INDEX_FILENAME; }
+
+std::string openMarkerPath() { return cache_dir + "/" + OPEN_MARKER_FILENAME; }
+
+bool isBookkeepingFile(const std::filesystem::path &path) {
+    return path.filename() == INDEX_FILENAME || path.filename() == OPEN_MARKER_FILENAME;
+}
+
+// Blobs are stored before the index naming them is written, so while the marker exists the directory may be
+// ahead of the index. shutdown() removes it once the index is up to date.
+void markOpenLocked() {
+    if (marked_open) {
+        return;
+    }
+    std::ofstream marker(openMarkerPath(), std::ios::trunc);
+    marked_open = marker.is_open();
+    if (!marked_open) {
+        Logger::warn("Failed to create image cache marker: " + openMarkerPath());
+    }
+}
+
+void removeFiles(const std::vector<std::string> &paths) {
+    for (const auto &path : paths) {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+}
+
+void eraseLocked(std::unordered_map<std::string, Entry>::iterator it, std::vector<std::string> &removedPaths) {
+    removedPaths.push_back(blobPath(it->first, it->second.format));
+    total_bytes -= std::min(total_bytes, it->second.size);
+    entries.erase(it);
+}
+
+void touchLocked(Entry &entry) {
+    entry.lastAccess = nowSeconds();
+    entry.useOrder = ++use_counter;
+}
+
+// keepKey is the entry being stored, which must survive its own store
+void evictOverCapLocked(std::vector<std::string> &removedPaths, const std::string &keepKey = {}) {
+    if (total_bytes <= max_bytes) {
+        return;
+    }
+
+    std::vector<std::pair<uint64_t, std::string>> byUse;
+    byUse.reserve(entries.size());
+    for (const auto &[key, entry] : entries) {
+        if (key != keepKey) {
+            byUse.emplace_back(entry.useOrder, key);
+        }
+    }
+    std::sort(byUse.begin(), byUse.end());
+
+    for (const auto &[useOrder, key] : byUse) {
+        if (total_bytes <= max_bytes) {
+            break;
+        }
+        eraseLocked(entries.find(key), removedPaths);
+        eviction_count++;
+    }
+}
+
+void removeAllFilesLocked() {
+    std::error_code ec;
+    size_t removed = 0;
+    for (const auto &entry : std::filesystem::directory_iterator(cache_dir, ec)) {
+        if (entry.is_regular_file(ec) && !isBookkeepingFile(entry.path())) {
+            std::filesystem::remove(entry.path(), ec);
+            removed++;
+        }
+    }
+    if (removed > 0) {
+        Logger::info("Removed " + std::to_string(removed) + " files from image cache");
+    }
+}
+
+// Blobs are named <key>.<format>; anything else in the directory is a temporary or from before the index
+bool parseBlobName(const std::string &name, std::string &key, std::string &format) {
+    size_t dot = name.find('.');
+    if (dot != KEY_LENGTH || name.find('.', dot + 1) != std::string::npos || dot + 1 == name.size()) {
+        return false;
+    }
+    key = name.substr(0, dot);
+    format = name.substr(dot + 1);
+    return std::all_of(key.begin(), key.end(), [](unsigned char c) { return std::isxdigit(c) != 0; });
+}
+
+// The index is only written every FLUSH_AFTER_CHANGES changes and at exit, so after a crash it can be behind
+// the directory. Blobs it does not know are adopted, entries whose blob is gone are dropped and only files that
+// cannot be blobs are deleted. This stats every file, so it only runs when the index cannot be trusted.
+void reconcileWithDirectoryLocked() {
+    std::unordered_set<std::string> found;
+    std::vector<std::pair<std::string, std::filesystem::path>> otherFormats; // Key also present in another format
+    size_t adopted = 0;
+    size_t removed = 0;
+
+    std::error_code ec;
+    for (const auto &file : std::filesystem::directory_iterator(cache_dir, ec)) {
+        std::error_code fileEc;
+        if (!file.is_regular_file(fileEc) || isBookkeepingFile(file.path())) {
+            continue;
+        }
+
+        std::string key, format;
+        uintmax_t size = file.file_size(fileEc);
+        if (!parseBlobName(file.path().filename().string(), key, format) || fileEc || size == 0) {
+            std::filesystem::remove(file.path(), fileEc);
+            removed++;
+            continue;
+        }
+
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            Entry entry;
+            entry.key = key;
+            entry.format = format;
+            entry.size = size;
+            entry.lastAccess = nowSeconds();
+            total_bytes += entry.size;
+            entries.emplace(key, std::move(entry));
+            found.insert(key);
+            adopted++;
+        } else if (it->second.format == format) {
+            // Rewritten after the last flush
+            total_bytes = total_bytes - std::min(total_bytes, it->second.size) + size;
+            it->second.size = size;
+            found.insert(key);
+        } else {
+            otherFormats.emplace_back(key, file.path());
+        }
+    }
+
+    // A format change stores the new blob before the old one is removed; keep whichever the index names
+    for (auto &[key, path] : otherFormats) {
+        std::error_code fileEc;
+        if (found.count(key) != 0) {
+            std::filesystem::remove(path, fileEc);
+            removed++;
+            continue;
+        }
+        Entry &entry = entries[key];
+        std::string ignored;
+        parseBlobName(path.filename().string(), ignored, entry.format);
+        uintmax_t size = std::filesystem::file_size(path, fileEc);
+        total_bytes = total_bytes - std::min(total_bytes, entry.size) + (fileEc ? 0 : size);
+        entry.size = fileEc ? 0 : size;
+        found.insert(key);
+        adopted++;
+    }
+
+    size_t dropped = 0;
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (found.count(it->first) == 0) {
+            total_bytes -= std::min(total_bytes, it->second.size);
+            it = entries.erase(it);
+            dropped++;
+        } else {
+            ++it;
+        }
+    }
+
+    if (adopted > 0 || removed > 0 || dropped > 0) {
+        Logger::info("Reconciled image cache with its directory: " + std::to_string(adopted) + " adopted, " +
+                     std::to_string(removed) + " stray files removed, " + std::to_string(dropped) +
+                     " missing entries dropped");
+        index_dirty = true;
+    }
+}
+
+void loadIndexLocked() {
+    if (index_loaded) {
+        return;
+    }
+    index_loaded = true;
+    cache_dir = resolveCacheDirectory();
+
+    bool trusted = false;
+    std::ifstream in(indexPath());
+    std::string line;
+    if (!in.is_open() || !std::getline(in, line) || line != INDEX_HEADER) {
+        Logger::info("Image cache index missing or outdated, rebuilding it from " + cache_dir);
+    } else {
+        bool corrupt = false;
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            Entry entry;
+            std::string size, lastAccess, expiresAt;
+            if (!std::getline(fields, entry.key, '\t') || !std::getline(fields, entry.format, '\t') ||
+                !std::getline(fields, size, '\t') || !std::getline(fields, lastAccess, '\t') ||
+                !std::getline(fields, expiresAt, '\t')) {
+                corrupt = true;
+                continue;
+            }
+            std::getline(fields, entry.etag);
+
+            try {
+                entry.size = std::stoull(size);
+                entry.lastAccess = std::stoll(lastAccess);
+                entry.expiresAt = std::stoll(expiresAt);
+            } catch (...) {
+                corrupt = true;
+                continue;
+            }
+
+            total_bytes += entry.size;
+            entries[entry.key] = std::move(entry);
+        }
+
+        std::error_code ec;
+        if (corrupt) {
+            Logger::info("Image cache index is damaged, checking it against " + cache_dir);
+        } else if (std::filesystem::exists(openMarkerPath(), ec)) {
+            Logger::info("Image cache was not closed cleanly, checking its index against " + cache_dir);
+        } else {
+            trusted = true;
+        }
+    }
+    in.close();
+
+    if (!trusted) {
+        reconcileWithDirectoryLocked();
+    }
+    markOpenLocked();
+
+    // Seconds are too coarse to order entries by, so recency is tracked with a counter seeded from them
+    std::vector<Entry *> byAge;
+    byAge.reserve(entries.size());
+    for (auto &[key, entry] : entries) {
+        byAge.push_back(&entry);
+    }
+    std::sort(byAge.begin(), byAge.end(), [](const Entry *a, const Entry *b) {
+        return a->lastAccess != b->lastAccess ? a->lastAccess < b->lastAccess : a->key < b->key;
+    });
+    for (Entry *entry : byAge) {
+        entry->useOrder = ++use_counter;
+    }
+
+    std::vector<std::string> removedPaths;
+    evictOverCapLocked(removedPaths);
+    removeFiles(removedPaths);
+
+    Logger::info("Loaded image cache index: " + std::to_string(entries.size()) + " entries, " +
+                 std::to_string(total_bytes / (1024 * 1024)) + " MiB");
+}
+
+void writeIndexLocked() {
+    if (!index_dirty) {
+        return;
+    }
+
+    std::string tempPath = indexPath() + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::trunc);
+        if (!out.is_open()) {
+            Logger::warn("Failed to write image cache index: " + tempPath);
+            return;
+        }
+
+        out << INDEX_HEADER << '\n';
+        for (const auto &[key, entry] : entries) {
+            out << key << '\t' << entry.format << '\t' << entry.size << '\t' << entry.lastAccess << '\t'
+                << entry.expiresAt << '\t' << entry.etag << '\n';
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tempPath, indexPath(), ec);
+    if (ec) {
+        Logger::warn("Failed to replace image cache index: " + ec.message());
+        return;
+    }
+
+    index_dirty = false;
+    changes_since_flush = 0;
+}
+
+void recordChangeLocked() {
+    markOpenLocked();
+    index_dirty = true;
+    if (++changes_since_flush >= FLUSH_AFTER_CHANGES) {
+        writeIndexLocked();
+    }
+}
+
+} // namespace
+
+std::string keyFor(const std::string &url) {
+    constexpr uint64_t FNV_PRIME = 1099511628211ull;
+    uint64_t low = 14695981039346656037ull;
+    uint64_t high = 0x6c62272e07bb0142ull;
+
+    for (unsigned char c : url) {
+        low = (low ^ c) * FNV_PRIME;
+        high = (high ^ c) * FNV_PRIME;
+        high ^= low >> 29;
+    }
+    high = (high ^ url.size()) * FNV_PRIME;
+
+    std::ostringstream oss;
+    oss << std::hex << std::setfill('0') << std::setw(16) << high << std::setw(16) << low;
+    return oss.str();
+}
+
+std::string directory() {
+    std::scoped_lock lock(cache_mutex);
+    loadIndexLocked();
+    return cache_dir;
+}
+
+std::optional<Entry> lookup(const std::string &url) {
+    std::scoped_lock lock(cache_mutex);
+    loadIndexLocked();
+    auto it = entries.find(keyFor(url));
+    if (it == entries.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+std::optional<std::string> read(const std::string &url) {
+    const std::string key = keyFor(url);
+    std::string path;
+    uint64_t expectedSize = 0;
+    {
+        std::scoped_lock lock(cache_mutex);
+        loadIndexLocked();
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            return std::nullopt;
+        }
+        path = blobPath(key, it->second.format);
+        expectedSize = it->second.size;
+    }
+
+    std::string data;
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (in.is_open()) {
+            std::ostringstream buffer;
+            buffer << in.rdbuf();
+            data = buffer.str();
+        }
+    }
+
+    std::scoped_lock lock(cache_mutex);
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        return std::nullopt;
+    }
+
+    if (data.size() != expectedSize || data.empty()) {
+        Logger::warn("Cached blob missing or truncated, dropping: " + path);
+        std::vector<std::string> removedPaths;
+        eraseLocked(it, removedPaths);
+        recordChangeLocked();
+        removeFiles(removedPaths);
+        return std::nullopt;
+    }
+
+    touchLocked(it->second);
+    index_dirty = true;
+    return data;
+}
+
+void store(const std::string &url, const std::string &data, const std::string &format, const std::string &etag,
+           int64_t maxAgeSeconds) {
+    const std::string key = keyFor(url);
+    std::string path;
+    std::string tempPath;
+    {
+        std::scoped_lock lock(cache_mutex);
+        loadIndexLocked();
+        markOpenLocked();
+        path = blobPath(key, format);
+        tempPath = path + TEMP_SUFFIX + std::to_string(++temp_counter);
+    }
+
+    // Written under a temporary name and renamed into place, so readers never see a partial blob
+    bool written = false;
+    try {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            Logger::warn("Failed to open cache file for writing: " + tempPath);
+        } else {
+            out.write(data.data(), static_cast<std::streamsize>(data.size()));
+            written = static_cast<bool>(out);
+            if (!written) {
+                Logger::warn("Failed to write cache file: " + tempPath);
+            }
+        }
+    } catch (const std::exception &e) {
+        Logger::warn("Failed to save to disk cache: " + std::string(e.what()));
+    }
+    if (!written) {
+        removeFiles({tempPath});
+        return;
+    }
+
+    std::scoped_lock lock(cache_mutex);
+    std::error_code ec;
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec) {
+        Logger::warn("Failed to move cache file into place: " + path + ": " + ec.message());
+        removeFiles({tempPath});
+        return;
+    }
+
+    std::vector<std::string> removedPaths;
+    auto existing = entries.find(key);
+    if (existing != entries.end()) {
+        total_bytes -= std::min(total_bytes, existing->second.size);
+        if (existing->second.format != format) {
+            removedPaths.push_back(blobPath(key, existing->second.format));
+        }
+    }
+
+    Entry &entry = entries[key];
+    entry.key = key;
+    entry.format = format;
+    entry.size = data.size();
+    touchLocked(entry);
+    entry.expiresAt = maxAgeSeconds > 0 ? entry.lastAccess + maxAgeSeconds : 0;
+    entry.etag = etag;
+    total_bytes += entry.size;
+
+    evictOverCapLocked(removedPaths, key);
+    recordChangeLocked();
+
+    // Still under the lock, so a blob stored again under an evicted name in the meantime is not deleted
+    removeFiles(removedPaths);
+}
+
+void refresh(const std::string &url, int64_t maxAgeSeconds) {
+    std::scoped_lock lock(cache_mutex);
+    loadIndexLocked();
+    auto it = entries.find(keyFor(url));
+    if (it == entries.end()) {
+        return;
+    }
+
+    touchLocked(it->second);
+    it->second.expiresAt = maxAgeSeconds > 0 ? it->second.lastAccess + maxAgeSeconds : 0;
+    recordChangeLocked();
+}
+
+void remove(const std::string &url) {
+    std::scoped_lock lock(cache_mutex);
+    loadIndexLocked();
+    auto it = entries.find(keyFor(url));
+    if (it == entries.end()) {
+        return;
+    }
+    std::vector<std::string> removedPaths;
+    eraseLocked(it, removedPaths);
+    recordChangeLocked();
+    removeFiles(removedPaths);
+}
+
+void setMaxBytes(uint64_t maxBytes) {
+    std::scoped_lock lock(cache_mutex);
+    loadIndexLocked();
+    max_bytes = maxBytes;
+    std::vector<std::string> removedPaths;
+    evictOverCapLocked(removedPaths);
+    if (!removedPaths.empty()) {
+        recordChangeLocked();
+    }
+    removeFiles(removedPaths);
+}
+
+void flush() {
+    std::scoped_lock lock(cache_mutex);
+    if (index_loaded) {
+        writeIndexLocked();
+    }
+}
+
+void shutdown() {
+    std::scoped_lock lock(cache_mutex);
+    if (!index_loaded) {
+        return;
+    }
+    writeIndexLocked();
+    if (index_dirty) {
+        return; // The index could not be written; the marker stays so the next start checks the directory
+    }
+    std::error_code ec;
+    std::filesystem::remove(openMarkerPath(), ec);
+    marked_open = false;
+}
+
+void clear() {
+    std::scoped_lock lock(cache_mutex);
+    loadIndexLocked();
+    entries.clear();
+    total_bytes = 0;
+    removeAllFilesLocked();
+    index_dirty = true;
+    writeIndexLocked();
+    Logger::info("Cleared disk cache at: " + cache_dir);
+}
+
+Stats getStats() {
+    std::scoped_lock lock(cache_mutex);
+    loadIndexLocked();
+    Stats stats;
+    stats.entries = entries.size();
+    stats.bytes = total_bytes;
+    stats.maxBytes = max_bytes;
+    stats.evictions = eviction_count;
+    return stats;
+}
+
+} // namespace DiskCache
@@ -0,0 +1,281 @@
+#include "utils/FrameProfiler.h"
+
+#include "utils/Logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace FrameProfiler {
+
+namespace {
+
+constexpr size_t kMaxEvents = 200000; // Oldest scopes are overwritten past this, a few minutes of busy UI
+constexpr size_t kRecentFrames = 600; // About ten seconds of frames at 60 fps
+constexpr size_t kReportedScopes = 10;
+
+struct Event {
+    const char *name;
+    double startUs;
+    double durationUs;
+    double busyUs; // Frames only
+};
+
+struct ScopeTotals {
+    uint64_t count = 0;
+    double totalUs = 0.0;
+    double maxUs = 0.0;
+};
+
+const char *const kFrameEvent = "Frame";
+const char *const kSlowFrameEvent = "Slow frame";
+
+const auto epoch = std::chrono::steady_clock::now();
+
+// Scopes on any thread read these two; ui_thread is stored before enabled publishes it
+std::atomic<bool> enabled{false};
+std::atomic<std::thread::id> ui_thread;
+
+// Everything below is only touched on the UI thread
+int depth = 0;
+double frame_start_us = -1.0; // Start of the first top-level scope of the current frame
+double frame_busy_us = 0.0;   // Time in top-level scopes during the current frame
+
+std::vector<Event> events; // Ring buffer once it reaches kMaxEvents, next_event is then the oldest
+size_t next_event = 0;
+
+std::vector<double> recent_frames_ms; // Ring buffer of the last kRecentFrames frame times
+size_t next_frame = 0;
+uint64_t frame_count = 0;
+uint64_t slow_frame_count = 0;
+
+std::unordered_map<const char *, ScopeTotals> scope_totals;
+
+double nowUs() { return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count(); }
+
+bool isRecording() {
+    return enabled.load(std::memory_order_acquire) &&
+           std::this_thread::get_id() == ui_thread.load(std::memory_order_relaxed);
+}
+
+void record(const Event &event) {
+    if (events.size() < kMaxEvents) {
+        events.push_back(event);
+        return;
+    }
+    events[next_event] = event;
+    next_event = (next_event + 1) % kMaxEvents;
+}
+
+std::string formatMs(double ms) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1) << ms;
+    return oss.str();
+}
+
+std::string jsonEscape(const char *text) {
+    std::string escaped;
+    for (const char *c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            escaped += '\\';
+        }
+        escaped += *c;
+    }
+    return escaped;
+}
+
+double percentile(const std::vector<double> &sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+} // namespace
+
+Scope::Scope(const char *name) : name_(name) {
+    if (!isRecording()) {
+        return;
+    }
+    active_ = true;
+    startUs_ = nowUs();
+    if (depth++ == 0 && frame_start_us < 0.0) {
+        frame_start_us = startUs_;
+    }
+}
+
+Scope::~Scope() {
+    // Only set on the UI thread, so depth never changes anywhere else
+    if (!active_) {
+        return;
+    }
+    depth = std::max(depth - 1, 0);
+    if (!isRecording()) {
+        return;
+    }
+
+    const double durationUs = nowUs() - startUs_;
+    record(Event{name_, startUs_, durationUs, 0.0});
+    if (depth == 0) {
+        frame_busy_us += durationUs;
+    }
+
+    ScopeTotals &totals = scope_totals[name_];
+    totals.count++;
+    totals.totalUs += durationUs;
+    totals.maxUs = std::max(totals.maxUs, durationUs);
+}
+
+void setEnabled(bool enable) {
+    if (enable && !enabled.load(std::memory_order_relaxed)) {
+        ui_thread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+        depth = 0;
+        frame_start_us = -1.0;
+        frame_busy_us = 0.0;
+        events.clear();
+        next_event = 0;
+        recent_frames_ms.clear();
+        next_frame = 0;
+        frame_count = 0;
+        slow_frame_count = 0;
+        scope_totals.clear();
+    }
+    enabled.store(enable, std::memory_order_release);
+}
+
+bool isEnabled() { return enabled.load(std::memory_order_acquire); }
+
+void initFromEnvironment() {
+    const char *value = std::getenv("DISCOVE_FRAME_PROFILER");
+    if (value && *value != '\0') {
+        setEnabled(true);
+        Logger::info("FrameProfiler: Recording frame times (slow frames are over " + formatMs(SLOW_FRAME_MS) +
+                     " ms)");
+    }
+}
+
+void endFrame() {
+    if (!isRecording() || frame_start_us < 0.0) {
+        return;
+    }
+
+    const double frameMs = frame_busy_us / 1000.0;
+    const bool slow = frameMs > SLOW_FRAME_MS;
+    record(Event{slow ? kSlowFrameEvent : kFrameEvent, frame_start_us, nowUs() - frame_start_us, frame_busy_us});
+    frame_start_us = -1.0;
+    frame_busy_us = 0.0;
+
+    frame_count++;
+    if (slow) {
+        slow_frame_count++;
+    }
+    if (recent_frames_ms.size() < kRecentFrames) {
+        recent_frames_ms.push_back(frameMs);
+    } else {
+        recent_frames_ms[next_frame] = frameMs;
+        next_frame = (next_frame + 1) % kRecentFrames;
+    }
+}
+
+Stats stats() {
+    Stats result;
+    result.frames = frame_count;
+    result.slowFrames = slow_frame_count;
+
+    std::vector<double> sorted = recent_frames_ms;
+    std::sort(sorted.begin(), sorted.end());
+    result.p50Ms = percentile(sorted, 0.50);
+    result.p95Ms = percentile(sorted, 0.95);
+    result.p99Ms = percentile(sorted, 0.99);
+    result.maxMs = sorted.empty() ? 0.0 : sorted.back();
+
+    for (double ms : sorted) {
+        auto bound = std::lower_bound(HISTOGRAM_BOUNDS_MS.begin(), HISTOGRAM_BOUNDS_MS.end(), ms);
+        result.histogram[static_cast<size_t>(bound - HISTOGRAM_BOUNDS_MS.begin())]++;
+    }
+    return result;
+}
+
+std::string summary() {
+    const Stats s = stats();
+    return "frame p50 " + formatMs(s.p50Ms) + " ms, p95 " + formatMs(s.p95Ms) + " ms, p99 " + formatMs(s.p99Ms) +
+           " ms, max " + formatMs(s.maxMs) + " ms; " + std::to_string(s.slowFrames) + " of " +
+           std::to_string(s.frames) + " over " + formatMs(SLOW_FRAME_MS) + " ms";
+}
+
+void logReport() {
+    const Stats s = stats();
+    Logger::info("FrameProfiler: " + summary());
+
+    double lower = 0.0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        std::string range = i < HISTOGRAM_BOUNDS_MS.size()
+                                ? formatMs(lower) + "-" + formatMs(HISTOGRAM_BOUNDS_MS[i]) + " ms"
+                                : "over " + formatMs(lower) + " ms";
+        Logger::info("FrameProfiler:   " + range + ": " + std::to_string(s.histogram[i]) + " frames");
+        if (i < HISTOGRAM_BOUNDS_MS.size()) {
+            lower = HISTOGRAM_BOUNDS_MS[i];
+        }
+    }
+
+    // The same name can come from several translation units, each with its own literal
+    std::map<std::string, ScopeTotals> byName;
+    for (const auto &[name, totals] : scope_totals) {
+        ScopeTotals &merged = byName[name];
+        merged.count += totals.count;
+        merged.totalUs += totals.totalUs;
+        merged.maxUs = std::max(merged.maxUs, totals.maxUs);
+    }
+    std::vector<std::pair<std::string, ScopeTotals>> ranked(byName.begin(), byName.end());
+    std::sort(ranked.begin(), ranked.end(),
+              [](const auto &a, const auto &b) { return a.second.totalUs > b.second.totalUs; });
+    ranked.resize(std::min(ranked.size(), kReportedScopes));
+    for (const auto &[name, totals] : ranked) {
+        Logger::info("FrameProfiler:   " + name + ": " + std::to_string(totals.count) + " calls, " +
+                     formatMs(totals.totalUs / 1000.0) + " ms total, max " + formatMs(totals.maxUs / 1000.0) +
+                     " ms");
+    }
+}
+
+bool writeTrace(const std::string &path) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        Logger::warn("FrameProfiler: Failed to open trace file: " + path);
+        return false;
+    }
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"UI thread\"}}";
+
+    const size_t oldest = events.size() < kMaxEvents ? 0 : next_event;
+    for (size_t i = 0; i < events.size(); ++i) {
+        const Event &event = events[(oldest + i) % events.size()];
+        const bool frame = event.name == kFrameEvent || event.name == kSlowFrameEvent;
+        out << ",\n{\"name\":\"" << jsonEscape(event.name) << "\",\"cat\":\"" << (frame ? "frame" : "ui")
+            << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":" << event.startUs << ",\"dur\":" << event.durationUs;
+        if (frame) {
+            out << ",\"args\":{\"busy_ms\":" << event.busyUs / 1000.0 << "}";
+        }
+        out << "}";
+    }
+    out << "\n]}\n";
+
+    if (!out) {
+        Logger::warn("FrameProfiler: Failed to write trace file: " + path);
+        return false;
+    }
+    Logger::info("FrameProfiler: Wrote " + std::to_string(events.size()) + " trace events to " + path);
+    return true;
+}
+
+} // namespace FrameProfiler
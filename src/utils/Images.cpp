@@ -1,6 +1,8 @@
 #include "utils/Images.h"
 
+#include "utils/DiskCache.h"
 #include "utils/Logger.h"
+#include "utils/PixelKernels.h"
 
 #include <FL/Fl.H>
 #include <FL/Fl_GIF_Image.H>
@@ -13,26 +15,40 @@
 #define NOMINMAX
 #endif
 #include <curl/curl.h>
+#include <webp/decode.h>
+#include <webp/demux.h>
 
 #include <algorithm>
 #include <atomic>
+#include <cctype>
 #include <cmath>
 #include <condition_variable>
 #include <cstring>
-#include <filesystem>
-#include <fstream>
+#include <list>
+#include <map>
 #include <mutex>
 #include <queue>
-#include <random>
-#include <sstream>
 #include <thread>
+#include <tuple>
 #include <unordered_set>
 #include <vector>
 
 namespace Images {
 
 namespace {
-std::unordered_map<std::string, std::unique_ptr<Fl_RGB_Image>> image_cache;
+struct CacheEntry {
+    std::unique_ptr<Fl_RGB_Image> image;
+    size_t bytes{0};
+    std::list<std::string>::iterator lruPosition;
+};
+
+// Most recently used URL is at the front of lru_order
+std::unordered_map<std::string, CacheEntry> image_cache;
+std::list<std::string> lru_order;
+std::unordered_map<std::string, int> pin_counts;
+size_t cache_bytes = 0;
+size_t cache_budget_bytes = DEFAULT_MEMORY_BUDGET_BYTES;
+CacheStats cache_stats;
 std::mutex cache_mutex;
 
 std::unordered_set<std::string> failed_urls;
@@ -48,20 +64,46 @@ std::mutex retry_mutex;
 constexpr int MAX_RETRY_ATTEMPTS = 3;
 constexpr int BASE_RETRY_DELAY_MS = 1000;
 
-struct DownloadRequest {
-    std::string url;
+// One caller waiting on a URL; either the memory cache keeps the image or the caller takes it over
+struct ImageRequest {
     ImageCallback callback;
+    OwnedImageCallback ownedCallback;
+    ImagePrepare prepare;
+    int targetWidth{0};
+    int targetHeight{0};
+    ScaleMode scaleMode{ScaleMode::Fill};
+
+    bool isScaled() const { return targetWidth > 0 && targetHeight > 0; }
+    bool isOwned() const { return static_cast<bool>(ownedCallback); }
+    std::string cacheKey(const std::string &url) const {
+        return isScaled() ? scaledCacheKey(url, targetWidth, targetHeight, scaleMode) : url;
+    }
+};
+
+struct DownloadJob {
+    std::string url;
     int retryAttempt{0};
 };
 
-std::queue<DownloadRequest> download_queue;
+std::queue<DownloadJob> download_queue;
 std::mutex queue_mutex;
 std::condition_variable queue_cv;
 std::atomic<bool> worker_running{true};
 std::atomic<int> active_workers{0};
-std::unordered_set<std::string> pending_downloads;
+// By URL: every size and holder that asked while the URL loads, served from one download and one decode
+std::unordered_map<std::string, std::vector<ImageRequest>> pending_downloads;
 constexpr int MAX_CONCURRENT_DOWNLOADS = 8;
 
+std::unordered_map<std::string, DownloadStats> download_stats;
+std::mutex stats_mutex;
+
+// Coverage masks by (shape, width, height, radius); avatars and icons only come in a handful of sizes
+enum class MaskShape { Circle, RoundedRect };
+using MaskKey = std::tuple<MaskShape, int, int, int>;
+constexpr size_t MAX_COVERAGE_MASKS = 64;
+std::map<MaskKey, std::shared_ptr<const PixelKernels::CoverageMask>> coverage_masks;
+std::mutex coverage_masks_mutex;
+
 void downloadWorker();
 
 size_t curlWriteCallback(void *contents, size_t size, size_t nmemb, void *userp) {
@@ -71,6 +113,82 @@ size_t curlWriteCallback(void *contents, size_t size, size_t nmemb, void *userp)
     return totalSize;
 }
 
+size_t imageBytes(const Fl_RGB_Image *image) {
+    return static_cast<size_t>(image->w()) * static_cast<size_t>(image->h()) * static_cast<size_t>(image->d());
+}
+
+// Evicted bitmaps may still be referenced by the UI thread for the rest of the current event, so they are
+// destroyed from an awake callback instead of on the thread that triggered eviction.
+void releaseOnUiThread(std::vector<std::unique_ptr<Fl_RGB_Image>> images) {
+    if (images.empty()) {
+        return;
+    }
+    auto *heapImages = new std::vector<std::unique_ptr<Fl_RGB_Image>>(std::move(images));
+    Fl::awake(
+        [](void *p) { delete static_cast<std::vector<std::unique_ptr<Fl_RGB_Image>> *>(p); }, heapImages);
+}
+
+void eraseEntryLocked(std::unordered_map<std::string, CacheEntry>::iterator it,
+                      std::vector<std::unique_ptr<Fl_RGB_Image>> &released) {
+    cache_bytes -= it->second.bytes;
+    lru_order.erase(it->second.lruPosition);
+    released.push_back(std::move(it->second.image));
+    image_cache.erase(it);
+}
+
+void evictOverBudgetLocked(std::vector<std::unique_ptr<Fl_RGB_Image>> &released) {
+    auto candidate = lru_order.end();
+    while (cache_bytes > cache_budget_bytes && candidate != lru_order.begin()) {
+        --candidate;
+        if (pin_counts.find(*candidate) != pin_counts.end()) {
+            continue;
+        }
+
+        auto it = image_cache.find(*candidate);
+        candidate = std::next(candidate);
+        eraseEntryLocked(it, released);
+        cache_stats.evictions++;
+    }
+}
+
+// The entry is stored pinned: completeRequest hands it to the waiting callback and unpins it afterwards.
+// An entry already cached under url wins, since holders may be drawing it; the new image is then dropped.
+// Returns the image that is cached under url.
+Fl_RGB_Image *storePinnedInCache(const std::string &url, Fl_RGB_Image *image) {
+    std::vector<std::unique_ptr<Fl_RGB_Image>> released;
+    Fl_RGB_Image *stored = image;
+    {
+        std::scoped_lock lock(cache_mutex);
+        pin_counts[url]++;
+        auto existing = image_cache.find(url);
+        if (existing != image_cache.end()) {
+            released.emplace_back(image);
+            stored = existing->second.image.get();
+            lru_order.splice(lru_order.begin(), lru_order, existing->second.lruPosition);
+        } else {
+            lru_order.push_front(url);
+            CacheEntry &entry = image_cache[url];
+            entry.image.reset(image);
+            entry.bytes = imageBytes(image);
+            entry.lruPosition = lru_order.begin();
+            cache_bytes += entry.bytes;
+        }
+
+        evictOverBudgetLocked(released);
+    }
+    releaseOnUiThread(std::move(released));
+    return stored;
+}
+
+Fl_RGB_Image *findInCacheLocked(const std::string &url) {
+    auto it = image_cache.find(url);
+    if (it == image_cache.end()) {
+        return nullptr;
+    }
+    lru_order.splice(lru_order.begin(), lru_order, it->second.lruPosition);
+    return it->second.image.get();
+}
+
 std::string detectImageFormat(const std::string &data) {
     if (data.size() < 8)
         return "unknown";
@@ -97,34 +215,6 @@ std::string detectImageFormat(const std::string &data) {
     return "unknown";
 }
 
-bool isValidPNG(const std::string &filePath) {
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file)
-        return false;
-
-    unsigned char signature[8];
-    file.read(reinterpret_cast<char *>(signature), 8);
-    if (file.gcount() != 8)
-        return false;
-
-    return signature[0] == 0x89 && signature[1] == 0x50 && signature[2] == 0x4E && signature[3] == 0x47 &&
-           signature[4] == 0x0D && signature[5] == 0x0A && signature[6] == 0x1A && signature[7] == 0x0A;
-}
-
-bool isValidGIF(const std::string &filePath) {
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file)
-        return false;
-
-    char signature[6];
-    file.read(signature, 6);
-    if (file.gcount() != 6)
-        return false;
-
-    return signature[0] == 'G' && signature[1] == 'I' && signature[2] == 'F' && signature[3] == '8' &&
-           (signature[4] == '7' || signature[4] == '9') && signature[5] == 'a';
-}
-
 bool shouldAttemptDownload(const std::string &url) {
     std::scoped_lock lock(failed_mutex);
     return failed_urls.find(url) == failed_urls.end();
@@ -173,24 +263,25 @@ void clearRetryState(const std::string &url) {
     retry_tracker.erase(url);
 }
 
-void scheduleRetry(const std::string &url, ImageCallback callback, int attemptCount) {
-    int delayMs = BASE_RETRY_DELAY_MS * (1 << attemptCount);
-    Logger::debug("Scheduling retry " + std::to_string(attemptCount + 1) + "/" + std::to_string(MAX_RETRY_ATTEMPTS) +
-                  " for " + url + " in " + std::to_string(delayMs) + "ms");
+void failWaiters(const std::string &url);
 
-    std::thread([url, callback, delayMs]() {
+// The URL's waiters stay in pending_downloads until the retry finishes
+void scheduleRetry(const DownloadJob &job) {
+    int delayMs = BASE_RETRY_DELAY_MS * (1 << job.retryAttempt);
+    Logger::debug("Scheduling retry " + std::to_string(job.retryAttempt + 1) + "/" +
+                  std::to_string(MAX_RETRY_ATTEMPTS) + " for " + job.url + " in " + std::to_string(delayMs) + "ms");
+
+    std::thread([job = DownloadJob(job), delayMs]() mutable {
         std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+        int attemptCount;
+        if (!canRetryNow(job.url, attemptCount)) {
+            failWaiters(job.url);
+            return;
+        }
         {
             std::scoped_lock lock(queue_mutex);
-            if (pending_downloads.find(url) != pending_downloads.end()) {
-                return;
-            }
-            int attemptCount;
-            if (!canRetryNow(url, attemptCount)) {
-                return;
-            }
-            pending_downloads.insert(url);
-            download_queue.push({url, callback, attemptCount});
+            job.retryAttempt = attemptCount;
+            download_queue.push(std::move(job));
         }
         queue_cv.notify_one();
         if (active_workers < MAX_CONCURRENT_DOWNLOADS) {
@@ -199,238 +290,296 @@ void scheduleRetry(const std::string &url, ImageCallback callback, int attemptCo
     }).detach();
 }
 
-std::string generateTempFilename(const std::string &extension) {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<> dis(0, 999999);
+bool hasValidDimensions(const Fl_Image *image, const std::string &format, const std::string &url) {
+    if (image->fail() < 0 || image->w() <= 0 || image->h() <= 0) {
+        Logger::warn("Failed to decode " + format + " image (" + std::to_string(image->w()) + "x" +
+                     std::to_string(image->h()) + ") for URL: " + url);
+        return false;
+    }
+    return true;
+}
 
-    std::string tempDir;
-#ifdef _WIN32
-    char *tempPath = nullptr;
-    size_t len;
-    if (_dupenv_s(&tempPath, &len, "TEMP") == 0 && tempPath != nullptr) {
-        tempDir = tempPath;
-        free(tempPath);
-    } else {
-        tempDir = "C:\\Temp";
+Fl_RGB_Image *decodeWebp(const std::string &data, const std::string &url) {
+    const auto *bytes = reinterpret_cast<const uint8_t *>(data.data());
+
+    WebPBitstreamFeatures features;
+    if (WebPGetFeatures(bytes, data.size(), &features) != VP8_STATUS_OK || features.width <= 0 ||
+        features.height <= 0) {
+        Logger::warn("Failed to read WebP header for URL: " + url);
+        return nullptr;
+    }
+
+    size_t bufferSize = static_cast<size_t>(features.width) * features.height * 4;
+    unsigned char *pixels = new unsigned char[bufferSize];
+
+    if (features.has_animation) {
+        // Static consumers get the first composited frame; GifAnimation decodes the full sequence
+        WebPAnimDecoderOptions options;
+        WebPAnimDecoderOptionsInit(&options);
+        options.color_mode = MODE_RGBA;
+
+        WebPData webpData{bytes, data.size()};
+        WebPAnimDecoder *decoder = WebPAnimDecoderNew(&webpData, &options);
+        uint8_t *frame = nullptr;
+        int timestamp = 0;
+        bool decoded = decoder && WebPAnimDecoderGetNext(decoder, &frame, &timestamp) && frame;
+        if (decoded) {
+            std::memcpy(pixels, frame, bufferSize);
+        }
+        if (decoder) {
+            WebPAnimDecoderDelete(decoder);
+        }
+        if (!decoded) {
+            delete[] pixels;
+            Logger::warn("Failed to decode animated WebP for URL: " + url);
+            return nullptr;
+        }
+    } else if (!WebPDecodeRGBAInto(bytes, data.size(), pixels, bufferSize, features.width * 4)) {
+        delete[] pixels;
+        Logger::warn("Failed to decode WebP for URL: " + url);
+        return nullptr;
     }
-#else
-    tempDir = "/tmp";
-#endif
 
-    return tempDir + "/discove_img_" + std::to_string(dis(gen)) + "." + extension;
+    Fl_RGB_Image *image = new Fl_RGB_Image(pixels, features.width, features.height, 4);
+    image->alloc_array = 1;
+    return image;
 }
 
-std::string getCacheDirectory() {
-    std::string cacheDir;
-#ifdef _WIN32
-    char *appData = nullptr;
-    size_t len;
-    if (_dupenv_s(&appData, &len, "LOCALAPPDATA") == 0 && appData != nullptr) {
-        cacheDir = std::string(appData) + "\\Discove\\cache";
-        free(appData);
-    } else {
-        cacheDir = "C:\\Temp\\Discove\\cache";
+Fl_RGB_Image *imageFromData(const std::string &data, const std::string &url) {
+    std::string format = detectImageFormat(data);
+    const auto *bytes = reinterpret_cast<const unsigned char *>(data.data());
+
+    if (format == "png") {
+        Fl_PNG_Image png_image(nullptr, bytes, static_cast<int>(data.size()));
+        if (!hasValidDimensions(&png_image, format, url))
+            return nullptr;
+        return static_cast<Fl_RGB_Image *>(png_image.copy());
     }
-#else
-    const char *home = getenv("HOME");
-    if (home) {
-        cacheDir = std::string(home) + "/.cache/discove";
-    } else {
-        cacheDir = "/tmp/discove_cache";
+
+    if (format == "jpeg") {
+        Fl_JPEG_Image jpg_image(nullptr, bytes, static_cast<int>(data.size()));
+        if (!hasValidDimensions(&jpg_image, format, url))
+            return nullptr;
+        return static_cast<Fl_RGB_Image *>(jpg_image.copy());
     }
-#endif
 
-    try {
-        std::filesystem::create_directories(cacheDir);
-    } catch (const std::exception &e) {
-        Logger::error("Failed to create cache directory: " + std::string(e.what()));
+    if (format == "webp") {
+        return decodeWebp(data, url);
+    }
+
+    if (format == "gif") {
+        // Fl_GIF_Image is a pixmap; convert to RGBA so callers always get an Fl_RGB_Image
+        Fl_GIF_Image gif_image(nullptr, bytes, data.size());
+        if (!hasValidDimensions(&gif_image, format, url))
+            return nullptr;
+        return new Fl_RGB_Image(&gif_image, FL_BLACK);
     }
 
-    return cacheDir;
+    Logger::warn("Unsupported image format: " + format + " for URL: " + url);
+    return nullptr;
 }
 
-std::string urlToFilename(const std::string &url) {
-    std::hash<std::string> hasher;
-    size_t hash = hasher(url);
+struct ResponseHeaders {
+    std::string etag;
+    int64_t maxAgeSeconds{0};
+};
 
-    std::ostringstream oss;
-    oss << std::hex << hash;
+size_t curlHeaderCallback(char *buffer, size_t size, size_t nitems, void *userp) {
+    size_t totalSize = size * nitems;
+    auto *headers = static_cast<ResponseHeaders *>(userp);
+    std::string line(buffer, totalSize);
 
-    return oss.str();
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+        return totalSize;
+    }
+
+    std::string name = line.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+    std::string value = line.substr(colon + 1);
+    value.erase(0, value.find_first_not_of(" \t"));
+    value.erase(value.find_last_not_of(" \t\r\n") + 1);
+
+    if (name == "etag") {
+        headers->etag = value;
+    } else if (name == "cache-control") {
+        size_t maxAge = value.find("max-age=");
+        if (maxAge != std::string::npos) {
+            try {
+                headers->maxAgeSeconds = std::stoll(value.substr(maxAge + 8));
+            } catch (...) {
+                headers->maxAgeSeconds = 0;
+            }
+        }
+    }
+
+    return totalSize;
 }
 
-std::string getCacheFilePath(const std::string &url, const std::string &extension) {
-    std::string cacheDir = getCacheDirectory();
-    std::string filename = urlToFilename(url) + "." + extension;
-    return cacheDir + "/" + filename;
+void runOnUiThread(std::function<void()> fn) {
+    auto *heapFn = new std::function<void()>(std::move(fn));
+    Fl::awake(
+        [](void *p) {
+            std::unique_ptr<std::function<void()>> fnPtr(static_cast<std::function<void()> *>(p));
+            (*fnPtr)();
+        },
+        heapFn);
 }
 
-void saveToCache(const std::string &url, const std::string &data, const std::string &format) {
-    try {
-        std::string cacheFile = getCacheFilePath(url, format);
-        std::ofstream out(cacheFile, std::ios::binary);
-        if (out.is_open()) {
-            out.write(data.data(), data.size());
-            out.close();
-            Logger::debug("Cached image to: " + cacheFile);
-        }
-    } catch (const std::exception &e) {
-        Logger::warn("Failed to save image to cache: " + std::string(e.what()));
+void failRequest(const ImageRequest &request) {
+    if (request.isOwned()) {
+        runOnUiThread([callback = request.ownedCallback]() { callback(nullptr); });
+    } else {
+        runOnUiThread([callback = request.callback]() { callback(nullptr); });
     }
 }
 
-std::string loadFromCache(const std::string &url, const std::string &format) {
-    try {
-        std::string cacheFile = getCacheFilePath(url, format);
+void completeRequest(const std::string &key, const ImageCallback &callback, Fl_RGB_Image *image) {
+    runOnUiThread([callback, key, image]() {
+        callback(image);
+        unpinImage(key);
+    });
+}
 
-        if (!std::filesystem::exists(cacheFile)) {
-            return "";
-        }
+// Next batch of requests waiting on url; once none are left the URL is no longer pending
+std::vector<ImageRequest> takeWaiters(const std::string &url) {
+    std::vector<ImageRequest> waiters;
+    std::scoped_lock lock(queue_mutex);
+    auto it = pending_downloads.find(url);
+    if (it == pending_downloads.end()) {
+        return waiters;
+    }
+    if (it->second.empty()) {
+        pending_downloads.erase(it);
+        return waiters;
+    }
+    waiters.swap(it->second);
+    return waiters;
+}
 
-        bool isValid = false;
-        if (format == "png") {
-            isValid = isValidPNG(cacheFile);
-        } else if (format == "gif") {
-            isValid = isValidGIF(cacheFile);
-        } else {
-            isValid = true;
+void failWaiters(const std::string &url) {
+    for (auto waiters = takeWaiters(url); !waiters.empty(); waiters = takeWaiters(url)) {
+        for (const auto &waiter : waiters) {
+            failRequest(waiter);
         }
+    }
+}
 
-        if (!isValid) {
-            Logger::warn("Corrupted " + format + " file detected, deleting: " + cacheFile);
-            std::filesystem::remove(cacheFile);
-            return "";
-        }
+// One waiter's image from the shared decode: resampled to its size, then its prepare step
+Fl_RGB_Image *prepareImage(const Fl_RGB_Image *decoded, const ImageRequest &request) {
+    Fl_RGB_Image *image = nullptr;
+    if (request.isScaled() && (decoded->w() != request.targetWidth || decoded->h() != request.targetHeight)) {
+        image = scaleImage(decoded, request.targetWidth, request.targetHeight, request.scaleMode);
+    } else {
+        image = static_cast<Fl_RGB_Image *>(const_cast<Fl_RGB_Image *>(decoded)->copy());
+    }
 
-        std::ifstream in(cacheFile, std::ios::binary);
-        if (!in.is_open()) {
-            return "";
+    if (image && request.prepare) {
+        if (Fl_RGB_Image *prepared = request.prepare(image)) {
+            delete image;
+            image = prepared;
         }
-
-        std::ostringstream buffer;
-        buffer << in.rdbuf();
-        return buffer.str();
-    } catch (const std::exception &e) {
-        Logger::warn("Failed to load image from cache: " + std::string(e.what()));
-        return "";
     }
+    return image;
 }
 
-Fl_RGB_Image *imageFromData(const std::string &data, const std::string &url) {
-    std::string format = detectImageFormat(data);
-
-    if (format == "png") {
-        std::unique_ptr<Fl_PNG_Image> png_image =
-            std::make_unique<Fl_PNG_Image>(nullptr, (const unsigned char *)data.data(), data.size());
-
-        if (png_image) {
-            if (png_image->w() > 0 && png_image->h() > 0) {
-                return (Fl_RGB_Image *)png_image->copy();
-            } else {
-                Logger::warn("PNG image has invalid dimensions (" + std::to_string(png_image->w()) + "x" +
-                             std::to_string(png_image->h()) + ") for URL: " + url);
-            }
-        } else {
-            Logger::warn("Failed to create PNG image object for URL: " + url);
+// Cache waiters sharing a key share one image, pinned once per waiter
+void completeGroup(const std::string &key, const std::vector<ImageRequest> &group, Fl_RGB_Image *image) {
+    if (!image) {
+        for (const auto &waiter : group) {
+            failRequest(waiter);
         }
-    } else if (format == "gif") {
-        std::string tempFile = generateTempFilename("gif");
-
-        std::ofstream out(tempFile, std::ios::binary);
-        if (out.is_open()) {
-            out.write(data.data(), data.size());
-            out.close();
-
-            std::unique_ptr<Fl_GIF_Image> gif_image = std::make_unique<Fl_GIF_Image>(tempFile.c_str());
+        return;
+    }
+    image = storePinnedInCache(key, image);
+    for (size_t i = 1; i < group.size(); ++i) {
+        pinImage(key);
+    }
+    for (const auto &waiter : group) {
+        completeRequest(key, waiter.callback, image);
+    }
+}
 
-            if (gif_image) {
-                if (gif_image->w() > 0 && gif_image->h() > 0) {
-                    Fl_RGB_Image *result = (Fl_RGB_Image *)gif_image->copy();
-                    std::remove(tempFile.c_str());
-                    return result;
-                } else {
-                    Logger::warn("GIF image has invalid dimensions (" + std::to_string(gif_image->w()) + "x" +
-                                 std::to_string(gif_image->h()) + ") for URL: " + url);
+// Serve every request for url from one decode, including ones that arrive while this runs. Every variant is
+// cached before takeWaiters finds no one left and ends the URL's pending state, so a request arriving in
+// between joins this decode rather than starting a second one. Full-size waiters pin the url entry until their
+// callbacks run, which keeps it valid to scale from for later waiters.
+void fanOut(const std::string &url, std::unique_ptr<Fl_RGB_Image> decoded) {
+    const Fl_RGB_Image *source = decoded.get();
+    Fl_RGB_Image *fullImage = nullptr;
+    std::vector<ImageRequest> fullSize;
+    for (auto waiters = takeWaiters(url); !waiters.empty(); waiters = takeWaiters(url)) {
+        std::unordered_map<std::string, std::vector<ImageRequest>> groups;
+        for (auto &waiter : waiters) {
+            if (waiter.isOwned()) {
+                Fl_RGB_Image *image = prepareImage(source, waiter);
+                if (!image) {
+                    failRequest(waiter);
+                    continue;
                 }
+                runOnUiThread([callback = std::move(waiter.ownedCallback), image]() {
+                    callback(std::unique_ptr<Fl_RGB_Image>(image));
+                });
+            } else if (waiter.isScaled()) {
+                groups[waiter.cacheKey(url)].push_back(std::move(waiter));
             } else {
-                Logger::warn("Failed to create GIF image object for URL: " + url);
-            }
-
-            std::remove(tempFile.c_str());
-        } else {
-            Logger::warn("Failed to create temp file for GIF decoding: " + tempFile);
-        }
-    } else if (format == "jpeg") {
-        std::string tempFile = generateTempFilename("jpg");
-
-        std::ofstream out(tempFile, std::ios::binary);
-        if (out.is_open()) {
-            out.write(data.data(), data.size());
-            out.close();
-
-            std::unique_ptr<Fl_JPEG_Image> jpg_image = std::make_unique<Fl_JPEG_Image>(tempFile.c_str());
-            if (jpg_image) {
-                if (jpg_image->w() > 0 && jpg_image->h() > 0) {
-                    Fl_RGB_Image *result = (Fl_RGB_Image *)jpg_image->copy();
-                    std::remove(tempFile.c_str());
-                    return result;
+                if (fullImage) {
+                    pinImage(url);
                 } else {
-                    Logger::warn("JPEG image has invalid dimensions (" + std::to_string(jpg_image->w()) + "x" +
-                                 std::to_string(jpg_image->h()) + ") for URL: " + url);
+                    fullImage = storePinnedInCache(url, decoded.release());
+                    source = fullImage;
                 }
-            } else {
-                Logger::warn("Failed to create JPEG image object for URL: " + url);
+                fullSize.push_back(std::move(waiter));
             }
-
-            std::remove(tempFile.c_str());
-        } else {
-            Logger::warn("Failed to create temp file for JPEG decoding: " + tempFile);
         }
-    } else {
-        Logger::warn("Unsupported image format: " + format + " for URL: " + url);
+        for (const auto &[key, group] : groups) {
+            completeGroup(key, group, prepareImage(source, group.front()));
+        }
     }
 
-    return nullptr;
+    for (const auto &waiter : fullSize) {
+        completeRequest(url, waiter.callback, fullImage);
+    }
+}
+
+// Decodes once and serves every waiter on url; false leaves the waiters pending for the caller to handle
+bool deliverDecoded(const std::string &url, const std::string &data) {
+    std::unique_ptr<Fl_RGB_Image> decoded(imageFromData(data, url));
+    if (!decoded) {
+        return false;
+    }
+    fanOut(url, std::move(decoded));
+    return true;
 }
 
-void processImageRequest(const std::string &url, ImageCallback callback, int retryAttempt = 0) {
+void processImageRequest(const DownloadJob &job) {
+    const std::string &url = job.url;
+    const int retryAttempt = job.retryAttempt;
+
     if (!shouldAttemptDownload(url)) {
-        auto *heapFn = new std::function<void()>([callback]() { callback(nullptr); });
-        Fl::awake(
-            [](void *p) {
-                std::unique_ptr<std::function<void()>> fnPtr(static_cast<std::function<void()> *>(p));
-                (*fnPtr)();
-            },
-            heapFn);
+        failWaiters(url);
         return;
     }
 
-    std::vector<std::string> formats = {"png", "gif", "jpeg", "webp"};
-    std::string cachedData;
-
-    for (const auto &format : formats) {
-        cachedData = loadFromCache(url, format);
-        if (!cachedData.empty()) {
-            Fl_RGB_Image *image = imageFromData(cachedData, url);
-            if (image) {
-                {
-                    std::scoped_lock lock(cache_mutex);
-                    image_cache[url] = std::unique_ptr<Fl_RGB_Image>(image);
+    // Fresh disk entries are used as-is; expired ones with an ETag are revalidated with If-None-Match
+    std::string staleData;
+    std::string staleEtag;
+    if (auto entry = DiskCache::lookup(url)) {
+        if (auto cachedData = DiskCache::read(url)) {
+            int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+                              std::chrono::system_clock::now().time_since_epoch())
+                              .count();
+            if (!entry->isExpired(now)) {
+                if (deliverDecoded(url, *cachedData)) {
+                    Logger::debug("Loaded from disk cache: " + url);
+                    clearRetryState(url);
+                    return;
                 }
-                Logger::debug("Loaded from disk cache: " + url);
-                clearRetryState(url);
-                auto *heapFn = new std::function<void()>([callback, url]() {
-                    Fl_RGB_Image *cachedImg = getCachedImage(url);
-                    callback(cachedImg);
-                });
-                Fl::awake(
-                    [](void *p) {
-                        std::unique_ptr<std::function<void()>> fnPtr(static_cast<std::function<void()> *>(p));
-                        (*fnPtr)();
-                    },
-                    heapFn);
-                return;
+                Logger::warn("Cached " + entry->format + " data failed to decode, discarding: " + url);
+                DiskCache::remove(url);
+            } else if (!entry->etag.empty()) {
+                staleData = std::move(*cachedData);
+                staleEtag = entry->etag;
             }
         }
     }
@@ -440,26 +589,28 @@ void processImageRequest(const std::string &url, ImageCallback callback, int ret
     std::string attemptInfo = retryAttempt > 0 ? " (attempt " + std::to_string(retryAttempt + 1) + "/" +
                                                      std::to_string(MAX_RETRY_ATTEMPTS) + ")"
                                                : "";
-    Logger::debug("Downloading image: " + url + attemptInfo);
+    Logger::debug((staleData.empty() ? "Downloading image: " : "Revalidating image: ") + url + attemptInfo);
 
     CURL *curl = curl_easy_init();
     if (!curl) {
         Logger::error("Failed to initialize CURL for image: " + url);
-        auto *heapFn = new std::function<void()>([callback]() { callback(nullptr); });
-        Fl::awake(
-            [](void *p) {
-                std::unique_ptr<std::function<void()>> fnPtr(static_cast<std::function<void()> *>(p));
-                (*fnPtr)();
-            },
-            heapFn);
+        failWaiters(url);
         return;
     }
 
     std::string imageData;
+    ResponseHeaders responseHeaders;
+    curl_slist *requestHeaders = nullptr;
+    if (!staleEtag.empty()) {
+        requestHeaders = curl_slist_append(requestHeaders, ("If-None-Match: " + staleEtag).c_str());
+    }
 
     curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curlWriteCallback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &imageData);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, curlHeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &responseHeaders);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, requestHeaders);
     curl_easy_setopt(curl, CURLOPT_USERAGENT, "Discove/1.0");
     curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
     curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
@@ -472,13 +623,28 @@ void processImageRequest(const std::string &url, ImageCallback callback, int ret
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
 
     curl_easy_cleanup(curl);
+    curl_slist_free_all(requestHeaders);
+
+    if (!staleData.empty() && (res != CURLE_OK || httpCode == 304)) {
+        if (httpCode == 304) {
+            DiskCache::refresh(url, responseHeaders.maxAgeSeconds);
+        } else {
+            Logger::debug("Revalidation failed, using stale cached copy: " + url);
+        }
+
+        if (deliverDecoded(url, staleData)) {
+            clearRetryState(url);
+            return;
+        }
+        DiskCache::remove(url);
+    }
 
     if (res != CURLE_OK) {
         Logger::error("CURL error (" + std::to_string(res) + "): " + std::string(curl_easy_strerror(res)) +
                       " for image: " + url);
 
         if (retryAttempt < MAX_RETRY_ATTEMPTS - 1) {
-            scheduleRetry(url, callback, retryAttempt);
+            scheduleRetry(job);
             return;
         } else {
             Logger::warn("Max retries exceeded for: " + url);
@@ -486,13 +652,7 @@ void processImageRequest(const std::string &url, ImageCallback callback, int ret
             clearRetryState(url);
         }
 
-        auto *heapFn = new std::function<void()>([callback]() { callback(nullptr); });
-        Fl::awake(
-            [](void *p) {
-                std::unique_ptr<std::function<void()>> fnPtr(static_cast<std::function<void()> *>(p));
-                (*fnPtr)();
-            },
-            heapFn);
+        failWaiters(url);
         return;
     }
 
@@ -502,90 +662,59 @@ void processImageRequest(const std::string &url, ImageCallback callback, int ret
         if (httpCode == 404 || httpCode == 403 || httpCode == 410) {
             markUrlAsFailed(url);
             clearRetryState(url);
+            DiskCache::remove(url);
         } else if (httpCode >= 500 && httpCode < 600 && retryAttempt < MAX_RETRY_ATTEMPTS - 1) {
-            scheduleRetry(url, callback, retryAttempt);
+            scheduleRetry(job);
             return;
         }
 
-        auto *heapFn = new std::function<void()>([callback]() { callback(nullptr); });
-        Fl::awake(
-            [](void *p) {
-                std::unique_ptr<std::function<void()>> fnPtr(static_cast<std::function<void()> *>(p));
-                (*fnPtr)();
-            },
-            heapFn);
+        failWaiters(url);
         return;
     }
     if (imageData.empty()) {
         Logger::error("Downloaded image has no data: " + url);
-        auto *heapFn = new std::function<void()>([callback]() { callback(nullptr); });
-        Fl::awake(
-            [](void *p) {
-                std::unique_ptr<std::function<void()>> fnPtr(static_cast<std::function<void()> *>(p));
-                (*fnPtr)();
-            },
-            heapFn);
+        failWaiters(url);
         return;
     }
 
     std::string format = detectImageFormat(imageData);
-    if (format == "unknown" || format == "webp") {
+    {
+        std::scoped_lock lock(stats_mutex);
+        auto &stats = download_stats[format];
+        stats.requests++;
+        stats.bytes += imageData.size();
+    }
+
+    if (format == "unknown") {
         Logger::warn("Unsupported image format for: " + url + " (format: " + format +
                      ", size: " + std::to_string(imageData.size()) + " bytes)");
         markUrlAsFailed(url);
         clearRetryState(url);
-        auto *heapFn = new std::function<void()>([callback]() { callback(nullptr); });
-        Fl::awake(
-            [](void *p) {
-                std::unique_ptr<std::function<void()>> fnPtr(static_cast<std::function<void()> *>(p));
-                (*fnPtr)();
-            },
-            heapFn);
+        failWaiters(url);
         return;
     }
 
-    saveToCache(url, imageData, format);
+    DiskCache::store(url, imageData, format, responseHeaders.etag, responseHeaders.maxAgeSeconds);
 
-    Fl_RGB_Image *image = imageFromData(imageData, url);
-    if (!image) {
+    clearFailedUrl(url);
+    clearRetryState(url);
+    if (!deliverDecoded(url, imageData)) {
         Logger::error("Failed to decode image from: " + url + " (format: " + format +
                       ", size: " + std::to_string(imageData.size()) + " bytes)");
         markUrlAsFailed(url);
         clearRetryState(url);
-        auto *heapFn = new std::function<void()>([callback]() { callback(nullptr); });
-        Fl::awake(
-            [](void *p) {
-                std::unique_ptr<std::function<void()>> fnPtr(static_cast<std::function<void()> *>(p));
-                (*fnPtr)();
-            },
-            heapFn);
+        failWaiters(url);
         return;
     }
 
-    clearFailedUrl(url);
-    clearRetryState(url);
-    {
-        std::scoped_lock lock(cache_mutex);
-        image_cache[url] = std::unique_ptr<Fl_RGB_Image>(image);
-    }
     Logger::debug("Successfully downloaded and cached image: " + url);
-    auto *heapFn = new std::function<void()>([callback, url]() {
-        Fl_RGB_Image *cachedImg = getCachedImage(url);
-        callback(cachedImg);
-    });
-    Fl::awake(
-        [](void *p) {
-            std::unique_ptr<std::function<void()>> fnPtr(static_cast<std::function<void()> *>(p));
-            (*fnPtr)();
-        },
-        heapFn);
 }
 
 void downloadWorker() {
     active_workers++;
 
     while (worker_running) {
-        DownloadRequest request;
+        DownloadJob job;
         {
             std::unique_lock<std::mutex> lock(queue_mutex);
             if (!queue_cv.wait_for(lock, std::chrono::seconds(1),
@@ -601,35 +730,30 @@ void downloadWorker() {
             }
 
             if (!download_queue.empty()) {
-                request = std::move(download_queue.front());
+                job = std::move(download_queue.front());
                 download_queue.pop();
             } else {
                 continue;
             }
         }
 
-        processImageRequest(request.url, request.callback, request.retryAttempt);
-        {
-            std::scoped_lock lock(queue_mutex);
-            pending_downloads.erase(request.url);
-        }
+        processImageRequest(job);
     }
 
     active_workers--;
 }
 
-void downloadImageAsync(const std::string &url, ImageCallback callback) {
+// Joins the URL's in-flight download when there is one, so each URL is fetched and decoded once for all sizes
+void downloadImageAsync(const std::string &url, ImageRequest request) {
     {
         std::scoped_lock lock(queue_mutex);
-        if (!shouldAttemptDownload(url)) {
-            return;
-        }
-        if (pending_downloads.find(url) != pending_downloads.end()) {
+        auto [it, inserted] = pending_downloads.try_emplace(url);
+        it->second.push_back(std::move(request));
+        if (!inserted) {
             return;
         }
 
-        pending_downloads.insert(url);
-        download_queue.push({url, callback});
+        download_queue.push(DownloadJob{url});
         Logger::debug("Queued image download (" + std::to_string(download_queue.size()) + " in queue): " + url);
     }
 
@@ -639,95 +763,222 @@ void downloadImageAsync(const std::string &url, ImageCallback callback) {
     }
 }
 
-bool isInsideCircle(int x, int y, int centerX, int centerY, int radius) {
-    int dx = x - centerX;
-    int dy = y - centerY;
-    return (dx * dx + dy * dy) <= (radius * radius);
+// Answers from memory when possible; returns false when a download is still needed
+bool resolveFromMemory(const std::string &key, const std::string &url, const ImageCallback &callback) {
+    Fl_RGB_Image *cached = nullptr;
+    {
+        std::scoped_lock lock(cache_mutex);
+        cached = findInCacheLocked(key);
+        if (cached) {
+            cache_stats.hits++;
+        } else {
+            cache_stats.misses++;
+        }
+    }
+    if (cached) {
+        callback(cached);
+        return true;
+    }
+
+    if (!shouldAttemptDownload(url)) {
+        runOnUiThread([callback]() { callback(nullptr); });
+        return true;
+    }
+    return false;
 }
 
-bool isInsideRoundedRect(int x, int y, int width, int height, int radius) {
-    bool inLeftCorner = x < radius;
-    bool inRightCorner = x >= width - radius;
-    bool inTopCorner = y < radius;
-    bool inBottomCorner = y >= height - radius;
+struct Contribution {
+    int start{0};
+    std::vector<float> weights;
+};
 
-    if (!inLeftCorner && !inRightCorner)
-        return true;
-    if (!inTopCorner && !inBottomCorner)
-        return true;
+// Per-destination source taps along one axis: area coverage when shrinking, linear interpolation when growing
+std::vector<Contribution> buildContributions(double srcOffset, double srcLength, int dstLength, int srcLimit) {
+    std::vector<Contribution> contributions(dstLength);
+    double ratio = srcLength / dstLength;
+
+    for (int i = 0; i < dstLength; ++i) {
+        Contribution &c = contributions[i];
+        if (ratio >= 1.0) {
+            double begin = srcOffset + i * ratio;
+            double end = begin + ratio;
+            int first = static_cast<int>(std::floor(begin));
+            int last = static_cast<int>(std::ceil(end)) - 1;
+            c.start = std::clamp(first, 0, srcLimit - 1);
+            for (int p = c.start; p <= std::min(last, srcLimit - 1); ++p) {
+                double coverage = std::min(end, p + 1.0) - std::max(begin, static_cast<double>(p));
+                c.weights.push_back(static_cast<float>(std::max(coverage, 0.0) / ratio));
+            }
+        } else {
+            double center = srcOffset + (i + 0.5) * ratio - 0.5;
+            int p0 = std::clamp(static_cast<int>(std::floor(center)), 0, srcLimit - 1);
+            int p1 = std::min(p0 + 1, srcLimit - 1);
+            float t = static_cast<float>(std::clamp(center - p0, 0.0, 1.0));
+            c.start = p0;
+            c.weights.push_back(1.0f - t);
+            if (p1 != p0) {
+                c.weights.push_back(t);
+            }
+        }
+        if (c.weights.empty()) {
+            c.weights.push_back(1.0f);
+        }
+    }
 
-    int cornerX = inLeftCorner ? radius : width - radius - 1;
-    int cornerY = inTopCorner ? radius : height - radius - 1;
+    return contributions;
+}
 
-    int dx = x - cornerX;
-    int dy = y - cornerY;
-    return (dx * dx + dy * dy) <= (radius * radius);
+std::shared_ptr<const PixelKernels::CoverageMask> getCoverageMask(MaskShape shape, int width, int height, int radius) {
+    const MaskKey key{shape, width, height, radius};
+    {
+        std::scoped_lock lock(coverage_masks_mutex);
+        auto it = coverage_masks.find(key);
+        if (it != coverage_masks.end()) {
+            return it->second;
+        }
+    }
+
+    auto mask = std::make_shared<const PixelKernels::CoverageMask>(
+        shape == MaskShape::Circle ? PixelKernels::circleMask(width)
+                                   : PixelKernels::roundedRectMask(width, height, radius));
+
+    std::scoped_lock lock(coverage_masks_mutex);
+    if (coverage_masks.size() >= MAX_COVERAGE_MASKS) {
+        coverage_masks.clear();
+    }
+    return coverage_masks.try_emplace(key, std::move(mask)).first->second;
 }
 
 } // namespace
 
 void loadImageAsync(const std::string &url, ImageCallback callback) {
-    {
-        std::scoped_lock lock(cache_mutex);
-        auto it = image_cache.find(url);
-        if (it != image_cache.end()) {
-            callback(it->second.get());
-            return;
-        }
+    if (!resolveFromMemory(url, url, callback)) {
+        ImageRequest request;
+        request.callback = std::move(callback);
+        downloadImageAsync(url, std::move(request));
+    }
+}
+
+void loadScaledImageAsync(const std::string &url, int width, int height, ImageCallback callback, ScaleMode mode) {
+    if (width <= 0 || height <= 0) {
+        loadImageAsync(url, std::move(callback));
+        return;
+    }
+
+    if (!resolveFromMemory(scaledCacheKey(url, width, height, mode), url, callback)) {
+        ImageRequest request;
+        request.callback = std::move(callback);
+        request.targetWidth = width;
+        request.targetHeight = height;
+        request.scaleMode = mode;
+        downloadImageAsync(url, std::move(request));
     }
+}
 
+void takeScaledImageAsync(const std::string &url, int width, int height, OwnedImageCallback callback, ScaleMode mode,
+                          ImagePrepare prepare) {
     if (!shouldAttemptDownload(url)) {
-        auto *heapFn = new std::function<void()>([callback]() { callback(nullptr); });
-        Fl::awake(
-            [](void *p) {
-                std::unique_ptr<std::function<void()>> fnPtr(static_cast<std::function<void()> *>(p));
-                (*fnPtr)();
-            },
-            heapFn);
+        runOnUiThread([callback = std::move(callback)]() { callback(nullptr); });
         return;
     }
 
-    downloadImageAsync(url, callback);
+    ImageRequest request;
+    request.ownedCallback = std::move(callback);
+    request.prepare = std::move(prepare);
+    request.targetWidth = width;
+    request.targetHeight = height;
+    request.scaleMode = mode;
+    downloadImageAsync(url, std::move(request));
+}
+
+std::string scaledCacheKey(const std::string &url, int width, int height, ScaleMode mode) {
+    return url + "#" + std::to_string(width) + "x" + std::to_string(height) + (mode == ScaleMode::Cover ? "c" : "");
 }
 
 Fl_RGB_Image *getCachedImage(const std::string &url) {
     std::scoped_lock lock(cache_mutex);
-    auto it = image_cache.find(url);
-    if (it != image_cache.end()) {
-        return it->second.get();
-    }
-    return nullptr;
+    return findInCacheLocked(url);
 }
 
 void evictFromMemory(const std::string &url) {
+    std::vector<std::unique_ptr<Fl_RGB_Image>> released;
+    {
+        std::scoped_lock lock(cache_mutex);
+        if (pin_counts.find(url) != pin_counts.end()) {
+            return;
+        }
+        auto it = image_cache.find(url);
+        if (it != image_cache.end()) {
+            eraseEntryLocked(it, released);
+        }
+    }
+    releaseOnUiThread(std::move(released));
+}
+
+void pinImage(const std::string &url) {
     std::scoped_lock lock(cache_mutex);
-    image_cache.erase(url);
+    pin_counts[url]++;
 }
 
-std::string getCacheFilePath(const std::string &url, const std::string &extension) {
-    std::string cacheDir = getCacheDirectory();
-    std::string filename = urlToFilename(url) + "." + extension;
-    return cacheDir + "/" + filename;
+void unpinImage(const std::string &url) {
+    std::vector<std::unique_ptr<Fl_RGB_Image>> released;
+    {
+        std::scoped_lock lock(cache_mutex);
+        auto it = pin_counts.find(url);
+        if (it == pin_counts.end()) {
+            return;
+        }
+        if (--it->second <= 0) {
+            pin_counts.erase(it);
+            evictOverBudgetLocked(released);
+        }
+    }
+    releaseOnUiThread(std::move(released));
+}
+
+void setMemoryBudget(size_t bytes) {
+    std::vector<std::unique_ptr<Fl_RGB_Image>> released;
+    {
+        std::scoped_lock lock(cache_mutex);
+        cache_budget_bytes = bytes;
+        evictOverBudgetLocked(released);
+    }
+    releaseOnUiThread(std::move(released));
+}
+
+CacheStats getCacheStats() {
+    std::scoped_lock lock(cache_mutex);
+    CacheStats stats = cache_stats;
+    stats.entries = image_cache.size();
+    stats.pinned = pin_counts.size();
+    stats.bytes = cache_bytes;
+    stats.budgetBytes = cache_budget_bytes;
+    return stats;
+}
+
+std::optional<std::string> readCachedFile(const std::string &url, const std::string &format) {
+    auto entry = DiskCache::lookup(url);
+    if (!entry || entry->format != format) {
+        return std::nullopt;
+    }
+    return DiskCache::read(url);
 }
 
 void clearCache() {
+    std::vector<std::unique_ptr<Fl_RGB_Image>> released;
     {
+        // Pinned entries are still drawn by their holders; they stay, with their pin counts, until unpinned
         std::scoped_lock lock(cache_mutex);
-        image_cache.clear();
-    }
-    try {
-        std::string cacheDir = getCacheDirectory();
-        if (std::filesystem::exists(cacheDir)) {
-            for (const auto &entry : std::filesystem::directory_iterator(cacheDir)) {
-                if (entry.is_regular_file()) {
-                    std::filesystem::remove(entry.path());
-                }
+        for (auto it = image_cache.begin(); it != image_cache.end();) {
+            auto next = std::next(it);
+            if (pin_counts.find(it->first) == pin_counts.end()) {
+                eraseEntryLocked(it, released);
             }
-            Logger::info("Cleared disk cache at: " + cacheDir);
+            it = next;
         }
-    } catch (const std::exception &e) {
-        Logger::error("Failed to clear disk cache: " + std::string(e.what()));
     }
+    releaseOnUiThread(std::move(released));
+    DiskCache::clear();
 }
 
 void shutdownDownloadWorker() {
@@ -737,6 +988,108 @@ void shutdownDownloadWorker() {
     while (active_workers > 0) {
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
+    DiskCache::flush();
+
+    CacheStats cacheStats = getCacheStats();
+    Logger::info("Image memory cache: " + std::to_string(cacheStats.hits) + " hits, " +
+                 std::to_string(cacheStats.misses) + " misses, " + std::to_string(cacheStats.evictions) +
+                 " evictions, " + std::to_string(cacheStats.bytes / (1024 * 1024)) + " MiB resident");
+
+    for (const auto &[format, stats] : getDownloadStats()) {
+        Logger::info("Image downloads (" + format + "): " + std::to_string(stats.requests) + " files, " +
+                     std::to_string(stats.bytes / 1024) + " KiB");
+    }
+}
+
+Fl_RGB_Image *scaleImage(const Fl_RGB_Image *source, int width, int height, ScaleMode mode) {
+    if (!source || source->w() <= 0 || source->h() <= 0 || width <= 0 || height <= 0) {
+        return nullptr;
+    }
+
+    const int srcW = source->w();
+    const int srcH = source->h();
+    const int depth = source->d();
+    const char *const *dataArray = source->data();
+    if (depth < 1 || depth > 4 || !dataArray || !dataArray[0]) {
+        return nullptr;
+    }
+    const auto *srcData = reinterpret_cast<const unsigned char *>(dataArray[0]);
+    const int srcLineSize = source->ld() ? source->ld() : srcW * depth;
+
+    double cropX = 0.0, cropY = 0.0, cropW = srcW, cropH = srcH;
+    if (mode == ScaleMode::Cover) {
+        double scale = std::max(static_cast<double>(width) / srcW, static_cast<double>(height) / srcH);
+        cropW = width / scale;
+        cropH = height / scale;
+        cropX = (srcW - cropW) / 2.0;
+        cropY = (srcH - cropH) / 2.0;
+    }
+
+    const auto columns = buildContributions(cropX, cropW, width, srcW);
+    const auto rows = buildContributions(cropY, cropH, height, srcH);
+
+    // Colour is averaged premultiplied so transparent pixels do not darken the edges they border
+    const bool hasAlpha = depth == 2 || depth == 4;
+    const int alphaChannel = depth - 1;
+
+    const int rowBegin = rows.front().start;
+    const int rowEnd = rows.back().start + static_cast<int>(rows.back().weights.size());
+    std::vector<float> horizontal(static_cast<size_t>(rowEnd - rowBegin) * width * depth, 0.0f);
+
+    for (int sy = rowBegin; sy < rowEnd; ++sy) {
+        const unsigned char *srcRow = srcData + static_cast<size_t>(sy) * srcLineSize;
+        float *outRow = horizontal.data() + static_cast<size_t>(sy - rowBegin) * width * depth;
+        for (int x = 0; x < width; ++x) {
+            const Contribution &c = columns[x];
+            float *out = outRow + x * depth;
+            for (size_t k = 0; k < c.weights.size(); ++k) {
+                const unsigned char *px = srcRow + (c.start + k) * depth;
+                float alpha = hasAlpha ? px[alphaChannel] / 255.0f : 1.0f;
+                float weight = c.weights[k];
+                for (int ch = 0; ch < depth; ++ch) {
+                    float value = px[ch];
+                    if (hasAlpha && ch != alphaChannel) {
+                        value *= alpha;
+                    }
+                    out[ch] += value * weight;
+                }
+            }
+        }
+    }
+
+    unsigned char *pixels = new unsigned char[static_cast<size_t>(width) * height * depth];
+    for (int y = 0; y < height; ++y) {
+        const Contribution &c = rows[y];
+        for (int x = 0; x < width; ++x) {
+            float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for (size_t k = 0; k < c.weights.size(); ++k) {
+                const float *in = horizontal.data() + (static_cast<size_t>(c.start + k - rowBegin) * width + x) * depth;
+                for (int ch = 0; ch < depth; ++ch) {
+                    acc[ch] += in[ch] * c.weights[k];
+                }
+            }
+
+            float unpremultiply = 1.0f;
+            if (hasAlpha) {
+                unpremultiply = acc[alphaChannel] > 0.0f ? 255.0f / acc[alphaChannel] : 0.0f;
+            }
+
+            unsigned char *out = pixels + (static_cast<size_t>(y) * width + x) * depth;
+            for (int ch = 0; ch < depth; ++ch) {
+                float value = (hasAlpha && ch != alphaChannel) ? acc[ch] * unpremultiply : acc[ch];
+                out[ch] = static_cast<unsigned char>(std::clamp(value + 0.5f, 0.0f, 255.0f));
+            }
+        }
+    }
+
+    auto *result = new Fl_RGB_Image(pixels, width, height, depth);
+    result->alloc_array = 1;
+    return result;
+}
+
+std::unordered_map<std::string, DownloadStats> getDownloadStats() {
+    std::scoped_lock lock(stats_mutex);
+    return download_stats;
 }
 
 Fl_RGB_Image *makeCircular(Fl_RGB_Image *source, int diameter) {
@@ -759,42 +1112,9 @@ Fl_RGB_Image *makeCircular(Fl_RGB_Image *source, int diameter) {
     int srcLineSize = scaled->ld() ? scaled->ld() : diameter * srcDepth;
 
     int newDepth = 4;
-    std::vector<unsigned char> buffer(diameter * diameter * newDepth);
-
-    int radius = diameter / 2;
-    int centerX = radius;
-    int centerY = radius;
-
-    for (int y = 0; y < diameter; y++) {
-        for (int x = 0; x < diameter; x++) {
-            int srcIdx = y * srcLineSize + x * srcDepth;
-            int dstIdx = (y * diameter + x) * newDepth;
-
-            if (srcDepth >= 3) {
-                buffer[dstIdx + 0] = srcData[srcIdx + 0];
-                buffer[dstIdx + 1] = srcData[srcIdx + 1];
-                buffer[dstIdx + 2] = srcData[srcIdx + 2];
-            } else if (srcDepth == 1) {
-                buffer[dstIdx + 0] = srcData[srcIdx];
-                buffer[dstIdx + 1] = srcData[srcIdx];
-                buffer[dstIdx + 2] = srcData[srcIdx];
-            }
-
-            unsigned char sourceAlpha = 255;
-            if (srcDepth == 4) {
-                sourceAlpha = srcData[srcIdx + 3];
-            }
-
-            if (isInsideCircle(x, y, centerX, centerY, radius)) {
-                buffer[dstIdx + 3] = sourceAlpha;
-            } else {
-                buffer[dstIdx + 3] = 0;
-            }
-        }
-    }
-
-    unsigned char *heapData = new unsigned char[buffer.size()];
-    std::memcpy(heapData, buffer.data(), buffer.size());
+    unsigned char *heapData = new unsigned char[static_cast<size_t>(diameter) * diameter * newDepth];
+    auto mask = getCoverageMask(MaskShape::Circle, diameter, diameter, 0);
+    PixelKernels::applyMask(srcData, srcDepth, srcLineSize, *mask, heapData);
 
     Fl_RGB_Image *result = new Fl_RGB_Image(heapData, diameter, diameter, newDepth);
     result->alloc_array = 1;
@@ -840,38 +1160,9 @@ Fl_RGB_Image *makeRoundedRect(Fl_RGB_Image *source, int width, int height, int r
     int srcLineSize = scaled->ld() ? scaled->ld() : width * srcDepth;
 
     int newDepth = 4;
-    std::vector<unsigned char> buffer(width * height * newDepth);
-
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            int srcIdx = y * srcLineSize + x * srcDepth;
-            int dstIdx = (y * width + x) * newDepth;
-
-            if (srcDepth >= 3) {
-                buffer[dstIdx + 0] = srcData[srcIdx + 0];
-                buffer[dstIdx + 1] = srcData[srcIdx + 1];
-                buffer[dstIdx + 2] = srcData[srcIdx + 2];
-            } else if (srcDepth == 1) {
-                buffer[dstIdx + 0] = srcData[srcIdx];
-                buffer[dstIdx + 1] = srcData[srcIdx];
-                buffer[dstIdx + 2] = srcData[srcIdx];
-            }
-
-            unsigned char sourceAlpha = 255;
-            if (srcDepth == 4) {
-                sourceAlpha = srcData[srcIdx + 3];
-            }
-
-            if (isInsideRoundedRect(x, y, width, height, radius)) {
-                buffer[dstIdx + 3] = sourceAlpha;
-            } else {
-                buffer[dstIdx + 3] = 0;
-            }
-        }
-    }
-
-    unsigned char *heapData = new unsigned char[buffer.size()];
-    std::memcpy(heapData, buffer.data(), buffer.size());
+    unsigned char *heapData = new unsigned char[static_cast<size_t>(width) * height * newDepth];
+    auto mask = getCoverageMask(MaskShape::RoundedRect, width, height, radius);
+    PixelKernels::applyMask(srcData, srcDepth, srcLineSize, *mask, heapData);
 
     Fl_RGB_Image *result = new Fl_RGB_Image(heapData, width, height, newDepth);
     result->alloc_array = 1;
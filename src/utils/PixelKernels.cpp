@@ -0,0 +1,336 @@
+#include "utils/PixelKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Compilers only target AVX2 (and with it SSSE3) in builds configured with DISCOVE_AVX2
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PIXEL_KERNELS_AVX2 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PIXEL_KERNELS_SSE2 1
+#if defined(__SSSE3__) || defined(__AVX2__)
+#include <tmmintrin.h>
+#define PIXEL_KERNELS_SSSE3 1
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define PIXEL_KERNELS_NEON 1
+#endif
+
+namespace PixelKernels {
+
+namespace {
+
+// The vector paths read a packed pixel as a little-endian word, so alpha is its top byte
+constexpr uint32_t kAlphaMask = 0xFF000000u;
+
+// Builds a mask from the coverage of each pixel; the shape must be convex so every row is one span
+template <typename CoverageFn> CoverageMask buildMask(int width, int height, CoverageFn pixelCoverage) {
+    CoverageMask mask;
+    mask.width = std::max(width, 0);
+    mask.height = std::max(height, 0);
+    mask.coverage.resize(static_cast<size_t>(mask.width) * mask.height);
+    mask.covered.resize(mask.height);
+    mask.opaque.resize(mask.height);
+
+    for (int y = 0; y < mask.height; y++) {
+        uint8_t *row = mask.coverage.data() + static_cast<size_t>(y) * mask.width;
+        Span covered{mask.width, 0};
+        Span opaque{mask.width, 0};
+        for (int x = 0; x < mask.width; x++) {
+            const double fraction = std::clamp(pixelCoverage(x + 0.5, y + 0.5), 0.0, 1.0);
+            row[x] = static_cast<uint8_t>(std::lround(fraction * 255.0));
+            if (row[x] > 0) {
+                covered = {std::min(covered.begin, x), x + 1};
+            }
+            if (row[x] == 255) {
+                opaque = {std::min(opaque.begin, x), x + 1};
+            }
+        }
+        mask.covered[y] = covered.begin < covered.end ? covered : Span{};
+        mask.opaque[y] = opaque.begin < opaque.end ? opaque : Span{covered.begin, covered.begin};
+        if (mask.covered[y].end == 0) {
+            mask.opaque[y] = Span{};
+        }
+    }
+    return mask;
+}
+
+// Coverage of a pixel centred at distance from the centre of a circle, with a one pixel wide edge ramp
+double circleCoverage(double radius, double dx, double dy) { return radius - std::hypot(dx, dy) + 0.5; }
+
+void grayToRgba(const uint8_t *src, size_t count, uint8_t *dst) {
+    size_t i = 0;
+#if defined(PIXEL_KERNELS_SSE2)
+    const __m128i opaque = _mm_set1_epi8(static_cast<char>(0xFF));
+    for (; i + 16 <= count; i += 16) {
+        __m128i gray = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i grayGrayLo = _mm_unpacklo_epi8(gray, gray);
+        __m128i grayGrayHi = _mm_unpackhi_epi8(gray, gray);
+        __m128i grayAlphaLo = _mm_unpacklo_epi8(gray, opaque);
+        __m128i grayAlphaHi = _mm_unpackhi_epi8(gray, opaque);
+        auto *out = reinterpret_cast<__m128i *>(dst + i * 4);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(grayGrayLo, grayAlphaLo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(grayGrayLo, grayAlphaLo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(grayGrayHi, grayAlphaHi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(grayGrayHi, grayAlphaHi));
+    }
+#elif defined(PIXEL_KERNELS_NEON)
+    for (; i + 8 <= count; i += 8) {
+        uint8x8_t gray = vld1_u8(src + i);
+        uint8x8x4_t rgba = {{gray, gray, gray, vdup_n_u8(0xFF)}};
+        vst4_u8(dst + i * 4, rgba);
+    }
+#endif
+    for (; i < count; i++) {
+        uint8_t *out = dst + i * 4;
+        out[0] = out[1] = out[2] = src[i];
+        out[3] = 0xFF;
+    }
+}
+
+void rgbToRgba(const uint8_t *src, size_t count, uint8_t *dst) {
+    size_t i = 0;
+#if defined(PIXEL_KERNELS_SSSE3)
+    const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i opaque = _mm_set1_epi32(static_cast<int>(kAlphaMask));
+    // Each step loads 16 bytes for 4 pixels, so stop while the load stays inside the row
+    for (; i + 6 <= count; i += 4) {
+        __m128i rgb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 3));
+        __m128i rgba = _mm_or_si128(_mm_shuffle_epi8(rgb, spread), opaque);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), rgba);
+    }
+#elif defined(PIXEL_KERNELS_NEON)
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x3_t rgb = vld3_u8(src + i * 3);
+        uint8x8x4_t rgba = {{rgb.val[0], rgb.val[1], rgb.val[2], vdup_n_u8(0xFF)}};
+        vst4_u8(dst + i * 4, rgba);
+    }
+#endif
+    for (; i < count; i++) {
+        const uint8_t *in = src + i * 3;
+        uint8_t *out = dst + i * 4;
+        out[0] = in[0];
+        out[1] = in[1];
+        out[2] = in[2];
+        out[3] = 0xFF;
+    }
+}
+
+void tintRgba(const uint8_t *src, size_t count, uint32_t color, uint8_t *dst) {
+    size_t i = 0;
+#if defined(PIXEL_KERNELS_AVX2)
+    {
+        const __m256i alphaMask = _mm256_set1_epi32(static_cast<int>(kAlphaMask));
+        const __m256i tintColor = _mm256_set1_epi32(static_cast<int>(color));
+        const __m256i zero = _mm256_setzero_si256();
+        for (; i + 8 <= count; i += 8) {
+            __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4));
+            __m256i alpha = _mm256_and_si256(pixels, alphaMask);
+            __m256i blank = _mm256_cmpeq_epi32(alpha, zero);
+            __m256i tinted = _mm256_or_si256(tintColor, alpha);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), _mm256_blendv_epi8(tinted, pixels, blank));
+        }
+    }
+#endif
+#if defined(PIXEL_KERNELS_SSE2)
+    const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(kAlphaMask));
+    const __m128i tintColor = _mm_set1_epi32(static_cast<int>(color));
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+        __m128i alpha = _mm_and_si128(pixels, alphaMask);
+        __m128i blank = _mm_cmpeq_epi32(alpha, zero);
+        __m128i tinted = _mm_or_si128(tintColor, alpha);
+        __m128i result = _mm_or_si128(_mm_and_si128(blank, pixels), _mm_andnot_si128(blank, tinted));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), result);
+    }
+#elif defined(PIXEL_KERNELS_NEON)
+    const uint32x4_t alphaMask = vdupq_n_u32(kAlphaMask);
+    const uint32x4_t tintColor = vdupq_n_u32(color);
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t pixels = vreinterpretq_u32_u8(vld1q_u8(src + i * 4));
+        uint32x4_t alpha = vandq_u32(pixels, alphaMask);
+        uint32x4_t blank = vceqq_u32(alpha, vdupq_n_u32(0));
+        uint32x4_t result = vbslq_u32(blank, pixels, vorrq_u32(tintColor, alpha));
+        vst1q_u8(dst + i * 4, vreinterpretq_u8_u32(result));
+    }
+#endif
+    const auto *tintBytes = reinterpret_cast<const uint8_t *>(&color);
+    for (; i < count; i++) {
+        const uint8_t *in = src + i * 4;
+        uint8_t *out = dst + i * 4;
+        if (in[3] > 0) {
+            out[0] = tintBytes[0];
+            out[1] = tintBytes[1];
+            out[2] = tintBytes[2];
+        } else {
+            out[0] = in[0];
+            out[1] = in[1];
+            out[2] = in[2];
+        }
+        out[3] = in[3];
+    }
+}
+
+} // namespace
+
+CoverageMask circleMask(int diameter) {
+    const double radius = diameter / 2.0;
+    return buildMask(diameter, diameter,
+                     [radius](double px, double py) { return circleCoverage(radius, px - radius, py - radius); });
+}
+
+CoverageMask roundedRectMask(int width, int height, int radius) {
+    const double r = std::clamp(radius, 0, std::min(width, height) / 2);
+    return buildMask(width, height, [=](double px, double py) {
+        const double cx = std::clamp(px, r, width - r);
+        const double cy = std::clamp(py, r, height - r);
+        if (cx == px || cy == py) {
+            return 1.0;
+        }
+        return circleCoverage(r, px - cx, py - cy);
+    });
+}
+
+void expandPalette(const uint8_t *indices, size_t count, const uint32_t *palette, uint8_t *dst) {
+    size_t i = 0;
+#if defined(PIXEL_KERNELS_AVX2)
+    for (; i + 8 <= count; i += 8) {
+        __m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(indices + i)));
+        __m256i colors = _mm256_i32gather_epi32(reinterpret_cast<const int *>(palette), lanes, 4);
+        __m256i keep = _mm256_srai_epi32(colors, 31);
+        auto *out = reinterpret_cast<__m256i *>(dst + i * 4);
+        _mm256_storeu_si256(out, _mm256_blendv_epi8(_mm256_loadu_si256(out), colors, keep));
+    }
+#endif
+#if defined(PIXEL_KERNELS_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        __m128i colors =
+            _mm_setr_epi32(static_cast<int>(palette[indices[i]]), static_cast<int>(palette[indices[i + 1]]),
+                           static_cast<int>(palette[indices[i + 2]]), static_cast<int>(palette[indices[i + 3]]));
+        // Opaque entries have the sign bit set; zero entries keep what is already on the canvas
+        __m128i keep = _mm_srai_epi32(colors, 31);
+        auto *out = reinterpret_cast<__m128i *>(dst + i * 4);
+        __m128i previous = _mm_loadu_si128(out);
+        _mm_storeu_si128(out, _mm_or_si128(_mm_and_si128(keep, colors), _mm_andnot_si128(keep, previous)));
+    }
+#elif defined(PIXEL_KERNELS_NEON)
+    for (; i + 4 <= count; i += 4) {
+        const uint32_t lanes[4] = {palette[indices[i]], palette[indices[i + 1]], palette[indices[i + 2]],
+                                   palette[indices[i + 3]]};
+        uint32x4_t colors = vld1q_u32(lanes);
+        uint32x4_t keep = vreinterpretq_u32_s32(vshrq_n_s32(vreinterpretq_s32_u32(colors), 31));
+        uint32x4_t previous = vreinterpretq_u32_u8(vld1q_u8(dst + i * 4));
+        vst1q_u8(dst + i * 4, vreinterpretq_u8_u32(vbslq_u32(keep, colors, previous)));
+    }
+#endif
+    for (; i < count; i++) {
+        const uint32_t color = palette[indices[i]];
+        if (color != 0) {
+            std::memcpy(dst + i * 4, &color, 4);
+        }
+    }
+}
+
+void toRgba(const uint8_t *src, int depth, size_t count, uint8_t *dst) {
+    switch (depth) {
+    case 4:
+        std::memcpy(dst, src, count * 4);
+        break;
+    case 3:
+        rgbToRgba(src, count, dst);
+        break;
+    case 2:
+        for (size_t i = 0; i < count; i++) {
+            uint8_t *out = dst + i * 4;
+            out[0] = out[1] = out[2] = src[i * 2];
+            out[3] = src[i * 2 + 1];
+        }
+        break;
+    case 1:
+        grayToRgba(src, count, dst);
+        break;
+    default:
+        std::memset(dst, 0, count * 4);
+        break;
+    }
+}
+
+void scaleAlpha(uint8_t *rgba, const uint8_t *coverage, size_t count) {
+    size_t i = 0;
+#if defined(PIXEL_KERNELS_SSE2)
+    const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i half = _mm_set1_epi32(128);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        int packed;
+        std::memcpy(&packed, coverage + i, 4);
+        __m128i weights = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgba + i * 4));
+        // alpha * weight / 255, rounded, using (t + (t >> 8)) >> 8 with t = product + 128
+        __m128i product = _mm_add_epi32(_mm_mullo_epi16(_mm_srli_epi32(pixels, 24), weights), half);
+        __m128i alpha = _mm_srli_epi32(_mm_add_epi32(product, _mm_srli_epi32(product, 8)), 8);
+        __m128i result = _mm_or_si128(_mm_and_si128(pixels, colorMask), _mm_slli_epi32(alpha, 24));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(rgba + i * 4), result);
+    }
+#elif defined(PIXEL_KERNELS_NEON)
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t pixels = vld4_u8(rgba + i * 4);
+        uint16x8_t product = vmlal_u8(vdupq_n_u16(128), pixels.val[3], vld1_u8(coverage + i));
+        pixels.val[3] = vshrn_n_u16(vsraq_n_u16(product, product, 8), 8);
+        vst4_u8(rgba + i * 4, pixels);
+    }
+#endif
+    for (; i < count; i++) {
+        const unsigned product = rgba[i * 4 + 3] * coverage[i] + 128u;
+        rgba[i * 4 + 3] = static_cast<uint8_t>((product + (product >> 8)) >> 8);
+    }
+}
+
+void applyMask(const uint8_t *src, int depth, size_t srcLineSize, const CoverageMask &mask, uint8_t *dst) {
+    const size_t width = static_cast<size_t>(mask.width);
+    for (int y = 0; y < mask.height; y++) {
+        uint8_t *row = dst + y * width * 4;
+        const uint8_t *coverage = mask.coverage.data() + y * width;
+        const Span covered = mask.covered[y];
+        const Span opaque = mask.opaque[y];
+
+        std::memset(row, 0, static_cast<size_t>(covered.begin) * 4);
+        toRgba(src + y * srcLineSize + static_cast<size_t>(covered.begin) * depth, depth,
+               static_cast<size_t>(covered.end - covered.begin), row + static_cast<size_t>(covered.begin) * 4);
+        std::memset(row + static_cast<size_t>(covered.end) * 4, 0, (width - covered.end) * 4);
+
+        // Only the anti-aliased edge on either side of the opaque run needs its alpha scaled
+        scaleAlpha(row + static_cast<size_t>(covered.begin) * 4, coverage + covered.begin,
+                   static_cast<size_t>(opaque.begin - covered.begin));
+        scaleAlpha(row + static_cast<size_t>(opaque.end) * 4, coverage + opaque.end,
+                   static_cast<size_t>(covered.end - opaque.end));
+    }
+}
+
+void tint(const uint8_t *src, int depth, size_t count, uint8_t red, uint8_t green, uint8_t blue, uint8_t *dst) {
+    if (depth == 4) {
+        const uint8_t bytes[4] = {red, green, blue, 0};
+        uint32_t color;
+        std::memcpy(&color, bytes, 4);
+        tintRgba(src, count, color, dst);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t *in = src + i * 3;
+        uint8_t *out = dst + i * 3;
+        const bool inked = in[0] || in[1] || in[2];
+        out[0] = inked ? red : in[0];
+        out[1] = inked ? green : in[1];
+        out[2] = inked ? blue : in[2];
+    }
+}
+
+} // namespace PixelKernels
@@ -0,0 +1,323 @@
+#include "utils/TextMetrics.h"
+
+#include <FL/fl_draw.H>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace TextMetrics {
+
+namespace {
+constexpr uint32_t REPLACEMENT_CHARACTER = 0xFFFD;
+constexpr uint32_t FIRST_PRINTABLE_ASCII = 0x20;
+constexpr uint32_t LAST_PRINTABLE_ASCII = 0x7E;
+constexpr size_t MAX_CACHED_RUNS = 4096; // Per face; the run cache is dropped when it grows past this
+
+struct FaceMetrics {
+    Fl_Font font{0};
+    int size{0};
+    int height{0};
+    int descent{0};
+    float fallbackAdvance{0.0f};
+    std::array<float, 128> ascii{};
+    std::unordered_map<uint32_t, float> other;
+    // fl_width() of whole strings with tabs, control characters or non-ASCII text, where summing glyph
+    // advances misses what FLTK does with combining marks, font fallback and tab expansion
+    std::unordered_map<std::string, float> runs;
+};
+
+struct PendingGlyph {
+    Fl_Font font;
+    int size;
+    uint32_t codepoint;
+    std::string run; // Measure this string instead of codepoint when not empty
+};
+
+// Faces are only added and glyphs only measured on the UI thread, under an exclusive lock;
+// workers read under a shared lock and queue whatever they could not find
+std::shared_mutex faces_mutex;
+std::unordered_map<uint64_t, FaceMetrics> faces;
+
+std::mutex pending_mutex;
+std::vector<PendingGlyph> pending_glyphs;
+
+std::atomic<uint64_t> metrics_epoch{0};
+
+thread_local int worker_depth = 0;
+thread_local bool worker_missed = false;
+
+uint64_t faceKey(Fl_Font font, int size) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(font)) << 32) | static_cast<uint32_t>(size);
+}
+
+void selectFont(Fl_Font font, int size) {
+    if (fl_font() != font || fl_size() != size) {
+        fl_font(font, size);
+    }
+}
+
+float measure(const FaceMetrics &face, uint32_t codepoint) {
+    selectFont(face.font, face.size);
+    return static_cast<float>(fl_width(static_cast<unsigned int>(codepoint)));
+}
+
+FaceMetrics createFace(Fl_Font font, int size) {
+    FaceMetrics face;
+    face.font = font;
+    face.size = size;
+    face.ascii.fill(0.0f);
+
+    selectFont(font, size);
+    face.height = fl_height();
+    face.descent = fl_descent();
+    for (uint32_t c = 0; c < face.ascii.size(); ++c) {
+        face.ascii[c] = measure(face, c);
+    }
+    face.fallbackAdvance = face.ascii['n'] > 0.0f ? face.ascii['n'] : size * 0.5f;
+    return face;
+}
+
+void queuePending(Fl_Font font, int size, uint32_t codepoint, std::string_view run = {}) {
+    worker_missed = true;
+    std::scoped_lock lock(pending_mutex);
+    pending_glyphs.push_back({font, size, codepoint, std::string(run)});
+}
+
+bool isPrintableAscii(std::string_view text) {
+    for (char c : text) {
+        auto byte = static_cast<unsigned char>(c);
+        if (byte < FIRST_PRINTABLE_ASCII || byte > LAST_PRINTABLE_ASCII) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Caller holds faces_mutex (shared on workers, exclusive on the UI thread); false on a worker cache miss
+bool cachedRunAdvance(FaceMetrics &face, std::string_view text, bool canMeasure, double &advance) {
+    auto it = face.runs.find(std::string(text));
+    if (it != face.runs.end()) {
+        advance = it->second;
+        return true;
+    }
+    if (!canMeasure) {
+        queuePending(face.font, face.size, 0, text);
+        return false;
+    }
+
+    selectFont(face.font, face.size);
+    auto measured = static_cast<float>(fl_width(text.data(), static_cast<int>(text.size())));
+    if (face.runs.size() >= MAX_CACHED_RUNS) {
+        face.runs.clear();
+    }
+    face.runs.emplace(text, measured);
+    advance = measured;
+    return true;
+}
+
+// Caller holds faces_mutex (shared on workers, exclusive on the UI thread)
+float cachedAdvance(FaceMetrics &face, uint32_t codepoint, bool canMeasure) {
+    if (codepoint < face.ascii.size()) {
+        return face.ascii[codepoint];
+    }
+
+    auto it = face.other.find(codepoint);
+    if (it != face.other.end()) {
+        return it->second;
+    }
+    if (!canMeasure) {
+        queuePending(face.font, face.size, codepoint);
+        return face.fallbackAdvance;
+    }
+    float advance = measure(face, codepoint);
+    face.other.emplace(codepoint, advance);
+    return advance;
+}
+
+uint32_t decode(std::string_view text, size_t offset, size_t &length) {
+    auto byteAt = [&](size_t i) { return static_cast<unsigned char>(text[i]); };
+    unsigned char lead = byteAt(offset);
+    if (lead < 0x80) {
+        length = 1;
+        return lead;
+    }
+
+    size_t expected = 0;
+    uint32_t codepoint = 0;
+    if ((lead & 0xE0) == 0xC0) {
+        expected = 2;
+        codepoint = lead & 0x1F;
+    } else if ((lead & 0xF0) == 0xE0) {
+        expected = 3;
+        codepoint = lead & 0x0F;
+    } else if ((lead & 0xF8) == 0xF0) {
+        expected = 4;
+        codepoint = lead & 0x07;
+    } else {
+        length = 1;
+        return REPLACEMENT_CHARACTER;
+    }
+
+    if (offset + expected > text.size()) {
+        length = 1;
+        return REPLACEMENT_CHARACTER;
+    }
+    for (size_t i = 1; i < expected; ++i) {
+        unsigned char continuation = byteAt(offset + i);
+        if ((continuation & 0xC0) != 0x80) {
+            length = 1;
+            return REPLACEMENT_CHARACTER;
+        }
+        codepoint = (codepoint << 6) | (continuation & 0x3F);
+    }
+
+    length = expected;
+    return codepoint;
+}
+
+/**
+ * Runs fn(face, canMeasure) with the face locked appropriately for the calling thread.
+ * Workers get nullptr when the face has never been measured.
+ */
+template <typename Fn> auto withFace(Fl_Font font, int size, Fn &&fn) {
+    const uint64_t key = faceKey(font, size);
+    if (worker_depth > 0) {
+        std::shared_lock lock(faces_mutex);
+        auto it = faces.find(key);
+        if (it == faces.end()) {
+            lock.unlock();
+            queuePending(font, size, 'n');
+            return fn(static_cast<FaceMetrics *>(nullptr), false);
+        }
+        return fn(&it->second, false);
+    }
+
+    std::unique_lock lock(faces_mutex);
+    auto it = faces.find(key);
+    if (it == faces.end()) {
+        it = faces.emplace(key, createFace(font, size)).first;
+    }
+    return fn(&it->second, true);
+}
+} // namespace
+
+double advance(std::string_view text, Fl_Font font, int size) {
+    if (text.empty()) {
+        return 0.0;
+    }
+
+    return withFace(font, size, [&](FaceMetrics *face, bool canMeasure) {
+        if (!face) {
+            return text.size() * size * 0.5;
+        }
+        double total = 0.0;
+        if (!isPrintableAscii(text) && cachedRunAdvance(*face, text, canMeasure, total)) {
+            return total;
+        }
+        size_t offset = 0;
+        while (offset < text.size()) {
+            size_t length = 1;
+            uint32_t codepoint = decode(text, offset, length);
+            total += cachedAdvance(*face, codepoint, canMeasure);
+            offset += length;
+        }
+        return total;
+    });
+}
+
+int width(std::string_view text, Fl_Font font, int size) { return static_cast<int>(advance(text, font, size)); }
+
+size_t fitPrefix(std::string_view text, double maxWidth, Fl_Font font, int size, double *fittedWidth) {
+    double total = 0.0;
+    size_t offset = withFace(font, size, [&](FaceMetrics *face, bool canMeasure) {
+        size_t end = 0;
+        while (end < text.size()) {
+            size_t length = 1;
+            uint32_t codepoint = decode(text, end, length);
+            double glyph = face ? cachedAdvance(*face, codepoint, canMeasure) : size * 0.5;
+            if (std::floor(total + glyph) > maxWidth) {
+                break;
+            }
+            total += glyph;
+            end += length;
+        }
+        return end;
+    });
+
+    if (fittedWidth) {
+        *fittedWidth = total;
+    }
+    return offset;
+}
+
+size_t codepointLength(std::string_view text) {
+    if (text.empty()) {
+        return 0;
+    }
+    size_t length = 1;
+    decode(text, 0, length);
+    return length;
+}
+
+int height(Fl_Font font, int size) {
+    return withFace(font, size, [&](FaceMetrics *face, bool) { return face ? face->height : size; });
+}
+
+int descent(Fl_Font font, int size) {
+    return withFace(font, size, [&](FaceMetrics *face, bool) { return face ? face->descent : size / 4; });
+}
+
+WorkerScope::WorkerScope() {
+    if (worker_depth++ == 0) {
+        worker_missed = false;
+    }
+}
+
+WorkerScope::~WorkerScope() { worker_depth--; }
+
+bool WorkerScope::missed() const { return worker_missed; }
+
+void resolvePending() {
+    std::vector<PendingGlyph> glyphs;
+    {
+        std::scoped_lock lock(pending_mutex);
+        glyphs.swap(pending_glyphs);
+    }
+    for (const auto &glyph : glyphs) {
+        height(glyph.font, glyph.size);
+
+        std::unique_lock lock(faces_mutex);
+        auto it = faces.find(faceKey(glyph.font, glyph.size));
+        if (it == faces.end()) {
+            continue;
+        }
+        if (glyph.run.empty()) {
+            cachedAdvance(it->second, glyph.codepoint, true);
+        } else {
+            double ignored = 0.0;
+            cachedRunAdvance(it->second, glyph.run, true, ignored);
+        }
+    }
+}
+
+void invalidate() {
+    {
+        std::unique_lock lock(faces_mutex);
+        faces.clear();
+    }
+    {
+        std::scoped_lock lock(pending_mutex);
+        pending_glyphs.clear();
+    }
+    metrics_epoch++;
+}
+
+uint64_t epoch() { return metrics_epoch.load(); }
+
+} // namespace TextMetrics
@@ -0,0 +1,79 @@
+#include "utils/WorkerPool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace WorkerPool {
+
+namespace {
+
+constexpr unsigned kMaxWorkers = 4;
+
+struct Pool {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> jobs;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+
+    // Reached only if shutdown() was never called; joining still beats std::terminate on a joinable thread
+    ~Pool() { stop(); }
+
+    void stop() {
+        std::vector<std::thread> joining;
+        {
+            std::scoped_lock lock(mutex);
+            stopping = true;
+            jobs.clear();
+            joining.swap(threads);
+        }
+        cv.notify_all();
+        for (auto &thread : joining) {
+            thread.join();
+        }
+    }
+};
+
+Pool pool;
+
+void workerLoop() {
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock lock(pool.mutex);
+            pool.cv.wait(lock, [] { return pool.stopping || !pool.jobs.empty(); });
+            if (pool.stopping) {
+                return;
+            }
+            job = std::move(pool.jobs.front());
+            pool.jobs.pop_front();
+        }
+        job();
+    }
+}
+
+} // namespace
+
+void post(std::function<void()> job) {
+    {
+        std::scoped_lock lock(pool.mutex);
+        if (pool.stopping) {
+            return;
+        }
+        pool.jobs.push_back(std::move(job));
+        unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+        size_t maxWorkers = std::clamp(hardware - 1, 1u, kMaxWorkers);
+        if (pool.threads.size() < maxWorkers && pool.threads.size() < pool.jobs.size()) {
+            pool.threads.emplace_back(workerLoop);
+        }
+    }
+    pool.cv.notify_one();
+}
+
+void shutdown() { pool.stop(); }
+
+} // namespace WorkerPool